@@ -0,0 +1,360 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <webp/decode.h>
+#include <webp/demux.h>
+
+#include "anim.h"
+#include "gif.h"
+#include "imageformat.h"
+#include "scale.h"
+
+struct AnimPlayer {
+    char    path[512];
+    FitMode mode;
+    int     dst_w, dst_h;
+    Uint32  ready_event;
+
+    SDL_Thread *thread;
+    SDL_mutex  *lock;
+    SDL_cond   *cond;       // a ring slot was freed, or quit
+
+    // Decoding thread only. Exactly one of gif/webp is open.
+    GifDecoder       *gif;
+    WebPAnimDecoder  *webp;
+    unsigned char    *file;         // the WebP, which libwebp reads in place
+    int               prev_timestamp;
+    int               canvas_w, canvas_h;
+    SDL_Rect          crop;         // of the canvas, for FIT_FILL
+    SDL_Surface      *canvas_view;  // crop of the current canvas
+    SDL_Surface      *frame_view[ANIM_RING];    // the placed frame in each slot
+    SDL_Rect          src;          // placed frame size, set before the first frame
+    size_t            bytes;        // for stats.bytes
+
+    // Frames in playing order, guarded by lock. Slots are as large as the
+    // placed frame plus a repeated column and row where that is smaller
+    // than the screen, as texpool_upload() does for stills.
+    SDL_Surface *ring[ANIM_RING];
+    int   delay[ANIM_RING];
+    int   head, count;
+    bool  quit;
+    bool  finished;     // no more frames will be decoded
+    bool  waiting;      // the render loop found the ring empty
+
+    // Render loop side, guarded by lock too as stats are shared
+    bool   started;
+    bool   stall_counted;
+    Uint32 due;         // when the frame at head goes up
+    AnimStats stats;
+};
+
+static unsigned char *read_file(const char *path, size_t max, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    struct stat st;
+    unsigned char *data = NULL;
+    if (fstat(fileno(f), &st) == 0 && st.st_size > 0 && (size_t)st.st_size <= max) {
+        *size = (size_t)st.st_size;
+        data = malloc(*size);
+        if (data && fread(data, 1, *size, f) != *size) {
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(f);
+    return data;
+}
+
+// Open the decoder and size the ring. False for stills and anything that
+// can't or shouldn't be played.
+static bool open_source(AnimPlayer *a) {
+    int frames = 0;
+    ImageFormat format = image_format_file(a->path);
+    if (format == IMAGE_GIF) {
+        a->gif = gif_open_file(a->path);
+        if (!a->gif) return false;
+        gif_size(a->gif, &a->canvas_w, &a->canvas_h);
+        frames = gif_count_frames(a->gif, 2);
+        a->bytes += gif_memory(a->gif);
+    } else if (format == IMAGE_WEBP) {
+        size_t size = 0;
+        a->file = read_file(a->path, ANIM_MAX_FILE, &size);
+        WebPBitstreamFeatures features;
+        if (!a->file || WebPGetFeatures(a->file, size, &features) != VP8_STATUS_OK ||
+            !features.has_animation)
+            return false;
+        a->canvas_w = features.width;
+        a->canvas_h = features.height;
+        if ((size_t)a->canvas_w * a->canvas_h > ANIM_MAX_PIXELS) return false;
+
+        WebPAnimDecoderOptions options;
+        if (!WebPAnimDecoderOptionsInit(&options)) return false;
+        options.color_mode  = MODE_RGBA;
+        options.use_threads = 0;
+        WebPData data = { a->file, size };
+        WebPAnimInfo info;
+        a->webp = WebPAnimDecoderNew(&data, &options);
+        if (!a->webp || !WebPAnimDecoderGetInfo(a->webp, &info)) return false;
+        frames = (int)info.frame_count;
+        // The file, and the canvas libwebp keeps twice over
+        a->bytes += size + (size_t)a->canvas_w * a->canvas_h * 4 * 2;
+    }
+    if (frames < 2 || (size_t)a->canvas_w * a->canvas_h > ANIM_MAX_PIXELS) return false;
+
+    int out_w, out_h;
+    decode_target(a->canvas_w, a->canvas_h, a->mode, a->dst_w, a->dst_h, &a->crop, &out_w, &out_h);
+    a->src.x = a->src.y = 0;
+    a->src.w = out_w;
+    a->src.h = out_h;
+    int slot_w = out_w < a->dst_w ? out_w + 1 : out_w;
+    int slot_h = out_h < a->dst_h ? out_h + 1 : out_h;
+
+    a->canvas_view = SDL_CreateRGBSurfaceWithFormatFrom(NULL, a->crop.w, a->crop.h, 32,
+                                                        a->canvas_w * 4, SDL_PIXELFORMAT_RGBA32);
+    if (!a->canvas_view) return false;
+    for (int i = 0; i < ANIM_RING; i++) {
+        SDL_Surface *s = SDL_CreateRGBSurfaceWithFormat(0, slot_w, slot_h, 32,
+                                                        SDL_PIXELFORMAT_RGBA32);
+        if (!s) return false;
+        a->ring[i] = s;
+        a->frame_view[i] = SDL_CreateRGBSurfaceWithFormatFrom(s->pixels, out_w, out_h, 32,
+                                                              s->pitch, SDL_PIXELFORMAT_RGBA32);
+        if (!a->frame_view[i]) return false;
+        a->bytes += (size_t)s->pitch * s->h;
+    }
+    a->bytes += sizeof(AnimPlayer);
+    return true;
+}
+
+static void close_source(AnimPlayer *a) {
+    gif_close(a->gif);
+    WebPAnimDecoderDelete(a->webp);
+    free(a->file);
+    SDL_FreeSurface(a->canvas_view);
+    for (int i = 0; i < ANIM_RING; i++) {
+        SDL_FreeSurface(a->frame_view[i]);
+        SDL_FreeSurface(a->ring[i]);
+    }
+}
+
+// 1 with a frame, 0 past the last one, -1 on error
+static int next_frame(AnimPlayer *a, const unsigned char **rgba, int *delay_ms) {
+    if (a->gif) return gif_next_frame(a->gif, rgba, delay_ms);
+    if (!WebPAnimDecoderHasMoreFrames(a->webp)) return 0;
+    uint8_t *buf;
+    int timestamp;
+    if (!WebPAnimDecoderGetNext(a->webp, &buf, &timestamp)) return -1;
+    *rgba = buf;
+    *delay_ms = timestamp - a->prev_timestamp;
+    a->prev_timestamp = timestamp;
+    return 1;
+}
+
+static int rewind_source(AnimPlayer *a) {
+    if (a->gif) return gif_rewind(a->gif);
+    WebPAnimDecoderReset(a->webp);
+    a->prev_timestamp = 0;
+    return 0;
+}
+
+// Crop and scale the canvas into a ring slot, then repeat its last column
+// and row into the padding
+static bool place_frame(AnimPlayer *a, const unsigned char *rgba, int slot) {
+    SDL_Surface *view = a->canvas_view, *out = a->frame_view[slot];
+    view->pixels = (void *)(rgba + ((size_t)a->crop.y * a->canvas_w + a->crop.x) * 4);
+    if (view->w == out->w && view->h == out->h) {
+        for (int y = 0; y < out->h; y++)
+            memcpy((unsigned char *)out->pixels + (size_t)y * out->pitch,
+                   (const unsigned char *)view->pixels + (size_t)y * view->pitch,
+                   (size_t)out->w * 4);
+    } else if (scale_surface_into(view, out) != 0) {
+        return false;
+    }
+
+    SDL_Surface *s = a->ring[slot];
+    unsigned char *row = s->pixels;
+    if (s->w > out->w)
+        for (int y = 0; y < out->h; y++, row += s->pitch)
+            memcpy(row + out->w * 4, row + (out->w - 1) * 4, 4);
+    if (s->h > out->h)
+        memcpy((unsigned char *)s->pixels + (size_t)out->h * s->pitch,
+               (unsigned char *)s->pixels + (size_t)(out->h - 1) * s->pitch, (size_t)s->w * 4);
+    return true;
+}
+
+static void push_ready(AnimPlayer *a) {
+    if (!a->ready_event) return;
+    SDL_Event ev;
+    SDL_zero(ev);
+    ev.type = a->ready_event;
+    SDL_PushEvent(&ev);
+}
+
+static int decode_thread(void *arg) {
+    AnimPlayer *a = arg;
+    bool ok = open_source(a);
+    SDL_LockMutex(a->lock);
+    a->stats.bytes = a->bytes;
+    SDL_UnlockMutex(a->lock);
+    while (ok) {
+        SDL_LockMutex(a->lock);
+        while (a->count == ANIM_RING && !a->quit)
+            SDL_CondWait(a->cond, a->lock);
+        int slot = (a->head + a->count) % ANIM_RING;
+        bool quit = a->quit;
+        SDL_UnlockMutex(a->lock);
+        if (quit) break;
+
+        // Loop forever, whatever the file asks for: the slide changes anyway
+        Uint64 start = SDL_GetPerformanceCounter();
+        const unsigned char *rgba;
+        int delay;
+        int rc = next_frame(a, &rgba, &delay);
+        if (rc == 0) {
+            ok = rewind_source(a) == 0;
+            continue;
+        }
+        ok = rc == 1 && place_frame(a, rgba, slot);
+        if (!ok) break;
+        double ms = (double)(SDL_GetPerformanceCounter() - start) * 1000.0 /
+                    (double)SDL_GetPerformanceFrequency();
+
+        SDL_LockMutex(a->lock);
+        a->delay[slot] = delay < ANIM_MIN_DELAY_MS ? 100 : delay;
+        a->count++;
+        a->stats.decoded++;
+        a->stats.decode_ms += ms;
+        if (ms > a->stats.max_decode_ms) a->stats.max_decode_ms = ms;
+        if (a->waiting) {
+            a->waiting = false;
+            push_ready(a);
+        }
+        SDL_UnlockMutex(a->lock);
+    }
+
+    SDL_LockMutex(a->lock);
+    a->finished = true;
+    SDL_UnlockMutex(a->lock);
+    return 0;
+}
+
+AnimPlayer *anim_open(const char *path, FitMode mode, int dst_w, int dst_h, Uint32 ready_event) {
+    ImageFormat format = image_format_file(path);
+    if (format != IMAGE_GIF && format != IMAGE_WEBP) return NULL;
+
+    AnimPlayer *a = calloc(1, sizeof(AnimPlayer));
+    if (!a) return NULL;
+    snprintf(a->path, sizeof(a->path), "%s", path);
+    a->mode        = mode;
+    a->dst_w       = dst_w;
+    a->dst_h       = dst_h;
+    a->ready_event = ready_event;
+    a->waiting     = true;      // for the first frame
+    a->lock        = SDL_CreateMutex();
+    a->cond        = SDL_CreateCond();
+    if (a->lock && a->cond)
+        a->thread = SDL_CreateThread(decode_thread, "anim", a);
+    if (!a->thread) {
+        if (a->cond) SDL_DestroyCond(a->cond);
+        if (a->lock) SDL_DestroyMutex(a->lock);
+        free(a);
+        return NULL;
+    }
+    return a;
+}
+
+void anim_close(AnimPlayer *a) {
+    if (!a) return;
+    SDL_LockMutex(a->lock);
+    a->quit = true;
+    SDL_CondBroadcast(a->cond);
+    SDL_UnlockMutex(a->lock);
+    SDL_WaitThread(a->thread, NULL);
+    close_source(a);
+    SDL_DestroyCond(a->cond);
+    SDL_DestroyMutex(a->lock);
+    free(a);
+}
+
+// Release the frame at head. With lock held.
+static void pop_frame(AnimPlayer *a) {
+    a->head = (a->head + 1) % ANIM_RING;
+    a->count--;
+    SDL_CondSignal(a->cond);
+}
+
+bool anim_update(AnimPlayer *a, Uint32 now, SDL_Texture *texture, SDL_Rect *src) {
+    SDL_LockMutex(a->lock);
+    if (a->started && (Sint32)(now - a->due) < 0) {
+        SDL_UnlockMutex(a->lock);
+        return false;
+    }
+    if (a->count == 0) {
+        if (a->started && !a->stall_counted && !a->finished) {
+            a->stats.stalls++;
+            a->stall_counted = true;
+        }
+        a->waiting = true;
+        SDL_UnlockMutex(a->lock);
+        return false;
+    }
+    // Behind: a frame whose successor is due already is never seen
+    while (a->started && a->count > 1 && (Sint32)(now - (a->due + a->delay[a->head])) >= 0) {
+        a->due += a->delay[a->head];
+        a->stats.dropped++;
+        pop_frame(a);
+    }
+    int slot = a->head;
+    SDL_UnlockMutex(a->lock);
+
+    // The decoder never writes to the head slot, so no lock for the upload
+    SDL_Surface *frame = a->ring[slot];
+    SDL_Rect area = { 0, 0, frame->w, frame->h };
+    int rc = SDL_UpdateTexture(texture, &area, frame->pixels, frame->pitch);
+
+    SDL_LockMutex(a->lock);
+    if (a->started) {
+        Uint32 late = now - a->due;
+        a->stats.error_ms += late;
+        if (late > a->stats.max_late_ms) a->stats.max_late_ms = late;
+        if (late > ANIM_LATE_MS) a->stats.late++;
+        a->due += a->delay[slot];
+        // After a stall, the frames that follow keep their own delays
+        // rather than rushing to catch up
+        if ((Sint32)(now - a->due) >= 0) a->due = now + a->delay[slot];
+    } else {
+        a->started = true;
+        a->due = now + a->delay[slot];
+    }
+    a->stats.shown++;
+    a->stall_counted = false;
+    pop_frame(a);
+    SDL_UnlockMutex(a->lock);
+
+    *src = a->src;
+    return rc == 0;
+}
+
+int anim_wait(AnimPlayer *a, Uint32 now) {
+    SDL_LockMutex(a->lock);
+    int wait;
+    if (a->count == 0) wait = -1;
+    else if (!a->started || (Sint32)(a->due - now) <= 0) wait = 0;
+    else wait = (int)(a->due - now);
+    SDL_UnlockMutex(a->lock);
+    return wait;
+}
+
+bool anim_finished(AnimPlayer *a) {
+    SDL_LockMutex(a->lock);
+    bool finished = a->finished && a->count == 0;
+    SDL_UnlockMutex(a->lock);
+    return finished;
+}
+
+void anim_stats(AnimPlayer *a, AnimStats *out) {
+    SDL_LockMutex(a->lock);
+    *out = a->stats;
+    SDL_UnlockMutex(a->lock);
+}
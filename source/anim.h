@@ -0,0 +1,71 @@
+#ifndef ANIM_H
+#define ANIM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <SDL2/SDL.h>
+
+#include "decode.h"
+
+// Plays an animated GIF or WebP slide. A thread of its own decodes frames
+// ahead, each scaled to its placed size, into a ring of ANIM_RING buffers;
+// the render loop uploads whichever is due into the slide's (streaming)
+// texture with SDL_UpdateTexture. Memory is the ring, the decoder's canvas
+// and, for WebP, the file, however many frames the animation has: GIFs
+// stream from the file, and libwebp needs the whole file but nothing else.
+//
+// Frames keep their own delays, timed from when the first one went up.
+// A frame that is already overdue when the next is due too is skipped,
+// so a slow decode or a long hitch never leaves the animation running
+// behind. Animations loop until the slide changes.
+
+#define ANIM_RING 3
+// Canvases larger than this are shown as stills
+#define ANIM_MAX_PIXELS (8u << 20)
+// WebP files are read whole; larger ones are shown as stills
+#define ANIM_MAX_FILE   (48u << 20)
+// Frames shorter than this play at 100 ms, as in browsers: many GIFs
+// leave the delay at 0 and expect that
+#define ANIM_MIN_DELAY_MS 20
+
+typedef struct AnimPlayer AnimPlayer;
+
+typedef struct {
+    unsigned shown;         // frames uploaded
+    unsigned dropped;       // decoded but skipped to catch up
+    unsigned late;          // uploaded more than ANIM_LATE_MS after their time
+    unsigned stalls;        // times a frame was due and none was decoded yet
+    double   error_ms;      // sum of how late each frame went up
+    Uint32   max_late_ms;
+    unsigned decoded;
+    double   decode_ms;     // total, including scaling
+    double   max_decode_ms;
+    size_t   bytes;         // ring, decoder and file data
+} AnimStats;
+
+// A display refresh: frames that go up later than this count as late
+#define ANIM_LATE_MS 17
+
+// Start decoding path, for an image placed on a dst_w x dst_h screen. If
+// ready_event is nonzero, an event of that type is pushed when a frame
+// lands in a ring the render loop found empty. NULL if the file isn't a
+// GIF or WebP or the thread can't start. A still, or an animation too
+// large to play, finishes without a frame, leaving the slide as it was.
+AnimPlayer *anim_open(const char *path, FitMode mode, int dst_w, int dst_h, Uint32 ready_event);
+void anim_close(AnimPlayer *a);
+
+// If a frame is due at now, upload it into texture at the top left (an
+// RGBA32 texture at least as large as the placed image) and set *src to
+// the part it covers. True if the texture changed.
+bool anim_update(AnimPlayer *a, Uint32 now, SDL_Texture *texture, SDL_Rect *src);
+
+// Milliseconds until the next frame is due, 0 if one is, or -1 if there is
+// none decoded yet (ready_event will say when) or none to come
+int anim_wait(AnimPlayer *a, Uint32 now);
+
+// Nothing more will come: the image was a still, or broken
+bool anim_finished(AnimPlayer *a);
+
+void anim_stats(AnimPlayer *a, AnimStats *out);
+
+#endif
@@ -0,0 +1,354 @@
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "cache.h"
+#include "util.h"
+
+static void blob_path(const ImageCache *c, uint64_t hash, char *out, size_t len) {
+    snprintf(out, len, "%s/%016llx.img", c->dir, (unsigned long long)hash);
+}
+
+static void manifest_path(const ImageCache *c, uint32_t key, char *out, size_t len) {
+    snprintf(out, len, "%s/%08x.man", c->dir, (unsigned)key);
+}
+
+// A url too long for CacheCategory.url isn't cached at all: its manifest
+// would be read back as a different url, under a different key
+static CacheCategory *find_cat(ImageCache *c, const char *url, int create) {
+    if (strlen(url) >= sizeof(c->cats[0].url)) return NULL;
+    uint32_t key = fnv1a32(url);
+    for (int i = 0; i < c->num_cats; i++)
+        if (c->cats[i].key == key) return &c->cats[i];
+    if (!create) return NULL;
+
+    CacheCategory *n = realloc(c->cats, (c->num_cats + 1) * sizeof(CacheCategory));
+    if (!n) return NULL;
+    c->cats = n;
+
+    CacheCategory *cat = &c->cats[c->num_cats++];
+    memset(cat, 0, sizeof(*cat));
+    cat->key = key;
+    snprintf(cat->url, sizeof(cat->url), "%s", url);
+    return cat;
+}
+
+static CacheEntry *find_entry(CacheCategory *cat, uint64_t hash) {
+    for (int i = 0; i < cat->count; i++)
+        if (cat->entries[i].hash == hash) return &cat->entries[i];
+    return NULL;
+}
+
+static CacheEntry *add_entry(CacheCategory *cat, uint64_t hash, uint32_t size, uint32_t last_used) {
+    if (cat->count >= cat->cap) {
+        int cap = cat->cap ? cat->cap * 2 : 16;
+        CacheEntry *n = realloc(cat->entries, cap * sizeof(CacheEntry));
+        if (!n) return NULL;
+        cat->entries = n;
+        cat->cap = cap;
+    }
+    CacheEntry *e = &cat->entries[cat->count++];
+    e->hash = hash;
+    e->size = size;
+    e->last_used = last_used;
+    return e;
+}
+
+static int blob_refs(const ImageCache *c, uint64_t hash) {
+    int refs = 0;
+    for (int i = 0; i < c->num_cats; i++)
+        for (int j = 0; j < c->cats[i].count; j++)
+            if (c->cats[i].entries[j].hash == hash) refs++;
+    return refs;
+}
+
+static void save_manifest(const ImageCache *c, CacheCategory *cat) {
+    cat->dirty = 0;
+    char path[512], tmp[520];
+    manifest_path(c, cat->key, path, sizeof(path));
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    FILE *f = fopen(tmp, "w");
+    if (!f) return;
+    fprintf(f, "url %s\n", cat->url);
+    if (cat->etag[0])          fprintf(f, "etag %s\n", cat->etag);
+    if (cat->last_modified[0]) fprintf(f, "lastmod %s\n", cat->last_modified);
+    if (cat->last_hash)        fprintf(f, "last %016llx\n", (unsigned long long)cat->last_hash);
+    for (int i = 0; i < cat->count; i++) {
+        const CacheEntry *e = &cat->entries[i];
+        fprintf(f, "%016llx %u %u\n", (unsigned long long)e->hash, e->size, e->last_used);
+    }
+    if (fclose(f) == 0)
+        replace_file(tmp, path);
+    else
+        remove(tmp);
+}
+
+static void save_dirty(ImageCache *c) {
+    for (int i = 0; i < c->num_cats; i++)
+        if (c->cats[i].dirty) save_manifest(c, &c->cats[i]);
+}
+
+// Copy a manifest field, refusing one too long for dst rather than
+// keeping a truncated URL or validator
+static int copy_field(char *dst, size_t len, const char *src) {
+    size_t n = strlen(src);
+    if (n >= len) return -1;
+    memcpy(dst, src, n + 1);
+    return 0;
+}
+
+// key is the one in the file name, which must be the url's. One written
+// by an older version with its url cut short is dropped, and its blobs
+// with it unless another category lists them.
+static void load_manifest(ImageCache *c, const char *path, uint32_t key) {
+    FILE *f = fopen(path, "r");
+    if (!f) return;
+
+    char line[512];
+    CacheCategory cat = {0};
+    while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\r\n")] = 0;
+
+        unsigned long long hash;
+        unsigned size, last_used;
+        char blob[512];
+        struct stat st;
+
+        if (strncmp(line, "url ", 4) == 0) {
+            if (copy_field(cat.url, sizeof(cat.url), line + 4) != 0) cat.url[0] = 0;
+        } else if (strncmp(line, "etag ", 5) == 0) {
+            if (copy_field(cat.etag, sizeof(cat.etag), line + 5) != 0) cat.etag[0] = 0;
+        } else if (strncmp(line, "lastmod ", 8) == 0) {
+            if (copy_field(cat.last_modified, sizeof(cat.last_modified), line + 8) != 0)
+                cat.last_modified[0] = 0;
+        } else if (strncmp(line, "last ", 5) == 0) {
+            cat.last_hash = strtoull(line + 5, NULL, 16);
+        } else if (sscanf(line, "%llx %u %u", &hash, &size, &last_used) == 3) {
+            // Drop entries whose blob went missing
+            blob_path(c, hash, blob, sizeof(blob));
+            if (stat(blob, &st) == 0 && (uint64_t)st.st_size == size)
+                add_entry(&cat, hash, size, last_used);
+        }
+    }
+    fclose(f);
+
+    if (cat.url[0] == 0 || fnv1a32(cat.url) != key) {
+        free(cat.entries);
+        remove(path);
+        return;
+    }
+    if (cat.last_hash && !find_entry(&cat, cat.last_hash)) {
+        cat.last_hash = 0;
+        cat.etag[0] = 0;
+        cat.last_modified[0] = 0;
+    }
+
+    CacheCategory *dst = find_cat(c, cat.url, 1);
+    if (!dst) {
+        free(cat.entries);
+        return;
+    }
+    cat.key = dst->key;
+    *dst = cat;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Sum of unique blob sizes; the same image may be listed by several categories
+static uint64_t unique_total(const ImageCache *c) {
+    int n = 0;
+    for (int i = 0; i < c->num_cats; i++) n += c->cats[i].count;
+    if (n == 0) return 0;
+
+    uint64_t *pairs = malloc(n * 2 * sizeof(uint64_t));
+    if (!pairs) return 0;
+    int k = 0;
+    for (int i = 0; i < c->num_cats; i++)
+        for (int j = 0; j < c->cats[i].count; j++) {
+            pairs[k * 2]     = c->cats[i].entries[j].hash;
+            pairs[k * 2 + 1] = c->cats[i].entries[j].size;
+            k++;
+        }
+    qsort(pairs, n, 2 * sizeof(uint64_t), cmp_u64);
+
+    uint64_t total = 0;
+    for (int i = 0; i < n; i++)
+        if (i == 0 || pairs[i * 2] != pairs[(i - 1) * 2]) total += pairs[i * 2 + 1];
+    free(pairs);
+    return total;
+}
+
+// Delete the blobs no manifest lists: left by a crash between writing a
+// blob and its manifest, or by a manifest that was dropped
+static void remove_orphans(const ImageCache *c) {
+    int n = 0;
+    for (int i = 0; i < c->num_cats; i++) n += c->cats[i].count;
+    uint64_t *hashes = malloc((n ? n : 1) * sizeof(uint64_t));
+    if (!hashes) return;
+    int k = 0;
+    for (int i = 0; i < c->num_cats; i++)
+        for (int j = 0; j < c->cats[i].count; j++) hashes[k++] = c->cats[i].entries[j].hash;
+    qsort(hashes, n, sizeof(uint64_t), cmp_u64);
+
+    DIR *d = opendir(c->dir);
+    struct dirent *entry;
+    while (d && (entry = readdir(d)) != NULL) {
+        char *end;
+        uint64_t hash = strtoull(entry->d_name, &end, 16);
+        if (end - entry->d_name != 16 || strcmp(end, ".img") != 0) continue;
+        if (bsearch(&hash, hashes, n, sizeof(uint64_t), cmp_u64)) continue;
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", c->dir, entry->d_name);
+        remove(path);
+    }
+    if (d) closedir(d);
+    free(hashes);
+}
+
+// Drop least recently used entries until we're back under budget. The
+// categories that lost entries are left dirty for the caller to save.
+static void evict(ImageCache *c) {
+    while (c->total > c->budget) {
+        CacheCategory *oldest_cat = NULL;
+        int oldest = -1;
+        for (int i = 0; i < c->num_cats; i++)
+            for (int j = 0; j < c->cats[i].count; j++)
+                if (!oldest_cat || c->cats[i].entries[j].last_used < oldest_cat->entries[oldest].last_used) {
+                    oldest_cat = &c->cats[i];
+                    oldest = j;
+                }
+        if (!oldest_cat) break;
+
+        CacheEntry victim = oldest_cat->entries[oldest];
+        oldest_cat->entries[oldest] = oldest_cat->entries[--oldest_cat->count];
+        if (oldest_cat->last_hash == victim.hash) {
+            oldest_cat->last_hash = 0;
+            oldest_cat->etag[0] = 0;
+            oldest_cat->last_modified[0] = 0;
+        }
+        oldest_cat->dirty = 1;
+
+        if (blob_refs(c, victim.hash) == 0) {
+            char path[512];
+            blob_path(c, victim.hash, path, sizeof(path));
+            remove(path);
+            c->total -= victim.size;
+        }
+    }
+}
+
+void cache_open(ImageCache *c, const char *dir, uint64_t budget) {
+    memset(c, 0, sizeof(*c));
+    snprintf(c->dir, sizeof(c->dir), "%s", dir);
+    c->budget = budget;
+    c->rng = rng_seed((uint64_t)time(NULL) ^ fnv1a32(dir));
+    if (budget == 0) return;
+
+    mkdir(dir, 0777);
+    DIR *d = opendir(dir);
+    if (!d) return;
+
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        char *end;
+        uint32_t key = (uint32_t)strtoul(entry->d_name, &end, 16);
+        if (end - entry->d_name != 8 || strcmp(end, ".man") != 0) continue;
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        load_manifest(c, path, key);
+    }
+    closedir(d);
+
+    remove_orphans(c);
+    c->total = unique_total(c);
+    evict(c);
+    save_dirty(c);
+}
+
+void cache_close(ImageCache *c) {
+    save_dirty(c);
+    for (int i = 0; i < c->num_cats; i++) free(c->cats[i].entries);
+    free(c->cats);
+    c->cats = NULL;
+    c->num_cats = 0;
+}
+
+const CacheCategory *cache_category(ImageCache *c, const char *url) {
+    if (c->budget == 0) return NULL;
+    return find_cat(c, url, 0);
+}
+
+int cache_store(ImageCache *c, const char *url, const unsigned char *data, size_t size,
+                const char *etag, const char *last_modified) {
+    if (c->budget == 0 || size == 0 || size > c->budget) return -1;
+
+    CacheCategory *cat = find_cat(c, url, 1);
+    if (!cat) return -1;
+
+    uint64_t hash = fnv1a64(data, size);
+    char path[512];
+    blob_path(c, hash, path, sizeof(path));
+
+    // A blob nobody lists isn't in total yet, even if its file is there
+    // (from a crash before its manifest was written)
+    int counted = blob_refs(c, hash) > 0;
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        char tmp[520];
+        snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+        FILE *f = fopen(tmp, "wb");
+        if (!f) return -1;
+        size_t written = fwrite(data, 1, size, f);
+        if (fclose(f) != 0 || written != size || replace_file(tmp, path) != 0) {
+            remove(tmp);
+            return -1;
+        }
+    }
+
+    CacheEntry *e = find_entry(cat, hash);
+    if (!e) e = add_entry(cat, hash, (uint32_t)size, 0);
+    if (!e) return -1;
+    if (!counted) c->total += size;
+    e->last_used = (uint32_t)time(NULL);
+
+    snprintf(cat->etag, sizeof(cat->etag), "%s", etag ? etag : "");
+    snprintf(cat->last_modified, sizeof(cat->last_modified), "%s", last_modified ? last_modified : "");
+    cat->last_hash = hash;
+    cat->dirty = 1;
+
+    evict(c);
+    save_dirty(c);
+    return 0;
+}
+
+static int entry_path(ImageCache *c, CacheCategory *cat, CacheEntry *e, char *out, size_t len) {
+    e->last_used = (uint32_t)time(NULL);
+    cat->dirty = 1;
+    blob_path(c, e->hash, out, len);
+    return 0;
+}
+
+int cache_last_path(ImageCache *c, const char *url, char *out, size_t len) {
+    CacheCategory *cat = c->budget ? find_cat(c, url, 0) : NULL;
+    CacheEntry *e = (cat && cat->last_hash) ? find_entry(cat, cat->last_hash) : NULL;
+    if (!e) return -1;
+    return entry_path(c, cat, e, out, len);
+}
+
+int cache_pick(ImageCache *c, const char *url, char *out, size_t len) {
+    CacheCategory *cat = c->budget ? find_cat(c, url, 0) : NULL;
+    if (!cat || cat->count == 0) return -1;
+    return entry_path(c, cat, &cat->entries[rng_below(&c->rng, cat->count)], out, len);
+}
+
+int cache_count(ImageCache *c, const char *url) {
+    CacheCategory *cat = c->budget ? find_cat(c, url, 0) : NULL;
+    return cat ? cat->count : 0;
+}
@@ -0,0 +1,66 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Bounded on-disk cache of downloaded images for remote categories.
+//
+// Blobs are stored once under their content hash; each category (keyed by
+// its URL) has a small text manifest listing the blobs it has seen plus the
+// ETag/Last-Modified of the last response. When the total size goes over
+// budget the least recently used entries are evicted. Manifests are
+// written once per store (after its evictions) and on close; a pick only
+// marks its category's manifest dirty.
+//
+// Not thread-safe: callers serialize access (main.c holds CACHE_LOCK).
+
+typedef struct {
+    uint64_t hash;
+    uint32_t size;
+    uint32_t last_used;     // unix time
+} CacheEntry;
+
+typedef struct {
+    uint32_t    key;        // fnv1a32(url)
+    char        url[256];
+    CacheEntry *entries;
+    int         count;
+    int         cap;
+
+    // Validators of the last 200 response, and the blob it produced
+    char        etag[128];
+    char        last_modified[64];
+    uint64_t    last_hash;
+
+    int         dirty;      // changed since its manifest was last written
+} CacheCategory;
+
+typedef struct {
+    char           dir[256];
+    uint64_t       budget;  // bytes; 0 disables the cache
+    uint64_t       total;   // bytes of unique blobs on disk
+    CacheCategory *cats;
+    int            num_cats;
+    uint64_t       rng;     // for cache_pick
+} ImageCache;
+
+void cache_open(ImageCache *c, const char *dir, uint64_t budget);
+void cache_close(ImageCache *c);
+
+// Validators to send with the next request for url (NULL if none)
+const CacheCategory *cache_category(ImageCache *c, const char *url);
+
+// Record a freshly downloaded image for url
+int cache_store(ImageCache *c, const char *url, const unsigned char *data, size_t size,
+                const char *etag, const char *last_modified);
+
+// Path of the blob the last 200 response for url produced, for a 304
+int cache_last_path(ImageCache *c, const char *url, char *out, size_t len);
+
+// Path of a random cached image for url, for offline rotation
+int cache_pick(ImageCache *c, const char *url, char *out, size_t len);
+
+int cache_count(ImageCache *c, const char *url);
+
+#endif
@@ -0,0 +1,506 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "config.h"
+#include "manifest.h"
+#include "prefetch.h"
+#include "transition.h"
+#include "util.h"
+#include "workpool.h"
+
+#define DEFAULT_INTERVAL_MINS 5
+#define DEFAULT_PREFETCH_DEPTH 2
+#define DEFAULT_CACHE_MB 256
+#define DEFAULT_THUMB_MB 1024
+#define DEFAULT_DECODE_MB 96
+#define DEFAULT_DECODE_THREADS 0   // one per core, less the render thread
+#define DEFAULT_BATTERY_PCT 200
+#define DEFAULT_CHARGER_PCT 100
+
+typedef struct {
+    const char *name;
+    int         kind;
+    int         order;      // later lines win
+} TransitionLine;
+
+void config_defaults(Config *c) {
+    memset(c, 0, sizeof(*c));
+    c->prefetch_depth     = DEFAULT_PREFETCH_DEPTH;
+    c->cache_mb           = DEFAULT_CACHE_MB;
+    c->thumb_mb           = DEFAULT_THUMB_MB;
+    c->decode_mb          = DEFAULT_DECODE_MB;
+    c->decode_threads     = DEFAULT_DECODE_THREADS;
+    c->default_transition = TRANSITION_FADE;
+    c->fit_mode           = FIT_CONTAIN;
+    c->playlist_mode      = PLAYLIST_SHUFFLE;
+    c->similar            = PLAYLIST_SIMILAR_SPACE;
+    c->interval_mins      = DEFAULT_INTERVAL_MINS;
+    c->battery_pct        = DEFAULT_BATTERY_PCT;
+    c->charger_pct        = DEFAULT_CHARGER_PCT;
+    c->category           = "";
+}
+
+void config_free(Config *c) {
+    free(c->categories);
+    free(c->text);
+    free(c->paths);
+    c->categories = NULL;
+    c->text = NULL;
+    c->paths = NULL;
+    c->num_categories = 0;
+    c->category = "";
+}
+
+int config_write_default(const char *path) {
+    // Create the folder first if it doesn't exist
+    char dir[256];
+    snprintf(dir, sizeof(dir), "%s", path);
+    char *slash = strrchr(dir, '/');
+    if (slash) {
+        *slash = 0;
+        mkdir(dir, 0777);
+    }
+
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+
+    fprintf(f, "[Settings]\n");
+    fprintf(f, "first_run = true\n");
+    fprintf(f, "; Minutes each slide stays up ([+]/[-] change it, and it's saved here)\n");
+    fprintf(f, "interval_mins = %d\n", DEFAULT_INTERVAL_MINS);
+    fprintf(f, "; The interval in percent on battery and on a charger (200 = twice as long)\n");
+    fprintf(f, "battery_interval_pct = %d\n", DEFAULT_BATTERY_PCT);
+    fprintf(f, "charger_interval_pct = %d\n", DEFAULT_CHARGER_PCT);
+    fprintf(f, "; How many upcoming slides to fetch and decode in the background\n");
+    fprintf(f, "prefetch_depth = %d\n", DEFAULT_PREFETCH_DEPTH);
+    fprintf(f, "; Megabytes of downloaded images kept for offline use (0 = off)\n");
+    fprintf(f, "cache_mb = %d\n", DEFAULT_CACHE_MB);
+    fprintf(f, "; Megabytes of screen-sized copies of local images, for fast loading (0 = off)\n");
+    fprintf(f, "thumb_mb = %d\n", DEFAULT_THUMB_MB);
+    fprintf(f, "; Megabytes set aside up front for decoding, so long runs don't fragment memory\n");
+    fprintf(f, "decode_mb = %d\n", DEFAULT_DECODE_MB);
+    fprintf(f, "; Threads for loading and scaling images (0 = one per spare CPU core)\n");
+    fprintf(f, "decode_threads = %d\n", DEFAULT_DECODE_THREADS);
+    fprintf(f, "; Slide transition: cut, fade, slide or kenburns\n");
+    fprintf(f, "transition = fade\n");
+    fprintf(f, "; How images are placed on screen: fit (letterbox), fill (crop) or stretch\n");
+    fprintf(f, "fit = fit\n");
+    fprintf(f, "; Order of local images: shuffle, sequential, newest or weighted\n");
+    fprintf(f, "; (weighted favours folders changed recently)\n");
+    fprintf(f, "order = shuffle\n");
+    fprintf(f, "; Near-duplicate local images (bursts, a screenshot taken twice): space them\n");
+    fprintf(f, "; out, skip all but one each time round, or off\n");
+    fprintf(f, "similar = space\n");
+    fprintf(f, "\n");
+	fprintf(f, "; Remote categories use a web URL from my random image generator\n");
+	fprintf(f, "; hosted on gandalfsax.com. You can host your own too!\n");
+	fprintf(f, "; https://github.com/TheExpertNoob/randomImage\n");
+	fprintf(f, "\n");
+    fprintf(f, "; Local categories may be any folder on your SD card containing\n");
+	fprintf(f, "; JPGs and/or PNGs. Searches subdirectories too!\n");
+	fprintf(f, "\n");
+    fprintf(f, "; Manifest categories download the images a server lists to the SD card\n");
+    fprintf(f, "; and play them from there, checking for new ones every hour:\n");
+    fprintf(f, ";   Name = manifest://https://example.com/album.txt\n");
+    fprintf(f, "\n");
+    fprintf(f, "; Add or remove categories freely in this file\n");
+	fprintf(f, "[Categories]\n");
+	fprintf(f, "Album = local://" SDMC_ROOT "Nintendo/Album/\n");
+	fprintf(f, "Video Games = https://gandalfsax.com/images/vg.jpg\n");
+	fprintf(f, "Halloween = https://gandalfsax.com/images/hw.jpg\n");
+    fprintf(f, ";Ancient Girls = https://gandalfsax.com/images/ag.jpg\n");
+    fprintf(f, ";Gaming Girls = https://gandalfsax.com/images/gg.jpg\n");
+    fprintf(f, ";Lofi Time = https://gandalfsax.com/images/lt.jpg\n");
+    fprintf(f, ";Waifu & Chill = https://gandalfsax.com/images/wac.jpg\n");
+	fprintf(f, ";All Girls = https://gandalfsax.com/images/girls.jpg\n");
+    fprintf(f, "\n");
+    fprintf(f, "; Per-category transitions, overriding the one in [Settings]\n");
+    fprintf(f, "[Transitions]\n");
+    fprintf(f, ";Album = kenburns\n");
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+// Whole file into a malloc'd, NUL-terminated buffer
+static char *read_file(const char *path, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    char *data = NULL;
+    size_t size = 0, capacity = 0;
+    for (;;) {
+        if (capacity - size < 4096) {
+            capacity = capacity ? capacity * 2 : 16384;
+            char *grown = realloc(data, capacity + 1);
+            if (!grown) {
+                free(data);
+                fclose(f);
+                return NULL;
+            }
+            data = grown;
+        }
+        size_t n = fread(data + size, 1, capacity - size, f);
+        size += n;
+        if (n == 0) break;
+    }
+    int failed = ferror(f);
+    fclose(f);
+    if (failed) {
+        free(data);
+        return NULL;
+    }
+    data[size] = 0;
+    *len = size;
+    return data;
+}
+
+static bool file_stamp(const char *path, int64_t *mtime, int64_t *size) {
+    struct stat st;
+    if (stat(path, &st) != 0) return false;
+    *mtime = (int64_t)st.st_mtime;
+    *size = (int64_t)st.st_size;
+    return true;
+}
+
+int config_load(Config *c, const char *path) {
+    config_defaults(c);
+
+    // If config doesn't exist, write defaults first
+    size_t len = 0;
+    char *text = read_file(path, &len);
+    if (!text) {
+        config_write_default(path);
+        text = read_file(path, &len);
+        if (!text) return -1; // SD card issue
+    }
+
+    // Stamped before parsing, so an edit made meanwhile is seen next time
+    if (!file_stamp(path, &c->mtime, &c->size)) c->mtime = c->size = -1;
+    return config_parse(c, text, len);
+}
+
+// Split off the next line, without its line ending, and move *p past it
+static char *next_line(char **p, char *end) {
+    char *line = *p;
+    char *nl = memchr(line, '\n', end - line);
+    char *eol = nl ? nl : end;
+    *p = nl ? nl + 1 : end;
+    if (eol > line && eol[-1] == '\r') eol--;
+    *eol = 0;
+    return line;
+}
+
+static char *trim(char *s) {
+    while (*s == ' ' || *s == '\t') s++;
+    char *end = s + strlen(s);
+    while (end > s && (end[-1] == ' ' || end[-1] == '\t')) end--;
+    *end = 0;
+    return s;
+}
+
+// Split "key = value" in place; false if the line has no '='
+static bool split_key(char *line, char **key, char **val) {
+    char *eq = strchr(line, '=');
+    if (!eq) return false;
+    *eq = 0;
+    *key = trim(line);
+    *val = trim(eq + 1);
+    return true;
+}
+
+static int clamp(int v, int lo, int hi) {
+    return v < lo ? lo : v > hi ? hi : v;
+}
+
+static void parse_setting(Config *c, const char *key, const char *val) {
+    if (strcmp(key, "first_run") == 0) {
+        c->first_run = (strcmp(val, "true") == 0);
+    } else if (strcmp(key, "interval_mins") == 0) {
+        c->interval_mins = clamp(atoi(val), MIN_INTERVAL_MINS, MAX_INTERVAL_MINS);
+    } else if (strcmp(key, "battery_interval_pct") == 0) {
+        c->battery_pct = clamp(atoi(val), MIN_INTERVAL_PCT, MAX_INTERVAL_PCT);
+    } else if (strcmp(key, "charger_interval_pct") == 0) {
+        c->charger_pct = clamp(atoi(val), MIN_INTERVAL_PCT, MAX_INTERVAL_PCT);
+    } else if (strcmp(key, "category") == 0) {
+        c->category = val;
+    } else if (strcmp(key, "prefetch_depth") == 0) {
+        c->prefetch_depth = clamp(atoi(val), 1, PREFETCH_MAX_DEPTH);
+    } else if (strcmp(key, "cache_mb") == 0) {
+        c->cache_mb = clamp(atoi(val), 0, INT_MAX);
+    } else if (strcmp(key, "thumb_mb") == 0) {
+        c->thumb_mb = clamp(atoi(val), 0, INT_MAX);
+    } else if (strcmp(key, "decode_mb") == 0) {
+        c->decode_mb = clamp(atoi(val), 0, INT_MAX);
+    } else if (strcmp(key, "decode_threads") == 0) {
+        c->decode_threads = clamp(atoi(val), 0, WORKPOOL_MAX_THREADS);
+    } else if (strcmp(key, "transition") == 0) {
+        int kind = transition_parse(val);
+        if (kind >= 0) c->default_transition = kind;
+    } else if (strcmp(key, "fit") == 0) {
+        int mode = fit_mode_parse(val);
+        if (mode >= 0) c->fit_mode = mode;
+    } else if (strcmp(key, "order") == 0) {
+        int mode = playlist_mode_parse(val);
+        if (mode >= 0) c->playlist_mode = mode;
+    } else if (strcmp(key, "similar") == 0) {
+        int similar = playlist_similar_parse(val);
+        if (similar >= 0) c->similar = similar;
+    }
+    // Future settings keys can be added here
+}
+
+static int cmp_transition(const void *a, const void *b) {
+    const TransitionLine *x = a, *y = b;
+    int by_name = strcmp(x->name, y->name);
+    return by_name ? by_name : x->order - y->order;
+}
+
+// Give each category its [Transitions] line, if it has one. Sorted so
+// big configs don't go quadratic.
+static void match_transitions(Config *c, TransitionLine *lines, int count) {
+    if (count == 0) return;
+    qsort(lines, count, sizeof(*lines), cmp_transition);
+    for (int i = 0; i < c->num_categories; i++) {
+        TransitionLine key = { c->categories[i].name, 0, 0 };
+        int lo = 0, hi = count;
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+            if (strcmp(lines[mid].name, key.name) <= 0) lo = mid + 1;
+            else hi = mid;
+        }
+        // lo is just past the last line with this name, the one that wins
+        if (lo > 0 && strcmp(lines[lo - 1].name, key.name) == 0)
+            c->categories[i].transition = lines[lo - 1].kind;
+    }
+}
+
+// Manifest categories play their sync folder as a local one. A URL
+// without a scheme is taken to be https.
+static int place_manifests(Config *c) {
+    size_t need = 0;
+    char dir[512];
+    for (int i = 0; i < c->num_categories; i++) {
+        const char *url = c->categories[i].manifest;
+        if (url[0] == 0) continue;
+        manifest_dir(url, dir, sizeof(dir));
+        need += strlen("https://") + strlen(url) + 1 + strlen(dir) + strlen(MANIFEST_IMAGES) + 1;
+    }
+    if (need == 0) return 0;
+    c->paths = malloc(need);
+    if (!c->paths) return -1;
+
+    char *p = c->paths;
+    for (int i = 0; i < c->num_categories; i++) {
+        Category *cat = &c->categories[i];
+        if (cat->manifest[0] == 0) continue;
+        const char *scheme = strstr(cat->manifest, "://") ? "" : "https://";
+        char *url = p;
+        p += sprintf(p, "%s%s", scheme, cat->manifest) + 1;
+        cat->manifest = url;
+        manifest_dir(url, dir, sizeof(dir));
+        cat->localpath = p;
+        p += sprintf(p, "%s" MANIFEST_IMAGES, dir) + 1;
+    }
+    return 0;
+}
+
+static bool grow(void **array, int *capacity, int count, size_t item) {
+    if (count < *capacity) return true;
+    int next = *capacity ? *capacity * 2 : 16;
+    void *grown = realloc(*array, (size_t)next * item);
+    if (!grown) return false;
+    *array = grown;
+    *capacity = next;
+    return true;
+}
+
+int config_parse(Config *c, char *text, size_t len) {
+    free(c->categories);
+    free(c->text);
+    free(c->paths);
+    c->paths = NULL;
+    c->categories = NULL;
+    c->num_categories = 0;
+    c->text = text;
+
+    enum { SECTION_NONE, SECTION_SETTINGS, SECTION_CATEGORIES, SECTION_TRANSITIONS } section = SECTION_NONE;
+    int cat_capacity = 0;
+    TransitionLine *trans = NULL;
+    int num_trans = 0, trans_capacity = 0;
+    int rc = 0;
+
+    char *p = text, *end = text + len;
+    while (p < end && rc == 0) {
+        char *line = trim(next_line(&p, end));
+
+        // Skip empty lines and comments
+        if (line[0] == 0 || line[0] == ';' || line[0] == '#') continue;
+
+        // Section headers
+        if (line[0] == '[') {
+            if (strncmp(line, "[Settings]", 10) == 0)         section = SECTION_SETTINGS;
+            else if (strncmp(line, "[Categories]", 12) == 0)  section = SECTION_CATEGORIES;
+            else if (strncmp(line, "[Transitions]", 13) == 0) section = SECTION_TRANSITIONS;
+            else                                              section = SECTION_NONE;
+            continue;
+        }
+
+        char *key, *val;
+        if (!split_key(line, &key, &val)) continue;
+
+        if (section == SECTION_SETTINGS) {
+            parse_setting(c, key, val);
+        } else if (section == SECTION_TRANSITIONS) {
+            int kind = transition_parse(val);
+            if (kind < 0) continue;
+            if (!grow((void **)&trans, &trans_capacity, num_trans, sizeof(*trans))) {
+                rc = -1;
+                break;
+            }
+            trans[num_trans] = (TransitionLine){ key, kind, num_trans };
+            num_trans++;
+        } else if (section == SECTION_CATEGORIES) {
+            if (!grow((void **)&c->categories, &cat_capacity, c->num_categories,
+                      sizeof(Category))) {
+                rc = -1;
+                break;
+            }
+            Category *cat = &c->categories[c->num_categories++];
+            cat->name = key;
+            cat->transition = -1;
+            cat->manifest = "";
+            if (strncmp(val, "local://", 8) == 0) {
+                cat->url = "";
+                cat->localpath = val + 8;
+            } else if (strncmp(val, "manifest://", 11) == 0) {
+                cat->url = "";
+                cat->localpath = "";    // its sync folder, see place_manifests()
+                cat->manifest = val + 11;
+            } else {
+                cat->url = val;
+                cat->localpath = "";
+            }
+        }
+    }
+
+    match_transitions(c, trans, num_trans);
+    free(trans);
+    if (place_manifests(c) != 0) rc = -1;
+    return rc;
+}
+
+bool config_changed(const Config *c, const char *path) {
+    int64_t mtime, size;
+    if (!file_stamp(path, &mtime, &size)) return c->mtime != -1;
+    return mtime != c->mtime || size != c->size;
+}
+
+// End of the line starting at start, past its line ending
+static size_t line_end(const char *text, size_t len, size_t start) {
+    const char *nl = memchr(text + start, '\n', len - start);
+    return nl ? (size_t)(nl - text) + 1 : len;
+}
+
+static void write_value(FILE *f, const ConfigValue *v, const char *eol) {
+    fprintf(f, "%s = %s%s", v->key, v->value, eol);
+}
+
+int config_update(Config *c, const char *path, const ConfigValue *values, int count) {
+    size_t len = 0;
+    char *text = read_file(path, &len);
+    if (!text) return -1;
+    bool edited = c && config_changed(c, path);
+
+    // One pass to find the [Settings] lines to replace and where to add
+    // the missing keys: after its last key, or its header if it has none
+    size_t *found = calloc(count ? count : 1, sizeof(size_t));   // line start + 1, 0 = missing
+    if (!found) {
+        free(text);
+        return -1;
+    }
+    char *copy = malloc(len + 1);   // split up in place; text is written out as is
+    if (!copy) {
+        free(found);
+        free(text);
+        return -1;
+    }
+    memcpy(copy, text, len + 1);
+    const char *eol = memchr(text, '\r', len) ? "\r\n" : "\n";
+    size_t insert = 0;
+    bool have_settings = false, in_settings = false;
+    for (char *p = copy; p < copy + len;) {
+        size_t start = p - copy;
+        char *line = trim(next_line(&p, copy + len));
+        size_t end = p - copy;
+
+        if (line[0] == '[') {
+            in_settings = strncmp(line, "[Settings]", 10) == 0;
+            if (in_settings && !have_settings) {
+                have_settings = true;
+                insert = end;
+            }
+        } else if (in_settings && line[0] != ';' && line[0] != '#') {
+            char *key, *val;
+            if (split_key(line, &key, &val)) {
+                insert = end;
+                for (int i = 0; i < count; i++)
+                    if (strcmp(key, values[i].key) == 0) found[i] = start + 1;
+            }
+        }
+    }
+    free(copy);
+
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "wb");
+    if (!f) {
+        free(found);
+        free(text);
+        return -1;
+    }
+
+    for (size_t start = 0; start <= len;) {
+        if (have_settings && start == insert) {
+            if (start > 0 && text[start - 1] != '\n') fputs(eol, f);
+            for (int i = 0; i < count; i++)
+                if (!found[i]) write_value(f, &values[i], eol);
+        }
+        if (start == len) break;
+
+        size_t end = line_end(text, len, start);
+        int replaced = -1;
+        for (int i = 0; i < count; i++)
+            if (found[i] == start + 1) replaced = i;
+        if (replaced >= 0) {
+            // A missing line ending on the last line stays missing
+            bool ends = text[end - 1] == '\n';
+            write_value(f, &values[replaced], ends ? eol : "");
+        } else {
+            fwrite(text + start, 1, end - start, f);
+        }
+        start = end;
+    }
+    if (!have_settings) {
+        // At the end, so it can't swallow lines that come before any header
+        if (len > 0 && text[len - 1] != '\n') fputs(eol, f);
+        fprintf(f, "%s[Settings]%s", len > 0 ? eol : "", eol);
+        for (int i = 0; i < count; i++) write_value(f, &values[i], eol);
+    }
+    free(found);
+    free(text);
+
+    int failed = ferror(f);
+    if (fclose(f) != 0 || failed || replace_file(tmp, path) != 0) {
+        remove(tmp);
+        return -1;
+    }
+    if (c && !edited && !file_stamp(path, &c->mtime, &c->size)) c->mtime = c->size = -1;
+    return 0;
+}
+
+int config_find_category(const Config *c, const char *name) {
+    for (int i = 0; i < c->num_categories; i++)
+        if (strcmp(c->categories[i].name, name) == 0) return i;
+    return -1;
+}
@@ -0,0 +1,97 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "decode.h"
+#include "platform.h"
+#include "playlist.h"
+
+// config.ini: [Settings], the [Categories] to cycle through, and
+// per-category [Transitions]. Written with defaults on first start.
+//
+// The file is read into memory once and parsed in place, so lines and
+// category lists have no length limit; the Category strings point into
+// that copy. Updates rewrite only the changed [Settings] lines, keeping
+// the user's comments and layout, through a temp file and a rename.
+
+#define CONFIG_DIR  SDMC_ROOT "config/NXPhotoFrame"
+#define CONFIG_PATH CONFIG_DIR "/config.ini"
+
+#define MIN_INTERVAL_MINS 5
+#define MAX_INTERVAL_MINS 1440
+#define MIN_INTERVAL_PCT  25
+#define MAX_INTERVAL_PCT  1000
+
+typedef struct {
+    const char *name;
+    const char *url;        // empty string for local and manifest categories
+    const char *localpath;  // empty string for remote ones; a manifest's sync folder
+    const char *manifest;   // the list's URL for manifest categories, else ""
+    int         transition; // TransitionKind, or -1 for the [Settings] default
+} Category;
+
+typedef struct {
+    bool         first_run;
+    int          prefetch_depth;
+    int          cache_mb;
+    int          thumb_mb;
+    int          decode_mb;
+    int          decode_threads;
+    int          default_transition;
+    FitMode      fit_mode;
+    PlaylistMode playlist_mode;
+    PlaylistSimilar similar;    // near-duplicate local images
+    int          battery_pct;   // slide interval scale on battery, in percent
+    int          charger_pct;   // and on a charger
+
+    // Where the slideshow was left, saved as it changes
+    int          interval_mins;
+    const char  *category;      // name of the category last shown, or ""
+
+    Category    *categories;
+    int          num_categories;
+
+    char        *text;          // the file contents the strings point into
+    char        *paths;         // manifest URLs and folders, likewise
+    int64_t      mtime, size;   // of the file when it was read, to spot edits
+} Config;
+
+// A [Settings] key to write and its new value
+typedef struct {
+    const char *key;
+    const char *value;
+} ConfigValue;
+
+void config_defaults(Config *c);
+void config_free(Config *c);
+
+// Write the default config.ini to path, creating its folder
+int  config_write_default(const char *path);
+
+// Read path over the defaults, writing the default file first if there is
+// none. Returns -1 (and leaves the defaults, with no categories) if it
+// can't be read. config_free() it either way.
+int  config_load(Config *c, const char *path);
+
+// Parse an INI document into c, set up by config_defaults(); settings it
+// doesn't mention keep their value. Takes ownership of text, which must be
+// malloc'd with a NUL at text[len]. Returns -1 if memory ran out, keeping
+// what was parsed up to there.
+int  config_parse(Config *c, char *text, size_t len);
+
+// Whether path was edited (or removed) since c was read from it
+bool config_changed(const Config *c, const char *path);
+
+// Set [Settings] keys in path, adding any that are missing, without
+// touching the rest of the file. If c was read from path it is marked
+// current again, so the write isn't mistaken for an edit (unless the file
+// had already been edited). Returns -1 on failure, leaving path as it was.
+int  config_update(Config *c, const char *path, const ConfigValue *values, int count);
+
+// Index of the category called name, or -1
+int  config_find_category(const Config *c, const char *name);
+
+#endif
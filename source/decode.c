@@ -0,0 +1,426 @@
+#include <setjmp.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <jpeglib.h>
+#include <png.h>
+#include <webp/decode.h>
+#include <webp/demux.h>
+
+#include "decode.h"
+#include "gif.h"
+#include "imageformat.h"
+#include "membudget.h"
+#include "qoi.h"
+#include "scale.h"
+
+SDL_Rect fit_rect(int src_w, int src_h, int dst_w, int dst_h) {
+    float src_ratio = (float)src_w / (float)src_h;
+    float dst_ratio = (float)dst_w / (float)dst_h;
+
+    int new_w, new_h;
+    if (src_ratio > dst_ratio) {
+        // Wider than the target — fit width, letterbox top/bottom
+        new_w = dst_w;
+        new_h = (int)(dst_w / src_ratio);
+    } else {
+        // Taller than the target — fit height, pillarbox left/right
+        new_h = dst_h;
+        new_w = (int)(dst_h * src_ratio);
+    }
+    if (new_w < 1) new_w = 1;
+    if (new_h < 1) new_h = 1;
+
+    SDL_Rect r = { (dst_w - new_w) / 2, (dst_h - new_h) / 2, new_w, new_h };
+    return r;
+}
+
+SDL_Rect place_rect(FitMode mode, int src_w, int src_h, int dst_w, int dst_h) {
+    if (mode == FIT_STRETCH) {
+        SDL_Rect r = { 0, 0, dst_w, dst_h };
+        return r;
+    }
+    if (mode == FIT_CONTAIN)
+        return fit_rect(src_w, src_h, dst_w, dst_h);
+
+    // Fill: scale by the larger ratio so both edges reach the screen
+    float scale_w = (float)dst_w / (float)src_w;
+    float scale_h = (float)dst_h / (float)src_h;
+    float scale = scale_w > scale_h ? scale_w : scale_h;
+    int new_w = (int)(src_w * scale + 0.5f);
+    int new_h = (int)(src_h * scale + 0.5f);
+    if (new_w < dst_w) new_w = dst_w;
+    if (new_h < dst_h) new_h = dst_h;
+
+    SDL_Rect r = { (dst_w - new_w) / 2, (dst_h - new_h) / 2, new_w, new_h };
+    return r;
+}
+
+int fit_mode_parse(const char *name) {
+    if (strcasecmp(name, "fit") == 0)     return FIT_CONTAIN;
+    if (strcasecmp(name, "fill") == 0)    return FIT_FILL;
+    if (strcasecmp(name, "stretch") == 0) return FIT_STRETCH;
+    return -1;
+}
+
+// The centered part of a src_w x src_h image that lands on screen with
+// FIT_FILL
+static SDL_Rect screen_crop(int src_w, int src_h, int dst_w, int dst_h) {
+    SDL_Rect r = place_rect(FIT_FILL, src_w, src_h, dst_w, dst_h);
+    int w = (int)((int64_t)src_w * dst_w / r.w);
+    int h = (int)((int64_t)src_h * dst_h / r.h);
+    if (w < 1) w = 1;
+    if (h < 1) h = 1;
+    if (w > src_w) w = src_w;
+    if (h > src_h) h = src_h;
+    SDL_Rect crop = { (src_w - w) / 2, (src_h - h) / 2, w, h };
+    return crop;
+}
+
+// For FIT_FILL only the part that lands on screen is kept; the rest would
+// be cropped by the renderer anyway
+static SDL_Surface *crop_to_screen(SDL_Surface *surface, int dst_w, int dst_h) {
+    SDL_Rect c = screen_crop(surface->w, surface->h, dst_w, dst_h);
+    int w = c.w, h = c.h;
+    int bpp = surface->format->BytesPerPixel;
+    if ((w >= surface->w && h >= surface->h) || surface->format->BitsPerPixel < 8)
+        return surface;
+
+    SDL_Surface *crop = scratch_surface(w, h, surface->format->format);
+    if (!crop) return surface;
+    if (surface->format->palette) SDL_SetSurfacePalette(crop, surface->format->palette);
+    Uint32 key;
+    if (SDL_GetColorKey(surface, &key) == 0) SDL_SetColorKey(crop, SDL_TRUE, key);
+
+    if (SDL_MUSTLOCK(surface)) SDL_LockSurface(surface);
+    const Uint8 *src = (const Uint8 *)surface->pixels +
+                       (size_t)c.y * surface->pitch + (size_t)c.x * bpp;
+    for (int y = 0; y < h; y++)
+        memcpy((Uint8 *)crop->pixels + (size_t)y * crop->pitch,
+               src + (size_t)y * surface->pitch, (size_t)w * bpp);
+    if (SDL_MUSTLOCK(surface)) SDL_UnlockSurface(surface);
+
+    SDL_FreeSurface(surface);
+    return crop;
+}
+
+// The result outlives the decode, so it can't stay in scratch memory
+static SDL_Surface *keep_surface(SDL_Surface *surface) {
+    if (!scratch_owns(surface->pixels)) return surface;
+    SDL_Surface *copy = SDL_DuplicateSurface(surface);
+    SDL_FreeSurface(surface);
+    return copy;
+}
+
+SDL_Surface *shrink_surface(SDL_Surface *surface, FitMode mode, int dst_w, int dst_h) {
+    if (!surface) return NULL;
+    if (mode == FIT_FILL) surface = crop_to_screen(surface, dst_w, dst_h);
+
+    SDL_Rect r = place_rect(mode, surface->w, surface->h, dst_w, dst_h);
+    if (mode == FIT_FILL) {
+        // Already screen-shaped; don't let rounding leave it a pixel over
+        r.w = dst_w;
+        r.h = dst_h;
+    }
+    if (surface->w <= r.w && surface->h <= r.h) return keep_surface(surface);
+
+    SDL_Surface *small = scale_surface(surface,
+                                       surface->w < r.w ? surface->w : r.w,
+                                       surface->h < r.h ? surface->h : r.h);
+    if (!small) return keep_surface(surface);
+    SDL_FreeSurface(surface);
+    return small;
+}
+
+int is_jpeg_data(const unsigned char *data, size_t size) {
+    return size >= 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF;
+}
+
+typedef struct {
+    struct jpeg_error_mgr pub;
+    jmp_buf jump;
+} JpegError;
+
+static void jpeg_error_exit(j_common_ptr cinfo) {
+    JpegError *err = (JpegError *)cinfo->err;
+    longjmp(err->jump, 1);
+}
+
+static void jpeg_output_message(j_common_ptr cinfo) {
+    // Keep libjpeg warnings off stderr
+}
+
+int decode_scale_denom(int src_w, int src_h, FitMode mode, int dst_w, int dst_h) {
+    SDL_Rect fit = place_rect(mode, src_w, src_h, dst_w, dst_h);
+    for (int denom = 8; denom > 1; denom /= 2) {
+        int w = (src_w + denom - 1) / denom;
+        int h = (src_h + denom - 1) / denom;
+        if (w >= fit.w && h >= fit.h) return denom;
+    }
+    return 1;
+}
+
+// Shared by the file and memory paths; exactly one of file/data is set
+static SDL_Surface *decode_jpeg(FILE *file, const unsigned char *data, size_t size,
+                                FitMode mode, int dst_w, int dst_h) {
+    struct jpeg_decompress_struct cinfo;
+    JpegError jerr;
+    SDL_Surface *volatile surface = NULL;
+
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit     = jpeg_error_exit;
+    jerr.pub.output_message = jpeg_output_message;
+
+    if (setjmp(jerr.jump)) {
+        jpeg_destroy_decompress(&cinfo);
+        if (surface) SDL_FreeSurface(surface);
+        return NULL;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    if (file)
+        jpeg_stdio_src(&cinfo, file);
+    else
+        jpeg_mem_src(&cinfo, (unsigned char *)data, (unsigned long)size);
+
+    jpeg_read_header(&cinfo, TRUE);
+
+    cinfo.scale_num   = 1;
+    cinfo.scale_denom = decode_scale_denom(cinfo.image_width, cinfo.image_height,
+                                           mode, dst_w, dst_h);
+#ifdef JCS_EXTENSIONS
+    // libjpeg-turbo: write RGBA rows straight into a 32-bit surface
+    cinfo.out_color_space = JCS_EXT_RGBA;
+    Uint32 format = SDL_PIXELFORMAT_RGBA32;
+#else
+    cinfo.out_color_space = JCS_RGB;
+    Uint32 format = SDL_PIXELFORMAT_RGB24;
+#endif
+
+    jpeg_start_decompress(&cinfo);
+
+    // Usually larger than the slide; shrink_surface() makes the copy we keep
+    surface = scratch_surface(cinfo.output_width, cinfo.output_height, format);
+    if (!surface) {
+        jpeg_destroy_decompress(&cinfo);
+        return NULL;
+    }
+
+    while (cinfo.output_scanline < cinfo.output_height) {
+        JSAMPROW row = (JSAMPROW)surface->pixels + (size_t)cinfo.output_scanline * surface->pitch;
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return surface;
+}
+
+SDL_Surface *decode_jpeg_file(const char *path, FitMode mode, int dst_w, int dst_h) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    SDL_Surface *surface = decode_jpeg(f, NULL, 0, mode, dst_w, dst_h);
+    fclose(f);
+    return surface;
+}
+
+SDL_Surface *decode_jpeg_mem(const unsigned char *data, size_t size,
+                             FitMode mode, int dst_w, int dst_h) {
+    if (!is_jpeg_data(data, size)) return NULL;
+    return decode_jpeg(NULL, data, size, mode, dst_w, dst_h);
+}
+
+void decode_target(int src_w, int src_h, FitMode mode, int dst_w, int dst_h,
+                          SDL_Rect *crop, int *out_w, int *out_h) {
+    SDL_Rect r;
+    if (mode == FIT_FILL) {
+        *crop = screen_crop(src_w, src_h, dst_w, dst_h);
+        r.w = dst_w;
+        r.h = dst_h;
+    } else {
+        crop->x = crop->y = 0;
+        crop->w = src_w;
+        crop->h = src_h;
+        r = place_rect(mode, src_w, src_h, dst_w, dst_h);
+    }
+    *out_w = crop->w < r.w ? crop->w : r.w;
+    *out_h = crop->h < r.h ? crop->h : r.h;
+}
+
+// libpng's simplified reader: any bit depth, palette or Adam7 comes out as
+// 8-bit RGBA. PNG has no way to decode at a smaller size, so this is full
+// size and shrink_surface() filters it down. Exactly one of file/data is set.
+static SDL_Surface *decode_png(FILE *file, const unsigned char *data, size_t size) {
+    png_image image;
+    memset(&image, 0, sizeof(image));
+    image.version = PNG_IMAGE_VERSION;
+    if (!(file ? png_image_begin_read_from_stdio(&image, file)
+               : png_image_begin_read_from_memory(&image, data, size)))
+        return NULL;
+    image.format = PNG_FORMAT_RGBA;
+
+    SDL_Surface *surface = scratch_surface(image.width, image.height, SDL_PIXELFORMAT_RGBA32);
+    if (!surface) {
+        png_image_free(&image);
+        return NULL;
+    }
+    // Frees the image either way
+    if (!png_image_finish_read(&image, NULL, surface->pixels, surface->pitch, NULL)) {
+        SDL_FreeSurface(surface);
+        return NULL;
+    }
+    return surface;
+}
+
+// libwebp crops (FIT_FILL) and scales while it decodes, area-averaging
+// straight into a slide-sized surface, so a 24-megapixel WebP never exists
+// at full size. An animation gives its first frame: that may be smaller
+// than the canvas and offset into it, in which case it is decoded unscaled
+// over a transparent canvas, as a player would show it.
+static SDL_Surface *decode_webp(const unsigned char *data, size_t size,
+                                FitMode mode, int dst_w, int dst_h) {
+    WebPDecoderConfig config;
+    if (!WebPInitDecoderConfig(&config) ||
+        WebPGetFeatures(data, size, &config.input) != VP8_STATUS_OK)
+        return NULL;
+
+    int canvas_w = config.input.width, canvas_h = config.input.height;
+    int x = 0, y = 0, w = canvas_w, h = canvas_h;
+    WebPDemuxer *demux = NULL;
+    WebPIterator iter;
+    if (config.input.has_animation) {
+        WebPData whole = { data, size };
+        demux = WebPDemux(&whole);
+        if (!demux || !WebPDemuxGetFrame(demux, 1, &iter)) {
+            WebPDemuxDelete(demux);
+            return NULL;
+        }
+        data = iter.fragment.bytes;
+        size = iter.fragment.size;
+        x = iter.x_offset;
+        y = iter.y_offset;
+        w = iter.width;
+        h = iter.height;
+    }
+
+    SDL_Surface *surface;
+    if (w == canvas_w && h == canvas_h) {
+        SDL_Rect crop;
+        int out_w, out_h;
+        decode_target(w, h, mode, dst_w, dst_h, &crop, &out_w, &out_h);
+        if (crop.w < w || crop.h < h) {
+            config.options.use_cropping = 1;
+            config.options.crop_left    = crop.x;
+            config.options.crop_top     = crop.y;
+            config.options.crop_width   = crop.w;
+            config.options.crop_height  = crop.h;
+        }
+        if (out_w < crop.w || out_h < crop.h) {
+            config.options.use_scaling   = 1;
+            config.options.scaled_width  = out_w;
+            config.options.scaled_height = out_h;
+        }
+        surface = scratch_surface(out_w, out_h, SDL_PIXELFORMAT_RGBA32);
+    } else {
+        surface = scratch_surface(canvas_w, canvas_h, SDL_PIXELFORMAT_RGBA32);
+        if (surface) memset(surface->pixels, 0, (size_t)surface->pitch * canvas_h);
+    }
+
+    if (surface) {
+        size_t offset = (size_t)y * surface->pitch + (size_t)x * 4;
+        config.output.colorspace         = MODE_RGBA;
+        config.output.is_external_memory = 1;
+        config.output.u.RGBA.rgba        = (uint8_t *)surface->pixels + offset;
+        config.output.u.RGBA.stride      = surface->pitch;
+        config.output.u.RGBA.size        = (size_t)surface->pitch * surface->h - offset;
+        if (WebPDecode(data, size, &config) != VP8_STATUS_OK) {
+            SDL_FreeSurface(surface);
+            surface = NULL;
+        }
+        WebPFreeDecBuffer(&config.output);
+    }
+
+    if (demux) {
+        WebPDemuxReleaseIterator(&iter);
+        WebPDemuxDelete(demux);
+    }
+    return surface;
+}
+
+// The first frame of a GIF, at full size; anim.c plays the rest. Takes the
+// decoder.
+static SDL_Surface *decode_gif(GifDecoder *g) {
+    if (!g) return NULL;
+    const unsigned char *rgba;
+    int w, h, delay;
+    gif_size(g, &w, &h);
+    SDL_Surface *surface = NULL;
+    if (gif_next_frame(g, &rgba, &delay) == 1)
+        surface = scratch_surface(w, h, SDL_PIXELFORMAT_RGBA32);
+    if (surface)
+        for (int y = 0; y < h; y++)
+            memcpy((unsigned char *)surface->pixels + (size_t)y * surface->pitch,
+                   rgba + (size_t)y * w * 4, (size_t)w * 4);
+    gif_close(g);
+    return surface;
+}
+
+// QOI has no reduced-size decode either; it is fast enough at full size
+static SDL_Surface *decode_qoi(const unsigned char *data, size_t size) {
+    QoiDesc desc;
+    if (qoi_read_header(data, size, &desc) != 0) return NULL;
+    SDL_Surface *surface = scratch_surface(desc.width, desc.height, SDL_PIXELFORMAT_RGBA32);
+    if (surface && qoi_decode(data, size, surface->pixels, surface->pitch) != 0) {
+        SDL_FreeSurface(surface);
+        surface = NULL;
+    }
+    return surface;
+}
+
+SDL_Surface *decode_image_mem(const unsigned char *data, size_t size,
+                              FitMode mode, int dst_w, int dst_h) {
+    switch (image_format(data, size)) {
+        case IMAGE_JPEG: return decode_jpeg(NULL, data, size, mode, dst_w, dst_h);
+        case IMAGE_PNG:  return decode_png(NULL, data, size);
+        case IMAGE_WEBP: return decode_webp(data, size, mode, dst_w, dst_h);
+        case IMAGE_QOI:  return decode_qoi(data, size);
+        case IMAGE_GIF:  return decode_gif(gif_open_mem(data, size));
+        default:         return NULL;
+    }
+}
+
+SDL_Surface *decode_image_file(const char *path, FitMode mode, int dst_w, int dst_h) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    unsigned char head[IMAGE_SNIFF_BYTES];
+    ImageFormat format = image_format(head, fread(head, 1, sizeof(head), f));
+    rewind(f);
+
+    // JPEG, PNG and GIF stream from the file; libwebp and the QOI decoder
+    // want the whole file, which is read into scratch memory
+    SDL_Surface *surface = NULL;
+    if (format == IMAGE_JPEG) {
+        surface = decode_jpeg(f, NULL, 0, mode, dst_w, dst_h);
+    } else if (format == IMAGE_PNG) {
+        surface = decode_png(f, NULL, 0);
+    } else if (format == IMAGE_GIF) {
+        surface = decode_gif(gif_open_file(path));
+    } else if (format != IMAGE_UNKNOWN) {
+        struct stat st;
+        unsigned char *data = NULL;
+        size_t size = 0;
+        if (fstat(fileno(f), &st) == 0 && st.st_size > 0) {
+            size = (size_t)st.st_size;
+            data = scratch_alloc(size);
+            if (data && fread(data, 1, size, f) != size) {
+                scratch_free(data);
+                data = NULL;
+            }
+        }
+        if (data) surface = decode_image_mem(data, size, mode, dst_w, dst_h);
+        scratch_free(data);
+    }
+    fclose(f);
+    return surface;
+}
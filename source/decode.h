@@ -0,0 +1,64 @@
+#ifndef DECODE_H
+#define DECODE_H
+
+#include <stddef.h>
+#include <SDL2/SDL.h>
+
+typedef enum {
+    FIT_CONTAIN,    // whole image visible, letterbox/pillarbox
+    FIT_FILL,       // cover the screen, cropping the overflow
+    FIT_STRETCH,    // cover the screen, ignoring the aspect ratio
+} FitMode;
+
+// Largest rect with the source aspect ratio that fits in dst_w x dst_h,
+// centered (letterbox/pillarbox).
+SDL_Rect fit_rect(int src_w, int src_h, int dst_w, int dst_h);
+
+// Where an src_w x src_h image is drawn on a dst_w x dst_h screen. For
+// FIT_FILL the rect is larger than the screen and the renderer clips it.
+SDL_Rect place_rect(FitMode mode, int src_w, int src_h, int dst_w, int dst_h);
+
+// "fit", "fill" or "stretch"; -1 if unknown
+int fit_mode_parse(const char *name);
+
+// Decode a JPEG at the smallest DCT scale (1/1, 1/2, 1/4 or 1/8) that still
+// covers the rect it will be placed in on a dst_w x dst_h screen. The
+// renderer does the remaining (at most 2:1) resize. Returns NULL on error
+// (e.g. CMYK JPEGs) so the caller can fall back to SDL_image. The surface
+// may be scratch memory (see membudget.h); pass it to shrink_surface().
+SDL_Surface *decode_jpeg_file(const char *path, FitMode mode, int dst_w, int dst_h);
+SDL_Surface *decode_jpeg_mem(const unsigned char *data, size_t size,
+                             FitMode mode, int dst_w, int dst_h);
+
+// Decode any supported image, choosing the decoder from the data's first
+// bytes rather than the file name (see imageformat.h): JPEGs as above,
+// WebPs cropped and scaled by libwebp straight to their placed size (the
+// first frame, if animated), PNG, QOI and GIF (its first frame) at full
+// size. NULL for other formats or broken data, so the caller can fall back
+// to SDL_image. The surface may be scratch memory; pass it to
+// shrink_surface().
+SDL_Surface *decode_image_file(const char *path, FitMode mode, int dst_w, int dst_h);
+SDL_Surface *decode_image_mem(const unsigned char *data, size_t size,
+                              FitMode mode, int dst_w, int dst_h);
+
+// Where a decoder that can crop and scale should take a src_w x src_h
+// image: *crop is the part to keep (all of it, except with FIT_FILL) and
+// *out_w x *out_h the size to scale that to, the same one shrink_surface()
+// would pick, so it has nothing left to do. Never larger than the crop.
+void decode_target(int src_w, int src_h, FitMode mode, int dst_w, int dst_h,
+                   SDL_Rect *crop, int *out_w, int *out_h);
+
+// The DCT scale denominator those pick for a src_w x src_h JPEG: the
+// largest reduction whose output still covers its placed rect
+int decode_scale_denom(int src_w, int src_h, FitMode mode, int dst_w, int dst_h);
+
+// Shrink a decoded surface that is larger than its placed rect down to that
+// rect with a proper area/bilinear filter, so the renderer never has to
+// minify and the texture stays small; for FIT_FILL the off-screen part is
+// cropped first, so no slide ends up larger than the screen. Frees and
+// replaces the input surface. The result is never in scratch memory.
+SDL_Surface *shrink_surface(SDL_Surface *surface, FitMode mode, int dst_w, int dst_h);
+
+int is_jpeg_data(const unsigned char *data, size_t size);
+
+#endif
@@ -0,0 +1,498 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "fetch.h"
+#include "trace.h"
+
+#define FETCH_POLL_MS 50        // how often waiting loaders check abort_fn
+#define FETCH_IDLE_MS 1000      // network thread sleep with nothing to do
+#define FETCH_STREAM_CHUNK (64 * 1024)  // most body copied out per lock for stream_fn
+
+typedef enum {
+    XFER_IDLE,
+    XFER_QUEUED,                // waiting for the network thread to start it
+    XFER_RUNNING,               // owned by the network thread
+    XFER_DONE,
+} XferState;
+
+typedef struct {
+    FetchContext ctx;
+    Fetcher  *owner;
+    XferState state;
+    char      url[512];
+    bool      claimed;          // a loader is waiting for or using it
+    bool      dropped;          // nobody wants it any more; stop it
+    CURLcode  result;
+    Uint32    done_at;
+    struct curl_slist *headers;
+} Transfer;
+
+struct Fetcher {
+    SDL_Thread *thread;
+    SDL_mutex  *lock;
+    SDL_cond   *cond;           // a transfer finished or a slot freed up
+    bool        quit;
+    bool        reset;
+
+    FetchValidatorsFn validators;
+    void             *user;
+
+    // Only touched by the network thread
+    CURLM  *multi;
+    CURLSH *share;
+
+    Transfer slots[FETCH_MAX_TRANSFERS];    // guarded by lock
+    FetchTiming last;                       // guarded by lock
+    bool        have_last;
+};
+
+// Make room for at least need bytes, either exactly (known length) or by
+// doubling (unknown length). Never shrinks.
+static int fetch_reserve(FetchContext *ctx, size_t need, int exact) {
+    if (need <= ctx->capacity) return 1;
+    if (need > FETCH_MAX_BYTES) return 0;
+
+    size_t cap = need;
+    if (!exact) {
+        cap = ctx->capacity ? ctx->capacity : FETCH_MIN_CAPACITY;
+        while (cap < need) cap *= 2;
+        if (cap > FETCH_MAX_BYTES) cap = FETCH_MAX_BYTES;
+    }
+
+    unsigned char *p = realloc(ctx->data, cap);
+    if (!p) return 0;   // old buffer is still owned by ctx
+    ctx->data = p;
+    ctx->capacity = cap;
+    ctx->allocs++;
+    return 1;
+}
+
+// Copy a header value, minus the leading spaces and trailing CRLF
+static void header_value(const char *src, size_t len, char *out, size_t out_len) {
+    while (len > 0 && *src == ' ') { src++; len--; }
+    while (len > 0 && (src[len - 1] == '\r' || src[len - 1] == '\n' || src[len - 1] == ' ')) len--;
+    if (len >= out_len) len = out_len - 1;
+    memcpy(out, src, len);
+    out[len] = 0;
+}
+
+static size_t header_callback(char *buffer, size_t size, size_t nitems, void *userp) {
+    size_t total = size * nitems;
+    Transfer *t = userp;
+    FetchContext *ctx = &t->ctx;
+
+    // A new status line starts a new response (e.g. after a redirect)
+    if (total > 5 && strncmp(buffer, "HTTP/", 5) == 0) {
+        ctx->etag[0] = 0;
+        ctx->last_modified[0] = 0;
+    } else if (total > 5 && strncasecmp(buffer, "ETag:", 5) == 0) {
+        header_value(buffer + 5, total - 5, ctx->etag, sizeof(ctx->etag));
+    } else if (total > 14 && strncasecmp(buffer, "Last-Modified:", 14) == 0) {
+        header_value(buffer + 14, total - 14, ctx->last_modified, sizeof(ctx->last_modified));
+    }
+
+    // Pre-size from Content-Length so the body lands in one allocation
+    if (total > 15 && strncasecmp(buffer, "Content-Length:", 15) == 0) {
+        unsigned long long len = strtoull(buffer + 15, NULL, 10);
+        if (len > FETCH_MAX_BYTES) return 0;
+        SDL_LockMutex(t->owner->lock);
+        int ok = fetch_reserve(ctx, (size_t)len, 1);
+        SDL_UnlockMutex(t->owner->lock);
+        if (!ok) return 0;
+    }
+    return total;
+}
+
+// The buffer and size are guarded by the lock while the transfer runs, as
+// a streaming loader may be copying out of them
+static size_t write_callback(char *contents, size_t size, size_t nmemb, void *userp) {
+    size_t total = size * nmemb;
+    Transfer *t = userp;
+    FetchContext *ctx = &t->ctx;
+    SDL_LockMutex(t->owner->lock);
+    int ok = fetch_reserve(ctx, ctx->size + total, 0);
+    if (ok) {
+        memcpy(ctx->data + ctx->size, contents, total);
+        ctx->size += total;
+    }
+    SDL_UnlockMutex(t->owner->lock);
+    return ok ? total : 0;
+}
+
+// Options that stay the same for every fetch; set once per handle
+static CURL *fetch_handle(Fetcher *f, Transfer *t) {
+    if (t->ctx.curl) return t->ctx.curl;
+
+    CURL *curl = curl_easy_init();
+    if (!curl) return NULL;
+
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, t);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, t);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, t);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 15L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, "NXPhotoFrame/" APP_VERSION " (Nintendo Switch)");
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_DNS_CACHE_TIMEOUT, 600L);
+    curl_easy_setopt(curl, CURLOPT_SSL_SESSIONID_CACHE, 1L);
+    if (f->share) curl_easy_setopt(curl, CURLOPT_SHARE, f->share);
+
+    t->ctx.curl = curl;
+    return curl;
+}
+
+static CURLM *multi_open(void) {
+    CURLM *multi = curl_multi_init();
+    if (multi) curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, 4L);
+    return multi;
+}
+
+// Point the slot's handle at its url and hand it to curl. Network thread,
+// without the lock; nobody else touches a running slot.
+static CURLcode begin(Fetcher *f, Transfer *t) {
+    FetchContext *ctx = &t->ctx;
+    ctx->http_code = 0;
+    ctx->allocs    = 0;
+    ctx->etag[0]   = 0;
+    ctx->last_modified[0] = 0;
+
+    CURL *curl = fetch_handle(f, t);
+    if (!curl) return CURLE_FAILED_INIT;
+
+    char etag[128] = "", last_modified[64] = "";
+    if (f->validators)
+        f->validators(t->url, etag, sizeof(etag), last_modified, sizeof(last_modified), f->user);
+
+    char line[256];
+    if (etag[0]) {
+        snprintf(line, sizeof(line), "If-None-Match: %s", etag);
+        t->headers = curl_slist_append(t->headers, line);
+    }
+    if (last_modified[0]) {
+        snprintf(line, sizeof(line), "If-Modified-Since: %s", last_modified);
+        t->headers = curl_slist_append(t->headers, line);
+    }
+    curl_easy_setopt(curl, CURLOPT_URL, t->url);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, t->headers);
+
+    return curl_multi_add_handle(f->multi, curl) == CURLM_OK ? CURLE_OK : CURLE_FAILED_INIT;
+}
+
+static void collect_stats(Transfer *t) {
+    FetchContext *ctx = &t->ctx;
+    CURL *curl = ctx->curl;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &ctx->http_code);
+
+    // All of curl's times are from the start of the request
+    curl_off_t dns = 0, connect = 0, tls = 0, ttfb = 0, total = 0, speed = 0;
+    long new_connects = 0;
+    curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &dns);
+    curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connect);
+    curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &tls);
+    curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &ttfb);
+    curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total);
+    curl_easy_getinfo(curl, CURLINFO_SPEED_DOWNLOAD_T, &speed);
+    curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &new_connects);
+    if (connect < dns) connect = dns;
+    if (tls < connect) tls = connect;       // plain HTTP has no TLS phase
+    if (ttfb < tls) ttfb = tls;
+
+    FetchTiming *tm = &ctx->timing;
+    tm->dns_ms        = (long)(dns / 1000);
+    tm->connect_ms    = (long)((connect - dns) / 1000);
+    tm->tls_ms        = (long)((tls - connect) / 1000);
+    tm->ttfb_ms       = (long)((ttfb - tls) / 1000);
+    tm->transfer_ms   = (long)((total - ttfb) / 1000);
+    tm->total_ms      = (long)(total / 1000);
+    tm->bytes_per_sec = (long)speed;
+    ctx->reused       = (new_connects == 0);
+    ctx->peak         = ctx->capacity;
+}
+
+// Take a running slot back from curl. Network thread, with the lock held.
+static void finish(Fetcher *f, Transfer *t, CURLcode res) {
+    curl_multi_remove_handle(f->multi, t->ctx.curl);
+    curl_easy_setopt(t->ctx.curl, CURLOPT_HTTPHEADER, NULL);
+    curl_slist_free_all(t->headers);
+    t->headers = NULL;
+
+    if (t->dropped) {
+        t->state   = XFER_IDLE;
+        t->dropped = false;
+    } else {
+        t->state   = XFER_DONE;
+        t->result  = res;
+        t->done_at = SDL_GetTicks();
+    }
+    SDL_CondBroadcast(f->cond);
+}
+
+static int network_thread(void *arg) {
+    Fetcher *f = arg;
+    Transfer *start[FETCH_MAX_TRANSFERS];
+    TRACE_THREAD("fetch");
+
+    for (;;) {
+        SDL_LockMutex(f->lock);
+        if (f->quit) {
+            SDL_UnlockMutex(f->lock);
+            break;
+        }
+
+        // Stop what is no longer wanted and pick up what is newly queued
+        bool reset = f->reset;
+        f->reset = false;
+        int num_start = 0;
+        for (int i = 0; i < FETCH_MAX_TRANSFERS; i++) {
+            Transfer *t = &f->slots[i];
+            if (reset && !t->claimed && t->state == XFER_RUNNING) t->dropped = true;
+            if (t->state == XFER_RUNNING && (t->dropped || reset)) {
+                finish(f, t, CURLE_COULDNT_CONNECT);
+            } else if (t->state == XFER_QUEUED) {
+                t->state = XFER_RUNNING;
+                start[num_start++] = t;
+            }
+        }
+        if (reset) {
+            // Connections live in the multi handle; a new one starts clean
+            curl_multi_cleanup(f->multi);
+            f->multi = multi_open();
+        }
+        SDL_UnlockMutex(f->lock);
+
+        for (int i = 0; i < num_start; i++) {
+            CURLcode res = f->multi ? begin(f, start[i]) : CURLE_FAILED_INIT;
+            if (res != CURLE_OK) {
+                SDL_LockMutex(f->lock);
+                finish(f, start[i], res);
+                SDL_UnlockMutex(f->lock);
+            }
+        }
+        if (!f->multi) {
+            SDL_Delay(FETCH_IDLE_MS);
+            continue;
+        }
+
+        int running = 0;
+        curl_multi_perform(f->multi, &running);
+
+        CURLMsg *msg;
+        int left;
+        while ((msg = curl_multi_info_read(f->multi, &left))) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            CURLcode res = msg->data.result;
+            Transfer *t = NULL;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&t);
+
+            collect_stats(t);
+            TRACE_INSTANT("transfer done");
+            SDL_LockMutex(f->lock);
+            f->last = t->ctx.timing;
+            f->have_last = true;
+            finish(f, t, res);
+            SDL_UnlockMutex(f->lock);
+        }
+        TRACE_COUNTER("transfers", running);
+
+        curl_multi_poll(f->multi, NULL, 0, FETCH_IDLE_MS, NULL);
+    }
+    return 0;
+}
+
+// Get the network thread out of curl_multi_poll. With lock held.
+static void wake(Fetcher *f) {
+    if (f->multi) curl_multi_wakeup(f->multi);
+}
+
+Fetcher *fetcher_create(FetchValidatorsFn validators, void *user) {
+    Fetcher *f = calloc(1, sizeof(Fetcher));
+    if (!f) return NULL;
+    f->validators = validators;
+    f->user       = user;
+    f->lock  = SDL_CreateMutex();
+    f->cond  = SDL_CreateCond();
+    f->multi = multi_open();
+    for (int i = 0; i < FETCH_MAX_TRANSFERS; i++)
+        f->slots[i].owner = f;
+
+    // Share TLS sessions between the slots' handles; the pool, DNS cache
+    // and connections are already shared through the multi handle. Only
+    // the network thread uses it, so no lock callbacks are needed.
+    f->share = curl_share_init();
+    if (f->share) curl_share_setopt(f->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+
+    if (f->lock && f->cond && f->multi)
+        f->thread = SDL_CreateThread(network_thread, "fetch", f);
+    if (!f->thread) {
+        fetcher_destroy(f);
+        return NULL;
+    }
+    return f;
+}
+
+void fetcher_destroy(Fetcher *f) {
+    if (!f) return;
+    if (f->thread) {
+        SDL_LockMutex(f->lock);
+        f->quit = true;
+        wake(f);
+        SDL_UnlockMutex(f->lock);
+        SDL_WaitThread(f->thread, NULL);
+    }
+
+    for (int i = 0; i < FETCH_MAX_TRANSFERS; i++) {
+        Transfer *t = &f->slots[i];
+        if (t->state == XFER_RUNNING) curl_multi_remove_handle(f->multi, t->ctx.curl);
+        if (t->ctx.curl) curl_easy_cleanup(t->ctx.curl);
+        curl_slist_free_all(t->headers);
+        free(t->ctx.data);
+    }
+    if (f->multi) curl_multi_cleanup(f->multi);
+    if (f->share) curl_share_cleanup(f->share);
+    if (f->cond) SDL_DestroyCond(f->cond);
+    if (f->lock) SDL_DestroyMutex(f->lock);
+    free(f);
+}
+
+void fetcher_reset(Fetcher *f) {
+    SDL_LockMutex(f->lock);
+    f->reset = true;
+    wake(f);
+    SDL_UnlockMutex(f->lock);
+}
+
+// Queue a download of url in a free slot, or NULL if all are busy. With
+// lock held.
+static Transfer *queue(Fetcher *f, const char *url, bool claimed) {
+    for (int i = 0; i < FETCH_MAX_TRANSFERS; i++) {
+        Transfer *t = &f->slots[i];
+        if (t->state != XFER_IDLE) continue;
+        snprintf(t->url, sizeof(t->url), "%s", url);
+        t->state       = XFER_QUEUED;
+        t->claimed     = claimed;
+        t->dropped     = false;
+        t->ctx.warmed  = !claimed;
+        t->ctx.size    = 0;     // a loader may stream it before it starts
+        wake(f);
+        return t;
+    }
+    return NULL;
+}
+
+// Nobody wants this transfer any more. With lock held.
+static void drop(Fetcher *f, Transfer *t) {
+    t->claimed = false;
+    if (t->state == XFER_RUNNING) {
+        t->dropped = true;
+        wake(f);
+    } else {
+        t->state = XFER_IDLE;
+        SDL_CondBroadcast(f->cond);
+    }
+}
+
+// A warmed transfer of url nobody has claimed yet, preferring a finished
+// one. Expired ones are dropped on the way. With lock held.
+static Transfer *find_warm(Fetcher *f, const char *url) {
+    Transfer *found = NULL;
+    for (int i = 0; i < FETCH_MAX_TRANSFERS; i++) {
+        Transfer *t = &f->slots[i];
+        if (t->state == XFER_IDLE || t->claimed || t->dropped || strcmp(t->url, url) != 0)
+            continue;
+        if (t->state == XFER_DONE && SDL_GetTicks() - t->done_at > FETCH_WARM_TTL_MS) {
+            drop(f, t);
+            continue;
+        }
+        if (!found || (t->state == XFER_DONE && found->state != XFER_DONE)) found = t;
+    }
+    return found;
+}
+
+void fetcher_warm(Fetcher *f, const char *const *urls, int count) {
+    SDL_LockMutex(f->lock);
+    for (int i = 0; i < FETCH_MAX_TRANSFERS; i++) {
+        Transfer *t = &f->slots[i];
+        if (t->state == XFER_IDLE || t->claimed || t->dropped) continue;
+        bool wanted = false;
+        for (int j = 0; j < count && !wanted; j++)
+            wanted = strcmp(t->url, urls[j]) == 0;
+        if (!wanted) drop(f, t);
+    }
+    for (int j = 0; j < count; j++)
+        if (!find_warm(f, urls[j])) queue(f, urls[j], false);
+    SDL_UnlockMutex(f->lock);
+}
+
+FetchContext *fetcher_take(Fetcher *f, const char *url, FetchAbortFn abort_fn, void *abort_arg,
+                           FetchStreamFn stream_fn, void *stream_arg, CURLcode *res) {
+    // The network thread may grow the buffer under us, so what has arrived
+    // is copied out a chunk at a time and handed over without the lock
+    unsigned char *chunk = stream_fn ? malloc(FETCH_STREAM_CHUNK) : NULL;
+    size_t streamed = 0;
+    SDL_LockMutex(f->lock);
+
+    // A warmed one if there is one, else a fresh download once a slot frees up
+    Transfer *t = NULL;
+    while (!t) {
+        if (f->quit || (abort_fn && abort_fn(abort_arg))) {
+            SDL_UnlockMutex(f->lock);
+            *res = CURLE_ABORTED_BY_CALLBACK;
+            return NULL;
+        }
+        t = find_warm(f, url);
+        if (!t) t = queue(f, url, true);
+        if (!t) SDL_CondWaitTimeout(f->cond, f->lock, FETCH_POLL_MS);
+    }
+    t->claimed = true;
+
+    while (t->state != XFER_DONE) {
+        if (f->quit || (abort_fn && abort_fn(abort_arg))) {
+            drop(f, t);
+            SDL_UnlockMutex(f->lock);
+            free(chunk);
+            *res = CURLE_ABORTED_BY_CALLBACK;
+            return NULL;
+        }
+        if (chunk && t->state == XFER_RUNNING && t->ctx.size > streamed) {
+            size_t n = t->ctx.size - streamed;
+            if (n > FETCH_STREAM_CHUNK) n = FETCH_STREAM_CHUNK;
+            memcpy(chunk, t->ctx.data + streamed, n);
+            streamed += n;
+            SDL_UnlockMutex(f->lock);
+            stream_fn(chunk, n, stream_arg);
+            SDL_LockMutex(f->lock);
+            continue;
+        }
+        SDL_CondWaitTimeout(f->cond, f->lock, FETCH_POLL_MS);
+    }
+    *res = t->result;
+    SDL_UnlockMutex(f->lock);
+    free(chunk);
+
+    // Done and ours alone now: the rest goes straight from the buffer
+    if (stream_fn && *res == CURLE_OK && t->ctx.size > streamed)
+        stream_fn(t->ctx.data + streamed, t->ctx.size - streamed, stream_arg);
+    return &t->ctx;
+}
+
+void fetcher_release(Fetcher *f, FetchContext *ctx) {
+    if (!ctx) return;
+    SDL_LockMutex(f->lock);
+    drop(f, (Transfer *)ctx);
+    SDL_UnlockMutex(f->lock);
+}
+
+bool fetcher_last_timing(Fetcher *f, FetchTiming *out) {
+    SDL_LockMutex(f->lock);
+    bool have = f->have_last;
+    if (have) *out = f->last;
+    SDL_UnlockMutex(f->lock);
+    return have;
+}
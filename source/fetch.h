@@ -0,0 +1,105 @@
+#ifndef FETCH_H
+#define FETCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <curl/curl.h>
+#include <SDL2/SDL.h>
+
+// HTTP downloads driven by one network thread through curl_multi, so
+// several transfers run side by side without blocking anyone: the slides
+// being loaded, plus the neighbouring remote categories warmed ahead of
+// a D-pad switch.
+//
+// Each transfer slot keeps its download buffer for the whole app. It is
+// sized up front from Content-Length when the server sends one, grows
+// geometrically when it doesn't, and is reused by the slot's next fetch.
+// All handles share one connection pool, DNS cache and TLS session cache,
+// so repeat fetches from the same host skip the handshakes.
+//
+// A loader can also watch its transfer's body arrive, e.g. to start
+// decoding a progressive image before the download is done. The bytes
+// are handed over on the loader's own thread, so a slow decoder never
+// holds up the other transfers.
+
+#define FETCH_MIN_CAPACITY (64 * 1024)
+#define FETCH_MAX_BYTES    (32 * 1024 * 1024)
+#define FETCH_MAX_TRANSFERS 8
+#define FETCH_WARM_TTL_MS  (5 * 60 * 1000)  // a warmed image older than this is refetched
+
+// Return nonzero to give up on the transfer being waited for
+typedef int (*FetchAbortFn)(void *arg);
+
+// The next size bytes of the body being waited for, in order. Called on
+// the thread in fetcher_take(); data is only valid during the call.
+typedef void (*FetchStreamFn)(const unsigned char *data, size_t size, void *arg);
+
+// Fill in the validators for a conditional request of url (leave them
+// empty for a plain one). Called on the network thread.
+typedef void (*FetchValidatorsFn)(const char *url, char *etag, size_t etag_len,
+                                  char *last_modified, size_t last_modified_len, void *user);
+
+// Where a transfer's time went, in order; each phase is the time since
+// the one before. connect and tls are 0 on a reused connection.
+typedef struct {
+    long dns_ms;
+    long connect_ms;    // TCP
+    long tls_ms;
+    long ttfb_ms;       // request sent to first byte of the response
+    long transfer_ms;   // first byte to last
+    long total_ms;
+    long bytes_per_sec; // average download speed
+} FetchTiming;
+
+typedef struct {
+    CURL *curl;         // the slot's easy handle, created on first use
+
+    unsigned char *data;
+    size_t size;        // bytes received
+    size_t capacity;
+    long   http_code;
+
+    // Validators from the response, for conditional requests
+    char   etag[128];
+    char   last_modified[64];
+
+    // Per-fetch allocation stats
+    unsigned allocs;    // buffer (re)allocations
+    size_t   peak;      // capacity at the end of the fetch
+
+    FetchTiming timing;
+    int  reused;        // no new connection was opened
+    bool warmed;        // started ahead of time, not for the loader that took it
+} FetchContext;
+
+typedef struct Fetcher Fetcher;
+
+Fetcher *fetcher_create(FetchValidatorsFn validators, void *user);
+// Loaders must be done with their transfers
+void fetcher_destroy(Fetcher *f);
+
+// Drop every connection and cut running transfers short, e.g. after the
+// network changed. Loaders waiting on them get CURLE_COULDNT_CONNECT.
+void fetcher_reset(Fetcher *f);
+
+// Keep one download of each of these urls running or finished ahead of
+// time, and cancel the warmed ones for any other url. Never blocks.
+void fetcher_warm(Fetcher *f, const char *const *urls, int count);
+
+// Download url, taking a warmed transfer for it if there is one, and wait
+// for it. Returns the finished transfer, to be handed back with
+// fetcher_release(), or NULL if abort_fn asked to give up (*res is then
+// CURLE_ABORTED_BY_CALLBACK). *res is the transfer's result; a 304 comes
+// back with no body.
+//
+// If stream_fn is given it is passed the body as it arrives; when the
+// transfer succeeds, it has seen all of it by the time this returns.
+FetchContext *fetcher_take(Fetcher *f, const char *url, FetchAbortFn abort_fn, void *abort_arg,
+                           FetchStreamFn stream_fn, void *stream_arg, CURLcode *res);
+void fetcher_release(Fetcher *f, FetchContext *ctx);
+
+// Timing of the most recently finished transfer, for the perf overlay.
+// Returns false if none has finished yet.
+bool fetcher_last_timing(Fetcher *f, FetchTiming *out);
+
+#endif
@@ -0,0 +1,414 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gif.h"
+
+#define GIF_READ_BUF 4096
+#define LZW_CODES    4096
+
+enum {
+    DISPOSE_NONE       = 1,    // leave the frame in place
+    DISPOSE_BACKGROUND = 2,    // clear its rect (to transparent, as browsers do)
+    DISPOSE_PREVIOUS   = 3,    // put back what was under it
+};
+
+struct GifDecoder {
+    // Exactly one of file/data is set. In a file, buf holds the bytes from
+    // buf_start on; pos is the read position in data.
+    FILE          *file;
+    unsigned char *buf;
+    size_t         buf_start, buf_len, buf_at;
+    const unsigned char *data;
+    size_t         size, pos;
+    size_t         first_block;    // just past the header and global palette
+
+    int w, h;
+    unsigned char *canvas;          // RGBA
+    unsigned char *saved;           // for DISPOSE_PREVIOUS, allocated on first use
+    unsigned char global[256 * 3];
+    unsigned char local[256 * 3];
+    bool has_global;
+    int  global_colors;
+
+    // Graphic control extension for the coming frame
+    int disposal, delay_ms, transparent;
+    // The frame before, whose disposal is applied before the next is drawn
+    int prev_disposal, px, py, pw, ph;
+    int frames;
+    bool done;
+
+    uint16_t prefix[LZW_CODES];
+    uint8_t  suffix[LZW_CODES];
+    uint8_t  stack[LZW_CODES + 1];
+};
+
+// ---- input ----------------------------------------------------------------
+
+static int get_byte(GifDecoder *g) {
+    if (g->data) return g->pos < g->size ? g->data[g->pos++] : -1;
+    if (g->buf_at == g->buf_len) {
+        g->buf_start += g->buf_len;
+        g->buf_len = fread(g->buf, 1, GIF_READ_BUF, g->file);
+        g->buf_at = 0;
+        if (g->buf_len == 0) return -1;
+    }
+    return g->buf[g->buf_at++];
+}
+
+static bool get_bytes(GifDecoder *g, unsigned char *out, int n) {
+    for (int i = 0; i < n; i++) {
+        int c = get_byte(g);
+        if (c < 0) return false;
+        if (out) out[i] = (unsigned char)c;
+    }
+    return true;
+}
+
+static size_t tell(const GifDecoder *g) {
+    return g->data ? g->pos : g->buf_start + g->buf_at;
+}
+
+static bool seek(GifDecoder *g, size_t offset) {
+    if (g->data) {
+        if (offset > g->size) return false;
+        g->pos = offset;
+        return true;
+    }
+    if (fseek(g->file, (long)offset, SEEK_SET) != 0) return false;
+    g->buf_start = offset;
+    g->buf_len = g->buf_at = 0;
+    return true;
+}
+
+// Skip data sub-blocks up to and including the empty one that ends them
+static bool skip_blocks(GifDecoder *g) {
+    for (;;) {
+        int n = get_byte(g);
+        if (n < 0) return false;
+        if (n == 0) return true;
+        if (!get_bytes(g, NULL, n)) return false;
+    }
+}
+
+// ---- open / close ---------------------------------------------------------
+
+static GifDecoder *open_decoder(GifDecoder *g) {
+    unsigned char head[13];
+    if (!get_bytes(g, head, sizeof(head)) ||
+        (memcmp(head, "GIF87a", 6) != 0 && memcmp(head, "GIF89a", 6) != 0)) {
+        gif_close(g);
+        return NULL;
+    }
+    g->w = head[6] | head[7] << 8;
+    g->h = head[8] | head[9] << 8;
+    if (g->w == 0 || g->h == 0 || (size_t)g->w * g->h > GIF_MAX_PIXELS) {
+        gif_close(g);
+        return NULL;
+    }
+    if (head[10] & 0x80) {
+        g->has_global = true;
+        g->global_colors = 2 << (head[10] & 7);
+        if (!get_bytes(g, g->global, 3 << ((head[10] & 7) + 1))) {
+            gif_close(g);
+            return NULL;
+        }
+    }
+    g->first_block = tell(g);
+
+    g->canvas = calloc((size_t)g->w * g->h, 4);
+    if (!g->canvas) {
+        gif_close(g);
+        return NULL;
+    }
+    return g;
+}
+
+GifDecoder *gif_open_mem(const unsigned char *data, size_t size) {
+    GifDecoder *g = calloc(1, sizeof(GifDecoder));
+    if (!g) return NULL;
+    g->data = data;
+    g->size = size;
+    return open_decoder(g);
+}
+
+GifDecoder *gif_open_file(const char *path) {
+    GifDecoder *g = calloc(1, sizeof(GifDecoder));
+    if (!g) return NULL;
+    g->file = fopen(path, "rb");
+    g->buf = malloc(GIF_READ_BUF);
+    if (!g->file || !g->buf) {
+        gif_close(g);
+        return NULL;
+    }
+    return open_decoder(g);
+}
+
+void gif_close(GifDecoder *g) {
+    if (!g) return;
+    if (g->file) fclose(g->file);
+    free(g->buf);
+    free(g->canvas);
+    free(g->saved);
+    free(g);
+}
+
+void gif_size(const GifDecoder *g, int *w, int *h) {
+    *w = g->w;
+    *h = g->h;
+}
+
+size_t gif_memory(const GifDecoder *g) {
+    size_t canvas = (size_t)g->w * g->h * 4;
+    return sizeof(GifDecoder) + canvas + (g->saved ? canvas : 0) + (g->buf ? GIF_READ_BUF : 0);
+}
+
+int gif_rewind(GifDecoder *g) {
+    memset(g->canvas, 0, (size_t)g->w * g->h * 4);
+    g->prev_disposal = 0;
+    g->frames = 0;
+    g->done = false;
+    return seek(g, g->first_block) ? 0 : -1;
+}
+
+int gif_count_frames(GifDecoder *g, int limit) {
+    if (!seek(g, g->first_block)) return -1;
+    int n = 0;
+    while (n < limit) {
+        int b = get_byte(g);
+        if (b == 0x2C) {
+            unsigned char desc[9];
+            if (!get_bytes(g, desc, 9)) break;
+            if (desc[8] & 0x80 && !get_bytes(g, NULL, 3 << ((desc[8] & 7) + 1))) break;
+            if (get_byte(g) < 0 || !skip_blocks(g)) break;
+            n++;
+        } else if (b == 0x21) {
+            if (get_byte(g) < 0 || !skip_blocks(g)) break;
+        } else {
+            break;     // trailer, end of file or junk
+        }
+    }
+    return gif_rewind(g) == 0 ? n : -1;
+}
+
+// ---- frames ---------------------------------------------------------------
+
+// Clip x, y, w, h to the canvas; false if nothing is left
+static bool clip(const GifDecoder *g, int *x, int *y, int *w, int *h) {
+    if (*x >= g->w || *y >= g->h) return false;
+    if (*x + *w > g->w) *w = g->w - *x;
+    if (*y + *h > g->h) *h = g->h - *y;
+    return *w > 0 && *h > 0;
+}
+
+static void copy_rect(unsigned char *dst, const unsigned char *src, int stride,
+                      int x, int y, int w, int h) {
+    for (int r = y; r < y + h; r++)
+        memcpy(dst + ((size_t)r * stride + x) * 4, src + ((size_t)r * stride + x) * 4,
+               (size_t)w * 4);
+}
+
+static void dispose_previous(GifDecoder *g) {
+    int x = g->px, y = g->py, w = g->pw, h = g->ph;
+    if (!clip(g, &x, &y, &w, &h)) return;
+    if (g->prev_disposal == DISPOSE_BACKGROUND) {
+        for (int r = y; r < y + h; r++)
+            memset(g->canvas + ((size_t)r * g->w + x) * 4, 0, (size_t)w * 4);
+    } else if (g->prev_disposal == DISPOSE_PREVIOUS && g->saved) {
+        copy_rect(g->canvas, g->saved, g->w, x, y, w, h);
+    }
+}
+
+// Where decoded pixels go: rows in file order (interlaced or not) mapped
+// onto the frame's rect, clipped to the canvas
+typedef struct {
+    const unsigned char *palette;
+    int colors;                     // entries in palette
+    int x, y, w, h;
+    int col, row, pass;
+    bool interlaced;
+} Cursor;
+
+static const int PASS_START[4] = { 0, 4, 2, 1 };
+static const int PASS_STEP[4]  = { 8, 8, 4, 2 };
+
+static void put_pixel(GifDecoder *g, Cursor *c, int index) {
+    if (c->row >= c->h) return;
+    int cx = c->x + c->col, cy = c->y + c->row;
+    // An index past the end of the palette is left transparent
+    if (index != g->transparent && index < c->colors && cx < g->w && cy < g->h) {
+        unsigned char *p = g->canvas + ((size_t)cy * g->w + cx) * 4;
+        const unsigned char *rgb = c->palette + index * 3;
+        p[0] = rgb[0];
+        p[1] = rgb[1];
+        p[2] = rgb[2];
+        p[3] = 255;
+    }
+    if (++c->col < c->w) return;
+    c->col = 0;
+    if (!c->interlaced) {
+        c->row++;
+        return;
+    }
+    c->row += PASS_STEP[c->pass];
+    while (c->row >= c->h && c->pass < 3) {
+        c->pass++;
+        c->row = PASS_START[c->pass];
+    }
+}
+
+// The next byte of image data: -1 at the block terminator, -2 at the end
+// of the file
+static int data_byte(GifDecoder *g, int *left) {
+    if (*left == 0) {
+        int n = get_byte(g);
+        if (n <= 0) return n < 0 ? -2 : -1;
+        *left = n;
+    }
+    (*left)--;
+    int c = get_byte(g);
+    return c < 0 ? -2 : c;
+}
+
+// LZW-decode the image data into the canvas. False if the file ended.
+static bool decode_pixels(GifDecoder *g, Cursor *cur, int min_size) {
+    int clear = 1 << min_size, eoi = clear + 1;
+    int next = clear + 2, size = min_size + 1;
+    int old = -1, first = 0;
+    uint32_t bits = 0;
+    int nbits = 0, left = 0;
+    for (int i = 0; i < clear; i++) {
+        g->prefix[i] = 0;
+        g->suffix[i] = (uint8_t)i;
+    }
+
+    for (;;) {
+        while (nbits < size) {
+            int c = data_byte(g, &left);
+            if (c == -1) return true;       // data ended without an end code
+            if (c == -2) return false;
+            bits |= (uint32_t)c << nbits;
+            nbits += 8;
+        }
+        int code = bits & ((1u << size) - 1);
+        bits >>= size;
+        nbits -= size;
+
+        if (code == clear) {
+            next = clear + 2;
+            size = min_size + 1;
+            old = -1;
+            continue;
+        }
+        if (code == eoi) break;
+        if (old < 0) {
+            if (code > clear) break;        // corrupt: nothing to refer to yet
+            put_pixel(g, cur, code);
+            old = first = code;
+            continue;
+        }
+
+        int in = code, sp = 0;
+        if (code >= next) {
+            if (code > next) break;         // corrupt
+            g->stack[sp++] = (uint8_t)first;
+            code = old;
+        }
+        while (code >= clear) {
+            g->stack[sp++] = g->suffix[code];
+            code = g->prefix[code];
+        }
+        first = code;
+        g->stack[sp++] = (uint8_t)first;
+        if (next < LZW_CODES) {
+            g->prefix[next] = (uint16_t)old;
+            g->suffix[next] = (uint8_t)first;
+            next++;
+            if (next == 1 << size && size < 12) size++;
+        }
+        old = in;
+        while (sp > 0) put_pixel(g, cur, g->stack[--sp]);
+    }
+
+    // Whatever is left of the data after the end code
+    if (left > 0 && !get_bytes(g, NULL, left)) return false;
+    return skip_blocks(g);
+}
+
+static int decode_frame(GifDecoder *g, const unsigned char **rgba, int *delay_ms) {
+    unsigned char desc[9];
+    if (!get_bytes(g, desc, 9)) return -1;
+    Cursor cur = {0};
+    cur.x = desc[0] | desc[1] << 8;
+    cur.y = desc[2] | desc[3] << 8;
+    cur.w = desc[4] | desc[5] << 8;
+    cur.h = desc[6] | desc[7] << 8;
+    cur.interlaced = (desc[8] & 0x40) != 0;
+    cur.palette = g->global;
+    cur.colors = g->global_colors;
+    if (desc[8] & 0x80) {
+        memset(g->local, 0, sizeof(g->local));
+        cur.colors = 2 << (desc[8] & 7);
+        if (!get_bytes(g, g->local, 3 * cur.colors)) return -1;
+        cur.palette = g->local;
+    } else if (!g->has_global) {
+        // No palette at all: every index is black
+        memset(g->global, 0, sizeof(g->global));
+        cur.colors = 256;
+    }
+    // The spec's range; past 8 the codes right after a clear would index
+    // past any palette
+    int min_size = get_byte(g);
+    if (min_size < 2 || min_size > 8) return -1;
+
+    dispose_previous(g);
+    int x = cur.x, y = cur.y, w = cur.w, h = cur.h;
+    if (g->disposal == DISPOSE_PREVIOUS && clip(g, &x, &y, &w, &h)) {
+        if (!g->saved) g->saved = malloc((size_t)g->w * g->h * 4);
+        if (g->saved) copy_rect(g->saved, g->canvas, g->w, x, y, w, h);
+    }
+    g->prev_disposal = g->disposal;
+    g->px = cur.x;
+    g->py = cur.y;
+    g->pw = cur.w;
+    g->ph = cur.h;
+
+    // A frame cut short is shown as far as it got, and is the last one
+    if (!decode_pixels(g, &cur, min_size)) g->done = true;
+    g->frames++;
+    *rgba = g->canvas;
+    *delay_ms = g->delay_ms;
+    return 1;
+}
+
+int gif_next_frame(GifDecoder *g, const unsigned char **rgba, int *delay_ms) {
+    if (g->done) return 0;
+    g->disposal = 0;
+    g->delay_ms = 0;
+    g->transparent = -1;
+    for (;;) {
+        int b = get_byte(g);
+        if (b == 0x2C) return decode_frame(g, rgba, delay_ms);
+        if (b == 0x21) {
+            int label = get_byte(g);
+            if (label == 0xF9) {
+                // Graphic control: disposal, delay and transparent index
+                unsigned char gce[4];
+                int n = get_byte(g);
+                if (n < 4 || !get_bytes(g, gce, 4) || !get_bytes(g, NULL, n - 4)) break;
+                g->disposal = (gce[0] >> 2) & 7;
+                g->delay_ms = (gce[1] | gce[2] << 8) * 10;
+                g->transparent = gce[0] & 1 ? gce[3] : -1;
+            }
+            if (label < 0 || !skip_blocks(g)) break;
+            continue;
+        }
+        // The trailer, or junk or the end of the file where it should be
+        if (b == 0x3B || g->frames > 0) break;
+        return -1;
+    }
+    g->done = true;
+    return g->frames > 0 ? 0 : -1;
+}
@@ -0,0 +1,43 @@
+#ifndef GIF_H
+#define GIF_H
+
+#include <stddef.h>
+
+// GIF decoder that composes one frame at a time onto a single canvas, the
+// way a browser plays the file: disposal methods, transparency, local
+// palettes and interlacing are handled, nothing is kept of earlier frames
+// but the canvas (and, for "restore to previous", a copy of it). Reading
+// from a file streams it through a small buffer, so memory doesn't grow
+// with the length of the animation.
+
+// Canvases larger than this are refused
+#define GIF_MAX_PIXELS (16u << 20)
+
+typedef struct GifDecoder GifDecoder;
+
+// data must stay valid until gif_close(). NULL if it isn't a GIF, it's too
+// large, or out of memory.
+GifDecoder *gif_open_mem(const unsigned char *data, size_t size);
+GifDecoder *gif_open_file(const char *path);
+void gif_close(GifDecoder *g);
+
+void gif_size(const GifDecoder *g, int *w, int *h);
+
+// Bytes the decoder has allocated: canvas, buffers, LZW tables
+size_t gif_memory(const GifDecoder *g);
+
+// Decode the next frame onto the canvas. Returns 1 with *rgba pointing at
+// the canvas (w * h RGBA pixels, rows w * 4 bytes apart, valid until the
+// next call) and *delay_ms set to how long the frame is shown as stored,
+// 0 if it's unset; 0 after the last frame; -1 if the data is corrupt. A
+// frame cut short still counts, with the rest of it left as it was.
+int gif_next_frame(GifDecoder *g, const unsigned char **rgba, int *delay_ms);
+
+// Back to a blank canvas before the first frame. 0, or -1 on a read error.
+int gif_rewind(GifDecoder *g);
+
+// Frames up to limit, counted by skipping through the file without
+// decoding; rewinds. -1 on a read error.
+int gif_count_frames(GifDecoder *g, int limit);
+
+#endif
@@ -0,0 +1,39 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "imageformat.h"
+
+ImageFormat image_format(const unsigned char *data, size_t size) {
+    static const unsigned char png_sig[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    if (size >= 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF)
+        return IMAGE_JPEG;
+    if (size >= 8 && memcmp(data, png_sig, 8) == 0)
+        return IMAGE_PNG;
+    if (size >= 12 && memcmp(data, "RIFF", 4) == 0 && memcmp(data + 8, "WEBP", 4) == 0)
+        return IMAGE_WEBP;
+    if (size >= 4 && memcmp(data, "qoif", 4) == 0)
+        return IMAGE_QOI;
+    if (size >= 6 && (memcmp(data, "GIF87a", 6) == 0 || memcmp(data, "GIF89a", 6) == 0))
+        return IMAGE_GIF;
+    return IMAGE_UNKNOWN;
+}
+
+ImageFormat image_format_file(const char *path) {
+    unsigned char head[IMAGE_SNIFF_BYTES];
+    FILE *f = fopen(path, "rb");
+    if (!f) return IMAGE_UNKNOWN;
+    size_t n = fread(head, 1, sizeof(head), f);
+    fclose(f);
+    return image_format(head, n);
+}
+
+const char *image_format_name(ImageFormat format) {
+    switch (format) {
+        case IMAGE_JPEG: return "jpeg";
+        case IMAGE_PNG:  return "png";
+        case IMAGE_WEBP: return "webp";
+        case IMAGE_QOI:  return "qoi";
+        case IMAGE_GIF:  return "gif";
+        default:         return "unknown";
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef IMAGEFORMAT_H
+#define IMAGEFORMAT_H
+
+#include <stddef.h>
+
+// Image formats are told apart by their first bytes, never by the file
+// extension: a .jpg that is really a WebP (or a download with no extension
+// at all) still goes to the right decoder.
+
+typedef enum {
+    IMAGE_UNKNOWN,
+    IMAGE_JPEG,
+    IMAGE_PNG,
+    IMAGE_WEBP,     // lossy, lossless or animated
+    IMAGE_QOI,
+    IMAGE_GIF,      // still or animated
+} ImageFormat;
+
+// Enough of the file to tell every format apart
+#define IMAGE_SNIFF_BYTES 12
+
+ImageFormat image_format(const unsigned char *data, size_t size);
+
+// Reads the first IMAGE_SNIFF_BYTES of path; IMAGE_UNKNOWN if it can't
+ImageFormat image_format_file(const char *path);
+
+// "jpeg", "png", "webp", "qoi", "gif" or "unknown", for status lines and the bench
+const char *image_format_name(ImageFormat format);
+
+#endif
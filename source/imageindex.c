@@ -0,0 +1,322 @@
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+#include "imageformat.h"
+#include "imageindex.h"
+#include "util.h"
+
+#define INDEX_MAGIC   "NXPI"
+#define INDEX_VERSION 1
+
+typedef struct {
+    char     magic[4];
+    uint32_t version;
+    uint32_t num_dirs;
+    uint32_t num_files;
+    uint32_t strtab_size;
+} IndexHeader;
+
+typedef struct {
+    ImageIndex idx;
+    uint32_t dir_cap;
+    uint32_t file_cap;
+    uint32_t str_cap;
+    bool failed;
+} IndexBuilder;
+
+bool is_image_file(const char *dir, const char *name) {
+    const char *ext = strrchr(name, '.');
+    if (ext && (
+        strcasecmp(ext, ".jpg") == 0 ||
+        strcasecmp(ext, ".jpeg") == 0 ||
+        strcasecmp(ext, ".png") == 0 ||
+        strcasecmp(ext, ".webp") == 0 ||
+        strcasecmp(ext, ".qoi") == 0 ||
+        strcasecmp(ext, ".gif") == 0))
+        return true;
+
+    char path[768];
+    snprintf(path, sizeof(path), "%s%s", dir, name);
+    return image_format_file(path) != IMAGE_UNKNOWN;
+}
+
+// Grow *p so it holds at least need elements, doubling as it goes
+static bool grow(void **p, uint32_t *cap, uint32_t need, size_t elem, uint32_t initial) {
+    if (need <= *cap) return true;
+    uint32_t n = *cap ? *cap : initial;
+    while (n < need) n *= 2;
+    void *np = realloc(*p, (size_t)n * elem);
+    if (!np) return false;
+    *p = np;
+    *cap = n;
+    return true;
+}
+
+static uint32_t add_string(IndexBuilder *b, const char *s) {
+    uint32_t n = (uint32_t)strlen(s) + 1;
+    if (!grow((void **)&b->idx.strtab, &b->str_cap, b->idx.strtab_size + n, 1, 4096)) {
+        b->failed = true;
+        return 0;
+    }
+    uint32_t off = b->idx.strtab_size;
+    memcpy(b->idx.strtab + off, s, n);
+    b->idx.strtab_size += n;
+    return off;
+}
+
+static void add_file(IndexBuilder *b, const char *relpath) {
+    uint32_t off = add_string(b, relpath);
+    if (b->failed) return;
+    if (!grow((void **)&b->idx.files, &b->file_cap, b->idx.num_files + 1, sizeof(uint32_t), 256)) {
+        b->failed = true;
+        return;
+    }
+    b->idx.files[b->idx.num_files++] = off;
+}
+
+static uint32_t add_dir(IndexBuilder *b, const char *relpath, int64_t mtime) {
+    uint32_t off = add_string(b, relpath);
+    if (b->failed) return 0;
+    if (!grow((void **)&b->idx.dirs, &b->dir_cap, b->idx.num_dirs + 1, sizeof(IndexDir), 16)) {
+        b->failed = true;
+        return 0;
+    }
+    IndexDir *d = &b->idx.dirs[b->idx.num_dirs];
+    d->path       = off;
+    d->subtree    = 1;
+    d->first_file = b->idx.num_files;
+    d->num_files  = 0;
+    d->mtime      = mtime;
+    return b->idx.num_dirs++;
+}
+
+static int64_t dir_mtime(const char *path) {
+    // stat() doesn't like the trailing slash on every devoptab
+    char p[512];
+    snprintf(p, sizeof(p), "%s", path);
+    size_t len = strlen(p);
+    if (len > 1 && p[len - 1] == '/' && p[len - 2] != ':') p[len - 1] = 0;
+
+    struct stat st;
+    if (stat(p, &st) != 0) return 0;
+    return (int64_t)st.st_mtime;
+}
+
+// Walk one directory. old_i is the matching record in the previous index,
+// or -1 if this directory wasn't there before.
+static void scan_dir(IndexBuilder *b, const ImageIndex *old, int64_t old_i, const char *rel) {
+    char full[INDEX_PATH_MAX];
+    snprintf(full, sizeof(full), "%s%s", b->idx.root, rel);
+    size_t root_len = strlen(b->idx.root);
+
+    int64_t mtime = dir_mtime(full);
+    uint32_t me = add_dir(b, rel, mtime);
+    if (b->failed) return;
+
+    if (old_i >= 0 && mtime != 0 && old->dirs[old_i].mtime == mtime) {
+        // Unchanged since last time: reuse its files and known subdirectories
+        const IndexDir *od = &old->dirs[old_i];
+        for (uint32_t f = 0; f < od->num_files && !b->failed; f++)
+            add_file(b, old->strtab + old->files[od->first_file + f]);
+        b->idx.dirs[me].num_files = b->idx.num_files - b->idx.dirs[me].first_file;
+
+        for (uint32_t c = (uint32_t)old_i + 1; c < old_i + od->subtree && !b->failed;
+             c += old->dirs[c].subtree)
+            scan_dir(b, old, c, old->strtab + old->dirs[c].path);
+    } else {
+        DIR *dir = opendir(full);
+        if (dir) {
+            b->idx.dirs_read++;
+            char **subdirs = NULL;
+            int num_subdirs = 0, sub_cap = 0;
+
+            // Files first so this directory's range in files[] stays contiguous
+            struct dirent *entry;
+            while ((entry = readdir(dir)) != NULL && !b->failed) {
+                if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+                    continue;
+
+                // A name too long to open later by its full path is left out
+                // rather than indexed cut short
+                char relpath[INDEX_PATH_MAX];
+                int len = snprintf(relpath, sizeof(relpath), "%s%s%s", rel, entry->d_name,
+                                   entry->d_type == DT_DIR ? "/" : "");
+                if (len < 0 || root_len + (size_t)len >= INDEX_PATH_MAX) continue;
+
+                if (entry->d_type == DT_DIR) {
+                    if (num_subdirs >= sub_cap) {
+                        sub_cap = sub_cap ? sub_cap * 2 : 8;
+                        char **n = realloc(subdirs, sub_cap * sizeof(char *));
+                        if (!n) { b->failed = true; break; }
+                        subdirs = n;
+                    }
+                    subdirs[num_subdirs++] = strdup(relpath);
+                } else if (is_image_file(full, entry->d_name)) {
+                    add_file(b, relpath);
+                }
+            }
+            closedir(dir);
+            if (!b->failed)
+                b->idx.dirs[me].num_files = b->idx.num_files - b->idx.dirs[me].first_file;
+
+            for (int s = 0; s < num_subdirs; s++) {
+                if (!b->failed && subdirs[s]) {
+                    const char *childrel = subdirs[s];
+                    int64_t match = -1;
+                    if (old_i >= 0) {
+                        const IndexDir *od = &old->dirs[old_i];
+                        for (uint32_t c = (uint32_t)old_i + 1; c < old_i + od->subtree;
+                             c += old->dirs[c].subtree) {
+                            if (strcmp(old->strtab + old->dirs[c].path, childrel) == 0) {
+                                match = c;
+                                break;
+                            }
+                        }
+                    }
+                    scan_dir(b, old, match, childrel);
+                }
+                free(subdirs[s]);
+            }
+            free(subdirs);
+        }
+    }
+
+    if (!b->failed)
+        b->idx.dirs[me].subtree = b->idx.num_dirs - me;
+}
+
+static bool index_equal(const ImageIndex *a, const ImageIndex *b) {
+    return a->num_dirs == b->num_dirs &&
+           a->num_files == b->num_files &&
+           a->strtab_size == b->strtab_size &&
+           memcmp(a->dirs, b->dirs, a->num_dirs * sizeof(IndexDir)) == 0 &&
+           memcmp(a->files, b->files, a->num_files * sizeof(uint32_t)) == 0 &&
+           memcmp(a->strtab, b->strtab, a->strtab_size) == 0;
+}
+
+int index_refresh(ImageIndex *idx) {
+    DIR *test = opendir(idx->root);
+    if (!test) {
+        index_free(idx);
+        return -1;
+    }
+    closedir(test);
+
+    IndexBuilder b = {0};
+    memcpy(b.idx.root, idx->root, sizeof(b.idx.root));
+    scan_dir(&b, idx, idx->num_dirs ? 0 : -1, "");
+
+    if (b.failed) {
+        // Out of memory: keep whatever we had before
+        index_free(&b.idx);
+        return 0;
+    }
+
+    int changed = !index_equal(idx, &b.idx);
+    index_free(idx);
+    *idx = b.idx;
+    return changed;
+}
+
+static bool index_valid(const ImageIndex *idx) {
+    if (idx->strtab_size == 0 || idx->strtab[idx->strtab_size - 1] != 0) return false;
+    for (uint32_t i = 0; i < idx->num_files; i++)
+        if (idx->files[i] >= idx->strtab_size) return false;
+    for (uint32_t i = 0; i < idx->num_dirs; i++) {
+        const IndexDir *d = &idx->dirs[i];
+        if (d->path >= idx->strtab_size || d->subtree == 0 ||
+            d->subtree > idx->num_dirs - i ||
+            d->first_file > idx->num_files ||
+            d->num_files > idx->num_files - d->first_file)
+            return false;
+    }
+    return true;
+}
+
+int index_load(ImageIndex *idx, const char *root, const char *index_path) {
+    memset(idx, 0, sizeof(*idx));
+    size_t len = strlen(root);
+    snprintf(idx->root, sizeof(idx->root), "%s%s", root,
+             (len && root[len - 1] == '/') ? "" : "/");
+
+    FILE *f = index_path ? fopen(index_path, "rb") : NULL;
+    if (!f) return -1;
+
+    IndexHeader hdr;
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+        memcmp(hdr.magic, INDEX_MAGIC, 4) != 0 ||
+        hdr.version != INDEX_VERSION || hdr.num_dirs == 0) {
+        fclose(f);
+        return -1;
+    }
+
+    idx->dirs   = malloc(hdr.num_dirs * sizeof(IndexDir));
+    idx->files  = malloc((hdr.num_files ? hdr.num_files : 1) * sizeof(uint32_t));
+    idx->strtab = malloc(hdr.strtab_size ? hdr.strtab_size : 1);
+    idx->num_dirs    = hdr.num_dirs;
+    idx->num_files   = hdr.num_files;
+    idx->strtab_size = hdr.strtab_size;
+
+    bool ok = idx->dirs && idx->files && idx->strtab &&
+        fread(idx->dirs, sizeof(IndexDir), hdr.num_dirs, f) == hdr.num_dirs &&
+        fread(idx->files, sizeof(uint32_t), hdr.num_files, f) == hdr.num_files &&
+        fread(idx->strtab, 1, hdr.strtab_size, f) == hdr.strtab_size &&
+        index_valid(idx);
+    fclose(f);
+
+    if (!ok) {
+        index_free(idx);
+        return -1;
+    }
+    return 0;
+}
+
+int index_save(const ImageIndex *idx, const char *index_path) {
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", index_path);
+
+    FILE *f = fopen(tmp, "wb");
+    if (!f) return -1;
+
+    IndexHeader hdr;
+    memcpy(hdr.magic, INDEX_MAGIC, 4);
+    hdr.version     = INDEX_VERSION;
+    hdr.num_dirs    = idx->num_dirs;
+    hdr.num_files   = idx->num_files;
+    hdr.strtab_size = idx->strtab_size;
+
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1 &&
+        fwrite(idx->dirs, sizeof(IndexDir), idx->num_dirs, f) == idx->num_dirs &&
+        fwrite(idx->files, sizeof(uint32_t), idx->num_files, f) == idx->num_files &&
+        fwrite(idx->strtab, 1, idx->strtab_size, f) == idx->strtab_size;
+    if (fclose(f) != 0) ok = false;
+
+    if (!ok) {
+        remove(tmp);
+        return -1;
+    }
+    return replace_file(tmp, index_path);
+}
+
+void index_free(ImageIndex *idx) {
+    free(idx->dirs);
+    free(idx->files);
+    free(idx->strtab);
+    idx->dirs = NULL;
+    idx->files = NULL;
+    idx->strtab = NULL;
+    idx->num_dirs = 0;
+    idx->num_files = 0;
+    idx->strtab_size = 0;
+}
+
+bool index_full_path(const ImageIndex *idx, uint32_t i, char *out, size_t len) {
+    int n = snprintf(out, len, "%s%s", idx->root, index_relpath(idx, i));
+    if (n >= 0 && (size_t)n < len) return true;
+    if (len > 0) out[0] = 0;
+    return false;
+}
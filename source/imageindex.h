@@ -0,0 +1,64 @@
+#ifndef IMAGEINDEX_H
+#define IMAGEINDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Persistent index of the images under a local category folder.
+//
+// Paths are stored relative to the root in one packed string table and
+// addressed through an offset array, so picking an image is an array
+// lookup. Directories keep their mtime; a refresh only re-reads the
+// directories whose mtime changed and reuses everything else.
+
+// Longest full path, root and relative path with the nul, that the index
+// holds. Entries that would be longer are left out rather than cut short.
+#define INDEX_PATH_MAX 512
+
+typedef struct {
+    uint32_t path;       // strtab offset, relative to root with trailing '/'
+    uint32_t subtree;    // dir records in this subtree, including itself
+    uint32_t first_file;
+    uint32_t num_files;
+    int64_t  mtime;      // 0 = unknown, always rescanned
+} IndexDir;
+
+typedef struct {
+    char      root[256];   // always ends with '/'
+    IndexDir *dirs;
+    uint32_t  num_dirs;
+    uint32_t *files;       // strtab offsets
+    uint32_t  num_files;
+    char     *strtab;
+    uint32_t  strtab_size;
+    uint32_t  dirs_read;   // directories the last refresh had to list
+} ImageIndex;
+
+// Load a previously saved index for root. Returns 0 on success; on any
+// failure (or with a NULL index_path) the index is left empty (but usable)
+// and -1 is returned.
+int  index_load(ImageIndex *idx, const char *root, const char *index_path);
+
+// Bring the index up to date with the filesystem. Returns 1 if anything
+// changed, 0 if not, -1 if the root folder can't be opened.
+int  index_refresh(ImageIndex *idx);
+
+int  index_save(const ImageIndex *idx, const char *index_path);
+void index_free(ImageIndex *idx);
+
+static inline const char *index_relpath(const ImageIndex *idx, uint32_t i) {
+    return idx->strtab + idx->files[i];
+}
+
+// Root and relative path of file i. False, with out empty, if it doesn't
+// fit in len bytes.
+bool index_full_path(const ImageIndex *idx, uint32_t i, char *out, size_t len);
+
+// Whether name, in the directory dir (ending with '/'), is a slide. Image
+// extensions are taken on trust, since the decoder checks the data anyway;
+// any other file is opened and its first bytes sniffed, so a photo with an
+// odd or missing extension is still found.
+bool is_image_file(const char *dir, const char *name);
+
+#endif
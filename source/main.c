@@ -2,21 +2,52 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <strings.h>
-#include <switch.h>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
 #include <SDL2/SDL_ttf.h>
 #include <curl/curl.h>
 #include <sys/stat.h>
+#include <time.h>
+
+#include "anim.h"
+#include "cache.h"
+#include "config.h"
+#include "decode.h"
+#include "fetch.h"
+#include "imageindex.h"
+#include "manifest.h"
+#include "membudget.h"
+#include "platform.h"
+#include "phash.h"
+#include "playlist.h"
+#include "prefetch.h"
+#include "progressive.h"
+#include "scale.h"
+#include "scheduler.h"
+#include "text.h"
+#include "thumbs.h"
+#include "trace.h"
+#include "transition.h"
+#include "util.h"
+#include "workpool.h"
 
 #define SCREEN_W 1280
 #define SCREEN_H 720
-#define DEFAULT_INTERVAL_MINS 5
+#define WORK_QUEUE_CAP 32
+#define SLIDE_TEXTURES 3     // incoming, current, and the outgoing one mid-transition
 #define UI_HIDE_DELAY_MS 4000
+#define PERF_REFRESH_MS  250   // perf overlay redraw rate while it's up
+#define CONFIG_POLL_MS   5000  // how often config.ini is checked for edits
+#define CHARGER_POLL_MS  30000 // and the charger
+#define PREVIEW_MIN_MS   300   // least time between previews of a downloading slide
+#define SYNC_POLL_MS     10000 // how often manifest syncs are checked for new images
+#define RESCAN_MIN_MS    (5 * 60 * 1000)  // least time between rescans while one runs
 
 #define BTN_A       0
 #define BTN_B       1
+#define BTN_Y       3
+#define BTN_L       6
+#define BTN_R       7
 #define BTN_PLUS    10
 #define BTN_MINUS   11
 #define BTN_DLEFT   12
@@ -29,139 +60,52 @@
 #define ICON_A      "\xee\x80\x84"   // U+E004
 #define ICON_B      "\xee\x80\x85"   // U+E005
 
-#define MAX_CATEGORIES 32
-#define CONFIG_PATH "sdmc:/config/NXPhotoFrame/config.ini"
-#define CONFIG_DIR  "sdmc:/config/NXPhotoFrame"
-
-typedef struct {
-    char name[64];
-    char url[256];       // NULL-equivalent: empty string
-    char localpath[256]; // NULL-equivalent: empty string
-} Category;
-
-static Category CATEGORIES[MAX_CATEGORIES];
-static int NUM_CATEGORIES = 0;
-
-typedef struct {
-    unsigned char *data;
-    size_t size;
-} MemoryBuffer;
-
-// Create directory and/or file if it doesn't exist
-void write_default_config(void) {
-    mkdir(CONFIG_DIR, 0777);
-
-    FILE *f = fopen(CONFIG_PATH, "w");
-    if (!f) return;
-
-    fprintf(f, "[Settings]\n");
-    fprintf(f, "first_run = true\n");
-    fprintf(f, "\n");
-	fprintf(f, "; Remote categories use a web URL from my random image generator\n");
-	fprintf(f, "; hosted on gandalfsax.com. You can host your own too!\n");
-	fprintf(f, "; https://github.com/TheExpertNoob/randomImage\n");
-	fprintf(f, "\n");
-    fprintf(f, "; Local categories may be any folder on your SD card containing\n");
-	fprintf(f, "; JPGs and/or PNGs. Searches subdirectories too!\n");
-	fprintf(f, "\n");
-    fprintf(f, "; Add or remove categories freely in this file\n");
-	fprintf(f, "[Categories]\n");
-	fprintf(f, "Album = local://sdmc:/Nintendo/Album/\n");
-	fprintf(f, "Video Games = https://gandalfsax.com/images/vg.jpg\n");
-	fprintf(f, "Halloween = https://gandalfsax.com/images/hw.jpg\n");
-    fprintf(f, ";Ancient Girls = https://gandalfsax.com/images/ag.jpg\n");
-    fprintf(f, ";Gaming Girls = https://gandalfsax.com/images/gg.jpg\n");
-    fprintf(f, ";Lofi Time = https://gandalfsax.com/images/lt.jpg\n");
-    fprintf(f, ";Waifu & Chill = https://gandalfsax.com/images/wac.jpg\n");
-	fprintf(f, ";All Girls = https://gandalfsax.com/images/girls.jpg\n");
-    fclose(f);
-}
-
-bool is_first_run = false;
-
-void load_config(void) {
-    // If config doesn't exist, write defaults first
-    FILE *f = fopen(CONFIG_PATH, "r");
-    if (!f) {
-        write_default_config();
-        f = fopen(CONFIG_PATH, "r");
-        if (!f) return; // SD card issue
-    }
-
-    NUM_CATEGORIES = 0;
-    char line[320];
-    int in_categories = 0;
-	int in_settings = 0;
-
-    while (fgets(line, sizeof(line), f) && NUM_CATEGORIES < MAX_CATEGORIES) {
-        // Trim newline
-        char *nl = strchr(line, '\n');
-        if (nl) *nl = 0;
-        char *cr = strchr(line, '\r');
-        if (cr) *cr = 0;
-
-        // Skip empty lines and comments
-        if (line[0] == 0 || line[0] == ';' || line[0] == '#') continue;
-
-        // Section headers
-        if (line[0] == '[') {
-            in_categories = (strncmp(line, "[Categories]", 12) == 0);
-            in_settings   = (strncmp(line, "[Settings]",   10) == 0);
-            continue;
-        }
-
-        // Parse key = value
-        char *eq = strchr(line, '=');
-        if (!eq) continue;
-
-        *eq = 0;
-        char *key = line;
-        char *val = eq + 1;
-
-        // Trim whitespace from key
-        while (*key == ' ') key++;
-        char *end = key + strlen(key) - 1;
-        while (end > key && *end == ' ') { *end = 0; end--; }
-
-        // Trim whitespace from value
-        while (*val == ' ') val++;
-        end = val + strlen(val) - 1;
-        while (end > val && *end == ' ') { *end = 0; end--; }
-
-        if (in_settings) {
-            if (strcmp(key, "first_run") == 0) {
-                is_first_run = (strcmp(val, "true") == 0);
-            }
-            // Future settings keys can be added here
-        }
-
-        if (in_categories) {
-            strncpy(CATEGORIES[NUM_CATEGORIES].name, key,
-                    sizeof(CATEGORIES[NUM_CATEGORIES].name) - 1);
-            CATEGORIES[NUM_CATEGORIES].name[sizeof(CATEGORIES[NUM_CATEGORIES].name) - 1] = 0;
-
-            if (strncmp(val, "local://", 8) == 0) {
-                CATEGORIES[NUM_CATEGORIES].url[0] = 0;
-                strncpy(CATEGORIES[NUM_CATEGORIES].localpath, val + 8,
-                        sizeof(CATEGORIES[NUM_CATEGORIES].localpath) - 1);
-                CATEGORIES[NUM_CATEGORIES].localpath[sizeof(CATEGORIES[NUM_CATEGORIES].localpath) - 1] = 0;
-            } else {
-                strncpy(CATEGORIES[NUM_CATEGORIES].url, val,
-                        sizeof(CATEGORIES[NUM_CATEGORIES].url) - 1);
-                CATEGORIES[NUM_CATEGORIES].url[sizeof(CATEGORIES[NUM_CATEGORIES].url) - 1] = 0;
-                CATEGORIES[NUM_CATEGORIES].localpath[0] = 0;
-            }
-            NUM_CATEGORIES++;
-        }
-    }
-    fclose(f);
-}
-
-void render_text(SDL_Renderer *renderer, TTF_Font *font, const char *text, SDL_Color color, int x, int y);
-
-void show_splash(SDL_Renderer *renderer, TTF_Font *font) {
+#define INDEX_DIR   CONFIG_DIR "/index"
+#define CACHE_DIR   CONFIG_DIR "/cache"
+#define THUMB_DIR   CONFIG_DIR "/thumbs"
+#define TRACE_PATH  CONFIG_DIR "/trace.json"
+
+static Config CONFIG;
+
+// One image index, playlist and set of perceptual hashes per local
+// category, parallel to CONFIG.categories. These and CONFIG are only
+// replaced on a config reload, while the prefetcher and thumbnail builder
+// are stopped.
+static ImageIndex *INDEXES;
+static Playlist *PLAYLISTS;
+static PhashIndex *PHASHES;
+
+// Manifest categories sync on a thread of their own. SYNC_SLOTS maps each
+// category to its manifest in SYNC, or -1; categories listing the same
+// manifest share it. Both are replaced with CONFIG.
+static ManifestSync *SYNC;
+static int *SYNC_SLOTS;
+static int SYNC_COUNT;
+
+// Downloads run on the fetcher's network thread; the offline cache is
+// shared by the pool workers and that thread under CACHE_LOCK
+static Fetcher *FETCHER;
+static SDL_atomic_t FETCH_IP;      // address the fetcher's connections were made from
+static ImageCache CACHE;
+static SDL_mutex *CACHE_LOCK;
+
+// Screen-sized copies of local images; hit counters are prefetch-thread only
+static ThumbCache THUMBS;
+static SDL_atomic_t THUMB_HITS, THUMB_MISSES;
+
+// Slides load on a worker pool; local ones share their playlist
+static WorkPool *POOL;
+static SDL_mutex *PLAYLIST_LOCK;   // also guards PHASHES
+static bool HASHES_SAVING;         // a worker is writing a batch; under PLAYLIST_LOCK
+
+// Decode scratch for each pool worker and the thumbnail builder, and the
+// textures slides are uploaded into
+static Arena SLIDE_ARENAS[WORKPOOL_MAX_THREADS], THUMB_ARENA;
+static TexturePool TEXTURES;
+
+void show_splash(SDL_Renderer *renderer, TextRenderer *text) {
     // Load splash image from romfs
-    SDL_Surface *bg = IMG_Load("romfs:/splash.png");
+    SDL_Surface *bg = IMG_Load(ROMFS_ROOT "splash.png");
     SDL_Texture *splash_tex = NULL;
     if (bg) {
         splash_tex = SDL_CreateTextureFromSurface(renderer, bg);
@@ -189,282 +133,838 @@ void show_splash(SDL_Renderer *renderer, TTF_Font *font) {
         SDL_RenderFillRect(renderer, &panel);
 
         // Title
-        render_text(renderer, font, "Welcome to NX PhotoFrame!",
-                    cyan, 160, 185);
+        text_draw(text, "Welcome to NX PhotoFrame!",
+                  cyan, 160, 185);
 
         // Instructions
-        render_text(renderer, font,
-                    "NX PhotoFrame displays images from remote or local sources.",
-                    white, 160, 240);
-        render_text(renderer, font,
-                    "Use D-Pad Left/Right to switch categories.",
-                    white, 160, 275);
-        render_text(renderer, font,
-                    "Use [+]/[-] to adjust the refresh interval.",
-                    white, 160, 310);
-        render_text(renderer, font,
-                    "Customize your categories by editing your config file at:",
-                    white, 160, 360);
-        render_text(renderer, font,
-                    "sdmc:/config/NXPhotoFrame/config.ini",
-                    yellow, 160, 395);
-        render_text(renderer, font,
-                    "Local categories such as Album, if empty will display an error.",
-                    white, 160, 445);
-        render_text(renderer, font,
-                    "Press any button to continue...",
-                    cyan, 160, 510);
+        text_draw(text,
+                  "NX PhotoFrame displays images from remote or local sources.",
+                  white, 160, 240);
+        text_draw(text,
+                  "Use D-Pad Left/Right to switch categories.",
+                  white, 160, 275);
+        text_draw(text,
+                  "Use [+]/[-] to adjust the refresh interval.",
+                  white, 160, 310);
+        text_draw(text,
+                  "Customize your categories by editing your config file at:",
+                  white, 160, 360);
+        text_draw(text,
+                  CONFIG_PATH,
+                  yellow, 160, 395);
+        text_draw(text,
+                  "Local categories such as Album, if empty will display an error.",
+                  white, 160, 445);
+        text_draw(text,
+                  "Press any button to continue...",
+                  cyan, 160, 510);
 
         SDL_RenderPresent(renderer);
 
-        // Check for any button press
+        // Nothing on the splash changes, so sleep until there's input
+        // (or the window needs repainting)
         SDL_Event event;
-        while (SDL_PollEvent(&event)) {
-            if (event.type == SDL_JOYBUTTONDOWN ||
+        while (!dismissed && SDL_WaitEvent(&event)) {
+            if (event.type == SDL_QUIT) {
+                SDL_PushEvent(&event);  // for the main loop to quit on
+                dismissed = true;
+            } else if (event.type == SDL_JOYBUTTONDOWN ||
                 event.type == SDL_FINGERDOWN ||
                 event.type == SDL_MOUSEBUTTONDOWN) {
                 dismissed = true;
+            } else if (event.type == SDL_WINDOWEVENT) {
+                break;
             }
         }
-        SDL_Delay(16);
     }
 
     if (splash_tex) SDL_DestroyTexture(splash_tex);
 }
 
-void write_first_run_false(void) {
-    FILE *f = fopen(CONFIG_PATH, "r");
-    if (!f) return;
-
-    char newcontents[4096] = {0};
-    char line[320];
-
-    while (fgets(line, sizeof(line), f)) {
-        if (strncmp(line, "first_run", 9) == 0) {
-            strcat(newcontents, "first_run = false\n");
-        } else {
-            strcat(newcontents, line);
-        }
+// Decode an image file with the decoder its first bytes call for: JPEGs at
+// the smallest DCT scale that still covers where they'll be placed, WebPs
+// scaled by libwebp, PNG and QOI at full size; anything else (or a file its
+// decoder refuses) via SDL_image. Either way the result is then filtered
+// down to its placed size.
+static SDL_Surface* load_image_file(const char *path) {
+    TRACE_BEGIN("decode");
+    Uint64 start = SDL_GetPerformanceCounter();
+    SDL_Surface *surface = decode_image_file(path, CONFIG.fit_mode, SCREEN_W, SCREEN_H);
+    if (!surface)
+        surface = IMG_Load(path);
+    if (!surface) {
+        TRACE_END("decode");
+        return NULL;
     }
-    fclose(f);
-
-    f = fopen(CONFIG_PATH, "w");
-    if (!f) return;
-    fputs(newcontents, f);
-    fclose(f);
+    stage_record(STAGE_DECODE, start);
+    TRACE_END("decode");
+
+    TRACE_BEGIN("scale");
+    start = SDL_GetPerformanceCounter();
+    surface = shrink_surface(surface, CONFIG.fit_mode, SCREEN_W, SCREEN_H);
+    stage_record(STAGE_SCALE, start);
+    TRACE_END("scale");
+    return surface;
 }
 
-static size_t write_callback(char *contents, size_t size, size_t nmemb, void *userp) {
-    size_t total = size * nmemb;
-    MemoryBuffer *buf = (MemoryBuffer *)userp;
-    buf->data = realloc(buf->data, buf->size + total + 1);
-    if (!buf->data) return 0;
-    memcpy(&(buf->data[buf->size]), contents, total);
-    buf->size += total;
-    buf->data[buf->size] = 0;
-    return total;
-}
+// Fall back to a previously downloaded image when the network lets us down.
+// Sets *retry, so the scheduler tries the source again sooner than usual.
+static SDL_Surface* load_cached_image(const char *url, const char *reason, bool *retry,
+                                      char *status_out, size_t status_len) {
+    char path[512];
+    *retry = true;
+    SDL_Surface *surface = NULL;
+    SDL_LockMutex(CACHE_LOCK);
+    int found = cache_pick(&CACHE, url, path, sizeof(path));
+    int count = cache_count(&CACHE, url);
+    SDL_UnlockMutex(CACHE_LOCK);
+    if (found == 0)
+        surface = load_image_file(path);
 
-SDL_Texture* fetch_image(SDL_Renderer *renderer, const char *url, char *status_out, size_t status_len) {
-    CURL *curl = curl_easy_init();
-    if (!curl) {
-        snprintf(status_out, status_len, "curl_easy_init failed");
+    if (!surface) {
+        snprintf(status_out, status_len, "%s", reason);
         return NULL;
     }
+    snprintf(status_out, status_len, "%s Showing cached image (%d saved)", reason, count);
+    return surface;
+}
 
-    MemoryBuffer buf = {0};
-    buf.data = malloc(1);
-    buf.size = 0;
+// Fetcher callback: make the request conditional on the last response
+static void cache_validators(const char *url, char *etag, size_t etag_len,
+                             char *last_modified, size_t last_modified_len, void *user) {
+    SDL_LockMutex(CACHE_LOCK);
+    const CacheCategory *cached = cache_category(&CACHE, url);
+    if (cached) {
+        snprintf(etag, etag_len, "%s", cached->etag);
+        snprintf(last_modified, last_modified_len, "%s", cached->last_modified);
+    }
+    SDL_UnlockMutex(CACHE_LOCK);
+}
 
-    curl_easy_setopt(curl, CURLOPT_URL, url);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &buf);
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 15L);
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
-	curl_easy_setopt(curl, CURLOPT_USERAGENT, "NXPhotoFrame/" APP_VERSION " (Nintendo Switch)");
+// Stop waiting for the transfer once the prefetcher no longer wants this slide
+static int fetch_abort(void *arg) {
+    return prefetch_job_cancelled((const PrefetchJob *)arg);
+}
 
-    CURLcode res = curl_easy_perform(curl);
-    long http_code = 0;
-    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
-    curl_easy_cleanup(curl);
+// A remote slide's body goes through a progressive decoder as it arrives,
+// and the render loop gets a preview whenever more of it is complete
+typedef struct {
+    const PrefetchJob  *job;
+    ProgressiveDecoder *decoder;
+    Uint32              last_preview;
+    bool                previewed;
+} SlideStream;
+
+static void stream_slide(const unsigned char *data, size_t size, void *arg) {
+    SlideStream *stream = arg;
+    if (!progressive_active(stream->decoder)) return;
+    progressive_feed(stream->decoder, data, size);
+
+    Uint32 now = SDL_GetTicks();
+    if (stream->previewed && now - stream->last_preview < PREVIEW_MIN_MS) return;
+    if (!prefetch_wants_preview(stream->job)) return;
+    TRACE_BEGIN("preview");
+    SDL_Surface *preview = progressive_preview(stream->decoder);
+    TRACE_END("preview");
+    if (!preview) return;
+    stream->last_preview = now;
+    stream->previewed = true;
+    prefetch_preview(stream->job, preview);
+}
 
-    if (res != CURLE_OK) {
-        snprintf(status_out, status_len, "Fetch error: %s", curl_easy_strerror(res));
-        free(buf.data);
+// streamed has been fed the whole body; if it decoded it, the result is
+// used instead of decoding the buffer again
+static SDL_Surface* decode_fetched(const char *url, const FetchContext *fetched,
+                                   ProgressiveDecoder *streamed, bool *retry,
+                                   char *status_out, size_t status_len) {
+    char reason[128];
+
+    if (fetched->http_code == 304) {
+        // Unchanged since last time; show the copy we already have
+        char path[512];
+        SDL_Surface *surface = NULL;
+        SDL_LockMutex(CACHE_LOCK);
+        int found = cache_last_path(&CACHE, url, path, sizeof(path));
+        SDL_UnlockMutex(CACHE_LOCK);
+        if (found == 0)
+            surface = load_image_file(path);
+        if (surface) {
+            snprintf(status_out, status_len, "Not modified (cached, %ld ms)", fetched->timing.total_ms);
+            return surface;
+        }
+        snprintf(status_out, status_len, "Not modified (HTTP 304), but no cached copy");
         return NULL;
     }
 
-    if (buf.size == 0) {
-        snprintf(status_out, status_len, "Empty response (HTTP %ld)", http_code);
-        free(buf.data);
-        return NULL;
+    if (fetched->http_code >= 400) {
+        snprintf(reason, sizeof(reason), "HTTP %ld.", fetched->http_code);
+        return load_cached_image(url, reason, retry, status_out, status_len);
     }
 
-    SDL_RWops *rw = SDL_RWFromMem(buf.data, (int)buf.size);
-    if (!rw) {
-        snprintf(status_out, status_len, "SDL_RWFromMem failed");
-        free(buf.data);
+    if (fetched->size == 0) {
+        snprintf(status_out, status_len, "Empty response (HTTP %ld)", fetched->http_code);
         return NULL;
     }
 
-    SDL_Surface *surface = IMG_Load_RW(rw, 1);
-    free(buf.data);
+    // Decode straight out of the transfer's buffer; nothing is copied
+    TRACE_BEGIN("decode");
+    Uint64 start = SDL_GetPerformanceCounter();
+    SDL_Surface *surface = streamed ? progressive_finish(streamed) : NULL;
+    bool progressive = surface != NULL;
+    if (!surface)
+        surface = decode_image_mem(fetched->data, fetched->size, CONFIG.fit_mode,
+                                   SCREEN_W, SCREEN_H);
+    if (!surface) {
+        SDL_RWops *rw = SDL_RWFromConstMem(fetched->data, (int)fetched->size);
+        if (rw) surface = IMG_Load_RW(rw, 1);
+    }
+    TRACE_END("decode");
 
     if (!surface) {
         snprintf(status_out, status_len, "IMG_Load failed: %s", IMG_GetError());
         return NULL;
     }
+    stage_record(STAGE_DECODE, start);
+    TRACE_BEGIN("scale");
+    start = SDL_GetPerformanceCounter();
+    surface = shrink_surface(surface, CONFIG.fit_mode, SCREEN_W, SCREEN_H);
+    stage_record(STAGE_SCALE, start);
+    TRACE_END("scale");
+
+    // Only keep what actually decoded
+    SDL_LockMutex(CACHE_LOCK);
+    cache_store(&CACHE, url, fetched->data, fetched->size, fetched->etag, fetched->last_modified);
+    SDL_UnlockMutex(CACHE_LOCK);
+
+    snprintf(status_out, status_len, "OK (%zu bytes, HTTP %ld, %ld ms, TTFB %ld ms, %ld KB/s%s%s%s)",
+             fetched->size, fetched->http_code, fetched->timing.total_ms, fetched->timing.ttfb_ms,
+             fetched->timing.bytes_per_sec / 1024, fetched->reused ? ", reused" : "",
+             fetched->warmed ? ", warmed" : "", progressive ? ", progressive" : "");
+    return surface;
+}
 
-    SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer, surface);
-    SDL_FreeSurface(surface);
+SDL_Surface* fetch_image(const char *url, const PrefetchJob *job, bool *retry,
+                         char *status_out, size_t status_len) {
+    CURLcode res;
+    SlideStream stream = { job, progressive_create(CONFIG.fit_mode, SCREEN_W, SCREEN_H) };
+    TRACE_BEGIN("fetch wait");
+    FetchContext *fetched = fetcher_take(FETCHER, url, fetch_abort, (void *)job,
+                                         stream.decoder ? stream_slide : NULL, &stream, &res);
+    TRACE_END("fetch wait");
+    if (!fetched || res != CURLE_OK) {
+        fetcher_release(FETCHER, fetched);
+        progressive_destroy(stream.decoder);
+        char reason[128];
+        snprintf(reason, sizeof(reason), "Fetch error: %s.", curl_easy_strerror(res));
+        return load_cached_image(url, reason, retry, status_out, status_len);
+    }
 
-    if (!texture) {
-        snprintf(status_out, status_len, "CreateTexture failed");
-        return NULL;
+    SDL_Surface *surface = decode_fetched(url, fetched, stream.decoder, retry,
+                                          status_out, status_len);
+    fetcher_release(FETCHER, fetched);
+    progressive_destroy(stream.decoder);
+    return surface;
+}
+
+// Start downloading the current category and its neighbours either side,
+// so D-pad switches between remote categories don't wait on the network
+static void warm_categories(int cat_index) {
+    const char *urls[3];
+    int count = 0;
+    for (int step = 0; step < 3 && step < CONFIG.num_categories; step++) {
+        int i = (cat_index + (step == 2 ? CONFIG.num_categories - 1 : step)) % CONFIG.num_categories;
+        bool seen = false;
+        for (int j = 0; j < count; j++) seen |= strcmp(urls[j], CONFIG.categories[i].url) == 0;
+        if (CONFIG.categories[i].url[0] != 0 && !seen) urls[count++] = CONFIG.categories[i].url;
     }
+    if (FETCHER) fetcher_warm(FETCHER, urls, count);
+}
 
-    snprintf(status_out, status_len, "OK (%zu bytes, HTTP %ld)", buf.size, http_code);
-    return texture;
+// Per-category state file under INDEX_DIR, named after the folder
+static void category_file(int i, const char *ext, char *out, size_t len) {
+    snprintf(out, len, "%s/%08x.%s", INDEX_DIR,
+             (unsigned)fnv1a32(CONFIG.categories[i].localpath), ext);
 }
 
-// Count and collect image files recursively
-static int collect_images(const char *folderpath, char ***list, int *count, int *capacity) {
-    DIR *dir = opendir(folderpath);
-    if (!dir) return 0;
+// Identifies which file each index slot refers to; a saved playlist is
+// only valid for the exact index it was built from
+static uint64_t index_fingerprint(const ImageIndex *idx) {
+    uint64_t h = fnv1a64(idx->files, idx->num_files * sizeof(uint32_t));
+    return (h * 1099511628211ull) ^ fnv1a64(idx->strtab, idx->strtab_size);
+}
 
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL) {
-        // Skip . and ..
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
-            continue;
+// qsort has no context argument; only used while building at startup
+static const ImageIndex *SORT_INDEX;
+static const int64_t *SORT_MTIMES;
 
-        char fullpath[512];
-        snprintf(fullpath, sizeof(fullpath), "%s%s", folderpath, entry->d_name);
+static int cmp_path(const void *a, const void *b) {
+    return strcmp(index_relpath(SORT_INDEX, *(const uint32_t *)a),
+                  index_relpath(SORT_INDEX, *(const uint32_t *)b));
+}
 
-        if (entry->d_type == DT_DIR) {
-            // Recurse into subdirectory
-            char subpath[512];
-            snprintf(subpath, sizeof(subpath), "%s%s/", folderpath, entry->d_name);
-            collect_images(subpath, list, count, capacity);
+// Newest folder first; within a folder, names descending, which for
+// Album-style timestamped names is newest first too
+static int cmp_newest(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    if (SORT_MTIMES[x] != SORT_MTIMES[y]) return SORT_MTIMES[x] < SORT_MTIMES[y] ? 1 : -1;
+    return -cmp_path(a, b);
+}
+
+// Files only carry their folder's mtime; that's enough to rank them
+static int64_t *file_mtimes(const ImageIndex *idx) {
+    int64_t *mtimes = malloc((idx->num_files ? idx->num_files : 1) * sizeof(int64_t));
+    if (!mtimes) return NULL;
+    for (uint32_t d = 0; d < idx->num_dirs; d++)
+        for (uint32_t f = 0; f < idx->dirs[d].num_files; f++)
+            mtimes[idx->dirs[d].first_file + f] = idx->dirs[d].mtime;
+    return mtimes;
+}
+
+// Weighted mode: files in folders changed in the last month come up four
+// times as often, the last year twice
+static float *recency_weights(const ImageIndex *idx, const int64_t *mtimes) {
+    float *weights = malloc((idx->num_files ? idx->num_files : 1) * sizeof(float));
+    if (!weights) return NULL;
+    int64_t now = (int64_t)time(NULL);
+    for (uint32_t i = 0; i < idx->num_files; i++) {
+        int64_t age = now - mtimes[i];
+        weights[i] = age < 30 * 86400 ? 4.0f : age < 365 * 86400 ? 2.0f : 1.0f;
+    }
+    return weights;
+}
+
+// Resume the saved playlist for a category, or build a fresh one if the
+// folder contents or the order setting changed
+static void load_playlist(int i, uint64_t seed) {
+    const ImageIndex *idx = &INDEXES[i];
+    Playlist *pl = &PLAYLISTS[i];
+    char path[512];
+    category_file(i, "pls", path, sizeof(path));
+
+    playlist_init(pl, CONFIG.playlist_mode, seed);
+    uint64_t fingerprint = index_fingerprint(idx);
+    int resumed = playlist_load(pl, path) == 0 && pl->mode == CONFIG.playlist_mode &&
+                  pl->count == idx->num_files && pl->fingerprint == fingerprint;
+    if (resumed && CONFIG.playlist_mode != PLAYLIST_WEIGHTED) return;
+
+    int64_t *mtimes = file_mtimes(idx);
+    uint32_t *sorted = NULL;
+    float *weights = NULL;
+    if (mtimes && (CONFIG.playlist_mode == PLAYLIST_SEQUENTIAL || CONFIG.playlist_mode == PLAYLIST_NEWEST)) {
+        sorted = malloc((idx->num_files ? idx->num_files : 1) * sizeof(uint32_t));
+        if (sorted) {
+            for (uint32_t f = 0; f < idx->num_files; f++) sorted[f] = f;
+            SORT_INDEX  = idx;
+            SORT_MTIMES = mtimes;
+            qsort(sorted, idx->num_files, sizeof(uint32_t),
+                  CONFIG.playlist_mode == PLAYLIST_NEWEST ? cmp_newest : cmp_path);
+        }
+    } else if (mtimes && CONFIG.playlist_mode == PLAYLIST_WEIGHTED) {
+        weights = recency_weights(idx, mtimes);
+    }
+
+    if (resumed) {
+        // Weights aren't saved; the alias table is cheap to rebuild
+        if (!weights || playlist_set_weights(pl, weights) != 0)
+            playlist_reset(pl, idx->num_files, fingerprint, NULL, weights);
+    } else {
+        pl->mode = CONFIG.playlist_mode;
+        playlist_reset(pl, idx->num_files, fingerprint, sorted, weights);
+        playlist_save(pl, path);
+    }
+
+    free(mtimes);
+    free(sorted);
+    free(weights);
+}
+
+// Playlist group callback: near-duplicates share the lowest item among them
+static uint32_t slide_group(void *user, uint32_t item) {
+    return phash_index_group(user, item);
+}
+
+static void attach_groups(int i) {
+    playlist_set_groups(&PLAYLISTS[i], CONFIG.similar, slide_group, &PHASHES[i]);
+}
+
+static void save_hashes(int i) {
+    if (CONFIG.categories[i].localpath[0] == 0 || PHASHES[i].unsaved == 0) return;
+    char path[512];
+    category_file(i, "phs", path, sizeof(path));
+    phash_index_save(&PHASHES[i], &INDEXES[i], CONFIG.fit_mode, path);
+}
+
+// Index of local category i from disk, brought up to date, its playlist
+// and the hashes taken so far
+static void load_category(int i, uint64_t seed) {
+    char path[512];
+    category_file(i, "idx", path, sizeof(path));
+
+    index_load(&INDEXES[i], CONFIG.categories[i].localpath, path);
+    if (index_refresh(&INDEXES[i]) > 0)
+        index_save(&INDEXES[i], path);
+
+    load_playlist(i, seed);
+
+    category_file(i, "phs", path, sizeof(path));
+    phash_index_load(&PHASHES[i], &INDEXES[i], CONFIG.fit_mode, path);
+    attach_groups(i);
+}
+
+static bool alloc_categories(int count) {
+    INDEXES = calloc(count ? count : 1, sizeof(ImageIndex));
+    PLAYLISTS = calloc(count ? count : 1, sizeof(Playlist));
+    PHASHES = calloc(count ? count : 1, sizeof(PhashIndex));
+    if (INDEXES && PLAYLISTS && PHASHES) return true;
+    free(INDEXES);
+    free(PLAYLISTS);
+    free(PHASHES);
+    INDEXES = NULL;
+    PLAYLISTS = NULL;
+    PHASHES = NULL;
+    return false;
+}
+
+static void free_categories(ImageIndex *indexes, Playlist *playlists, PhashIndex *phashes,
+                            int count) {
+    for (int i = 0; i < count; i++) {
+        index_free(&indexes[i]);
+        playlist_free(&playlists[i]);
+        phash_index_free(&phashes[i]);
+    }
+    free(indexes);
+    free(playlists);
+    free(phashes);
+}
+
+void load_indexes(void) {
+    mkdir(CONFIG_DIR, 0777);
+    mkdir(INDEX_DIR, 0777);
+
+    uint64_t seed = (uint64_t)time(NULL) ^ SDL_GetPerformanceCounter();
+    srand((unsigned)seed);
+
+    if (!alloc_categories(CONFIG.num_categories)) {
+        CONFIG.num_categories = 0;
+        return;
+    }
+    for (int i = 0; i < CONFIG.num_categories; i++)
+        if (CONFIG.categories[i].localpath[0] != 0) load_category(i, seed + i);
+}
+
+// Swap in an edited config.ini. Folders that are still listed keep their
+// index and playlist, so only new ones are scanned. Nothing else may be
+// using CONFIG or the indexes: stop the prefetcher and thumbnail builder.
+static bool apply_config(Config *next) {
+    // Sized at startup; changing these takes a restart
+    next->cache_mb       = CONFIG.cache_mb;
+    next->thumb_mb       = CONFIG.thumb_mb;
+    next->decode_mb      = CONFIG.decode_mb;
+    next->decode_threads = CONFIG.decode_threads;
+    next->fit_mode       = CONFIG.fit_mode;
+
+    for (int i = 0; i < CONFIG.num_categories; i++) save_hashes(i);
+
+    Config old = CONFIG;
+    ImageIndex *old_indexes = INDEXES;
+    Playlist *old_playlists = PLAYLISTS;
+    PhashIndex *old_phashes = PHASHES;
+    if (!alloc_categories(next->num_categories)) {
+        INDEXES = old_indexes;
+        PLAYLISTS = old_playlists;
+        PHASHES = old_phashes;
+        config_free(next);
+        return false;
+    }
+    CONFIG = *next;
+
+    uint64_t seed = (uint64_t)time(NULL) ^ SDL_GetPerformanceCounter();
+    for (int i = 0; i < CONFIG.num_categories; i++) {
+        const char *folder = CONFIG.categories[i].localpath;
+        if (folder[0] == 0) continue;
+
+        int j = 0;
+        while (j < old.num_categories && strcmp(old.categories[j].localpath, folder) != 0) j++;
+        if (j == old.num_categories) {
+            load_category(i, seed + i);
+            continue;
+        }
+        INDEXES[i] = old_indexes[j];
+        memset(&old_indexes[j], 0, sizeof(ImageIndex));
+        PHASHES[i] = old_phashes[j];
+        memset(&old_phashes[j], 0, sizeof(PhashIndex));
+        old.categories[j].localpath = "";   // taken
+        if (old_playlists[j].mode == CONFIG.playlist_mode) {
+            PLAYLISTS[i] = old_playlists[j];
+            memset(&old_playlists[j], 0, sizeof(Playlist));
         } else {
-            const char *ext = strrchr(entry->d_name, '.');
-            if (ext && (
-                strcasecmp(ext, ".jpg") == 0 ||
-                strcasecmp(ext, ".jpeg") == 0 ||
-                strcasecmp(ext, ".png") == 0)) {
-                // Grow list if needed
-                if (*count >= *capacity) {
-                    *capacity *= 2;
-                    *list = realloc(*list, *capacity * sizeof(char *));
-                }
-                (*list)[*count] = strdup(fullpath);
-                (*count)++;
+            load_playlist(i, seed + i);
+        }
+        attach_groups(i);
+    }
+
+    free_categories(old_indexes, old_playlists, old_phashes, old.num_categories);
+    config_free(&old);
+    return true;
+}
+
+// Sync the manifest categories in the background
+static void start_sync(void) {
+    int n = CONFIG.num_categories;
+    SYNC_SLOTS = malloc((n ? n : 1) * sizeof(int));
+    const char **urls = malloc((n ? n : 1) * sizeof(char *));
+    char (*dirs)[512] = malloc((n ? n : 1) * sizeof(*dirs));
+    const char **dir_ptrs = malloc((n ? n : 1) * sizeof(char *));
+    SYNC_COUNT = 0;
+    if (SYNC_SLOTS && urls && dirs && dir_ptrs) {
+        for (int i = 0; i < n; i++) {
+            const char *url = CONFIG.categories[i].manifest;
+            int slot = -1;
+            for (int j = 0; j < i && url[0] && slot < 0; j++)
+                if (strcmp(CONFIG.categories[j].manifest, url) == 0) slot = SYNC_SLOTS[j];
+            if (url[0] && slot < 0) {
+                slot = SYNC_COUNT++;
+                urls[slot] = url;
+                manifest_dir(url, dirs[slot], sizeof(dirs[slot]));
+                dir_ptrs[slot] = dirs[slot];
             }
+            SYNC_SLOTS[i] = slot;
         }
+        SYNC = manifest_sync_start(urls, dir_ptrs, SYNC_COUNT);
     }
-    closedir(dir);
-    return *count;
+    if (!SYNC) SYNC_COUNT = 0;
+    free(urls);
+    free(dirs);
+    free(dir_ptrs);
 }
 
-SDL_Texture* load_local_image(SDL_Renderer *renderer, const char *folderpath,
-                               char *status_out, size_t status_len) {
-    // Check folder exists first
-    DIR *test = opendir(folderpath);
-    if (!test) {
-        snprintf(status_out, status_len, "Folder not found: %s", folderpath);
-        return NULL;
+static void stop_sync(void) {
+    manifest_sync_stop(SYNC);
+    free(SYNC_SLOTS);
+    SYNC = NULL;
+    SYNC_SLOTS = NULL;
+    SYNC_COUNT = 0;
+}
+
+// Images sync s added or deleted that the index hasn't caught up with,
+// if it's time to rescan for them: once the sync is done or, while a long
+// one runs, if a category of it is still empty or the last rescan is stale
+static int sync_changes(int s, bool stale) {
+    ManifestStatus st;
+    manifest_sync_status(SYNC, s, &st);
+    if (st.changes <= 0) return 0;
+    if (!st.syncing || stale) return st.changes;
+    for (int i = 0; i < CONFIG.num_categories; i++)
+        if (SYNC_SLOTS[i] == s && INDEXES[i].num_files == 0) return st.changes;
+    return 0;
+}
+
+// Rebuild the index, playlist and hashes of the categories of sync s, as
+// for a folder new to the config. The prefetcher and thumbnail builder
+// must be stopped.
+static void rescan_sync(int s, int changes) {
+    uint64_t seed = (uint64_t)time(NULL) ^ SDL_GetPerformanceCounter();
+    for (int i = 0; i < CONFIG.num_categories; i++) {
+        if (SYNC_SLOTS[i] != s) continue;
+        save_hashes(i);
+        index_free(&INDEXES[i]);
+        playlist_free(&PLAYLISTS[i]);
+        phash_index_free(&PHASHES[i]);
+        load_category(i, seed + i);
     }
-    closedir(test);
+    manifest_sync_seen(SYNC, s, changes);
+}
 
-    // Collect all images recursively
-    int count = 0;
-    int capacity = 64;
-    char **imagelist = malloc(capacity * sizeof(char *));
+// Why a manifest category has nothing to show yet. False if cat_index
+// isn't one.
+static bool sync_message(int cat_index, char *status_out, size_t status_len) {
+    if (!SYNC || SYNC_SLOTS[cat_index] < 0) return false;
+    ManifestStatus st;
+    manifest_sync_status(SYNC, SYNC_SLOTS[cat_index], &st);
+    const char *name = CONFIG.categories[cat_index].name;
+    if (st.listed > 0 && (st.syncing || !st.error[0]))
+        snprintf(status_out, status_len, "Syncing %s: %d of %d images", name, st.have, st.listed);
+    else if (st.syncs > 0 && st.error[0])
+        snprintf(status_out, status_len, "Sync of %s failed: %s", name, st.error);
+    else if (st.syncs > 0 && !st.syncing)
+        snprintf(status_out, status_len, "No images listed for %s", name);
+    else
+        snprintf(status_out, status_len, "Syncing %s...", name);
+    return true;
+}
 
-    collect_images(folderpath, &imagelist, &count, &capacity);
+// Remember the interval and category in config.ini, so the next start
+// resumes here
+static void save_state(int interval_mins, int cat_index) {
+    if (CONFIG.num_categories == 0) return;
+    char interval[16];
+    snprintf(interval, sizeof(interval), "%d", interval_mins);
+    ConfigValue values[] = {
+        { "interval_mins", interval },
+        { "category",      CONFIG.categories[cat_index].name },
+    };
+    config_update(&CONFIG, CONFIG_PATH, values, 2);
+}
+
+// Prefetcher pick: the next playlist entry, chosen in slide order even
+// though the loads run in parallel
+static uint32_t pick_slide(int cat_index, void *user) {
+    if (CONFIG.categories[cat_index].localpath[0] == 0) return PLAYLIST_NONE;
+    SDL_LockMutex(PLAYLIST_LOCK);
+    uint32_t item = playlist_next(&PLAYLISTS[cat_index]);
+    SDL_UnlockMutex(PLAYLIST_LOCK);
+    return item;
+}
+
+// A slide picked but never shown (category switch, reload, exit) goes back
+// to the head of its playlist, so the round still shows every image
+static void unpick_slide(int cat_index, uint32_t item, void *user) {
+    if (CONFIG.categories[cat_index].localpath[0] == 0 || item == PLAYLIST_NONE) return;
+    char pl_path[512];
+    category_file(cat_index, "pls", pl_path, sizeof(pl_path));
+    SDL_LockMutex(PLAYLIST_LOCK);
+    playlist_unpick(&PLAYLISTS[cat_index], item);
+    playlist_save_position(&PLAYLISTS[cat_index], pl_path);
+    SDL_UnlockMutex(PLAYLIST_LOCK);
+}
+
+// New hashes are saved in batches that grow with the album, so a first
+// pass over a large one rewrites the file only a few dozen times
+#define PHASH_SAVE_EVERY 256
+
+// Record the hash of a placed slide, unless the file's is already known
+static void hash_slide(int cat_index, uint32_t item, const struct stat *st,
+                       SDL_Surface *placed) {
+    if (CONFIG.similar == PLAYLIST_SIMILAR_OFF) return;
+    PhashIndex *ix = &PHASHES[cat_index];
+    uint32_t stamp = phash_stamp((uint64_t)st->st_size, (int64_t)st->st_mtime);
+    SDL_LockMutex(PLAYLIST_LOCK);
+    bool known = phash_index_check(ix, item, stamp);
+    SDL_UnlockMutex(PLAYLIST_LOCK);
+    if (known) return;
+
+    uint64_t hash = phash_surface(placed);
+    PhashSnapshot snap;
+    bool save = false;
+    SDL_LockMutex(PLAYLIST_LOCK);
+    phash_index_set(ix, item, hash, stamp);
+    if (!HASHES_SAVING && ix->unsaved >= PHASH_SAVE_EVERY && ix->unsaved >= ix->hashed / 8)
+        save = HASHES_SAVING = phash_index_snapshot(ix, &INDEXES[cat_index], &snap) == 0;
+    SDL_UnlockMutex(PLAYLIST_LOCK);
+    if (!save) return;
+
+    // The file is written without the lock, so other workers' picks and
+    // hashes don't wait on the SD card
+    char path[512];
+    category_file(cat_index, "phs", path, sizeof(path));
+    int rc = phash_snapshot_write(&snap, CONFIG.fit_mode, path);
+    SDL_LockMutex(PLAYLIST_LOCK);
+    if (rc != 0) ix->unsaved += snap.unsaved;
+    HASHES_SAVING = false;
+    SDL_UnlockMutex(PLAYLIST_LOCK);
+}
+
+SDL_Surface* load_local_image(int cat_index, uint32_t item, char *status_out, size_t status_len) {
+    const ImageIndex *idx = &INDEXES[cat_index];
+    Playlist *pl = &PLAYLISTS[cat_index];
 
-    if (count == 0) {
-        free(imagelist);
-        snprintf(status_out, status_len, "No images found in %s", folderpath);
+    if (idx->num_files == 0 && sync_message(cat_index, status_out, status_len))
+        return NULL;
+
+    if (idx->num_dirs == 0) {
+        snprintf(status_out, status_len, "Folder not found: %s", idx->root);
         return NULL;
     }
 
-    // Pick a random one
-    int target = rand() % count;
-    char chosen[512];
-    strncpy(chosen, imagelist[target], sizeof(chosen) - 1);
-	chosen[sizeof(chosen) - 1] = 0;
+    if (idx->num_files == 0) {
+        snprintf(status_out, status_len, "No images found in %s", idx->root);
+        return NULL;
+    }
 
-    // Free the list
-    for (int i = 0; i < count; i++) free(imagelist[i]);
-    free(imagelist);
+    // Picked from the playlist when the load was queued; only the small
+    // header is written back
+    if (item == PLAYLIST_NONE || item >= idx->num_files) {
+        snprintf(status_out, status_len, "Playlist unavailable for %s", idx->root);
+        return NULL;
+    }
+    char pl_path[512];
+    category_file(cat_index, "pls", pl_path, sizeof(pl_path));
+    SDL_LockMutex(PLAYLIST_LOCK);
+    playlist_save_position(pl, pl_path);
+    SDL_UnlockMutex(PLAYLIST_LOCK);
 
-    SDL_Surface *surface = IMG_Load(chosen);
+    char chosen[512];
+    if (!index_full_path(idx, item, chosen, sizeof(chosen))) {
+        snprintf(status_out, status_len, "Path too long in %s", idx->root);
+        return NULL;
+    }
+
+    // Prefer the screen-sized thumbnail; on a miss decode the original and
+    // leave a thumbnail behind for next time
+    Uint64 start = SDL_GetPerformanceCounter();
+    struct stat st;
+    int have_stat = stat(chosen, &st) == 0;
+    SDL_Surface *surface = have_stat ? thumb_load(&THUMBS, chosen, &st) : NULL;
+    int hit = surface != NULL;
     if (!surface) {
-    snprintf(status_out, status_len, "IMG_Load failed: %s", IMG_GetError());
-    return NULL;
+        surface = load_image_file(chosen);
+        if (surface && have_stat) thumb_store(&THUMBS, chosen, &st, surface);
     }
-    
-    // Scale to fit 1280x720 preserving aspect ratio (letterbox/pillarbox)
-    if (surface->w != SCREEN_W || surface->h != SCREEN_H) {
-        float src_ratio = (float)surface->w / (float)surface->h;
-        float dst_ratio = (float)SCREEN_W / (float)SCREEN_H;
-    
-        int new_w, new_h;
-        if (src_ratio > dst_ratio) {
-            // Wider than 16:9 — fit width, letterbox top/bottom
-            new_w = SCREEN_W;
-            new_h = (int)(SCREEN_W / src_ratio);
-        } else {
-            // Taller than 16:9 — fit height, pillarbox left/right
-            new_h = SCREEN_H;
-            new_w = (int)(SCREEN_H * src_ratio);
-        }
-    
-        // Create black canvas at full screen size
-        SDL_Surface *canvas = SDL_CreateRGBSurface(0, SCREEN_W, SCREEN_H, 32,
-            0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
-        SDL_FillRect(canvas, NULL, SDL_MapRGB(canvas->format, 0, 0, 0));
-    
-        // Center the scaled image on the canvas
-        SDL_Rect dst_rect = {
-            (SCREEN_W - new_w) / 2,
-            (SCREEN_H - new_h) / 2,
-            new_w,
-            new_h
-        };
-        SDL_BlitScaled(surface, NULL, canvas, &dst_rect);
-        SDL_FreeSurface(surface);
-        surface = canvas;
-    }
-
-    SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer, surface);
-    SDL_FreeSurface(surface);
-
-    if (!texture) {
-        snprintf(status_out, status_len, "CreateTexture failed");
+    if (!surface) {
+        snprintf(status_out, status_len, "IMG_Load failed: %s", IMG_GetError());
         return NULL;
     }
+    if (have_stat) hash_slide(cat_index, item, &st, surface);
+    long ms = (long)((SDL_GetPerformanceCounter() - start) * 1000 / SDL_GetPerformanceFrequency());
+    SDL_AtomicAdd(hit ? &THUMB_HITS : &THUMB_MISSES, 1);
+    unsigned hits = SDL_AtomicGet(&THUMB_HITS), misses = SDL_AtomicGet(&THUMB_MISSES);
 
     // Show just the filename in status, not the full path
     const char *filename = strrchr(chosen, '/');
-    snprintf(status_out, status_len, "Local: %s", filename ? filename + 1 : chosen);
-    return texture;
+    if (THUMBS.budget)
+        snprintf(status_out, status_len, "Local: %s (%s, %ld ms, %u%% thumb hits)",
+                 filename ? filename + 1 : chosen, hit ? "thumb" : "original", ms,
+                 hits * 100 / (hits + misses));
+    else
+        snprintf(status_out, status_len, "Local: %s (%ld ms)", filename ? filename + 1 : chosen, ms);
+    return surface;
+}
+
+// Remote fetch — check network first
+static SDL_Surface* load_remote_image(const PrefetchJob *job, bool *retry,
+                                      char *status_out, size_t status_len) {
+    const Category *cat = &CONFIG.categories[job->cat_index];
+    uint32_t ip = 0;
+    bool online = platform_online(&ip);
+
+    // Cached connections are useless once the network changed
+    if ((uint32_t)SDL_AtomicSet(&FETCH_IP, (int)ip) != ip)
+        fetcher_reset(FETCHER);
+
+    if (!online)
+        return load_cached_image(cat->url, "No internet connection.", retry,
+                                 status_out, status_len);
+    return fetch_image(cat->url, job, retry, status_out, status_len);
 }
 
-void render_text(SDL_Renderer *renderer, TTF_Font *font, const char *text, SDL_Color color, int x, int y) {
-    SDL_Surface *s = TTF_RenderUTF8_Blended(font, text, color);
-    if (!s) return;
-    SDL_Texture *t = SDL_CreateTextureFromSurface(renderer, s);
-    SDL_Rect dst = {x, y, s->w, s->h};
-    SDL_RenderCopy(renderer, t, NULL, &dst);
-    SDL_DestroyTexture(t);
-    SDL_FreeSurface(s);
+// A local GIF or WebP that turns out to be animated plays in place of its
+// still, which is its first frame. Remote slides stay still: the file is
+// gone once decoded.
+static AnimPlayer *start_animation(int cat_index, uint32_t item, Uint32 ready_event) {
+    if (CONFIG.categories[cat_index].localpath[0] == 0) return NULL;
+    const ImageIndex *idx = &INDEXES[cat_index];
+    if (item == PLAYLIST_NONE || item >= idx->num_files) return NULL;
+    char path[512];
+    if (!index_full_path(idx, item, path, sizeof(path))) return NULL;
+    return anim_open(path, CONFIG.fit_mode, SCREEN_W, SCREEN_H, ready_event);
 }
 
-void render_ui(SDL_Renderer *renderer, TTF_Font *font, int interval_mins,
+// Pool worker: produce the next slide for a category
+static SDL_Surface* load_slide(const PrefetchJob *job, char *status_out, size_t status_len,
+                               bool *retry, void *user) {
+    const Category *cat = &CONFIG.categories[job->cat_index];
+    scratch_begin(&SLIDE_ARENAS[workpool_worker()]);
+
+    if (cat->url[0] != 0) {
+        if (!FETCHER) {
+            snprintf(status_out, status_len, "Network thread failed to start");
+            return NULL;
+        }
+        return load_remote_image(job, retry, status_out, status_len);
+    }
+
+    if (cat->localpath[0] != 0) {
+        // Local fetch — no network check needed
+        return load_local_image(job->cat_index, job->item, status_out, status_len);
+    }
+
+    snprintf(status_out, status_len, "No source for %s", cat->name);
+    return NULL;
+}
+
+// Thumbnail builder thread: decode in its own scratch arena
+static SDL_Surface* build_thumb(const char *path) {
+    scratch_begin(&THUMB_ARENA);
+    return load_image_file(path);
+}
+
+// Builder hook: hash every local image whose file changed since it was
+// last hashed. Loaded hashes are grouped as this checks them.
+static bool wants_hash(void *user, const ImageIndex *idx, uint32_t file, const struct stat *st) {
+    uint32_t stamp = phash_stamp((uint64_t)st->st_size, (int64_t)st->st_mtime);
+    SDL_LockMutex(PLAYLIST_LOCK);
+    bool known = phash_index_check(&PHASHES[idx - INDEXES], file, stamp);
+    SDL_UnlockMutex(PLAYLIST_LOCK);
+    return !known;
+}
+
+static void got_hash(void *user, const ImageIndex *idx, uint32_t file, const struct stat *st,
+                     SDL_Surface *placed) {
+    hash_slide((int)(idx - INDEXES), file, st, placed);
+}
+
+// Fill in missing thumbnails and hashes of the local categories in the
+// background, at low priority
+static ThumbBuilder *start_thumb_builder(void) {
+    const ImageIndex **local_indexes = malloc((CONFIG.num_categories + 1) * sizeof(ImageIndex *));
+    if (!local_indexes) return NULL;
+    int num_local = 0;
+    for (int i = 0; i < CONFIG.num_categories; i++)
+        if (CONFIG.categories[i].localpath[0] != 0) local_indexes[num_local++] = &INDEXES[i];
+    ThumbHook hook = { wants_hash, got_hash, NULL };
+    ThumbBuilder *tb = thumbs_build_start(&THUMBS, local_indexes, num_local, build_thumb,
+                                          CONFIG.similar != PLAYLIST_SIMILAR_OFF ? &hook : NULL);
+    free(local_indexes);
+    return tb;
+}
+
+// Presented frames over the last hour, in one-minute buckets. With the
+// render loop idle between slides this should sit near the slide rate.
+typedef struct {
+    Uint32 minutes[60];
+    Uint32 minute;      // SDL_GetTicks() / 60000 of the newest bucket
+    Uint32 second;      // SDL_GetTicks() / 1000 of this_second
+    Uint32 this_second;
+    Uint32 last_second; // presents in the second before
+} PresentCounter;
+
+static void present_count(PresentCounter *pc, Uint32 now, Uint32 n) {
+    Uint32 second = now / 1000;
+    if (second != pc->second) {
+        pc->last_second = second == pc->second + 1 ? pc->this_second : 0;
+        pc->this_second = 0;
+        pc->second = second;
+    }
+    pc->this_second += n;
+
+    Uint32 minute = now / 60000;
+    // Clear the buckets we skipped while idle
+    for (Uint32 m = pc->minute + 1; m <= minute && m <= pc->minute + 60; m++)
+        pc->minutes[m % 60] = 0;
+    if (minute > pc->minute) pc->minute = minute;
+    pc->minutes[minute % 60] += n;
+}
+
+static Uint32 presents_per_hour(PresentCounter *pc, Uint32 now) {
+    present_count(pc, now, 0);
+    Uint32 total = 0;
+    for (int i = 0; i < 60; i++) total += pc->minutes[i];
+    return total;
+}
+
+static Uint32 presents_per_second(PresentCounter *pc, Uint32 now) {
+    present_count(pc, now, 0);
+    return pc->last_second;
+}
+
+void render_centered_text(TextRenderer *text, const char *str) {
+    SDL_Color white = {255, 255, 255, 255};
+    int w = 0, h = 0;
+    text_size(text, str, &w, &h);
+    text_draw(text, str, white, (SCREEN_W - w) / 2, (SCREEN_H - h) / 2);
+}
+
+void render_ui(SDL_Renderer *renderer, TextRenderer *text, int interval_mins,
                int cat_index, const char *fetch_status) {
     SDL_Color white  = {255, 255, 255, 255};
     SDL_Color yellow = {255, 220,  80, 255};
@@ -480,237 +980,606 @@ void render_ui(SDL_Renderer *renderer, TTF_Font *font, int interval_mins,
     int row1_y = SCREEN_H - 95;
     char cat_line[128];
     snprintf(cat_line, sizeof(cat_line), "%s %s  Category: [%s]  (%d/%d)",
-             ICON_DLEFT, ICON_DRIGHT, CATEGORIES[cat_index].name, cat_index + 1, NUM_CATEGORIES);
-    render_text(renderer, font, cat_line, cyan, 20, row1_y);
+             ICON_DLEFT, ICON_DRIGHT, CONFIG.num_categories ? CONFIG.categories[cat_index].name : "",
+             cat_index + 1, CONFIG.num_categories);
+    text_draw(text, cat_line, cyan, 20, row1_y);
 
     // Row 2: interval + fetch status
     char line2[256];
     snprintf(line2, sizeof(line2),
              "Interval: %d min(s)     %s Increase     %s Decrease     %s Exit",
              interval_mins, ICON_PLUS, ICON_MINUS, ICON_B);
-    render_text(renderer, font, line2, white, 20, SCREEN_H - 62);
+    text_draw(text, line2, white, 20, SCREEN_H - 62);
 
     char line3[256];
     snprintf(line3, sizeof(line3), "Fetch: %s", fetch_status);
-    render_text(renderer, font, line3, yellow, 20, SCREEN_H - 32);
+    text_draw(text, line3, yellow, 20, SCREEN_H - 32);
+}
+
+// Start loading slides of cat_index ahead of time. NULL, with the reason
+// in status_out, if there's nothing to load or the pool failed.
+static Prefetcher *start_prefetcher(int cat_index, Uint32 slide_event, char *status_out,
+                                    size_t status_len) {
+    if (CONFIG.num_categories == 0) {
+        snprintf(status_out, status_len, "No categories in config.ini");
+        return NULL;
+    }
+    Prefetcher *pf = prefetch_create(POOL, CONFIG.prefetch_depth, cat_index, pick_slide,
+                                     unpick_slide, load_slide, NULL, slide_event);
+    if (!pf) snprintf(status_out, status_len, "Worker pool failed: %s", SDL_GetError());
+    return pf;
+}
+
+// Perf overlay (L+R): where the time of the last slide went, top left
+void render_perf(SDL_Renderer *renderer, TextRenderer *text, float frame_ms,
+                 Uint32 presents_second, Uint32 presents_hour) {
+    SDL_Color white = {255, 255, 255, 255};
+    SDL_Color green = {120, 255, 120, 255};
+    char lines[7][128];
+
+    // Time spent building each frame (excluding the vsync wait), and how
+    // many frames were actually presented lately
+    snprintf(lines[0], sizeof(lines[0]), "Frame: %.2f ms  Presents/s: %u  Presents/h: %u",
+             frame_ms, (unsigned)presents_second, (unsigned)presents_hour);
+
+    FetchTiming tm;
+    if (FETCHER && fetcher_last_timing(FETCHER, &tm))
+        snprintf(lines[1], sizeof(lines[1]),
+                 "Fetch: DNS %ld  Connect %ld  TLS %ld  TTFB %ld  Transfer %ld ms  (%ld KB/s)",
+                 tm.dns_ms, tm.connect_ms, tm.tls_ms, tm.ttfb_ms, tm.transfer_ms,
+                 tm.bytes_per_sec / 1024);
+    else
+        snprintf(lines[1], sizeof(lines[1]), "Fetch: -");
+
+    snprintf(lines[2], sizeof(lines[2]), "Last: Queue %.1f  Decode %.1f  Scale %.1f  Upload %.1f ms",
+             stage_last_ms(STAGE_QUEUE), stage_last_ms(STAGE_DECODE),
+             stage_last_ms(STAGE_SCALE), stage_last_ms(STAGE_UPLOAD));
+    snprintf(lines[3], sizeof(lines[3]), "Avg/max: Decode %.1f/%.1f  Scale %.1f/%.1f  Upload %.1f/%.1f ms",
+             stage_avg_ms(STAGE_DECODE), stage_max_ms(STAGE_DECODE),
+             stage_avg_ms(STAGE_SCALE), stage_max_ms(STAGE_SCALE),
+             stage_avg_ms(STAGE_UPLOAD), stage_max_ms(STAGE_UPLOAD));
+
+    uint64_t process = platform_process_memory();
+    snprintf(lines[4], sizeof(lines[4]), "Heap: %.1f MB  Process: %.1f MB",
+             heap_in_use() / (1024.0 * 1024.0), process / (1024.0 * 1024.0));
+
+    // Peak decode scratch in use, and anything that had to spill to the heap
+    size_t scratch_peak = THUMB_ARENA.high_water, scratch_size = THUMB_ARENA.size;
+    unsigned spills = THUMB_ARENA.overflows + TEXTURES.fallbacks;
+    for (int i = 0; i < WORKPOOL_MAX_THREADS; i++) {
+        scratch_peak += SLIDE_ARENAS[i].high_water;
+        scratch_size += SLIDE_ARENAS[i].size;
+        spills += SLIDE_ARENAS[i].overflows;
+    }
+    snprintf(lines[5], sizeof(lines[5]), "Scratch: %u/%u MB  Textures: %d/%d  Spills: %u",
+             (unsigned)(scratch_peak >> 20), (unsigned)(scratch_size >> 20),
+             TEXTURES.high_water, TEXTURES.count, spills);
+
+#ifdef ENABLE_TRACE
+    snprintf(lines[6], sizeof(lines[6]), "Trace: %u events  Y: save to %s", trace_count(), TRACE_PATH);
+#else
+    snprintf(lines[6], sizeof(lines[6]), "Trace: off (build with TRACE=1)");
+#endif
+
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 170);
+    SDL_Rect panel = {10, 10, 900, 20 + 7 * 30};
+    SDL_RenderFillRect(renderer, &panel);
+    for (int i = 0; i < 7; i++)
+        text_draw(text, lines[i], i == 0 ? green : white, 20, 20 + i * 30);
 }
 
 int main(int argc, char *argv[]) {
-    romfsInit();
-	fsdevMountSdmc();
-	load_config();
-    socketInitializeDefault();
-    appletInitialize();
+    platform_init();
+	config_load(&CONFIG, CONFIG_PATH);
+	load_indexes();
 	
-	Uint32 last_charger_check = 0;
-    PsmChargerType last_charger = PsmChargerType_Unconnected;
+    bool charging = platform_charging();
 	
     // Initial charger state
-    psmInitialize();
-    psmGetChargerType(&last_charger);
-    psmExit();
-    if (last_charger != PsmChargerType_Unconnected) {
-        appletSetMediaPlaybackState(true);
+    if (charging) {
+        platform_keep_awake(true);
     }
 	
 	char fetch_status[256] = "Waiting...";
 	
-	// Check for internet connection at start.
-    NifmInternetConnectionStatus netStatus = NifmInternetConnectionStatus_ConnectingUnknown1;
-    nifmInitialize(NifmServiceType_User);
-    Result rc = nifmGetInternetConnectionStatus(NULL, NULL, &netStatus);
-    nifmExit();
-    if (R_FAILED(rc) || netStatus != NifmInternetConnectionStatus_Connected) {
+	// Check for internet connection at start. The address seeds the
+	// network-change check, so the first remote slide doesn't reset the
+	// fetcher and drop the categories warmed for it.
+    uint32_t ip = 0;
+    bool online = platform_online(&ip);
+    SDL_AtomicSet(&FETCH_IP, (int)ip);
+    if (!online) {
         snprintf(fetch_status, sizeof(fetch_status), "No internet connection.");
     }
 	
     SDL_Init(SDL_INIT_VIDEO | SDL_INIT_JOYSTICK);
+    TRACE_THREAD("main");
     IMG_Init(IMG_INIT_JPG | IMG_INIT_PNG);
     TTF_Init();
     curl_global_init(CURL_GLOBAL_ALL);
+    CACHE_LOCK = SDL_CreateMutex();
+    cache_open(&CACHE, CACHE_DIR, (uint64_t)CONFIG.cache_mb * 1024 * 1024);
+    FETCHER = fetcher_create(cache_validators, NULL);
+    start_sync();
+    thumbs_init(&THUMBS, THUMB_DIR, CONFIG.fit_mode, SCREEN_W, SCREEN_H, (uint64_t)CONFIG.thumb_mb * 1024 * 1024);
+
+    // Slide loads and big scales share the worker pool
+    PLAYLIST_LOCK = SDL_CreateMutex();
+    POOL = workpool_create(CONFIG.decode_threads, WORK_QUEUE_CAP);
+    scale_set_pool(POOL);
+
+    // The thumbnail builder gets a share of the decode budget if it runs;
+    // the rest is split evenly between the workers
+    size_t decode_bytes = (size_t)CONFIG.decode_mb * 1024 * 1024;
+    size_t thumb_bytes = THUMBS.budget ? decode_bytes / 3 : 0;
+    int workers = workpool_threads(POOL) > 0 ? workpool_threads(POOL) : 1;
+    for (int i = 0; i < workers; i++)
+        arena_init(&SLIDE_ARENAS[i], (decode_bytes - thumb_bytes) / workers);
+    arena_init(&THUMB_ARENA, thumb_bytes);
+
+    ThumbBuilder *thumb_builder = start_thumb_builder();
+
+    // Filtered scaling for letterboxed and Ken Burns slides
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
 
     SDL_Window *window = SDL_CreateWindow("NX PhotoFrame",
         SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
         SCREEN_W, SCREEN_H, SDL_WINDOW_FULLSCREEN);
     SDL_Renderer *renderer = SDL_CreateRenderer(window, -1,
         SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+    if (!renderer)  // headless host build: no GPU
+        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
 
     SDL_Joystick *joystick = SDL_JoystickOpen(0);
-    TTF_Font *font = TTF_OpenFont("romfs:/font.ttf", 22);
-
-    int interval_mins = DEFAULT_INTERVAL_MINS;
-    int cat_index     = 0;
+    TTF_Font *font = TTF_OpenFont(ROMFS_ROOT "font.ttf", 22);
+    TextRenderer *text = font ? text_create(renderer, font) : NULL;
+    texpool_init(&TEXTURES, renderer, SLIDE_TEXTURES, SCREEN_W, SCREEN_H);
+
+    // Resume where the last run left off
+    int interval_mins = CONFIG.interval_mins;
+    int cat_index     = config_find_category(&CONFIG, CONFIG.category);
+    if (cat_index < 0) cat_index = 0;
+    int state_dirty   = 0;   // interval or category changed since saved
 	int pending_fetch = 0;
 	int force_fetch   = 0;
+	int awaiting_slide = 0;
+    int preview_shown = 0;   // the slide awaited is up, still downloading
     int ui_visible    = 1;
-    Uint32 ui_show_time = SDL_GetTicks();
-    Uint32 last_fetch   = SDL_GetTicks() - (interval_mins * 60 * 1000);
+    int perf_visible  = 0;
+    int dirty         = 1;
     SDL_Texture *current_image = NULL;
-
-    if (is_first_run) {
-        show_splash(renderer, font);
-        write_first_run_false();
+    SDL_Texture *previous_image = NULL;   // still drawn while a transition runs
+    AnimPlayer *anim = NULL;              // playing into current_image
+    SDL_Rect current_rect = {0, 0, SCREEN_W, SCREEN_H};
+    Transition transition = { TRANSITION_CUT };
+    float frame_ms = 0.0f;
+    PresentCounter presents = { {0}, SDL_GetTicks() / 60000 };
+
+    // Every deadline the loop sleeps on; the first slide is due right away
+    Scheduler sched;
+    Uint64 start = SDL_GetTicks64();
+    sched_init(&sched, (Uint32)time(NULL) ^ (Uint32)SDL_GetPerformanceCounter());
+    sched_set_power_scale(&sched, CONFIG.battery_pct, CONFIG.charger_pct);
+    sched_set_charging(&sched, charging, interval_mins);
+    sched_set_online(&sched, start, online);
+    sched_at(&sched, TIMER_SLIDE, start);
+    sched_at(&sched, TIMER_UI_HIDE, start + UI_HIDE_DELAY_MS);
+    sched_at(&sched, TIMER_CHARGER, start + CHARGER_POLL_MS);
+    sched_at(&sched, TIMER_CONFIG, start + CONFIG_POLL_MS);
+    if (SYNC) sched_at(&sched, TIMER_SYNC, start + SYNC_POLL_MS);
+    Uint64 last_rescan = start;
+
+    // The worker wakes the render loop with this once a slide is ready
+    Uint32 slide_event = SDL_RegisterEvents(1);
+    if (slide_event == (Uint32)-1) slide_event = 0;
+
+    // Start fetching the first slide right away, even behind the splash
+    Prefetcher *prefetcher = start_prefetcher(cat_index, slide_event, fetch_status,
+                                              sizeof(fetch_status));
+    warm_categories(cat_index);
+
+    if (CONFIG.first_run) {
+        show_splash(renderer, text);
+        ConfigValue seen = { "first_run", "false" };
+        config_update(&CONFIG, CONFIG_PATH, &seen, 1);
     }
 
+    // Only redraw when something on screen changed (new slide, HUD shown or
+    // hidden, status text); otherwise sleep until the next event or deadline.
     while (1) {
-        Uint32 now = SDL_GetTicks();
+        Uint64 ticks = SDL_GetTicks64();
+        Uint32 now = (Uint32)ticks;
+
+        // Whatever came due while the loop slept
+        int timer;
+        while ((timer = sched_due(&sched, ticks)) >= 0) {
+            switch (timer) {
+                case TIMER_SLIDE:
+                    awaiting_slide = 1;
+                    preview_shown = 0;
+                    dirty = 1;
+                    break;
 
-        // Fetch when timer expires
-        if (force_fetch || (now - last_fetch) >= (Uint32)(interval_mins * 60 * 1000)) {
-            force_fetch = 0;
-            SDL_Texture *new_image = NULL;
-
-            if (CATEGORIES[cat_index].url[0] != 0) {
-                // Remote fetch — check network first
-                nifmInitialize(NifmServiceType_User);
-                rc = nifmGetInternetConnectionStatus(NULL, NULL, &netStatus);
-                nifmExit();
-
-                if (R_SUCCEEDED(rc) && netStatus == NifmInternetConnectionStatus_Connected) {
-                    // Show loading overlay
-                    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-                    SDL_RenderClear(renderer);
-                    if (current_image) SDL_RenderCopy(renderer, current_image, NULL, NULL);
-                    if (font) {
-                        SDL_Color white = {255,255,255,255};
-                        SDL_Surface *ls = TTF_RenderUTF8_Blended(font, "Loading...", white);
-                        if (ls) {
-                            SDL_Texture *lt = SDL_CreateTextureFromSurface(renderer, ls);
-                            SDL_Rect dst = {(SCREEN_W-ls->w)/2, (SCREEN_H-ls->h)/2, ls->w, ls->h};
-                            SDL_RenderCopy(renderer, lt, NULL, &dst);
-                            SDL_DestroyTexture(lt);
-                            SDL_FreeSurface(ls);
-                        }
+                case TIMER_UI_HIDE:
+                    ui_visible = 0;
+                    dirty = 1;
+                    // Save what +/- and the D-pad changed once the user is done
+                    if (state_dirty) {
+                        save_state(interval_mins, cat_index);
+                        state_dirty = 0;
+                    }
+                    if (pending_fetch) {
+                        pending_fetch = 0;
+                        force_fetch = 1;
                     }
-                    SDL_RenderPresent(renderer);
-                    new_image = fetch_image(renderer,
-                        CATEGORIES[cat_index].url, fetch_status, sizeof(fetch_status));
-                } else {
-                    snprintf(fetch_status, sizeof(fetch_status), "No internet connection.");
+                    break;
+
+                case TIMER_CHARGER: {
+                    sched_at(&sched, TIMER_CHARGER, ticks + CHARGER_POLL_MS);
+                    bool now_charging = platform_charging();
+                    if (now_charging != charging) {
+                        charging = now_charging;
+                        platform_keep_awake(charging);
+                        sched_set_charging(&sched, charging, interval_mins);
+                    }
+                    break;
                 }
 
-            } else if (CATEGORIES[cat_index].localpath[0] != 0) {
-                // Local fetch — no network check needed
-                new_image = load_local_image(renderer,
-                    CATEGORIES[cat_index].localpath, fetch_status, sizeof(fetch_status));
+                case TIMER_NETWORK:
+                    // Only armed while fetches fail; a reconnect retries at once
+                    if (sched_set_online(&sched, ticks, platform_online(NULL))) {
+                        manifest_sync_now(SYNC);
+                        snprintf(fetch_status, sizeof(fetch_status), "Back online, retrying...");
+                        dirty = 1;
+                    }
+                    break;
+
+                case TIMER_CONFIG:
+                    // Pick up edits to config.ini without a restart
+                    sched_at(&sched, TIMER_CONFIG, ticks + CONFIG_POLL_MS);
+                    if (config_changed(&CONFIG, CONFIG_PATH)) {
+                        Config next;
+                        if (config_load(&next, CONFIG_PATH) == 0 && next.num_categories > 0) {
+                            // Workers and the thumbnail builder read CONFIG and the
+                            // indexes, so both stop for the swap
+                            char *shown = CONFIG.num_categories ? strdup(CONFIG.categories[cat_index].name) : NULL;
+                            prefetch_destroy(prefetcher);
+                            thumbs_build_stop(thumb_builder);
+                            stop_sync();
+                            if (apply_config(&next)) {
+                                snprintf(fetch_status, sizeof(fetch_status), "Settings reloaded");
+                                interval_mins = CONFIG.interval_mins;
+                                sched_set_power_scale(&sched, CONFIG.battery_pct, CONFIG.charger_pct);
+                                int found = shown ? config_find_category(&CONFIG, shown) : -1;
+                                if (found >= 0) cat_index = found;
+                                else if (cat_index >= CONFIG.num_categories) cat_index = CONFIG.num_categories - 1;
+                            } else {
+                                snprintf(fetch_status, sizeof(fetch_status), "Out of memory reloading settings");
+                            }
+                            free(shown);
+                            start_sync();
+                            if (SYNC) sched_at(&sched, TIMER_SYNC, ticks + SYNC_POLL_MS);
+                            else sched_cancel(&sched, TIMER_SYNC);
+                            thumb_builder = start_thumb_builder();
+                            prefetcher = start_prefetcher(cat_index, slide_event, fetch_status,
+                                                          sizeof(fetch_status));
+                            warm_categories(cat_index);
+                            awaiting_slide = 0;
+                            pending_fetch = 0;
+                            force_fetch = 1;
+                        } else {
+                            // Keep the old settings until the file is edited again
+                            CONFIG.mtime = next.mtime;
+                            CONFIG.size = next.size;
+                            config_free(&next);
+                            snprintf(fetch_status, sizeof(fetch_status),
+                                     "config.ini not reloaded: no categories");
+                        }
+                        ui_visible = 1;
+                        sched_at(&sched, TIMER_UI_HIDE, ticks + UI_HIDE_DELAY_MS);
+                        dirty = 1;
+                    }
+                    break;
+
+                case TIMER_PERF:
+                    dirty = 1;
+                    break;
+
+                case TIMER_SYNC: {
+                    // New images join the playlist once a sync is done, and
+                    // every so often while a long one runs
+                    sched_at(&sched, TIMER_SYNC, ticks + SYNC_POLL_MS);
+                    bool stopped = false, was_empty = false;
+                    for (int s = 0; s < SYNC_COUNT; s++) {
+                        int changes = sync_changes(s, ticks - last_rescan >= RESCAN_MIN_MS);
+                        if (changes == 0) continue;
+                        if (!stopped) {
+                            // The workers read the indexes
+                            prefetch_destroy(prefetcher);
+                            thumbs_build_stop(thumb_builder);
+                            stopped = true;
+                        }
+                        if (SYNC_SLOTS[cat_index] == s && INDEXES[cat_index].num_files == 0)
+                            was_empty = true;
+                        rescan_sync(s, changes);
+                    }
+                    if (!stopped) break;
+                    last_rescan = ticks;
+                    thumb_builder = start_thumb_builder();
+                    prefetcher = start_prefetcher(cat_index, slide_event, fetch_status,
+                                                  sizeof(fetch_status));
+                    // Show the first images of an album as soon as they land
+                    if (was_empty) force_fetch = 1;
+                    break;
+                }
             }
+        }
+
+        // The category changed (or the config did): load the next slide now
+        if (force_fetch) {
+            force_fetch = 0;
+            awaiting_slide = 1;
+            preview_shown = 0;
+            dirty = 1;
+        }
+        if (awaiting_slide) sched_slide_wanted(&sched);
+
+        // Swap in the prefetched slide as soon as the worker has one ready,
+        // or meanwhile a preview of it if it's a progressive download
+        PrefetchSlide slide;
+        SDL_Surface *picture = NULL;
+        int picture_cat = cat_index;
+        int popped = 0;
+        if (awaiting_slide && prefetcher && prefetch_pop(prefetcher, &slide)) {
+            popped = 1;
+            awaiting_slide = 0;
+            snprintf(fetch_status, sizeof(fetch_status), "%s", slide.status);
+            picture = slide.surface;
+            picture_cat = slide.cat_index;
+        } else if (awaiting_slide && prefetcher) {
+            picture = prefetch_take_preview(prefetcher);
+        }
 
-            if (new_image) {
-                if (current_image) SDL_DestroyTexture(current_image);
+        if (picture) {
+            // Upload at decoded size into a pooled texture; the renderer
+            // scales and letterboxes
+            SDL_Rect src;
+            TRACE_BEGIN("upload");
+            Uint64 upload_start = SDL_GetPerformanceCounter();
+            SDL_Texture *new_image = texpool_upload(&TEXTURES, renderer, picture, &src);
+            if (popped) stage_record(STAGE_UPLOAD, upload_start);
+            TRACE_END("upload");
+            SDL_Rect new_rect = place_rect(CONFIG.fit_mode, picture->w, picture->h,
+                                           SCREEN_W, SCREEN_H);
+            SDL_FreeSurface(picture);
+            if (new_image && preview_shown) {
+                // A sharper copy of the picture already up: swap it in
+                // place and let its transition carry on
+                texpool_release(&TEXTURES, current_image);
+                current_image = new_image;
+                current_rect = new_rect;
+                transition_refine(&transition, &src);
+            } else if (new_image) {
+                anim_close(anim);
+                anim = popped ? start_animation(picture_cat, slide.item, slide_event) : NULL;
+                texpool_release(&TEXTURES, previous_image);
+                previous_image = current_image;
                 current_image = new_image;
+                current_rect = new_rect;
+
+                int kind = CONFIG.categories[picture_cat].transition;
+                transition_start(&transition, kind >= 0 ? kind : CONFIG.default_transition,
+                                 SDL_GetTicks(), (Uint32)sched_interval_ms(&sched, interval_mins),
+                                 &src);
+            } else {
+                snprintf(fetch_status, sizeof(fetch_status), "CreateTexture failed");
+            }
+            if (new_image) preview_shown = !popped;
+            dirty = 1;
+        }
+        if (popped) {
+            preview_shown = 0;
+            // Uploading can take a while; time the slide from when it's up
+            ticks = SDL_GetTicks64();
+            now = (Uint32)ticks;
+            sched_slide_shown(&sched, ticks, interval_mins, slide.retry);
+            if (slide.retry) {
+                size_t len = strlen(fetch_status);
+                snprintf(fetch_status + len, sizeof(fetch_status) - len, " Retrying in %d s.",
+                         (int)(sched.retry_ms / 1000));
             }
-            last_fetch = SDL_GetTicks();
             ui_visible = 1;
-            ui_show_time = SDL_GetTicks();
+            sched_at(&sched, TIMER_UI_HIDE, ticks + UI_HIDE_DELAY_MS);
+            dirty = 1;
         }
 
-        // Re-check charger state every 30 seconds
-        if (now - last_charger_check >= 30000) {
-            last_charger_check = now;
-            PsmChargerType current_charger = PsmChargerType_Unconnected;
-            psmInitialize();
-            psmGetChargerType(&current_charger);
-            psmExit();
-            if (current_charger != last_charger) {
-                last_charger = current_charger;
-                appletSetMediaPlaybackState(current_charger != PsmChargerType_Unconnected);
+        // An animated slide uploads its frames into its texture as they
+        // come due
+        if (anim) {
+            SDL_Rect src;
+            if (anim_update(anim, now, current_image, &src)) {
+                current_rect = place_rect(CONFIG.fit_mode, src.w, src.h, SCREEN_W, SCREEN_H);
+                transition_refine(&transition, &src);
+                dirty = 1;
+            } else if (anim_finished(anim)) {
+                anim_close(anim);
+                anim = NULL;
             }
         }
 
+        // Transitions ask for frames on their own schedule
+        if (current_image && transition_wait(&transition, now) == 0)
+            dirty = 1;
+
         // Render
-        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-        SDL_RenderClear(renderer);
-        if (current_image) {
-            SDL_RenderCopy(renderer, current_image, NULL, NULL);
-        } else if (font) {
-            SDL_Color white = {255,255,255,255};
-            SDL_Surface *s = TTF_RenderUTF8_Blended(font, fetch_status, white);
-            if (s) {
-                SDL_Texture *t = SDL_CreateTextureFromSurface(renderer, s);
-                SDL_Rect dst = {(SCREEN_W-s->w)/2, (SCREEN_H-s->h)/2, s->w, s->h};
-                SDL_RenderCopy(renderer, t, NULL, &dst);
-                SDL_DestroyTexture(t);
-                SDL_FreeSurface(s);
+        if (dirty) {
+            TRACE_BEGIN("frame");
+            Uint64 frame_start = SDL_GetPerformanceCounter();
+            SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+            SDL_RenderClear(renderer);
+            if (current_image) {
+                transition_draw(&transition, renderer, previous_image, current_image,
+                                &current_rect, now);
+            } else if (text && !awaiting_slide) {
+                render_centered_text(text, fetch_status);
+            }
+            if (awaiting_slide && !preview_shown && text) {
+                // Loading overlay; the worker is still fetching or decoding
+                render_centered_text(text, "Loading...");
+            }
+            if (ui_visible && text)
+                render_ui(renderer, text, interval_mins, cat_index, fetch_status);
+            if (perf_visible && text) {
+                render_perf(renderer, text, frame_ms, presents_per_second(&presents, now),
+                            presents_per_hour(&presents, now));
+                sched_at(&sched, TIMER_PERF, ticks + PERF_REFRESH_MS);
             }
-        }
-        if (ui_visible && font)
-            render_ui(renderer, font, interval_mins, cat_index, fetch_status);
-        SDL_RenderPresent(renderer);
 
-        if (ui_visible && (now - ui_show_time > UI_HIDE_DELAY_MS)) {
-            ui_visible = 0;
-            if (pending_fetch) {
-                pending_fetch = 0;
-                force_fetch = 1;
+            // Smoothed over ~30 frames so the counter is readable
+            float ms = (float)(SDL_GetPerformanceCounter() - frame_start) * 1000.0f /
+                       (float)SDL_GetPerformanceFrequency();
+            frame_ms += (ms - frame_ms) / 30.0f;
+            TRACE_BEGIN("present");
+            SDL_RenderPresent(renderer);
+            TRACE_END("present");
+            present_count(&presents, now, 1);
+            dirty = 0;
+            TRACE_END("frame");
+
+            if (previous_image && transition_blend_done(&transition, now)) {
+                texpool_release(&TEXTURES, previous_image);
+                previous_image = NULL;
             }
         }
 
+        // Sleep until the nearest deadline, or the next transition frame
+        Uint32 wait = sched_wait(&sched, ticks, CHARGER_POLL_MS);
+        if ((awaiting_slide || anim) && !slide_event && wait > 16)
+            wait = 16;  // no wakeup from the worker; fall back to polling
+        int frame = current_image ? transition_wait(&transition, now) : -1;
+        if (frame >= 0 && (Uint32)frame < wait) wait = frame;
+        frame = anim ? anim_wait(anim, now) : -1;
+        if (frame >= 0 && (Uint32)frame < wait) wait = frame;
+
         // Events
         SDL_Event event;
-        while (SDL_PollEvent(&event)) {
+        int have_event = SDL_WaitEventTimeout(&event, (int)wait);
+        while (have_event || SDL_PollEvent(&event)) {
+            have_event = 0;
+            if (slide_event && event.type == slide_event)
+                continue;   // handled by prefetch_pop at the top of the loop
+
             switch (event.type) {
                 case SDL_QUIT:
                     goto cleanup;
 
+                case SDL_WINDOWEVENT:
+                    dirty = 1;
+                    break;
+
                 case SDL_FINGERDOWN:
                 case SDL_MOUSEBUTTONDOWN:
                     ui_visible = 1;
-                    ui_show_time = SDL_GetTicks();
+                    sched_at(&sched, TIMER_UI_HIDE, SDL_GetTicks64() + UI_HIDE_DELAY_MS);
+                    dirty = 1;
                     break;
 
                 case SDL_JOYBUTTONDOWN:
                     switch (event.jbutton.button) {
                         case BTN_B:
                             goto cleanup;
+                        case BTN_L:
+                        case BTN_R:
+                            // L+R together toggles the perf overlay
+                            if (SDL_JoystickGetButton(joystick, BTN_L) &&
+                                SDL_JoystickGetButton(joystick, BTN_R))
+                                perf_visible = !perf_visible;
+                            if (!perf_visible) sched_cancel(&sched, TIMER_PERF);
+                            break;
+                        case BTN_Y:
+                            if (perf_visible) {
+                                int n = trace_dump(TRACE_PATH);
+                                if (n >= 0)
+                                    snprintf(fetch_status, sizeof(fetch_status),
+                                             "Trace saved (%d events)", n);
+                                else
+                                    snprintf(fetch_status, sizeof(fetch_status),
+                                             "Trace not saved");
+                            }
+                            break;
                         case BTN_PLUS:
-                            if (interval_mins < 1440) interval_mins++;
-                            ui_visible = 1;
-                            ui_show_time = SDL_GetTicks();
+                            interval_mins = sched_interval_step(interval_mins, 1);
+                            if (interval_mins > MAX_INTERVAL_MINS) interval_mins = MAX_INTERVAL_MINS;
+                            sched_retime(&sched, interval_mins);
+                            state_dirty = 1;
                             break;
                         case BTN_MINUS:
-                            if (interval_mins > 5) interval_mins--;
-                            ui_visible = 1;
-                            ui_show_time = SDL_GetTicks();
+                            interval_mins = sched_interval_step(interval_mins, -1);
+                            if (interval_mins < MIN_INTERVAL_MINS) interval_mins = MIN_INTERVAL_MINS;
+                            sched_retime(&sched, interval_mins);
+                            state_dirty = 1;
                             break;
                         case BTN_DLEFT:
-                            cat_index = (cat_index - 1 + NUM_CATEGORIES) % NUM_CATEGORIES;
-                            // Force immediate fetch of new category
+                            if (CONFIG.num_categories == 0) break;
+                            cat_index = (cat_index - 1 + CONFIG.num_categories) % CONFIG.num_categories;
+                            // Start loading the new category now, show it once the UI hides
+                            if (prefetcher) prefetch_set_category(prefetcher, cat_index);
+                            warm_categories(cat_index);
+                            awaiting_slide = 0;
                             pending_fetch = 1;
-                            ui_visible = 1;
-                            ui_show_time = SDL_GetTicks();
+                            state_dirty = 1;
                             break;
                         case BTN_DRIGHT:
-                            cat_index = (cat_index + 1) % NUM_CATEGORIES;
+                            if (CONFIG.num_categories == 0) break;
+                            cat_index = (cat_index + 1) % CONFIG.num_categories;
+                            if (prefetcher) prefetch_set_category(prefetcher, cat_index);
+                            warm_categories(cat_index);
+                            awaiting_slide = 0;
                             pending_fetch = 1;
-                            ui_visible = 1;
-                            ui_show_time = SDL_GetTicks();
+                            state_dirty = 1;
                             break;
                         default:
-                            ui_visible = 1;
-                            ui_show_time = SDL_GetTicks();
                             break;
                     }
+                    // Any button shows the HUD
+                    ui_visible = 1;
+                    sched_at(&sched, TIMER_UI_HIDE, SDL_GetTicks64() + UI_HIDE_DELAY_MS);
+                    dirty = 1;
                     break;
             }
         }
-
-        SDL_Delay(16);
     }
 
 cleanup:
-    if (current_image) SDL_DestroyTexture(current_image);
+    if (state_dirty) save_state(interval_mins, cat_index);
+    anim_close(anim);
+    prefetch_destroy(prefetcher);
+    fetcher_destroy(FETCHER);
+    thumbs_build_stop(thumb_builder);
+    stop_sync();
+    texpool_release(&TEXTURES, current_image);
+    texpool_release(&TEXTURES, previous_image);
+    texpool_free(&TEXTURES);
+    workpool_destroy(POOL);
+    for (int i = 0; i < WORKPOOL_MAX_THREADS; i++)
+        arena_free(&SLIDE_ARENAS[i]);
+    arena_free(&THUMB_ARENA);
+    SDL_DestroyMutex(PLAYLIST_LOCK);
+    text_destroy(text);
     if (font) TTF_CloseFont(font);
+    for (int i = 0; i < CONFIG.num_categories; i++) save_hashes(i);
+    free_categories(INDEXES, PLAYLISTS, PHASHES, CONFIG.num_categories);
+    config_free(&CONFIG);
     if (joystick) SDL_JoystickClose(joystick);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
+    cache_close(&CACHE);
+    SDL_DestroyMutex(CACHE_LOCK);
     curl_global_cleanup();
     TTF_Quit();
     IMG_Quit();
     SDL_Quit();
-    appletSetMediaPlaybackState(false);
-    appletExit();
-    socketExit();
-	fsdevUnmountDevice("sdmc");
-    romfsExit();
+    platform_exit();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,695 @@
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <curl/curl.h>
+
+#include "manifest.h"
+#include "platform.h"
+#include "util.h"
+
+#define LIST_FILE  "list"
+#define LIST_MAGIC "NXPhotoFrame manifest 1"
+
+typedef struct {
+    uint64_t    hash;
+    uint64_t    size;
+    const char *url;        // into the list text
+    char        ext[8];     // ".jpg", or "" to leave it to sniffing
+    bool        have;
+} Entry;
+
+typedef struct {
+    char  *text;            // the body, NUL-terminated; parsed in place
+    size_t size;
+    char   etag[128];
+    char   last_modified[64];
+    Entry *entries;         // sorted by hash, one per hash
+    int    count;
+} List;
+
+static void report(ManifestSync *ms, int i, const ManifestStatus *st, int changes);
+
+void manifest_dir(const char *url, char *out, size_t len) {
+    snprintf(out, len, "%s/%08x/", MANIFEST_DIR, (unsigned)fnv1a32(url));
+}
+
+// ---- the list ---------------------------------------------------------------
+
+static void list_free(List *l) {
+    free(l->text);
+    free(l->entries);
+    memset(l, 0, sizeof(*l));
+}
+
+static int cmp_entry(const void *a, const void *b) {
+    uint64_t x = ((const Entry *)a)->hash, y = ((const Entry *)b)->hash;
+    return x < y ? -1 : x > y;
+}
+
+// The url's extension, if it's a plausible one, for the file name
+static void url_ext(const char *url, char *out, size_t len) {
+    out[0] = 0;
+    size_t end = strcspn(url, "?#");
+    const char *dot = NULL;
+    for (size_t i = 0; i < end; i++) {
+        if (url[i] == '/') dot = NULL;
+        else if (url[i] == '.') dot = url + i;
+    }
+    if (!dot) return;
+    size_t n = url + end - dot - 1;
+    if (n < 1 || n > 5 || n + 2 > len) return;
+    out[0] = '.';
+    for (size_t i = 0; i < n; i++) {
+        char c = dot[1 + i];
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))) {
+            out[0] = 0;
+            return;
+        }
+        out[1 + i] = (char)(c | 0x20);
+    }
+    out[1 + n] = 0;
+}
+
+// Split l->text into entries. Lines that don't parse are skipped, as are
+// images too large to keep.
+static int list_parse(List *l) {
+    int cap = 0;
+    char *p = l->text, *end = l->text + l->size;
+    while (p < end) {
+        char *line = p;
+        char *nl = memchr(p, '\n', end - p);
+        p = nl ? nl + 1 : end;
+        if (nl) *nl = 0;
+        else *end = 0;
+
+        char *q = line;
+        while (*q == ' ' || *q == '\t') q++;
+        if (*q == 0 || *q == '#' || *q == '\r') continue;
+
+        char *after;
+        uint64_t size = strtoull(q, &after, 10);
+        if (after == q || (*after != ' ' && *after != '\t')) continue;
+        q = after;
+        while (*q == ' ' || *q == '\t') q++;
+        uint64_t hash = strtoull(q, &after, 16);
+        if (after - q != 16 || (*after != ' ' && *after != '\t')) continue;
+        q = after;
+        while (*q == ' ' || *q == '\t') q++;
+        char *url_end = q + strlen(q);
+        while (url_end > q && (url_end[-1] == '\r' || url_end[-1] == ' ' || url_end[-1] == '\t'))
+            url_end--;
+        *url_end = 0;
+        if (*q == 0 || size == 0 || size > MANIFEST_MAX_FILE) continue;
+
+        if (l->count == cap) {
+            int next = cap ? cap * 2 : 256;
+            Entry *grown = realloc(l->entries, (size_t)next * sizeof(Entry));
+            if (!grown) return -1;
+            l->entries = grown;
+            cap = next;
+        }
+        Entry *e = &l->entries[l->count++];
+        e->hash = hash;
+        e->size = size;
+        e->url  = q;
+        e->have = false;
+        url_ext(q, e->ext, sizeof(e->ext));
+    }
+
+    // The same image listed twice is kept once
+    qsort(l->entries, l->count, sizeof(Entry), cmp_entry);
+    int n = 0;
+    for (int i = 0; i < l->count; i++)
+        if (n == 0 || l->entries[i].hash != l->entries[n - 1].hash) l->entries[n++] = l->entries[i];
+    l->count = n;
+    return 0;
+}
+
+static Entry *list_find(const List *l, uint64_t hash) {
+    Entry key = { .hash = hash };
+    return bsearch(&key, l->entries, l->count, sizeof(Entry), cmp_entry);
+}
+
+// The last list fetched, with its validators
+static int list_load(List *l, const char *dir) {
+    char path[600];
+    snprintf(path, sizeof(path), "%s" LIST_FILE, dir);
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+    struct stat st;
+    char *data = NULL;
+    size_t size = 0;
+    if (fstat(fileno(f), &st) == 0 && st.st_size > 0 && st.st_size <= MANIFEST_MAX_LIST + 1024) {
+        size = (size_t)st.st_size;
+        data = malloc(size + 1);
+        if (data && fread(data, 1, size, f) != size) {
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(f);
+    if (!data) return -1;
+    data[size] = 0;
+
+    // Three header lines: the magic, ETag and Last-Modified
+    char *lines[3], *p = data;
+    for (int i = 0; i < 3; i++) {
+        char *nl = strchr(p, '\n');
+        if (!nl) {
+            free(data);
+            return -1;
+        }
+        *nl = 0;
+        lines[i] = p;
+        p = nl + 1;
+    }
+    if (strcmp(lines[0], LIST_MAGIC) != 0) {
+        free(data);
+        return -1;
+    }
+    snprintf(l->etag, sizeof(l->etag), "%s", lines[1]);
+    snprintf(l->last_modified, sizeof(l->last_modified), "%s", lines[2]);
+    l->size = size - (size_t)(p - data);
+    memmove(data, p, l->size + 1);
+    l->text = data;
+    return 0;
+}
+
+static int list_save(const List *l, const char *dir) {
+    char path[600], tmp[610];
+    snprintf(path, sizeof(path), "%s" LIST_FILE, dir);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "wb");
+    if (!f) return -1;
+    int ok = fprintf(f, "%s\n%s\n%s\n", LIST_MAGIC, l->etag, l->last_modified) > 0 &&
+             fwrite(l->text, 1, l->size, f) == l->size;
+    if (fclose(f) != 0) ok = 0;
+    if (!ok || replace_file(tmp, path) != 0) {
+        remove(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+// ---- transfers --------------------------------------------------------------
+
+static size_t list_write(char *data, size_t size, size_t nmemb, void *user) {
+    List *l = user;
+    size_t n = size * nmemb;
+    if (l->size + n > MANIFEST_MAX_LIST) return 0;
+    char *grown = realloc(l->text, l->size + n + 1);
+    if (!grown) return 0;
+    memcpy(grown + l->size, data, n);
+    l->text = grown;
+    l->size += n;
+    l->text[l->size] = 0;
+    return n;
+}
+
+// Copy a header's value if the line is that header
+static void header_value(const char *line, size_t len, const char *name, char *out,
+                         size_t out_len) {
+    size_t n = strlen(name);
+    if (len <= n || strncasecmp(line, name, n) != 0) return;
+    const char *v = line + n, *end = line + len;
+    while (v < end && (*v == ' ' || *v == '\t')) v++;
+    while (end > v && (end[-1] == '\r' || end[-1] == '\n' || end[-1] == ' ')) end--;
+    snprintf(out, out_len, "%.*s", (int)(end - v), v);
+}
+
+static size_t list_header(char *data, size_t size, size_t nmemb, void *user) {
+    List *l = user;
+    size_t n = size * nmemb;
+    header_value(data, n, "ETag:", l->etag, sizeof(l->etag));
+    header_value(data, n, "Last-Modified:", l->last_modified, sizeof(l->last_modified));
+    return n;
+}
+
+static int quit_progress(void *user, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal,
+                         curl_off_t ulnow) {
+    SDL_atomic_t *quit = user;
+    return quit && SDL_AtomicGet(quit);
+}
+
+static CURL *open_handle(SDL_atomic_t *quit) {
+    CURL *curl = curl_easy_init();
+    if (!curl) return NULL;
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 15L);
+    // No overall timeout for large images, but a stalled one is given up
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 64L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 30L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, "NXPhotoFrame/" APP_VERSION " (Nintendo Switch)");
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, quit_progress);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, quit);
+    return curl;
+}
+
+// Fetch the list if it changed since the copy in *l; *l is replaced by the
+// new one. 1 if it changed, 0 if not, -1 on failure.
+static int list_fetch(CURL *curl, const char *url, List *l, char *error, size_t error_len) {
+    struct curl_slist *headers = NULL;
+    char line[256];
+    if (l->text && l->etag[0]) {
+        snprintf(line, sizeof(line), "If-None-Match: %s", l->etag);
+        headers = curl_slist_append(headers, line);
+    }
+    if (l->text && l->last_modified[0]) {
+        snprintf(line, sizeof(line), "If-Modified-Since: %s", l->last_modified);
+        headers = curl_slist_append(headers, line);
+    }
+
+    List fresh;
+    memset(&fresh, 0, sizeof(fresh));
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, list_write);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &fresh);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, list_header);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &fresh);
+    curl_easy_setopt(curl, CURLOPT_RESUME_FROM_LARGE, (curl_off_t)0);
+    CURLcode res = curl_easy_perform(curl);
+    long code = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, NULL);
+    // With no header function, curl hands the headers to the write one
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, NULL);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, NULL);
+    curl_slist_free_all(headers);
+
+    if (res == CURLE_OK && code == 304 && l->text) {
+        list_free(&fresh);
+        return 0;
+    }
+    if (res != CURLE_OK || code != 200) {
+        if (res == CURLE_OK) snprintf(error, error_len, "Manifest: HTTP %ld", code);
+        else snprintf(error, error_len, "Manifest: %s", curl_easy_strerror(res));
+        list_free(&fresh);
+        return -1;
+    }
+    if (!fresh.text && !(fresh.text = calloc(1, 1))) return -1;   // an empty album
+    list_free(l);
+    *l = fresh;
+    return 1;
+}
+
+typedef struct {
+    FILE       *f;
+    uint64_t    have;       // bytes in the file
+    uint64_t    size;       // listed size
+    uint64_t   *bytes;      // received, for the status
+} Download;
+
+static size_t download_write(char *data, size_t size, size_t nmemb, void *user) {
+    Download *d = user;
+    size_t n = size * nmemb;
+    if (d->have + n > d->size || fwrite(data, 1, n, d->f) != n) return 0;
+    d->have += n;
+    *d->bytes += n;
+    return n;
+}
+
+static uint64_t file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (uint64_t)st.st_size : 0;
+}
+
+static bool file_matches(const char *path, uint64_t hash) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return false;
+    // fnv1a64() over the whole file, a block at a time
+    unsigned char buf[16384];
+    uint64_t h = 14695981039346656037ull;
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            h ^= buf[i];
+            h *= 1099511628211ull;
+        }
+    }
+    fclose(f);
+    return h == hash;
+}
+
+// The url of an entry, which may be relative to the manifest's
+static void entry_url(const char *base, const char *url, char *out, size_t len) {
+    if (strstr(url, "://")) {
+        snprintf(out, len, "%s", url);
+        return;
+    }
+    size_t keep;
+    if (url[0] == '/') {
+        // Scheme and host only
+        const char *host = strstr(base, "://");
+        host = host ? host + 3 : base;
+        keep = (size_t)(host - base) + strcspn(host, "/?#");
+    } else {
+        size_t path_end = strcspn(base, "?#");
+        keep = path_end;
+        while (keep > 0 && base[keep - 1] != '/') keep--;
+    }
+    snprintf(out, len, "%.*s%s", (int)keep, base, url);
+}
+
+// The last part of url's path, at most max bytes of it: enough to name an
+// image in st->error, which is too short for whole urls
+static int url_name(const char *url, int max, const char **name) {
+    int end = (int)strcspn(url, "?#");
+    int start = end;
+    while (start > 0 && url[start - 1] != '/') start--;
+    *name = url + start;
+    return end - start < max ? end - start : max;
+}
+
+// Download e into dir, going on from a .part left by an earlier sync
+static int download(CURL *curl, const char *base, const char *dir, const Entry *e,
+                    ManifestStatus *st) {
+    char part[600], dest[640], url[1024];
+    snprintf(part, sizeof(part), "%s%016llx.part", dir, (unsigned long long)e->hash);
+    snprintf(dest, sizeof(dest), "%s" MANIFEST_IMAGES "%016llx%s", dir,
+             (unsigned long long)e->hash, e->ext);
+    entry_url(base, e->url, url, sizeof(url));
+
+    Download d = { NULL, file_size(part), e->size, &st->bytes };
+    if (d.have > e->size) {
+        remove(part);
+        d.have = 0;
+    }
+    CURLcode res = CURLE_OK;
+    long code = 0;
+    for (int attempt = 0; d.have < e->size && attempt < 2; attempt++) {
+        d.f = fopen(part, d.have ? "ab" : "wb");
+        if (!d.f) {
+            snprintf(st->error, sizeof(st->error), "Can't write %016llx.part",
+                     (unsigned long long)e->hash);
+            return -1;
+        }
+        curl_easy_setopt(curl, CURLOPT_URL, url);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, download_write);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &d);
+        curl_easy_setopt(curl, CURLOPT_RESUME_FROM_LARGE, (curl_off_t)d.have);
+        res = curl_easy_perform(curl);
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+        if (fclose(d.f) != 0 && res == CURLE_OK) res = CURLE_WRITE_ERROR;
+
+        // A server that can't resume is asked for the whole file
+        if (res != CURLE_RANGE_ERROR || d.have == 0) break;
+        remove(part);
+        d.have = 0;
+    }
+
+    if (res == CURLE_OK && file_size(part) == e->size && file_matches(part, e->hash) &&
+        replace_file(part, dest) == 0)
+        return 0;
+
+    // Kept to go on from next time, unless it can't be right
+    if (res == CURLE_OK || code == 416 || d.have >= e->size) remove(part);
+    const char *name;
+    int name_len = url_name(url, 48, &name);
+    if (res == CURLE_OK || d.have >= e->size)
+        snprintf(st->error, sizeof(st->error), "%.*s didn't match the manifest", name_len, name);
+    else if (code >= 400)
+        snprintf(st->error, sizeof(st->error), "%.*s: HTTP %ld", name_len, name, code);
+    else
+        snprintf(st->error, sizeof(st->error), "%.*s: %s", name_len, name,
+                 curl_easy_strerror(res));
+    return -1;
+}
+
+// ---- sync -------------------------------------------------------------------
+
+// Hash of a file name written by download(), or false if it isn't one
+static bool name_hash(const char *name, const char *suffix, uint64_t *hash) {
+    char *end;
+    *hash = strtoull(name, &end, 16);
+    if (end - name != 16) return false;
+    return suffix ? strcmp(end, suffix) == 0 : (*end == 0 || *end == '.');
+}
+
+// Mark the entries already in the folder, delete the images no longer
+// listed and the parts of ones that are gone from the list. An image of
+// the wrong size is deleted only if the list was just fetched; against
+// the saved copy it stays up until its download replaces it.
+static void reconcile(const char *dir, List *l, bool fresh, ManifestStatus *st,
+                      ManifestSync *ms, int index) {
+    char images[600], path[900];
+    snprintf(images, sizeof(images), "%s" MANIFEST_IMAGES, dir);
+    DIR *d = opendir(images);
+    struct dirent *entry;
+    while (d && (entry = readdir(d)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        snprintf(path, sizeof(path), "%s%s", images, entry->d_name);
+        uint64_t hash;
+        Entry *e = name_hash(entry->d_name, NULL, &hash) ? list_find(l, hash) : NULL;
+        if (e && !e->have && file_size(path) == e->size) {
+            e->have = true;
+            st->have++;
+        } else if (e && !e->have && !fresh) {
+            continue;
+        } else if (remove(path) == 0) {
+            st->removed++;
+            report(ms, index, st, 1);
+        }
+    }
+    if (d) closedir(d);
+
+    d = opendir(dir);
+    while (d && (entry = readdir(d)) != NULL) {
+        uint64_t hash;
+        if (!name_hash(entry->d_name, ".part", &hash)) continue;
+        Entry *e = list_find(l, hash);
+        if (e && !e->have) continue;
+        snprintf(path, sizeof(path), "%s%s", dir, entry->d_name);
+        remove(path);
+    }
+    if (d) closedir(d);
+}
+
+static int sync_manifest(const char *url, const char *dir, ManifestStatus *st,
+                         SDL_atomic_t *quit, ManifestSync *ms, int index) {
+    memset(st, 0, sizeof(*st));
+    char images[600];
+    snprintf(images, sizeof(images), "%s" MANIFEST_IMAGES, dir);
+    mkdir(dir, 0777);
+    mkdir(images, 0777);
+
+    CURL *curl = open_handle(quit);
+    if (!curl) {
+        snprintf(st->error, sizeof(st->error), "Out of memory");
+        return -1;
+    }
+
+    List l;
+    memset(&l, 0, sizeof(l));
+    list_load(&l, dir);
+    int changed = list_fetch(curl, url, &l, st->error, sizeof(st->error));
+    st->unchanged = changed == 0;
+    // Saved before parsing, which cuts up the text; if it can't be, the
+    // next sync just gets the whole list again
+    if (changed > 0) list_save(&l, dir);
+    // An unreachable server leaves the folder as it was
+    if (changed < 0 || !l.text || list_parse(&l) != 0) {
+        if (!st->error[0]) snprintf(st->error, sizeof(st->error), "Out of memory");
+        list_free(&l);
+        curl_easy_cleanup(curl);
+        return -1;
+    }
+    st->listed = l.count;
+    reconcile(dir, &l, changed > 0, st, ms, index);
+    report(ms, index, st, 0);
+
+    for (int i = 0; i < l.count && !(quit && SDL_AtomicGet(quit)); i++) {
+        if (l.entries[i].have) continue;
+        if (download(curl, url, dir, &l.entries[i], st) == 0) {
+            st->have++;
+            st->added++;
+            report(ms, index, st, 1);
+        } else {
+            st->failed++;
+            report(ms, index, st, 0);
+        }
+    }
+    if (quit && SDL_AtomicGet(quit) && st->have < st->listed)
+        snprintf(st->error, sizeof(st->error), "Stopped");
+
+    list_free(&l);
+    curl_easy_cleanup(curl);
+    return st->have == st->listed ? 0 : -1;
+}
+
+int manifest_sync_once(const char *url, const char *dir, ManifestStatus *st,
+                       SDL_atomic_t *quit) {
+    return sync_manifest(url, dir, st, quit, NULL, 0);
+}
+
+// ---- background -------------------------------------------------------------
+
+typedef struct {
+    char          *url;
+    char          *dir;
+    ManifestStatus status;      // guarded by the lock
+    Uint32         due;         // SDL_GetTicks() when the next sync is due
+    Uint32         retry_ms;    // wait after the next failure
+} SyncItem;
+
+struct ManifestSync {
+    SDL_Thread  *thread;
+    SDL_mutex   *lock;
+    SDL_cond    *wake;
+    SDL_atomic_t quit;
+    SyncItem    *items;
+    int          count;
+};
+
+static void report(ManifestSync *ms, int i, const ManifestStatus *st, int changes) {
+    if (!ms) return;
+    SDL_LockMutex(ms->lock);
+    ManifestStatus *out = &ms->items[i].status;
+    int syncs = out->syncs, pending = out->changes;
+    *out = *st;
+    out->syncing = true;
+    out->syncs = syncs;
+    out->changes = pending + changes;
+    SDL_UnlockMutex(ms->lock);
+}
+
+static int sync_thread(void *arg) {
+    ManifestSync *ms = arg;
+    SDL_SetThreadPriority(SDL_THREAD_PRIORITY_LOW);
+    mkdir(MANIFEST_DIR, 0777);
+
+    SDL_LockMutex(ms->lock);
+    while (!SDL_AtomicGet(&ms->quit)) {
+        Uint32 now = SDL_GetTicks();
+        int next = -1;
+        Sint32 wait = MANIFEST_SYNC_MINS * 60000;
+        for (int i = 0; i < ms->count; i++) {
+            Sint32 left = (Sint32)(ms->items[i].due - now);
+            if (left < wait || next < 0) {
+                wait = left;
+                next = i;
+            }
+        }
+        if (next < 0 || wait > 0) {
+            SDL_CondWaitTimeout(ms->wake, ms->lock, next < 0 ? MANIFEST_RETRY_MS : (Uint32)wait);
+            continue;
+        }
+
+        SyncItem *it = &ms->items[next];
+        it->status.syncing = true;
+        SDL_UnlockMutex(ms->lock);
+        ManifestStatus st;
+        int rc;
+        if (platform_online(NULL)) {
+            rc = sync_manifest(it->url, it->dir, &st, &ms->quit, ms, next);
+        } else {
+            memset(&st, 0, sizeof(st));
+            snprintf(st.error, sizeof(st.error), "No internet connection");
+            rc = -1;
+        }
+        SDL_LockMutex(ms->lock);
+
+        // Keep the counts of the last sync that got the list
+        if (it->status.listed == 0 || st.listed > 0 || rc == 0) {
+            int syncs = it->status.syncs, pending = it->status.changes;
+            it->status = st;
+            it->status.syncs = syncs;
+            it->status.changes = pending;
+        } else {
+            snprintf(it->status.error, sizeof(it->status.error), "%s", st.error);
+        }
+        it->status.syncing = false;
+        it->status.syncs++;
+        if (rc == 0) {
+            it->retry_ms = MANIFEST_RETRY_MS;
+            it->due = SDL_GetTicks() + MANIFEST_SYNC_MINS * 60000u;
+        } else {
+            it->due = SDL_GetTicks() + it->retry_ms;
+            if (it->retry_ms < MANIFEST_SYNC_MINS * 60000u / 2) it->retry_ms *= 2;
+        }
+    }
+    SDL_UnlockMutex(ms->lock);
+    return 0;
+}
+
+ManifestSync *manifest_sync_start(const char *const *urls, const char *const *dirs, int count) {
+    if (count == 0) return NULL;
+    ManifestSync *ms = calloc(1, sizeof(ManifestSync));
+    if (!ms) return NULL;
+    ms->items = calloc(count, sizeof(SyncItem));
+    ms->lock  = SDL_CreateMutex();
+    ms->wake  = SDL_CreateCond();
+    bool ok = ms->items && ms->lock && ms->wake;
+    Uint32 now = SDL_GetTicks();
+    for (int i = 0; ok && i < count; i++) {
+        SyncItem *it = &ms->items[i];
+        it->url = strdup(urls[i]);
+        it->dir = strdup(dirs[i]);
+        it->due = now;
+        it->retry_ms = MANIFEST_RETRY_MS;
+        ms->count = i + 1;
+        ok = it->url && it->dir;
+    }
+    if (ok) ms->thread = SDL_CreateThread(sync_thread, "manifest", ms);
+    if (!ms->thread) {
+        manifest_sync_stop(ms);
+        return NULL;
+    }
+    return ms;
+}
+
+void manifest_sync_stop(ManifestSync *ms) {
+    if (!ms) return;
+    if (ms->thread) {
+        SDL_AtomicSet(&ms->quit, 1);
+        SDL_LockMutex(ms->lock);
+        SDL_CondSignal(ms->wake);
+        SDL_UnlockMutex(ms->lock);
+        SDL_WaitThread(ms->thread, NULL);
+    }
+    for (int i = 0; i < ms->count; i++) {
+        free(ms->items[i].url);
+        free(ms->items[i].dir);
+    }
+    free(ms->items);
+    if (ms->wake) SDL_DestroyCond(ms->wake);
+    if (ms->lock) SDL_DestroyMutex(ms->lock);
+    free(ms);
+}
+
+void manifest_sync_now(ManifestSync *ms) {
+    if (!ms) return;
+    SDL_LockMutex(ms->lock);
+    Uint32 now = SDL_GetTicks();
+    for (int i = 0; i < ms->count; i++) {
+        if ((Sint32)(ms->items[i].due - now) > 0) ms->items[i].due = now;
+        ms->items[i].retry_ms = MANIFEST_RETRY_MS;
+    }
+    SDL_CondSignal(ms->wake);
+    SDL_UnlockMutex(ms->lock);
+}
+
+void manifest_sync_status(ManifestSync *ms, int i, ManifestStatus *out) {
+    if (!ms || i < 0 || i >= ms->count) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    SDL_LockMutex(ms->lock);
+    *out = ms->items[i].status;
+    SDL_UnlockMutex(ms->lock);
+}
+
+void manifest_sync_seen(ManifestSync *ms, int i, int changes) {
+    if (!ms || i < 0 || i >= ms->count) return;
+    SDL_LockMutex(ms->lock);
+    ms->items[i].status.changes -= changes;
+    SDL_UnlockMutex(ms->lock);
+}
@@ -0,0 +1,83 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+#include "config.h"
+
+// Manifest categories, `Name = manifest://https://example.com/album.txt`
+// in [Categories]: the server lists an album's images once, and they're
+// downloaded to the SD card and shown from there like a local folder.
+//
+// The manifest is plain text, one image per line:
+//     <size> <hash> <url>
+// size in bytes, hash the 64-bit FNV-1a of the file in 16 hex digits (as
+// the download cache names its blobs), url absolute or relative to the
+// manifest's. Blank lines and lines starting with '#' are skipped.
+//
+// Each manifest has a folder under MANIFEST_DIR with the last list, its
+// ETag and Last-Modified, any half-downloaded files, and the images in an
+// images/ subfolder, named by hash. A sync is one conditional GET of the
+// list, which for an album that hasn't changed is a 304 and nothing else,
+// then a download of each listed image that isn't in the folder yet and
+// a delete of each one no longer listed. Downloads go to a .part file
+// that the next sync continues with a Range request, so an interrupted
+// one picks up where it stopped, and only go into images/ once their
+// size and hash check out.
+//
+// A thread of its own syncs every manifest category at start and then
+// every MANIFEST_SYNC_MINS, sooner after a failure.
+
+#define MANIFEST_DIR       CONFIG_DIR "/manifest"
+#define MANIFEST_IMAGES    "images/"
+#define MANIFEST_SYNC_MINS 60
+#define MANIFEST_MAX_LIST  (8 * 1024 * 1024)    // bytes of list
+#define MANIFEST_MAX_FILE  (64 * 1024 * 1024)   // larger images are left out
+#define MANIFEST_RETRY_MS  (60 * 1000)          // first retry; doubles to the sync interval
+
+typedef struct {
+    int      listed;        // distinct images in the list
+    int      have;          // of those, in the folder
+    int      added;         // downloaded by this sync
+    int      removed;       // deleted as no longer listed
+    int      failed;        // downloads that failed or didn't match
+    uint64_t bytes;         // downloaded by this sync, resumed parts included
+    bool     unchanged;     // the list came back 304
+    char     error[128];    // why the sync stopped short, "" if it didn't
+
+    // Background syncing only
+    bool     syncing;       // these are of a sync still running
+    int      syncs;         // finished, successfully or not
+    int      changes;       // images added or removed, not yet seen
+} ManifestStatus;
+
+// Sync folder of the manifest at url, with a trailing '/'
+void manifest_dir(const char *url, char *out, size_t len);
+
+// One sync of the manifest at url into dir, blocking. Gives up between
+// (and during) downloads once *quit is set, if quit isn't NULL. 0 if
+// everything listed is now in the folder, -1 if not (see st->error).
+int manifest_sync_once(const char *url, const char *dir, ManifestStatus *st,
+                       SDL_atomic_t *quit);
+
+// Background syncing of count manifests, urls[i] into dirs[i]
+typedef struct ManifestSync ManifestSync;
+
+ManifestSync *manifest_sync_start(const char *const *urls, const char *const *dirs, int count);
+// Stops a sync in progress (between reads) and waits for the thread
+void manifest_sync_stop(ManifestSync *ms);
+
+// Sync every manifest now, e.g. after coming back online
+void manifest_sync_now(ManifestSync *ms);
+
+// Status of manifest i, updated as each image lands
+void manifest_sync_status(ManifestSync *ms, int i, ManifestStatus *out);
+
+// The folder of manifest i was rescanned after changes (as reported by
+// manifest_sync_status) were made
+void manifest_sync_seen(ManifestSync *ms, int i, int changes);
+
+#endif
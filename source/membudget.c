@@ -0,0 +1,193 @@
+#include <malloc.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "membudget.h"
+
+#define ARENA_ALIGN  16
+#define ARENA_HEADER 16     // holds the previous allocation's offset
+#define ARENA_NONE   SIZE_MAX
+
+// The arena the current thread decodes into, if any
+static __thread Arena *SCRATCH;
+
+int arena_init(Arena *a, size_t size) {
+    memset(a, 0, sizeof(*a));
+    a->last = ARENA_NONE;
+    if (size == 0) return 0;
+    a->base = malloc(size);
+    if (!a->base) return -1;
+    a->size = size;
+    return 0;
+}
+
+void arena_free(Arena *a) {
+    free(a->base);
+    memset(a, 0, sizeof(*a));
+    a->last = ARENA_NONE;
+}
+
+void scratch_begin(Arena *a) {
+    SCRATCH = a;
+    if (a) {
+        a->used = 0;
+        a->last = ARENA_NONE;
+    }
+}
+
+// NULL if the thread has no arena or it's full
+static void *arena_take(size_t size) {
+    Arena *a = SCRATCH;
+    if (!a || !a->base) return NULL;
+
+    size_t off = (a->used + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (off > a->size || ARENA_HEADER > a->size - off || size > a->size - off - ARENA_HEADER) {
+        a->overflows++;
+        return NULL;
+    }
+    memcpy(a->base + off, &a->last, sizeof(size_t));
+    a->last = off;
+    a->used = off + ARENA_HEADER + size;
+    if (a->used > a->high_water) a->high_water = a->used;
+    return a->base + off + ARENA_HEADER;
+}
+
+void *scratch_alloc(size_t size) {
+    void *p = arena_take(size);
+    return p ? p : malloc(size);
+}
+
+bool scratch_owns(const void *p) {
+    const Arena *a = SCRATCH;
+    return a && a->base && (const unsigned char *)p >= a->base &&
+           (const unsigned char *)p < a->base + a->size;
+}
+
+void scratch_free(void *p) {
+    if (!p) return;
+    if (!scratch_owns(p)) {
+        free(p);
+        return;
+    }
+    // Only the newest allocation can be given back before the next begin
+    Arena *a = SCRATCH;
+    if (a->last != ARENA_NONE && (unsigned char *)p == a->base + a->last + ARENA_HEADER) {
+        a->used = a->last;
+        memcpy(&a->last, a->base + a->last, sizeof(size_t));
+    }
+}
+
+SDL_Surface *scratch_surface(int w, int h, Uint32 format) {
+    int bpp = SDL_BYTESPERPIXEL(format);
+    int pitch = (w * bpp + 3) & ~3;
+    void *pixels = w > 0 && h > 0 ? arena_take((size_t)pitch * h) : NULL;
+    if (!pixels)
+        return SDL_CreateRGBSurfaceWithFormat(0, w, h, SDL_BITSPERPIXEL(format), format);
+
+    SDL_Surface *s = SDL_CreateRGBSurfaceWithFormatFrom(pixels, w, h, SDL_BITSPERPIXEL(format),
+                                                        pitch, format);
+    if (!s) scratch_free(pixels);
+    return s;
+}
+
+int texpool_init(TexturePool *p, SDL_Renderer *renderer, int count, int w, int h) {
+    memset(p, 0, sizeof(*p));
+    if (count > TEXPOOL_MAX) count = TEXPOOL_MAX;
+    p->w = w;
+    p->h = h;
+    for (int i = 0; i < count; i++) {
+        SDL_Texture *t = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32,
+                                           SDL_TEXTUREACCESS_STREAMING, w, h);
+        if (!t) break;
+        SDL_SetTextureBlendMode(t, SDL_BLENDMODE_BLEND);
+        p->textures[p->count++] = t;
+    }
+    return p->count;
+}
+
+void texpool_free(TexturePool *p) {
+    for (int i = 0; i < p->count; i++)
+        SDL_DestroyTexture(p->textures[i]);
+    memset(p, 0, sizeof(*p));
+}
+
+// Convert straight into the texture's staging memory, then repeat the last
+// column and row once so linear filtering at the edge of the slide never
+// picks up what an earlier, larger slide left behind
+static int upload(const TexturePool *p, SDL_Texture *texture, SDL_Surface *s) {
+    SDL_Rect area = { 0, 0, s->w < p->w ? s->w + 1 : s->w, s->h < p->h ? s->h + 1 : s->h };
+    void *pixels;
+    int pitch;
+    if (SDL_LockTexture(texture, &area, &pixels, &pitch) != 0) return -1;
+
+    if (SDL_MUSTLOCK(s)) SDL_LockSurface(s);
+    int rc = SDL_ConvertPixels(s->w, s->h, s->format->format, s->pixels, s->pitch,
+                               SDL_PIXELFORMAT_RGBA32, pixels, pitch);
+    if (SDL_MUSTLOCK(s)) SDL_UnlockSurface(s);
+
+    if (rc == 0) {
+        unsigned char *row = pixels;
+        if (area.w > s->w)
+            for (int y = 0; y < s->h; y++, row += pitch)
+                memcpy(row + s->w * 4, row + (s->w - 1) * 4, 4);
+        if (area.h > s->h)
+            memcpy((unsigned char *)pixels + (size_t)s->h * pitch,
+                   (unsigned char *)pixels + (size_t)(s->h - 1) * pitch, (size_t)area.w * 4);
+    }
+    SDL_UnlockTexture(texture);
+    return rc;
+}
+
+SDL_Texture *texpool_upload(TexturePool *p, SDL_Renderer *renderer, SDL_Surface *surface,
+                            SDL_Rect *src) {
+    src->x = 0;
+    src->y = 0;
+    src->w = surface->w;
+    src->h = surface->h;
+
+    int slot = -1;
+    if (surface->w <= p->w && surface->h <= p->h)
+        for (int i = 0; i < p->count && slot < 0; i++)
+            if (!p->in_use[i]) slot = i;
+
+    if (slot >= 0) {
+        // SDL_ConvertPixels can't expand palettes
+        SDL_Surface *s = surface;
+        if (SDL_ISPIXELFORMAT_INDEXED(surface->format->format))
+            s = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA32, 0);
+        int rc = s ? upload(p, p->textures[slot], s) : -1;
+        if (s && s != surface) SDL_FreeSurface(s);
+
+        if (rc == 0) {
+            p->in_use[slot] = true;
+            p->uploads++;
+            int used = 0;
+            for (int i = 0; i < p->count; i++) used += p->in_use[i];
+            if (used > p->high_water) p->high_water = used;
+            return p->textures[slot];
+        }
+    }
+
+    p->fallbacks++;
+    return SDL_CreateTextureFromSurface(renderer, surface);
+}
+
+void texpool_release(TexturePool *p, SDL_Texture *texture) {
+    if (!texture) return;
+    for (int i = 0; i < p->count; i++) {
+        if (p->textures[i] == texture) {
+            p->in_use[i] = false;
+            return;
+        }
+    }
+    SDL_DestroyTexture(texture);
+}
+
+size_t heap_in_use(void) {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    return mallinfo2().uordblks;
+#else
+    return (size_t)mallinfo().uordblks;
+#endif
+}
@@ -0,0 +1,73 @@
+#ifndef MEMBUDGET_H
+#define MEMBUDGET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <SDL2/SDL.h>
+
+// Keeps the heap steady over weeks of slides.
+//
+// Decoders take their short-lived buffers (the full-size JPEG output,
+// scaler rows, thumbnail file data) from a scratch arena: one block
+// allocated at startup per decoding thread and rewound before every
+// load, so those multi-megabyte buffers never go back to the heap.
+// Slides are uploaded into a fixed pool of screen-sized streaming
+// textures instead of a new texture per slide.
+
+typedef struct {
+    unsigned char *base;
+    size_t   size;
+    size_t   used;
+    size_t   last;          // offset of the newest allocation, for rewinding it
+    size_t   high_water;    // most ever in use at once
+    unsigned overflows;     // requests that didn't fit and went to the heap
+} Arena;
+
+int  arena_init(Arena *a, size_t size);
+void arena_free(Arena *a);
+
+// Make arena the calling thread's scratch space and empty it. Anything
+// allocated from it before is gone.
+void scratch_begin(Arena *a);
+
+// 16-byte aligned. Comes from the heap when the thread has no arena or the
+// arena is full, so callers always pair it with scratch_free().
+void *scratch_alloc(size_t size);
+// Frees heap fallbacks; arena memory is only reclaimed if it's the newest
+// allocation (or on the next scratch_begin)
+void  scratch_free(void *p);
+bool  scratch_owns(const void *p);
+
+// A surface whose pixels are scratch memory when there's room, else an
+// ordinary one. Either way SDL_FreeSurface() it, and don't keep it past
+// the current load.
+SDL_Surface *scratch_surface(int w, int h, Uint32 format);
+
+#define TEXPOOL_MAX 4
+
+typedef struct {
+    SDL_Texture *textures[TEXPOOL_MAX];
+    bool     in_use[TEXPOOL_MAX];
+    int      count;
+    int      w, h;
+    int      high_water;    // most textures in use at once
+    unsigned uploads;
+    unsigned fallbacks;     // slides that didn't fit and got their own texture
+} TexturePool;
+
+// count streaming RGBA textures of w x h. Returns the number created.
+int  texpool_init(TexturePool *p, SDL_Renderer *renderer, int count, int w, int h);
+void texpool_free(TexturePool *p);
+
+// Copy surface into a free pool texture, at the top left; *src is set to
+// the part it covers. Falls back to a texture of its own when the surface
+// is too large or the pool is empty. NULL on failure.
+SDL_Texture *texpool_upload(TexturePool *p, SDL_Renderer *renderer, SDL_Surface *surface,
+                            SDL_Rect *src);
+// Give a texture from texpool_upload() back (or destroy a fallback one)
+void texpool_release(TexturePool *p, SDL_Texture *texture);
+
+// Bytes of malloc heap currently handed out, for the perf overlay
+size_t heap_in_use(void);
+
+#endif
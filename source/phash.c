@@ -0,0 +1,391 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PHASH_NEON 1
+#endif
+
+#include "phash.h"
+#include "util.h"
+
+#define PHASH_MAGIC   "NXPH"
+#define PHASH_VERSION 1
+
+#define GRID_W 9
+#define GRID_H 8
+#define NONE   0xFFFFFFFFu
+
+typedef struct {
+    char     magic[4];
+    uint32_t version;
+    uint32_t fit;
+    uint32_t count;
+} PhashHeader;
+
+typedef struct PhashRecord {
+    uint64_t key;       // fnv1a64 of the path relative to the root
+    uint64_t hash;
+    uint32_t stamp;
+    uint32_t reserved;
+} PhashRecord;
+
+// ---- hashing ----------------------------------------------------------------
+
+// Sum of the brightness, (77 R + 150 G + 29 B) / 256, of n pixels of bpp
+// bytes with the channels at byte offsets r, g and b
+static uint32_t luma_sum(const uint8_t *p, int n, int bpp, int r, int g, int b) {
+    uint32_t sum = 0;
+    int i = 0;
+#ifdef PHASH_NEON
+    uint32x4_t acc = vdupq_n_u32(0);
+    const uint8x8_t wr = vdup_n_u8(77), wg = vdup_n_u8(150), wb = vdup_n_u8(29);
+    if (bpp == 4) {
+        for (; i + 8 <= n; i += 8, p += 32) {
+            uint8x8x4_t v = vld4_u8(p);
+            uint16x8_t y = vmull_u8(v.val[r], wr);
+            y = vmlal_u8(y, v.val[g], wg);
+            y = vmlal_u8(y, v.val[b], wb);
+            acc = vpadalq_u16(acc, vshrq_n_u16(y, 8));
+        }
+    } else {
+        for (; i + 8 <= n; i += 8, p += 24) {
+            uint8x8x3_t v = vld3_u8(p);
+            uint16x8_t y = vmull_u8(v.val[r], wr);
+            y = vmlal_u8(y, v.val[g], wg);
+            y = vmlal_u8(y, v.val[b], wb);
+            acc = vpadalq_u16(acc, vshrq_n_u16(y, 8));
+        }
+    }
+    sum = vgetq_lane_u32(acc, 0) + vgetq_lane_u32(acc, 1) +
+          vgetq_lane_u32(acc, 2) + vgetq_lane_u32(acc, 3);
+#endif
+    for (; i < n; i++, p += bpp) sum += (77u * p[r] + 150u * p[g] + 29u * p[b]) >> 8;
+    return sum;
+}
+
+uint64_t phash_surface(SDL_Surface *s) {
+    const SDL_PixelFormat *fmt = s->format;
+    int bpp = fmt->BytesPerPixel, r, g, b;
+    SDL_Surface *converted = NULL;
+    // Byte order in memory; the Switch is little-endian
+    if (fmt->format == SDL_PIXELFORMAT_RGBA32 || fmt->format == SDL_PIXELFORMAT_RGB24) {
+        r = 0, g = 1, b = 2;
+    } else if (fmt->format == SDL_PIXELFORMAT_ARGB8888) {
+        r = 2, g = 1, b = 0;
+    } else {
+        converted = SDL_ConvertSurfaceFormat(s, SDL_PIXELFORMAT_RGBA32, 0);
+        if (!converted) return 0;
+        s = converted;
+        bpp = 4, r = 0, g = 1, b = 2;
+    }
+
+    // Images smaller than the grid have nothing to compare
+    uint64_t hash = 0;
+    if (s->w >= GRID_W && s->h >= GRID_H) {
+        int x0[GRID_W + 1];
+        for (int c = 0; c <= GRID_W; c++) x0[c] = c * s->w / GRID_W;
+        uint64_t sum[GRID_H][GRID_W] = {{0}};
+
+        if (SDL_MUSTLOCK(s)) SDL_LockSurface(s);
+        for (int y = 0; y < s->h; y++) {
+            const uint8_t *row = (const uint8_t *)s->pixels + (size_t)y * s->pitch;
+            int cy = (int)((int64_t)y * GRID_H / s->h);
+            for (int c = 0; c < GRID_W; c++)
+                sum[cy][c] += luma_sum(row + (size_t)x0[c] * bpp, x0[c + 1] - x0[c], bpp, r, g, b);
+        }
+        if (SDL_MUSTLOCK(s)) SDL_UnlockSurface(s);
+
+        // Cells in a row are equally tall, so compare sums scaled by the
+        // other cell's width rather than dividing
+        for (int cy = 0; cy < GRID_H; cy++) {
+            for (int c = 0; c < GRID_W - 1; c++) {
+                uint64_t left  = sum[cy][c] * (uint64_t)(x0[c + 2] - x0[c + 1]);
+                uint64_t right = sum[cy][c + 1] * (uint64_t)(x0[c + 1] - x0[c]);
+                hash = hash << 1 | (left > right);
+            }
+        }
+    }
+    SDL_FreeSurface(converted);
+    return hash;
+}
+
+uint32_t phash_stamp(uint64_t size, int64_t mtime) {
+    uint64_t v[2] = { size, (uint64_t)mtime };
+    uint64_t h = fnv1a64(v, sizeof(v));
+    uint32_t stamp = (uint32_t)(h ^ (h >> 32));
+    return stamp ? stamp : 1;
+}
+
+// ---- index ------------------------------------------------------------------
+
+static inline uint32_t chunk(uint64_t hash, int t) {
+    return (uint32_t)(hash >> (16 * t)) & 0xffff;
+}
+
+int phash_index_init(PhashIndex *ix, uint32_t count) {
+    memset(ix, 0, sizeof(*ix));
+    uint32_t buckets = 64;
+    while (buckets < count / 2 && buckets < 65536) buckets *= 2;
+    size_t n = count ? count : 1;
+
+    ix->hash   = malloc(n * sizeof(uint64_t));
+    ix->stamp  = calloc(n, sizeof(uint32_t));
+    ix->parent = malloc(n * sizeof(uint32_t));
+    ix->linked = calloc(n, 1);
+    bool ok = ix->hash && ix->stamp && ix->parent && ix->linked;
+    for (int t = 0; t < PHASH_CHUNKS; t++) {
+        ix->head[t] = malloc(buckets * sizeof(uint32_t));
+        ix->next[t] = malloc(n * sizeof(uint32_t));
+        ok = ok && ix->head[t] && ix->next[t];
+    }
+    if (!ok) {
+        phash_index_free(ix);
+        return -1;
+    }
+
+    ix->count = count;
+    ix->mask  = buckets - 1;
+    for (uint32_t i = 0; i < count; i++) ix->parent[i] = i;
+    for (int t = 0; t < PHASH_CHUNKS; t++) memset(ix->head[t], 0xff, buckets * sizeof(uint32_t));
+    return 0;
+}
+
+void phash_index_free(PhashIndex *ix) {
+    free(ix->hash);
+    free(ix->stamp);
+    free(ix->parent);
+    free(ix->linked);
+    for (int t = 0; t < PHASH_CHUNKS; t++) {
+        free(ix->head[t]);
+        free(ix->next[t]);
+    }
+    memset(ix, 0, sizeof(*ix));
+}
+
+typedef void (*Visit)(void *ctx, uint32_t item);
+
+// Each linked item in one bucket of table t that has a chunk within slack
+// bits of the hash's there, and isn't in reach in an earlier table
+static uint32_t scan_bucket(const PhashIndex *ix, int t, uint32_t bucket, uint64_t hash,
+                            int radius, int slack, Visit visit, void *ctx) {
+    uint32_t found = 0;
+    for (uint32_t i = ix->head[t][bucket]; i != NONE; i = ix->next[t][i]) {
+        uint64_t other = ix->hash[i];
+        // Buckets only tell the low bits apart
+        if (__builtin_popcount(chunk(other, t) ^ chunk(hash, t)) > slack) continue;
+        bool earlier = false;
+        for (int e = 0; e < t && !earlier; e++)
+            earlier = __builtin_popcount(chunk(other, e) ^ chunk(hash, e)) <= slack;
+        if (earlier || phash_distance(hash, other) > radius) continue;
+        if (visit) visit(ctx, i);
+        found++;
+    }
+    return found;
+}
+
+static uint32_t search(const PhashIndex *ix, uint64_t hash, int radius, Visit visit, void *ctx) {
+    if (radius > PHASH_MAX_RADIUS) radius = PHASH_MAX_RADIUS;
+    int slack = radius / PHASH_CHUNKS;
+    int bits = __builtin_popcount(ix->mask);
+    uint32_t found = 0;
+
+    // Every bucket within slack bits of the hash's; flipping a bit above
+    // the mask lands in the same bucket, which is scanned anyway
+    for (int t = 0; t < PHASH_CHUNKS; t++) {
+        uint32_t key = chunk(hash, t) & ix->mask;
+        found += scan_bucket(ix, t, key, hash, radius, slack, visit, ctx);
+        for (int i = 0; i < bits && slack >= 1; i++) {
+            found += scan_bucket(ix, t, key ^ (1u << i), hash, radius, slack, visit, ctx);
+            for (int j = i + 1; j < bits && slack >= 2; j++)
+                found += scan_bucket(ix, t, key ^ (1u << i) ^ (1u << j), hash, radius, slack,
+                                     visit, ctx);
+        }
+    }
+    return found;
+}
+
+typedef struct {
+    uint32_t *out;
+    uint32_t  max, n;
+} Collect;
+
+static void collect(void *ctx, uint32_t item) {
+    Collect *c = ctx;
+    if (c->n < c->max) c->out[c->n] = item;
+    c->n++;
+}
+
+uint32_t phash_index_near(const PhashIndex *ix, uint64_t hash, int radius,
+                          uint32_t *out, uint32_t max) {
+    Collect c = { out, max, 0 };
+    return search(ix, hash, radius, collect, &c);
+}
+
+static uint32_t find(PhashIndex *ix, uint32_t item) {
+    while (ix->parent[item] != item) {
+        ix->parent[item] = ix->parent[ix->parent[item]];   // path halving
+        item = ix->parent[item];
+    }
+    return item;
+}
+
+uint32_t phash_index_group(PhashIndex *ix, uint32_t item) {
+    return item < ix->count ? find(ix, item) : item;
+}
+
+typedef struct {
+    PhashIndex *ix;
+    uint32_t    item;
+} Join;
+
+static void join(void *ctx, uint32_t other) {
+    Join *j = ctx;
+    uint32_t a = find(j->ix, j->item), b = find(j->ix, other);
+    if (a < b) j->ix->parent[b] = a;
+    else if (b < a) j->ix->parent[a] = b;
+}
+
+static void link_item(PhashIndex *ix, uint32_t item) {
+    Join j = { ix, item };
+    search(ix, ix->hash[item], PHASH_NEAR, join, &j);
+    for (int t = 0; t < PHASH_CHUNKS; t++) {
+        uint32_t bucket = chunk(ix->hash[item], t) & ix->mask;
+        ix->next[t][item] = ix->head[t][bucket];
+        ix->head[t][bucket] = item;
+    }
+    ix->linked[item] = 1;
+}
+
+static void unlink_item(PhashIndex *ix, uint32_t item) {
+    for (int t = 0; t < PHASH_CHUNKS; t++) {
+        uint32_t *p = &ix->head[t][chunk(ix->hash[item], t) & ix->mask];
+        while (*p != item) p = &ix->next[t][*p];
+        *p = ix->next[t][item];
+    }
+    ix->linked[item] = 0;
+}
+
+bool phash_index_check(PhashIndex *ix, uint32_t item, uint32_t stamp) {
+    if (item >= ix->count || stamp == 0 || ix->stamp[item] != stamp) return false;
+    if (!ix->linked[item]) link_item(ix, item);
+    return true;
+}
+
+void phash_index_set(PhashIndex *ix, uint32_t item, uint64_t hash, uint32_t stamp) {
+    if (item >= ix->count || stamp == 0) return;
+    ix->unsaved++;
+    if (ix->linked[item]) {
+        if (ix->hash[item] == hash) {
+            ix->stamp[item] = stamp;
+            return;
+        }
+        unlink_item(ix, item);
+    }
+    if (ix->stamp[item] == 0) ix->hashed++;
+    ix->hash[item]  = hash;
+    ix->stamp[item] = stamp;
+    link_item(ix, item);
+}
+
+// ---- load / save ------------------------------------------------------------
+
+static uint64_t path_key(const ImageIndex *idx, uint32_t i) {
+    const char *rel = index_relpath(idx, i);
+    return fnv1a64(rel, strlen(rel));
+}
+
+static int cmp_record(const void *a, const void *b) {
+    uint64_t x = ((const PhashRecord *)a)->key, y = ((const PhashRecord *)b)->key;
+    return x < y ? -1 : x > y;
+}
+
+int phash_index_load(PhashIndex *ix, const ImageIndex *idx, int fit, const char *path) {
+    if (phash_index_init(ix, idx->num_files) != 0) return -1;
+
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+    PhashHeader h;
+    PhashRecord *records = NULL;
+    bool ok = fread(&h, sizeof(h), 1, f) == 1 && memcmp(h.magic, PHASH_MAGIC, 4) == 0 &&
+              h.version == PHASH_VERSION && h.fit == (uint32_t)fit;
+    if (ok && h.count) {
+        records = malloc((size_t)h.count * sizeof(PhashRecord));
+        ok = records && fread(records, sizeof(PhashRecord), h.count, f) == h.count;
+    }
+    fclose(f);
+    if (!ok) {
+        free(records);
+        return -1;
+    }
+
+    // Grouped as the thumbnail builder checks each one, see phash_index_check()
+    for (uint32_t i = 0; i < ix->count && h.count; i++) {
+        PhashRecord key = { .key = path_key(idx, i) };
+        const PhashRecord *r = bsearch(&key, records, h.count, sizeof(PhashRecord), cmp_record);
+        if (!r || r->stamp == 0) continue;
+        ix->hash[i]  = r->hash;
+        ix->stamp[i] = r->stamp;
+        ix->hashed++;
+    }
+    free(records);
+    return 0;
+}
+
+int phash_index_snapshot(PhashIndex *ix, const ImageIndex *idx, PhashSnapshot *out) {
+    if (ix->count != idx->num_files) return -1;
+    PhashRecord *records = malloc((ix->hashed ? ix->hashed : 1) * sizeof(PhashRecord));
+    if (!records) return -1;
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < ix->count && n < ix->hashed; i++) {
+        if (ix->stamp[i] == 0) continue;
+        PhashRecord r = { path_key(idx, i), ix->hash[i], ix->stamp[i], 0 };
+        records[n++] = r;
+    }
+    out->records = records;
+    out->count   = n;
+    out->unsaved = ix->unsaved;
+    ix->unsaved  = 0;
+    return 0;
+}
+
+int phash_snapshot_write(PhashSnapshot *snap, int fit, const char *path) {
+    PhashRecord *records = snap->records;
+    uint32_t n = snap->count;
+    snap->records = NULL;
+    qsort(records, n, sizeof(PhashRecord), cmp_record);
+
+    char tmp[520];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "wb");
+    if (!f) {
+        free(records);
+        return -1;
+    }
+    PhashHeader h;
+    memcpy(h.magic, PHASH_MAGIC, 4);
+    h.version = PHASH_VERSION;
+    h.fit     = (uint32_t)fit;
+    h.count   = n;
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+              fwrite(records, sizeof(PhashRecord), n, f) == n;
+    if (fclose(f) != 0) ok = false;
+    free(records);
+
+    if (!ok || replace_file(tmp, path) != 0) {
+        remove(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+int phash_index_save(PhashIndex *ix, const ImageIndex *idx, int fit, const char *path) {
+    PhashSnapshot snap;
+    if (phash_index_snapshot(ix, idx, &snap) != 0) return -1;
+    if (phash_snapshot_write(&snap, fit, path) != 0) {
+        ix->unsaved += snap.unsaved;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,100 @@
+#ifndef PHASH_H
+#define PHASH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+#include "imageindex.h"
+
+// Perceptual hashes of local slides, to tell near-duplicates (burst shots,
+// a screenshot taken twice, a photo saved again smaller) from different
+// pictures.
+//
+// The hash is a dHash: the image is averaged down to a 9x8 grid of
+// brightness and each of the 64 bits says whether a cell is brighter than
+// the one to its right. Scaling, recompression and small changes of
+// exposure hardly move it; unrelated pictures differ in about half the
+// bits.
+//
+// A PhashIndex holds the hashes of one category, parallel to its image
+// index, and groups the images that are within PHASH_NEAR bits of each
+// other. Lookups use multi-index hashing: each hash is split into four
+// 16-bit chunks with a table each, and two hashes within r bits have some
+// chunk within r / 4 bits of the other, so a lookup probes a few dozen
+// buckets rather than comparing every image. Adding a hash is one lookup
+// and four list insertions, so groups stay current as hashes come in.
+
+// Images this many bits apart or closer count as one shot
+#define PHASH_NEAR 7
+// Largest radius phash_index_near() can search
+#define PHASH_MAX_RADIUS 11
+
+#define PHASH_CHUNKS 4
+
+// dHash of s, which may be any format; RGBA32, ARGB8888 and RGB24 are read
+// directly (with NEON on the Switch), anything else is converted first
+uint64_t phash_surface(SDL_Surface *s);
+
+static inline int phash_distance(uint64_t a, uint64_t b) {
+    return __builtin_popcountll(a ^ b);
+}
+
+// Identifies the version of a file a hash was taken from; never 0
+uint32_t phash_stamp(uint64_t size, int64_t mtime);
+
+typedef struct {
+    uint32_t  count;        // images, as in the category's index
+    uint64_t *hash;
+    uint32_t *stamp;        // file version hashed, 0 if none
+    uint32_t *parent;       // union-find; a group is named by its lowest item
+    uint8_t  *linked;       // in the lookup tables and grouped
+    uint32_t *head[PHASH_CHUNKS];   // first item in each bucket
+    uint32_t *next[PHASH_CHUNKS];   // next item in the same bucket
+    uint32_t  mask;         // buckets - 1, a power of two up to 65536
+    uint32_t  hashed;       // items with a hash
+    uint32_t  unsaved;      // hashes set since loaded or saved
+} PhashIndex;
+
+// Room for count images, none hashed. -1 if out of memory, leaving an
+// empty (but usable) index.
+int  phash_index_init(PhashIndex *ix, uint32_t count);
+void phash_index_free(PhashIndex *ix);
+
+// Whether item has a hash for the file as stamped. A hash loaded from
+// disk is grouped the first time it's checked, which keeps loading a
+// large category quick.
+bool phash_index_check(PhashIndex *ix, uint32_t item, uint32_t stamp);
+
+// Record item's hash and group it with every image within PHASH_NEAR. A
+// file hashed again keeps the groups it was in until the next load.
+void phash_index_set(PhashIndex *ix, uint32_t item, uint64_t hash, uint32_t stamp);
+
+// Grouped items within radius (up to PHASH_MAX_RADIUS) bits of hash. Up to
+// max are written to out; returns how many there are.
+uint32_t phash_index_near(const PhashIndex *ix, uint64_t hash, int radius,
+                          uint32_t *out, uint32_t max);
+
+// The lowest item in item's group; item itself if nothing is near it
+uint32_t phash_index_group(PhashIndex *ix, uint32_t item);
+
+// Hashes are saved keyed by each file's path, so they outlive changes to
+// the index, and with the fit mode the images were placed with. Loading
+// sizes ix to idx and keeps the hashes of the files still in it.
+int phash_index_load(PhashIndex *ix, const ImageIndex *idx, int fit, const char *path);
+int phash_index_save(PhashIndex *ix, const ImageIndex *idx, int fit, const char *path);
+
+// phash_index_save() in two halves, for an index other threads add to:
+// copy the hashes out under the caller's lock, then write them without
+// it. Taking the snapshot counts them as saved; if the write fails, add
+// snap.unsaved back to ix->unsaved. The write frees the records.
+typedef struct {
+    struct PhashRecord *records;
+    uint32_t count;
+    uint32_t unsaved;       // ix->unsaved when taken
+} PhashSnapshot;
+
+int phash_index_snapshot(PhashIndex *ix, const ImageIndex *idx, PhashSnapshot *out);
+int phash_snapshot_write(PhashSnapshot *snap, int fit, const char *path);
+
+#endif
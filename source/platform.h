@@ -0,0 +1,41 @@
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// The little the slideshow needs from the system it runs on. The Switch
+// build implements it with libnx (platform_switch.c); the Linux host build
+// (Makefile.host) with plain POSIX and SDL's dummy video driver
+// (platform_host.c), so the core can be run and benchmarked on a PC.
+
+#ifdef __SWITCH__
+#define SDMC_ROOT  "sdmc:/"
+#define ROMFS_ROOT "romfs:/"
+#else
+// Relative to the working directory: run from the repo root
+#define SDMC_ROOT  "sdmc/"
+#define ROMFS_ROOT "romfs/"
+#endif
+
+// Mount the SD card and romfs and bring up sockets; call before anything
+// touches SDMC_ROOT. platform_exit() undoes it and lets the console sleep.
+void platform_init(void);
+void platform_exit(void);
+
+// Whether there is an internet connection. *ip (if given) is set to the
+// current address, 0 when offline, so callers can spot a network change.
+// The system sessions behind this and platform_charging() stay open from
+// platform_init() on, so both are cheap enough to poll.
+bool platform_online(uint32_t *ip);
+
+// Whether a charger is plugged in
+bool platform_charging(void);
+
+// Keep the screen on (no auto-sleep or dimming) while awake is true
+void platform_keep_awake(bool awake);
+
+// Memory used by the whole process, in bytes (0 if unknown)
+uint64_t platform_process_memory(void);
+
+#endif
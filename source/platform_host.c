@@ -0,0 +1,45 @@
+#ifndef __SWITCH__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "platform.h"
+
+void platform_init(void) {
+    // Headless unless told otherwise, e.g. SDL_VIDEODRIVER=x11 to watch
+    setenv("SDL_VIDEODRIVER", "dummy", 0);
+
+    // The SD card is a folder in the working directory
+    mkdir(SDMC_ROOT, 0777);
+    mkdir(SDMC_ROOT "config", 0777);
+}
+
+void platform_exit(void) {
+}
+
+// A workstation is assumed to be online and on mains power
+bool platform_online(uint32_t *ip) {
+    if (ip) *ip = 0x0100007f;   // 127.0.0.1
+    return true;
+}
+
+bool platform_charging(void) {
+    return true;
+}
+
+void platform_keep_awake(bool awake) {
+}
+
+uint64_t platform_process_memory(void) {
+    // Resident set size, in pages, is the second field
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (!f) return 0;
+    unsigned long long size = 0, resident = 0;
+    int n = fscanf(f, "%llu %llu", &size, &resident);
+    fclose(f);
+    return n == 2 ? (uint64_t)resident * (uint64_t)sysconf(_SC_PAGESIZE) : 0;
+}
+
+#endif
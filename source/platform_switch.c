@@ -0,0 +1,58 @@
+#ifdef __SWITCH__
+
+#include <switch.h>
+
+#include "platform.h"
+
+// Opened once and kept, so the connection and charger can be polled often
+// without setting up a service session each time
+static bool NIFM_UP, PSM_UP;
+
+void platform_init(void) {
+    romfsInit();
+    fsdevMountSdmc();
+    socketInitializeDefault();
+    appletInitialize();
+    NIFM_UP = R_SUCCEEDED(nifmInitialize(NifmServiceType_User));
+    PSM_UP = R_SUCCEEDED(psmInitialize());
+}
+
+void platform_exit(void) {
+    if (PSM_UP) psmExit();
+    if (NIFM_UP) nifmExit();
+    PSM_UP = NIFM_UP = false;
+    appletSetMediaPlaybackState(false);
+    appletExit();
+    socketExit();
+    fsdevUnmountDevice("sdmc");
+    romfsExit();
+}
+
+bool platform_online(uint32_t *ip) {
+    u32 addr = 0;
+    NifmInternetConnectionStatus status = NifmInternetConnectionStatus_ConnectingUnknown1;
+    bool online = NIFM_UP &&
+                  R_SUCCEEDED(nifmGetInternetConnectionStatus(NULL, NULL, &status)) &&
+                  status == NifmInternetConnectionStatus_Connected;
+    if (ip && online) nifmGetCurrentIpAddress(&addr);
+    if (ip) *ip = addr;
+    return online;
+}
+
+bool platform_charging(void) {
+    PsmChargerType charger = PsmChargerType_Unconnected;
+    if (PSM_UP) psmGetChargerType(&charger);
+    return charger != PsmChargerType_Unconnected;
+}
+
+void platform_keep_awake(bool awake) {
+    appletSetMediaPlaybackState(awake);
+}
+
+uint64_t platform_process_memory(void) {
+    u64 used = 0;
+    svcGetInfo(&used, InfoType_UsedMemorySize, CUR_PROCESS_HANDLE, 0);
+    return used;
+}
+
+#endif
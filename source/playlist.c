@@ -0,0 +1,402 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "playlist.h"
+#include "util.h"
+
+#define PLAYLIST_MAGIC   "NXPL"
+#define PLAYLIST_VERSION 2
+
+typedef struct {
+    char     magic[4];
+    uint32_t version;
+    uint32_t mode;
+    uint32_t count;
+    uint32_t pos;
+    uint32_t last;
+    uint64_t rng;
+    uint64_t fingerprint;
+    uint32_t num_returned;
+    uint32_t returned[PLAYLIST_RETURNED];
+    uint32_t num_recent;
+    uint32_t recent[PLAYLIST_SPACING];  // so spacing carries over a restart
+} PlaylistHeader;
+
+static const char *MODE_NAMES[] = { "shuffle", "sequential", "newest", "weighted" };
+static const char *SIMILAR_NAMES[] = { "off", "space", "skip" };
+
+int playlist_mode_parse(const char *name) {
+    for (int i = 0; i < (int)(sizeof(MODE_NAMES) / sizeof(MODE_NAMES[0])); i++)
+        if (strcasecmp(name, MODE_NAMES[i]) == 0) return i;
+    return -1;
+}
+
+int playlist_similar_parse(const char *name) {
+    for (int i = 0; i < (int)(sizeof(SIMILAR_NAMES) / sizeof(SIMILAR_NAMES[0])); i++)
+        if (strcasecmp(name, SIMILAR_NAMES[i]) == 0) return i;
+    return -1;
+}
+
+uint32_t playlist_random(Playlist *pl, uint32_t n) {
+    return rng_below(&pl->rng, n);
+}
+
+void playlist_init(Playlist *pl, PlaylistMode mode, uint64_t seed) {
+    memset(pl, 0, sizeof(*pl));
+    pl->mode = mode;
+    pl->last = PLAYLIST_NONE;
+    pl->rng  = rng_seed(seed);
+}
+
+void playlist_free(Playlist *pl) {
+    free(pl->order);
+    free(pl->prob);
+    free(pl->alias);
+    free(pl->seen);
+    pl->order = NULL;
+    pl->prob  = NULL;
+    pl->alias = NULL;
+    pl->seen  = NULL;
+    pl->count = 0;
+    pl->pos   = 0;
+    pl->num_recent = 0;
+    pl->num_moved  = 0;
+    pl->num_returned = 0;
+}
+
+void playlist_set_groups(Playlist *pl, PlaylistSimilar similar, PlaylistGroupFn group,
+                         void *user) {
+    pl->similar    = group ? similar : PLAYLIST_SIMILAR_OFF;
+    pl->group      = group;
+    pl->group_user = user;
+    free(pl->seen);     // rebuilt on the next pick, if skipping
+    pl->seen = NULL;
+}
+
+static uint32_t group_of(const Playlist *pl, uint32_t item) {
+    return pl->group(pl->group_user, item);
+}
+
+// Whether item is a near-duplicate of one of the last few picks
+static int near_recent(const Playlist *pl, uint32_t item) {
+    if (pl->similar == PLAYLIST_SIMILAR_OFF) return 0;
+    uint32_t g = group_of(pl, item);
+    uint32_t n = pl->num_recent < PLAYLIST_SPACING ? pl->num_recent : PLAYLIST_SPACING;
+    for (uint32_t k = 0; k < n; k++)
+        if (group_of(pl, pl->recent[k]) == g) return 1;
+    return 0;
+}
+
+// SKIP: the groups shown this round, worked out again from the order
+// after a load or a change of groups
+static uint8_t *seen_groups(Playlist *pl) {
+    if (pl->seen || pl->similar != PLAYLIST_SIMILAR_SKIP || !pl->order) return pl->seen;
+    pl->seen = calloc((pl->count + 7) / 8, 1);
+    for (uint32_t i = 0; pl->seen && i < pl->pos; i++) {
+        uint32_t g = group_of(pl, pl->order[i]);
+        pl->seen[g / 8] |= 1 << (g % 8);
+    }
+    return pl->seen;
+}
+
+static int group_seen(const Playlist *pl, uint32_t item) {
+    uint32_t g = group_of(pl, item);
+    return (pl->seen[g / 8] >> (g % 8)) & 1;
+}
+
+// Remember a swapped slot for playlist_save_position
+static void slot_moved(Playlist *pl, uint32_t slot) {
+    if (pl->num_moved < PLAYLIST_MOVED) pl->moved[pl->num_moved++] = slot;
+    else pl->reshuffled = 1;
+}
+
+static void shuffle(Playlist *pl) {
+    for (uint32_t i = pl->count - 1; i > 0; i--) {
+        uint32_t j = playlist_random(pl, i + 1);
+        uint32_t t = pl->order[i];
+        pl->order[i] = pl->order[j];
+        pl->order[j] = t;
+    }
+
+    // Don't open the round with the picture that closed the last one
+    if (pl->count > 1 && pl->order[0] == pl->last) {
+        uint32_t j = 1 + playlist_random(pl, pl->count - 1);
+        pl->order[0] = pl->order[j];
+        pl->order[j] = pl->last;
+    }
+}
+
+int playlist_set_weights(Playlist *pl, const float *weights) {
+    uint32_t n = pl->count;
+    free(pl->prob);
+    free(pl->alias);
+    pl->prob  = malloc(n * sizeof(float));
+    pl->alias = malloc(n * sizeof(uint32_t));
+    uint32_t *work = malloc(n * sizeof(uint32_t));
+    if (!pl->prob || !pl->alias || !work) {
+        free(work);
+        playlist_free(pl);
+        return -1;
+    }
+
+    double sum = 0;
+    for (uint32_t i = 0; i < n; i++) sum += weights[i] > 0 ? weights[i] : 0;
+
+    // Vose's alias method. Small entries fill from the front of work,
+    // large ones from the back.
+    uint32_t small = 0, large = n;
+    for (uint32_t i = 0; i < n; i++) {
+        float w = weights[i] > 0 ? weights[i] : 0;
+        pl->prob[i] = sum > 0 ? (float)(w * n / sum) : 1.0f;
+        pl->alias[i] = i;
+        if (pl->prob[i] < 1.0f) work[small++] = i;
+        else                    work[--large] = i;
+    }
+    uint32_t s = 0, l = large;
+    while (s < small && l < n) {
+        uint32_t lo = work[s++], hi = work[l];
+        pl->alias[lo] = hi;
+        pl->prob[hi] -= 1.0f - pl->prob[lo];
+        if (pl->prob[hi] < 1.0f) {
+            // hi is now small; reuse its slot on the small side
+            l++;
+            work[--s] = hi;
+        }
+    }
+    // Whatever is left over is 1 up to rounding
+    for (; s < small; s++) pl->prob[work[s]] = 1.0f;
+    for (; l < n; l++)     pl->prob[work[l]] = 1.0f;
+
+    free(work);
+    return 0;
+}
+
+int playlist_reset(Playlist *pl, uint32_t count, uint64_t fingerprint,
+                   const uint32_t *sorted, const float *weights) {
+    playlist_free(pl);
+    pl->fingerprint = fingerprint;
+    if (count == 0) return 0;
+
+    pl->count = count;
+    if (pl->mode == PLAYLIST_WEIGHTED)
+        return weights ? playlist_set_weights(pl, weights) : -1;
+
+    pl->order = malloc(count * sizeof(uint32_t));
+    if (!pl->order) {
+        pl->count = 0;
+        return -1;
+    }
+    for (uint32_t i = 0; i < count; i++)
+        pl->order[i] = (sorted && pl->mode != PLAYLIST_SHUFFLE) ? sorted[i] : i;
+    if (pl->mode == PLAYLIST_SHUFFLE) shuffle(pl);
+    return 0;
+}
+
+uint32_t playlist_next(Playlist *pl) {
+    if (pl->count == 0) return PLAYLIST_NONE;
+
+    uint32_t item;
+    if (pl->mode == PLAYLIST_WEIGHTED) {
+        if (!pl->prob) return PLAYLIST_NONE;
+        // A few retries keep the same photo, or one just like it, from
+        // coming up again right away
+        for (int tries = 0; tries < 8; tries++) {
+            uint32_t i = playlist_random(pl, pl->count);
+            float coin = (float)rng_next32(&pl->rng) / 4294967296.0f;
+            item = coin < pl->prob[i] ? i : pl->alias[i];
+            if ((item != pl->last && !near_recent(pl, item)) || pl->count == 1) break;
+        }
+    } else if (pl->num_returned > 0) {
+        // The end of the last round, given back after this one was dealt
+        item = pl->returned[--pl->num_returned];
+    } else {
+        uint8_t *seen = seen_groups(pl);
+        for (;;) {
+            if (pl->pos >= pl->count) {
+                pl->pos = 0;
+                if (pl->mode == PLAYLIST_SHUFFLE) {
+                    shuffle(pl);
+                    pl->reshuffled = 1;
+                }
+                if (seen) memset(seen, 0, (pl->count + 7) / 8);
+            }
+            // One of each group a round: the rest count as shown
+            if (seen && group_seen(pl, pl->order[pl->pos])) {
+                pl->pos++;
+                continue;
+            }
+            break;
+        }
+
+        // Shuffled, a near-duplicate of a recent pick trades places with
+        // the next slot in the round that isn't one
+        if (pl->mode == PLAYLIST_SHUFFLE && near_recent(pl, pl->order[pl->pos])) {
+            uint32_t end = pl->count - pl->pos > PLAYLIST_LOOKAHEAD ? pl->pos + PLAYLIST_LOOKAHEAD
+                                                                     : pl->count;
+            for (uint32_t j = pl->pos + 1; j < end; j++) {
+                if ((seen && group_seen(pl, pl->order[j])) || near_recent(pl, pl->order[j]))
+                    continue;
+                uint32_t t = pl->order[pl->pos];
+                pl->order[pl->pos] = pl->order[j];
+                pl->order[j] = t;
+                slot_moved(pl, pl->pos);
+                slot_moved(pl, j);
+                break;
+            }
+        }
+
+        item = pl->order[pl->pos++];
+        if (seen) {
+            uint32_t g = group_of(pl, item);
+            seen[g / 8] |= 1 << (g % 8);
+        }
+    }
+
+    pl->last = item;
+    pl->recent[pl->num_recent++ % PLAYLIST_SPACING] = item;
+    return item;
+}
+
+void playlist_unpick(Playlist *pl, uint32_t item) {
+    if (!pl->order || item >= pl->count) return;
+
+    if (pl->pos == 0) {
+        // From the end of the last round, whose order is gone: it's handed
+        // out again before this round starts, which is left as dealt
+        if (pl->num_returned < PLAYLIST_RETURNED) pl->returned[pl->num_returned++] = item;
+    } else {
+        // Normally the newest pick not yet given back, just behind pos.
+        // Passed-over near-duplicates may lie in between: it trades places
+        // with the slot behind pos.
+        uint32_t j = pl->pos;
+        while (j > 0 && pl->order[j - 1] != item) j--;
+        if (j == 0) return;
+        if (--j != pl->pos - 1) {
+            pl->order[j] = pl->order[pl->pos - 1];
+            pl->order[pl->pos - 1] = item;
+            slot_moved(pl, j);
+            slot_moved(pl, pl->pos - 1);
+        }
+        pl->pos--;
+        if (pl->pos > 0) pl->last = pl->order[pl->pos - 1];
+    }
+
+    if (pl->num_recent > 0 && pl->recent[(pl->num_recent - 1) % PLAYLIST_SPACING] == item)
+        pl->num_recent--;
+    // SKIP: its group no longer counts as shown; rebuilt on the next pick
+    free(pl->seen);
+    pl->seen = NULL;
+}
+
+int playlist_load(Playlist *pl, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+
+    PlaylistHeader h;
+    if (fread(&h, sizeof(h), 1, f) != 1 ||
+        memcmp(h.magic, PLAYLIST_MAGIC, 4) != 0 || h.version != PLAYLIST_VERSION ||
+        h.mode > PLAYLIST_WEIGHTED || h.pos > h.count || h.rng == 0 ||
+        h.num_returned > PLAYLIST_RETURNED || (h.num_returned > 0 && h.pos > 0)) {
+        fclose(f);
+        return -1;
+    }
+    uint32_t recent = h.num_recent < PLAYLIST_SPACING ? h.num_recent : PLAYLIST_SPACING;
+    int bad = 0;
+    for (uint32_t k = 0; k < recent; k++) bad |= h.recent[k] >= h.count;
+    for (uint32_t k = 0; k < h.num_returned; k++) bad |= h.returned[k] >= h.count;
+    if (bad) {
+        fclose(f);
+        return -1;
+    }
+
+    uint32_t *order = NULL;
+    if (h.mode != PLAYLIST_WEIGHTED && h.count > 0) {
+        order = malloc(h.count * sizeof(uint32_t));
+        if (!order || fread(order, sizeof(uint32_t), h.count, f) != h.count) {
+            free(order);
+            fclose(f);
+            return -1;
+        }
+        for (uint32_t i = 0; i < h.count; i++) {
+            if (order[i] >= h.count) {
+                free(order);
+                fclose(f);
+                return -1;
+            }
+        }
+    }
+    fclose(f);
+
+    playlist_free(pl);
+    pl->mode        = h.mode;
+    pl->count       = h.count;
+    pl->order       = order;
+    pl->pos         = h.pos;
+    pl->last        = h.last;
+    pl->rng         = h.rng;
+    pl->fingerprint = h.fingerprint;
+    pl->num_returned = h.num_returned;
+    memcpy(pl->returned, h.returned, sizeof(pl->returned));
+    pl->num_recent  = h.num_recent;
+    memcpy(pl->recent, h.recent, sizeof(pl->recent));
+    return 0;
+}
+
+static void fill_header(const Playlist *pl, PlaylistHeader *h) {
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, PLAYLIST_MAGIC, 4);
+    h->version     = PLAYLIST_VERSION;
+    h->mode        = pl->mode;
+    h->count       = pl->count;
+    h->pos         = pl->pos;
+    h->last        = pl->last;
+    h->rng         = pl->rng;
+    h->fingerprint = pl->fingerprint;
+    h->num_returned = pl->num_returned;
+    memcpy(h->returned, pl->returned, sizeof(h->returned));
+    h->num_recent  = pl->num_recent;
+    memcpy(h->recent, pl->recent, sizeof(h->recent));
+}
+
+int playlist_save(Playlist *pl, const char *path) {
+    char tmp[520];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "wb");
+    if (!f) return -1;
+
+    PlaylistHeader h;
+    fill_header(pl, &h);
+    int ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    if (ok && pl->order)
+        ok = fwrite(pl->order, sizeof(uint32_t), pl->count, f) == pl->count;
+    if (fclose(f) != 0) ok = 0;
+
+    if (!ok || replace_file(tmp, path) != 0) {
+        remove(tmp);
+        return -1;
+    }
+    pl->reshuffled = 0;
+    pl->num_moved  = 0;
+    return 0;
+}
+
+int playlist_save_position(Playlist *pl, const char *path) {
+    if (pl->reshuffled) return playlist_save(pl, path);
+
+    FILE *f = fopen(path, "r+b");
+    if (!f) return playlist_save(pl, path);
+
+    PlaylistHeader h;
+    fill_header(pl, &h);
+    int ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    for (uint32_t i = 0; ok && i < pl->num_moved; i++) {
+        long at = (long)(sizeof(h) + (size_t)pl->moved[i] * sizeof(uint32_t));
+        ok = fseek(f, at, SEEK_SET) == 0 &&
+             fwrite(&pl->order[pl->moved[i]], sizeof(uint32_t), 1, f) == 1;
+    }
+    if (fclose(f) != 0) ok = 0;
+    if (ok) pl->num_moved = 0;
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,116 @@
+#ifndef PLAYLIST_H
+#define PLAYLIST_H
+
+#include <stdint.h>
+
+// Order in which a local category's images are shown.
+//
+// Shuffle deals from a Fisher-Yates bag: every image is shown once before
+// any repeats, and a new round never starts with the image that ended the
+// last one. The permutation, position and last few picks are saved, so a
+// restart picks up where it left off. Picking the next image is an array
+// lookup; the only O(n) work is the reshuffle at the end of each round.
+//
+// Near-duplicates (burst shots, the same screenshot twice) can be kept
+// apart: given a group for each item, a pick that shares its group with
+// one of the last PLAYLIST_SPACING is swapped with a later slot of the
+// round, or passed over if only one of each group is to be shown.
+//
+// Pure C with its own PRNG, so it behaves the same on the Switch and on a
+// PC.
+
+typedef enum {
+    PLAYLIST_SHUFFLE,
+    PLAYLIST_SEQUENTIAL,   // in the order given to playlist_reset
+    PLAYLIST_NEWEST,       // likewise; the caller sorts newest first
+    PLAYLIST_WEIGHTED,     // random with replacement, by weight (alias method)
+} PlaylistMode;
+
+// What to do with items that share a group (playlist_set_groups)
+typedef enum {
+    PLAYLIST_SIMILAR_OFF,
+    PLAYLIST_SIMILAR_SPACE,     // PLAYLIST_SPACING picks apart; shuffle and weighted only
+    PLAYLIST_SIMILAR_SKIP,      // one per group each round, spaced too; weighted only spaces
+} PlaylistSimilar;
+
+#define PLAYLIST_NONE      0xFFFFFFFFu
+#define PLAYLIST_SPACING   8    // picks before a group may come up again
+#define PLAYLIST_LOOKAHEAD 64   // slots searched for a pick from another group
+#define PLAYLIST_MOVED     16   // slots swapped between saves, before a full save
+#define PLAYLIST_RETURNED  16   // picks given back from the end of the last round
+
+// Group of an item: items in the same one are near-duplicates
+typedef uint32_t (*PlaylistGroupFn)(void *user, uint32_t item);
+
+typedef struct {
+    PlaylistMode mode;
+    uint32_t  count;
+    uint32_t *order;        // permutation of 0..count-1 (not used when weighted)
+    uint32_t  pos;          // next slot in order
+    uint32_t  last;         // item returned last, or PLAYLIST_NONE
+    uint64_t  rng;
+    uint64_t  fingerprint;  // identifies the set of items order was built for
+
+    // Weighted mode: Vose alias table
+    float    *prob;
+    uint32_t *alias;
+
+    int       reshuffled;   // order was rebuilt since the last save
+
+    // Near-duplicates, see playlist_set_groups()
+    PlaylistSimilar similar;
+    PlaylistGroupFn group;
+    void     *group_user;
+    uint32_t  recent[PLAYLIST_SPACING]; // last picks, a ring
+    uint32_t  num_recent;
+    uint8_t  *seen;         // SKIP: groups shown this round, a bit each
+    uint32_t  moved[PLAYLIST_MOVED];    // order slots swapped since the last save
+    uint32_t  num_moved;
+    uint32_t  returned[PLAYLIST_RETURNED];  // see playlist_unpick; a stack
+    uint32_t  num_returned;
+} Playlist;
+
+// "shuffle", "sequential", "newest" or "weighted"; -1 if unknown
+int playlist_mode_parse(const char *name);
+// "off", "space" or "skip"; -1 if unknown
+int playlist_similar_parse(const char *name);
+
+void playlist_init(Playlist *pl, PlaylistMode mode, uint64_t seed);
+void playlist_free(Playlist *pl);
+
+// Start over with `count` items. `sorted` is the order for SEQUENTIAL and
+// NEWEST (NULL = 0..count-1); `weights` is required for WEIGHTED. Returns
+// 0, or -1 if out of memory (the playlist is then empty).
+int playlist_reset(Playlist *pl, uint32_t count, uint64_t fingerprint,
+                   const uint32_t *sorted, const float *weights);
+
+// Rebuild just the alias table after a load (weights aren't saved)
+int playlist_set_weights(Playlist *pl, const float *weights);
+
+// Keep near-duplicates apart from now on, group(user, item) naming each
+// item's group. Groups may merge as they're learned; group is called with
+// whatever lock guards the playlist held. Kept over playlist_reset() and
+// playlist_load(), not over playlist_init().
+void playlist_set_groups(Playlist *pl, PlaylistSimilar similar, PlaylistGroupFn group,
+                         void *user);
+
+// Next item, or PLAYLIST_NONE if the playlist is empty
+uint32_t playlist_next(Playlist *pl);
+
+// Give back an item from playlist_next() that was never shown (its load
+// was cancelled), so it comes up next instead of being lost from the
+// round. Items given back in the reverse of the order they were picked
+// come up again in that order. Nothing to do when weighted.
+void playlist_unpick(Playlist *pl, uint32_t item);
+
+// Uniform random integer in [0, n)
+uint32_t playlist_random(Playlist *pl, uint32_t n);
+
+// Load/save the whole playlist. After a pick, playlist_save_position only
+// rewrites the small header and any slots swapped to space near-duplicates,
+// unless the order was reshuffled.
+int playlist_load(Playlist *pl, const char *path);
+int playlist_save(Playlist *pl, const char *path);
+int playlist_save_position(Playlist *pl, const char *path);
+
+#endif
@@ -0,0 +1,263 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "prefetch.h"
+
+struct Prefetcher {
+    WorkPool   *pool;
+    SDL_mutex  *lock;
+    SDL_cond   *cond;       // a load finished
+
+    PrefetchPick   pick;
+    PrefetchUnpick unpick;
+    PrefetchLoader loader;
+    void          *user;
+    Uint32         ready_event;
+
+    int depth;
+    int cat_index;
+    SDL_atomic_t gen;
+    SDL_atomic_t quit;
+
+    // Ring of slides in playing order, guarded by lock. A slot is reserved
+    // (with the category and item picked for it) when its load is queued
+    // and becomes ready when the load finishes.
+    PrefetchSlide slides[PREFETCH_MAX_DEPTH];
+    bool ready[PREFETCH_MAX_DEPTH];
+    int head;
+    int count;
+    int inflight;           // loads queued or running, any generation
+
+    // Set when a failed load is queued; no more loads start until it has
+    // been consumed, instead of hammering a dead source.
+    bool stalled;
+
+    bool waiting;           // prefetch_pop() found the head slide not ready
+    SDL_Surface *preview;   // of the head slide, not taken yet
+};
+
+typedef struct {
+    PrefetchJob job;
+    int         slot;
+} LoadTask;
+
+// Newest first, so picks handed back to the front of a playlist end up in
+// the order they were taken
+static void drop_slides(Prefetcher *pf) {
+    for (int i = pf->count - 1; i >= 0; i--) {
+        int slot = (pf->head + i) % PREFETCH_MAX_DEPTH;
+        if (pf->unpick) pf->unpick(pf->slides[slot].cat_index, pf->slides[slot].item, pf->user);
+        if (pf->ready[slot] && pf->slides[slot].surface)
+            SDL_FreeSurface(pf->slides[slot].surface);
+        pf->slides[slot].surface = NULL;
+        pf->ready[slot] = false;
+    }
+    pf->head = 0;
+    pf->count = 0;
+    pf->stalled = false;
+    pf->waiting = false;
+    if (pf->preview) SDL_FreeSurface(pf->preview);
+    pf->preview = NULL;
+}
+
+static void load_task(void *arg);
+
+static void push_ready(Prefetcher *pf) {
+    if (!pf->ready_event) return;
+    SDL_Event ev;
+    SDL_zero(ev);
+    ev.type = pf->ready_event;
+    SDL_PushEvent(&ev);
+}
+
+// Queue loads until depth slides are ready or on their way. With lock held.
+static void fill(Prefetcher *pf) {
+    while (pf->count < pf->depth && !pf->stalled && !SDL_AtomicGet(&pf->quit)) {
+        LoadTask *task = malloc(sizeof(LoadTask));
+        if (!task) return;
+        task->slot = (pf->head + pf->count) % PREFETCH_MAX_DEPTH;
+        task->job.pf        = pf;
+        task->job.cat_index = pf->cat_index;
+        task->job.gen       = SDL_AtomicGet(&pf->gen);
+        task->job.item      = pf->pick ? pf->pick(pf->cat_index, pf->user) : 0;
+        task->job.slot      = task->slot;
+        task->job.queued_at = SDL_GetPerformanceCounter();
+
+        if (workpool_submit(pf->pool, load_task, task, pf) != 0) {
+            // Pool is full; the next pop or finished load tries again
+            free(task);
+            return;
+        }
+        pf->slides[task->slot].cat_index = task->job.cat_index;
+        pf->slides[task->slot].item      = task->job.item;
+        pf->ready[task->slot] = false;
+        pf->count++;
+        pf->inflight++;
+    }
+}
+
+static void load_task(void *arg) {
+    LoadTask *task = arg;
+    Prefetcher *pf = task->job.pf;
+    stage_record(STAGE_QUEUE, task->job.queued_at);
+
+    PrefetchSlide slide;
+    slide.cat_index = task->job.cat_index;
+    slide.item = task->job.item;
+    slide.status[0] = 0;
+    slide.retry = false;
+    slide.surface = pf->loader(&task->job, slide.status, sizeof(slide.status), &slide.retry,
+                               pf->user);
+    slide.ready_at = SDL_GetTicks();
+
+    SDL_LockMutex(pf->lock);
+    pf->inflight--;
+    if (prefetch_job_cancelled(&task->job)) {
+        // Category changed (or we're quitting) while loading; the slot
+        // may belong to a newer load by now
+        if (slide.surface) SDL_FreeSurface(slide.surface);
+    } else {
+        pf->slides[task->slot] = slide;
+        pf->ready[task->slot] = true;
+        if (!slide.surface) pf->stalled = true;
+        push_ready(pf);
+        fill(pf);
+    }
+    SDL_CondBroadcast(pf->cond);
+    SDL_UnlockMutex(pf->lock);
+    free(task);
+}
+
+Prefetcher *prefetch_create(WorkPool *pool, int depth, int cat_index, PrefetchPick pick,
+                            PrefetchUnpick unpick, PrefetchLoader loader, void *user,
+                            Uint32 ready_event) {
+    if (!pool) return NULL;
+    Prefetcher *pf = calloc(1, sizeof(Prefetcher));
+    if (!pf) return NULL;
+
+    if (depth < 1) depth = 1;
+    if (depth > PREFETCH_MAX_DEPTH) depth = PREFETCH_MAX_DEPTH;
+
+    pf->pool      = pool;
+    pf->depth     = depth;
+    pf->cat_index = cat_index;
+    pf->pick      = pick;
+    pf->unpick    = unpick;
+    pf->loader    = loader;
+    pf->user      = user;
+    pf->ready_event = ready_event;
+    pf->lock      = SDL_CreateMutex();
+    pf->cond      = SDL_CreateCond();
+
+    if (!pf->lock || !pf->cond) {
+        if (pf->cond) SDL_DestroyCond(pf->cond);
+        if (pf->lock) SDL_DestroyMutex(pf->lock);
+        free(pf);
+        return NULL;
+    }
+
+    SDL_LockMutex(pf->lock);
+    fill(pf);
+    SDL_UnlockMutex(pf->lock);
+    return pf;
+}
+
+void prefetch_destroy(Prefetcher *pf) {
+    if (!pf) return;
+
+    SDL_LockMutex(pf->lock);
+    SDL_AtomicSet(&pf->quit, 1);
+    pf->inflight -= workpool_cancel(pf->pool, pf, free);
+    while (pf->inflight > 0)
+        SDL_CondWait(pf->cond, pf->lock);
+    drop_slides(pf);
+    SDL_UnlockMutex(pf->lock);
+
+    SDL_DestroyCond(pf->cond);
+    SDL_DestroyMutex(pf->lock);
+    free(pf);
+}
+
+void prefetch_set_category(Prefetcher *pf, int cat_index) {
+    SDL_LockMutex(pf->lock);
+    pf->cat_index = cat_index;
+    SDL_AtomicAdd(&pf->gen, 1);
+    pf->inflight -= workpool_cancel(pf->pool, pf, free);
+    drop_slides(pf);
+    fill(pf);
+    SDL_UnlockMutex(pf->lock);
+}
+
+bool prefetch_pop(Prefetcher *pf, PrefetchSlide *out) {
+    SDL_LockMutex(pf->lock);
+    if (pf->count == 0 || !pf->ready[pf->head]) {
+        pf->waiting = pf->count > 0;
+        SDL_UnlockMutex(pf->lock);
+        return false;
+    }
+
+    // A stale failure (or stand-in for a source that couldn't be reached)
+    // is dropped and a fresh load queued in its place
+    PrefetchSlide *head = &pf->slides[pf->head];
+    bool stale = (!head->surface || head->retry) &&
+                 SDL_GetTicks() - head->ready_at > PREFETCH_RETRY_MS;
+    if (!stale) *out = *head;
+    else if (head->surface) SDL_FreeSurface(head->surface);
+
+    head->surface = NULL;
+    pf->ready[pf->head] = false;
+    pf->head = (pf->head + 1) % PREFETCH_MAX_DEPTH;
+    pf->count--;
+    if (stale || !out->surface) pf->stalled = false;
+
+    // The slide itself is here; a preview that came in after the last
+    // look is of no use now
+    pf->waiting = false;
+    if (pf->preview) SDL_FreeSurface(pf->preview);
+    pf->preview = NULL;
+
+    fill(pf);
+    SDL_UnlockMutex(pf->lock);
+    return !stale;
+}
+
+bool prefetch_job_cancelled(const PrefetchJob *job) {
+    return SDL_AtomicGet(&job->pf->quit) ||
+           SDL_AtomicGet(&job->pf->gen) != job->gen;
+}
+
+// With lock held
+static bool wants_preview(const PrefetchJob *job) {
+    Prefetcher *pf = job->pf;
+    return pf->waiting && !prefetch_job_cancelled(job) && pf->count > 0 &&
+           job->slot == pf->head && !pf->ready[pf->head];
+}
+
+bool prefetch_wants_preview(const PrefetchJob *job) {
+    SDL_LockMutex(job->pf->lock);
+    bool wanted = wants_preview(job);
+    SDL_UnlockMutex(job->pf->lock);
+    return wanted;
+}
+
+void prefetch_preview(const PrefetchJob *job, SDL_Surface *surface) {
+    Prefetcher *pf = job->pf;
+    SDL_LockMutex(pf->lock);
+    if (wants_preview(job)) {
+        // Only the newest matters; an older one nobody took is dropped
+        if (pf->preview) SDL_FreeSurface(pf->preview);
+        pf->preview = surface;
+        surface = NULL;
+        push_ready(pf);
+    }
+    SDL_UnlockMutex(pf->lock);
+    if (surface) SDL_FreeSurface(surface);
+}
+
+SDL_Surface *prefetch_take_preview(Prefetcher *pf) {
+    SDL_LockMutex(pf->lock);
+    SDL_Surface *preview = pf->preview;
+    pf->preview = NULL;
+    SDL_UnlockMutex(pf->lock);
+    return preview;
+}
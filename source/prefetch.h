@@ -0,0 +1,98 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+#include "workpool.h"
+
+// Keeps the next slide(s) of the current category fetched and decoded
+// into SDL_Surfaces, so the render thread only has to upload a texture
+// when it's time to switch.
+//
+// Up to `depth` loads run at once on a worker pool and may finish in any
+// order; slides still come out in the order they were picked. While the
+// render loop waits on a slide, its loader may offer previews of it (a
+// progressive image still downloading) to show in the meantime. The actual
+// fetch/decode is done by a loader callback; only SDL threads are used,
+// so it runs the same on the Switch and on a PC.
+
+#define PREFETCH_MAX_DEPTH 8
+
+// A failed load older than this is stale by the time anyone asks for it;
+// it's dropped and retried instead of being reported. So is a slide marked
+// retry, as its source may be back by now.
+#define PREFETCH_RETRY_MS  2000
+
+typedef struct Prefetcher Prefetcher;
+
+typedef struct {
+    Prefetcher *pf;
+    int         cat_index;
+    int         gen;
+    uint32_t    item;       // what the pick callback chose for this slide
+    int         slot;       // its place in the ring
+    Uint64      queued_at;  // SDL_GetPerformanceCounter()
+} PrefetchJob;
+
+typedef struct {
+    SDL_Surface *surface;   // NULL if the load failed; status says why
+    int          cat_index;
+    uint32_t     item;      // the job's item, as picked
+    Uint32       ready_at;  // SDL_GetTicks() when the load finished
+    bool         retry;     // the source couldn't be reached; try again soon
+    char         status[256];
+} PrefetchSlide;
+
+// Called in slide order, with the prefetcher's lock held, each time a load
+// is queued: choose what it will load (e.g. the next playlist entry).
+// Must be quick and must not call back into the prefetcher.
+typedef uint32_t (*PrefetchPick)(int cat_index, void *user);
+
+// Called, likewise with the lock held, for each picked slide that is
+// dropped without being popped (a category switch, or destroy), newest
+// first, so the pick can be put back (e.g. at the head of the playlist).
+typedef void (*PrefetchUnpick)(int cat_index, uint32_t item, void *user);
+
+// Runs on a pool thread, possibly several at once, so it must be thread
+// safe. Long loads should poll prefetch_job_cancelled() and bail out
+// early once it returns true. Setting *retry marks the slide as a failure
+// to reach its source (even if it fell back to an old copy).
+typedef SDL_Surface *(*PrefetchLoader)(const PrefetchJob *job, char *status_out,
+                                       size_t status_len, bool *retry, void *user);
+
+// pick and unpick may be NULL. If ready_event is nonzero, an event of
+// that type is pushed each time a slide is ready, so the render loop can
+// sleep in SDL_WaitEvent instead of polling.
+Prefetcher *prefetch_create(WorkPool *pool, int depth, int cat_index, PrefetchPick pick,
+                            PrefetchUnpick unpick, PrefetchLoader loader, void *user,
+                            Uint32 ready_event);
+void prefetch_destroy(Prefetcher *pf);
+
+// Switch categories; loads still queued for the old one are pulled from
+// the pool, ones already running are dropped when they finish, and their
+// picks are handed to unpick
+void prefetch_set_category(Prefetcher *pf, int cat_index);
+
+// Take the oldest ready slide without blocking. The caller owns the surface.
+bool prefetch_pop(Prefetcher *pf, PrefetchSlide *out);
+
+bool prefetch_job_cancelled(const PrefetchJob *job);
+
+// Whether a preview of the job's slide would be shown: it's the next one
+// and prefetch_pop() has been asked for it. Loaders can skip the work of
+// making previews otherwise.
+bool prefetch_wants_preview(const PrefetchJob *job);
+
+// Offer a partial picture of the job's slide (e.g. a progressive image
+// still downloading) to show until it's ready. Takes the surface, which is
+// simply freed if the slide isn't wanted yet. Pushes ready_event.
+void prefetch_preview(const PrefetchJob *job, SDL_Surface *surface);
+
+// The newest preview of the next slide since the last call, or NULL. The
+// caller owns the surface.
+SDL_Surface *prefetch_take_preview(Prefetcher *pf);
+
+#endif
@@ -0,0 +1,398 @@
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <jpeglib.h>
+#include <png.h>
+
+#include "membudget.h"
+#include "progressive.h"
+
+#define SNIFF_BYTES 8       // enough to tell a JPEG from a PNG
+#define PNG_PASSES  7
+
+typedef enum {
+    PD_SNIFF,       // too few bytes yet to tell what it is
+    PD_JPEG,        // reading a progressive JPEG's header and scans
+    PD_PNG,         // feeding an interlaced PNG to libpng
+    PD_COMPLETE,    // all of it is in; progressive_finish() can run
+    PD_IGNORED,     // not something to decode early, or broken
+} ProgressiveState;
+
+typedef struct {
+    struct jpeg_error_mgr pub;
+    jmp_buf jump;
+} JpegError;
+
+struct ProgressiveDecoder {
+    ProgressiveState state;
+    bool     is_png;
+    FitMode  mode;
+    int      dst_w, dst_h;
+    int      previewed;     // how complete the last preview was
+
+    // Bytes fed in but not used yet, for sniffing and for libjpeg, which
+    // backs up to the start of whatever it couldn't finish. src tracks the
+    // unused part.
+    unsigned char *buf;
+    size_t   capacity;
+    size_t   skip;          // libjpeg skipped past the end of what we had
+    struct jpeg_source_mgr src;
+
+    SDL_Surface *surface;   // decode target, may be scratch memory
+
+    struct jpeg_decompress_struct cinfo;
+    JpegError jerr;
+    bool     have_jpeg;
+    bool     started;       // jpeg_start_decompress() is done
+
+    png_structp png;
+    png_infop   info;
+    int      passes;        // PNG passes fully decoded
+};
+
+// Drop the decoder state; the caller decodes the whole file instead
+static void release(ProgressiveDecoder *pd) {
+    if (pd->have_jpeg) jpeg_destroy_decompress(&pd->cinfo);
+    pd->have_jpeg = false;
+    if (pd->png) png_destroy_read_struct(&pd->png, pd->info ? &pd->info : NULL, NULL);
+    pd->png  = NULL;
+    pd->info = NULL;
+    if (pd->surface) SDL_FreeSurface(pd->surface);
+    pd->surface = NULL;
+    free(pd->buf);
+    pd->buf = NULL;
+    pd->capacity = 0;
+    pd->src.next_input_byte = NULL;
+    pd->src.bytes_in_buffer = 0;
+}
+
+static void ignore(ProgressiveDecoder *pd) {
+    release(pd);
+    pd->state = PD_IGNORED;
+}
+
+// Keep what hasn't been used yet and add the new bytes after it
+static bool buffer_input(ProgressiveDecoder *pd, const unsigned char *data, size_t size) {
+    size_t skipped = pd->skip < size ? pd->skip : size;
+    pd->skip -= skipped;
+    data += skipped;
+    size -= skipped;
+
+    size_t keep = pd->src.bytes_in_buffer;
+    if (keep && pd->src.next_input_byte != pd->buf)
+        memmove(pd->buf, pd->src.next_input_byte, keep);
+    if (keep + size > pd->capacity) {
+        size_t cap = pd->capacity ? pd->capacity : 16 * 1024;
+        while (cap < keep + size) cap *= 2;
+        unsigned char *p = realloc(pd->buf, cap);
+        if (!p) return false;
+        pd->buf = p;
+        pd->capacity = cap;
+    }
+    if (size) memcpy(pd->buf + keep, data, size);
+    pd->src.next_input_byte = pd->buf;
+    pd->src.bytes_in_buffer = keep + size;
+    return true;
+}
+
+// ---- JPEG: buffered-image mode over a suspending source ----
+
+static void jpeg_error_exit(j_common_ptr cinfo) {
+    JpegError *err = (JpegError *)cinfo->err;
+    longjmp(err->jump, 1);
+}
+
+static void jpeg_output_message(j_common_ptr cinfo) {
+    // Keep libjpeg warnings off stderr
+}
+
+static void src_init(j_decompress_ptr cinfo) {}
+static void src_term(j_decompress_ptr cinfo) {}
+
+// Out of data: suspend, and carry on from the same spot on the next feed
+static boolean src_fill(j_decompress_ptr cinfo) {
+    return FALSE;
+}
+
+static void src_skip(j_decompress_ptr cinfo, long count) {
+    ProgressiveDecoder *pd = cinfo->client_data;
+    if (count <= 0) return;
+    size_t n = (size_t)count;
+    if (n > pd->src.bytes_in_buffer) {
+        pd->skip += n - pd->src.bytes_in_buffer;
+        n = pd->src.bytes_in_buffer;
+    }
+    pd->src.next_input_byte += n;
+    pd->src.bytes_in_buffer -= n;
+}
+
+// Take in as much as has arrived. The work per byte is only entropy
+// decoding into libjpeg's coefficient buffer; pixels are made on demand.
+static void feed_jpeg(ProgressiveDecoder *pd) {
+    struct jpeg_decompress_struct *cinfo = &pd->cinfo;
+    if (setjmp(pd->jerr.jump)) {
+        ignore(pd);
+        return;
+    }
+
+    if (!pd->have_jpeg) {
+        cinfo->err = jpeg_std_error(&pd->jerr.pub);
+        pd->jerr.pub.error_exit     = jpeg_error_exit;
+        pd->jerr.pub.output_message = jpeg_output_message;
+        jpeg_create_decompress(cinfo);
+        pd->have_jpeg = true;
+        cinfo->client_data = pd;
+        pd->src.init_source       = src_init;
+        pd->src.fill_input_buffer = src_fill;
+        pd->src.skip_input_data   = src_skip;
+        pd->src.resync_to_restart = jpeg_resync_to_restart;
+        pd->src.term_source       = src_term;
+        cinfo->src = &pd->src;
+    }
+
+    if (!pd->started) {
+        if (jpeg_read_header(cinfo, TRUE) == JPEG_SUSPENDED) return;
+        // A baseline JPEG has one scan, top to bottom; nothing to show early
+        if (!jpeg_has_multiple_scans(cinfo)) {
+            ignore(pd);
+            return;
+        }
+        cinfo->scale_num   = 1;
+        cinfo->scale_denom = decode_scale_denom(cinfo->image_width, cinfo->image_height,
+                                                pd->mode, pd->dst_w, pd->dst_h);
+#ifdef JCS_EXTENSIONS
+        cinfo->out_color_space = JCS_EXT_RGBA;
+        Uint32 format = SDL_PIXELFORMAT_RGBA32;
+#else
+        cinfo->out_color_space = JCS_RGB;
+        Uint32 format = SDL_PIXELFORMAT_RGB24;
+#endif
+        cinfo->buffered_image = TRUE;
+        jpeg_start_decompress(cinfo);   // returns at once in buffered-image mode
+
+        pd->surface = scratch_surface(cinfo->output_width, cinfo->output_height, format);
+        if (!pd->surface) {
+            ignore(pd);
+            return;
+        }
+        pd->started = true;
+    }
+
+    for (;;) {
+        int rc = jpeg_consume_input(cinfo);
+        if (rc == JPEG_SUSPENDED) return;
+        if (rc == JPEG_REACHED_EOI) {
+            pd->state = PD_COMPLETE;
+            return;
+        }
+    }
+}
+
+// Render everything up to scan into the surface. scan must be complete, or
+// libjpeg would have to wait for more input halfway through.
+static bool output_jpeg(ProgressiveDecoder *pd, int scan) {
+    struct jpeg_decompress_struct *cinfo = &pd->cinfo;
+    jpeg_start_output(cinfo, scan);
+    while (cinfo->output_scanline < cinfo->output_height) {
+        JSAMPROW row = (JSAMPROW)pd->surface->pixels +
+                       (size_t)cinfo->output_scanline * pd->surface->pitch;
+        if (jpeg_read_scanlines(cinfo, &row, 1) != 1) return false;
+    }
+    return jpeg_finish_output(cinfo);
+}
+
+// ---- PNG: libpng's push reader, Adam7 only ----
+
+static void png_quiet_error(png_structp png, png_const_charp msg) {
+    png_longjmp(png, 1);
+}
+
+static void png_quiet_warning(png_structp png, png_const_charp msg) {
+}
+
+static void on_png_info(png_structp png, png_infop info) {
+    ProgressiveDecoder *pd = png_get_progressive_ptr(png);
+    png_uint_32 w, h;
+    int depth, color, interlace;
+    png_get_IHDR(png, info, &w, &h, &depth, &color, &interlace, NULL, NULL);
+    // A plain PNG arrives top to bottom; nothing to show early
+    if (interlace != PNG_INTERLACE_ADAM7) png_error(png, "not interlaced");
+
+    png_set_expand(png);
+    png_set_strip_16(png);
+    if (color == PNG_COLOR_TYPE_GRAY || color == PNG_COLOR_TYPE_GRAY_ALPHA)
+        png_set_gray_to_rgb(png);
+    png_set_add_alpha(png, 0xFF, PNG_FILLER_AFTER);
+    png_set_interlace_handling(png);
+    png_read_update_info(png, info);
+    if (png_get_rowbytes(png, info) != (size_t)w * 4) png_error(png, "unexpected row size");
+
+    pd->surface = scratch_surface((int)w, (int)h, SDL_PIXELFORMAT_RGBA32);
+    if (!pd->surface) png_error(png, "out of memory");
+}
+
+static void on_png_row(png_structp png, png_bytep row, png_uint_32 y, int pass) {
+    ProgressiveDecoder *pd = png_get_progressive_ptr(png);
+    if (pass > pd->passes) pd->passes = pass;   // the ones before it are done
+    if (y >= (png_uint_32)pd->surface->h) return;
+    png_progressive_combine_row(png, (png_bytep)pd->surface->pixels + (size_t)y * pd->surface->pitch,
+                                row);
+}
+
+static void on_png_end(png_structp png, png_infop info) {
+    ProgressiveDecoder *pd = png_get_progressive_ptr(png);
+    pd->passes = PNG_PASSES;
+    pd->state  = PD_COMPLETE;
+}
+
+static void feed_png(ProgressiveDecoder *pd, const unsigned char *data, size_t size) {
+    if (setjmp(png_jmpbuf(pd->png))) {
+        ignore(pd);
+        return;
+    }
+    png_process_data(pd->png, pd->info, (png_bytep)data, size);
+}
+
+static void start_png(ProgressiveDecoder *pd) {
+    pd->png  = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, png_quiet_error,
+                                      png_quiet_warning);
+    pd->info = pd->png ? png_create_info_struct(pd->png) : NULL;
+    if (!pd->info) {
+        ignore(pd);
+        return;
+    }
+    png_set_progressive_read_fn(pd->png, pd, on_png_info, on_png_row, on_png_end);
+    pd->is_png = true;
+    pd->state  = PD_PNG;
+
+    // libpng keeps what it needs itself, so the sniffed bytes can go
+    unsigned char *sniffed = pd->buf;
+    size_t size = pd->src.bytes_in_buffer;
+    pd->buf = NULL;
+    pd->capacity = 0;
+    pd->src.bytes_in_buffer = 0;
+    feed_png(pd, sniffed, size);
+    free(sniffed);
+}
+
+// After Adam7 passes 1, 3 and 5 the known pixels form a square grid, one
+// per 8x8, 4x4 and 2x2 block; pick them out into a small image
+static SDL_Surface *png_grid(const ProgressiveDecoder *pd, int level) {
+    const SDL_Surface *src = pd->surface;
+    int step = 16 >> level;
+    int w = (src->w + step - 1) / step;
+    int h = (src->h + step - 1) / step;
+    SDL_Surface *grid = SDL_CreateRGBSurfaceWithFormat(0, w, h, 32, SDL_PIXELFORMAT_RGBA32);
+    if (!grid) return NULL;
+    for (int y = 0; y < h; y++) {
+        const Uint32 *in = (const Uint32 *)((const Uint8 *)src->pixels +
+                                            (size_t)y * step * src->pitch);
+        Uint32 *out = (Uint32 *)((Uint8 *)grid->pixels + (size_t)y * grid->pitch);
+        for (int x = 0; x < w; x++)
+            out[x] = in[x * step];
+    }
+    return grid;
+}
+
+// How far along a preview would be: complete JPEG scans, or the PNG grid
+// level (1 to 3) reached
+static int completed(const ProgressiveDecoder *pd) {
+    if (pd->is_png)
+        return pd->passes >= 5 ? 3 : pd->passes >= 3 ? 2 : pd->passes >= 1 ? 1 : 0;
+    if (!pd->started) return 0;
+    // The scan being read is only known to be complete once the next
+    // one's header (or the end of the file) is in
+    return jpeg_input_complete((j_decompress_ptr)&pd->cinfo) ? pd->cinfo.input_scan_number
+                                                             : pd->cinfo.input_scan_number - 1;
+}
+
+ProgressiveDecoder *progressive_create(FitMode mode, int dst_w, int dst_h) {
+    ProgressiveDecoder *pd = calloc(1, sizeof(ProgressiveDecoder));
+    if (!pd) return NULL;
+    pd->state = PD_SNIFF;
+    pd->mode  = mode;
+    pd->dst_w = dst_w;
+    pd->dst_h = dst_h;
+    return pd;
+}
+
+void progressive_destroy(ProgressiveDecoder *pd) {
+    if (!pd) return;
+    release(pd);
+    free(pd);
+}
+
+void progressive_feed(ProgressiveDecoder *pd, const unsigned char *data, size_t size) {
+    if (pd->state == PD_PNG) {
+        feed_png(pd, data, size);
+        return;
+    }
+    if (pd->state != PD_SNIFF && pd->state != PD_JPEG) return;
+
+    if (!buffer_input(pd, data, size)) {
+        ignore(pd);
+        return;
+    }
+    if (pd->state == PD_SNIFF) {
+        const unsigned char *head = pd->src.next_input_byte;
+        if (pd->src.bytes_in_buffer < SNIFF_BYTES) return;
+        if (is_jpeg_data(head, SNIFF_BYTES)) {
+            pd->state = PD_JPEG;
+        } else if (png_sig_cmp((png_const_bytep)head, 0, SNIFF_BYTES) == 0) {
+            start_png(pd);
+            return;
+        } else {
+            ignore(pd);
+            return;
+        }
+    }
+    feed_jpeg(pd);
+}
+
+bool progressive_active(const ProgressiveDecoder *pd) {
+    return pd->state != PD_IGNORED;
+}
+
+SDL_Surface *progressive_preview(ProgressiveDecoder *pd) {
+    if (pd->state != PD_JPEG && pd->state != PD_PNG) return NULL;
+    int level = completed(pd);
+    if (level <= pd->previewed) return NULL;
+    pd->previewed = level;
+
+    SDL_Surface *small;
+    if (pd->is_png) {
+        small = png_grid(pd, level);
+    } else {
+        if (setjmp(pd->jerr.jump)) {
+            ignore(pd);
+            return NULL;
+        }
+        if (!output_jpeg(pd, level)) {
+            ignore(pd);
+            return NULL;
+        }
+        small = SDL_DuplicateSurface(pd->surface);  // out of scratch memory
+    }
+    return small ? shrink_surface(small, pd->mode, pd->dst_w, pd->dst_h) : NULL;
+}
+
+SDL_Surface *progressive_finish(ProgressiveDecoder *pd) {
+    if (pd->state != PD_COMPLETE) return NULL;
+    if (!pd->is_png) {
+        if (setjmp(pd->jerr.jump)) {
+            ignore(pd);
+            return NULL;
+        }
+        // One last pass over every scan, at full quality
+        if (!output_jpeg(pd, pd->cinfo.input_scan_number)) {
+            ignore(pd);
+            return NULL;
+        }
+        jpeg_finish_decompress(&pd->cinfo);
+    }
+    SDL_Surface *surface = pd->surface;
+    pd->surface = NULL;
+    ignore(pd);
+    return surface;
+}
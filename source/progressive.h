@@ -0,0 +1,43 @@
+#ifndef PROGRESSIVE_H
+#define PROGRESSIVE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <SDL2/SDL.h>
+
+#include "decode.h"
+
+// Decodes a progressive JPEG or an Adam7-interlaced PNG while it is still
+// downloading, so a slow link shows a coarse picture early and sharpens it
+// as more arrives. JPEGs go through libjpeg's buffered-image mode, PNGs
+// through libpng's push reader; bytes are fed in as they come and nothing
+// is kept once the decoder has used it.
+//
+// Anything else (baseline JPEGs, plain PNGs, other formats) is spotted from
+// its header and then ignored: progressive_finish() returns NULL and the
+// caller decodes the whole download the usual way.
+
+typedef struct ProgressiveDecoder ProgressiveDecoder;
+
+// Previews and the final image are for an image placed on a dst_w x dst_h
+// screen, as with decode_jpeg_mem()
+ProgressiveDecoder *progressive_create(FitMode mode, int dst_w, int dst_h);
+void progressive_destroy(ProgressiveDecoder *pd);
+
+// The next size bytes of the file
+void progressive_feed(ProgressiveDecoder *pd, const unsigned char *data, size_t size);
+
+// False once the data turned out not to be progressive, or broken
+bool progressive_active(const ProgressiveDecoder *pd);
+
+// The picture so far, if more scans (or PNG passes) are complete than at
+// the last call, else NULL. Already shrunk to its placed size; the caller
+// owns it.
+SDL_Surface *progressive_preview(ProgressiveDecoder *pd);
+
+// The whole image, once the last byte has been fed, or NULL if the data
+// wasn't progressive or was cut short. Like decode_jpeg_mem() it may be
+// scratch memory; pass it to shrink_surface().
+SDL_Surface *progressive_finish(ProgressiveDecoder *pd);
+
+#endif
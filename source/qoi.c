@@ -0,0 +1,181 @@
+#include <string.h>
+
+#include "qoi.h"
+
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF  0x40
+#define QOI_OP_LUMA  0x80
+#define QOI_OP_RUN   0xc0
+#define QOI_OP_RGB   0xfe
+#define QOI_OP_RGBA  0xff
+#define QOI_MASK_2   0xc0
+
+#define QOI_HASH(p) (((p)[0] * 3 + (p)[1] * 5 + (p)[2] * 7 + (p)[3] * 11) % 64)
+
+// Largest image we'll accept, to keep width * height * 4 well inside size_t
+#define QOI_MAX_PIXELS 400000000u
+
+static const unsigned char QOI_END[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+
+static void write_be32(unsigned char *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static uint32_t read_be32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+size_t qoi_max_size(const QoiDesc *desc) {
+    if (desc->width == 0 || desc->height == 0 ||
+        (desc->channels != 3 && desc->channels != 4) ||
+        desc->height >= QOI_MAX_PIXELS / desc->width)
+        return 0;
+    return (size_t)desc->width * desc->height * (desc->channels + 1) +
+           QOI_HEADER_SIZE + sizeof(QOI_END);
+}
+
+size_t qoi_encode(const unsigned char *rgba, int pitch, const QoiDesc *desc,
+                  unsigned char *out) {
+    if (qoi_max_size(desc) == 0) return 0;
+
+    size_t n = 0;
+    memcpy(out, "qoif", 4);
+    write_be32(out + 4, desc->width);
+    write_be32(out + 8, desc->height);
+    out[12] = desc->channels;
+    out[13] = desc->colorspace;
+    n = QOI_HEADER_SIZE;
+
+    unsigned char index[64][4];
+    memset(index, 0, sizeof(index));
+    unsigned char prev[4] = {0, 0, 0, 255};
+    int run = 0;
+
+    for (uint32_t y = 0; y < desc->height; y++) {
+        const unsigned char *row = rgba + (size_t)y * pitch;
+        for (uint32_t x = 0; x < desc->width; x++) {
+            unsigned char px[4] = { row[x * 4], row[x * 4 + 1], row[x * 4 + 2],
+                                    desc->channels == 4 ? row[x * 4 + 3] : 255 };
+
+            if (memcmp(px, prev, 4) == 0) {
+                run++;
+                if (run == 62) {
+                    out[n++] = QOI_OP_RUN | (run - 1);
+                    run = 0;
+                }
+                continue;
+            }
+            if (run > 0) {
+                out[n++] = QOI_OP_RUN | (run - 1);
+                run = 0;
+            }
+
+            int h = QOI_HASH(px);
+            if (memcmp(index[h], px, 4) == 0) {
+                out[n++] = QOI_OP_INDEX | h;
+            } else {
+                memcpy(index[h], px, 4);
+                if (px[3] == prev[3]) {
+                    signed char vr = px[0] - prev[0];
+                    signed char vg = px[1] - prev[1];
+                    signed char vb = px[2] - prev[2];
+                    signed char vg_r = vr - vg;
+                    signed char vg_b = vb - vg;
+
+                    if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+                        out[n++] = QOI_OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2);
+                    } else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 &&
+                               vg_b > -9 && vg_b < 8) {
+                        out[n++] = QOI_OP_LUMA | (vg + 32);
+                        out[n++] = (vg_r + 8) << 4 | (vg_b + 8);
+                    } else {
+                        out[n++] = QOI_OP_RGB;
+                        out[n++] = px[0];
+                        out[n++] = px[1];
+                        out[n++] = px[2];
+                    }
+                } else {
+                    out[n++] = QOI_OP_RGBA;
+                    memcpy(out + n, px, 4);
+                    n += 4;
+                }
+            }
+            memcpy(prev, px, 4);
+        }
+    }
+    if (run > 0) out[n++] = QOI_OP_RUN | (run - 1);
+
+    memcpy(out + n, QOI_END, sizeof(QOI_END));
+    n += sizeof(QOI_END);
+    return n;
+}
+
+int qoi_read_header(const unsigned char *data, size_t size, QoiDesc *desc) {
+    if (size < QOI_HEADER_SIZE || memcmp(data, "qoif", 4) != 0) return -1;
+    desc->width      = read_be32(data + 4);
+    desc->height     = read_be32(data + 8);
+    desc->channels   = data[12];
+    desc->colorspace = data[13];
+    if (desc->width == 0 || desc->height == 0 ||
+        (desc->channels != 3 && desc->channels != 4) ||
+        desc->height >= QOI_MAX_PIXELS / desc->width)
+        return -1;
+    return 0;
+}
+
+int qoi_decode(const unsigned char *data, size_t size, unsigned char *rgba, int pitch) {
+    QoiDesc desc;
+    if (qoi_read_header(data, size, &desc) != 0) return -1;
+
+    unsigned char index[64][4];
+    memset(index, 0, sizeof(index));
+    unsigned char px[4] = {0, 0, 0, 255};
+    int run = 0;
+
+    size_t p = QOI_HEADER_SIZE;
+    size_t end = size >= sizeof(QOI_END) ? size - sizeof(QOI_END) : 0;
+
+    for (uint32_t y = 0; y < desc.height; y++) {
+        unsigned char *row = rgba + (size_t)y * pitch;
+        for (uint32_t x = 0; x < desc.width; x++) {
+            if (run > 0) {
+                run--;
+            } else {
+                if (p >= end) return -1;
+                int b1 = data[p++];
+
+                if (b1 == QOI_OP_RGB) {
+                    if (p + 3 > end) return -1;
+                    px[0] = data[p++];
+                    px[1] = data[p++];
+                    px[2] = data[p++];
+                } else if (b1 == QOI_OP_RGBA) {
+                    if (p + 4 > end) return -1;
+                    memcpy(px, data + p, 4);
+                    p += 4;
+                } else if ((b1 & QOI_MASK_2) == QOI_OP_INDEX) {
+                    memcpy(px, index[b1], 4);
+                } else if ((b1 & QOI_MASK_2) == QOI_OP_DIFF) {
+                    px[0] += ((b1 >> 4) & 0x03) - 2;
+                    px[1] += ((b1 >> 2) & 0x03) - 2;
+                    px[2] += ( b1       & 0x03) - 2;
+                } else if ((b1 & QOI_MASK_2) == QOI_OP_LUMA) {
+                    if (p >= end) return -1;
+                    int b2 = data[p++];
+                    int vg = (b1 & 0x3f) - 32;
+                    px[0] += vg - 8 + ((b2 >> 4) & 0x0f);
+                    px[1] += vg;
+                    px[2] += vg - 8 + (b2 & 0x0f);
+                } else {
+                    run = b1 & 0x3f;
+                }
+                memcpy(index[QOI_HASH(px)], px, 4);
+            }
+            memcpy(row + x * 4, px, 4);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,36 @@
+#ifndef QOI_H
+#define QOI_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The "Quite OK Image" format (https://qoiformat.org): lossless, roughly
+// PNG-sized for screenshots and decodes many times faster, which makes it
+// a good fit for caching already-scaled slides.
+
+#define QOI_HEADER_SIZE 14
+
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint8_t  channels;    // 3 = RGB, 4 = RGBA
+    uint8_t  colorspace;
+} QoiDesc;
+
+// Worst-case encoded size for desc, or 0 if the image is invalid or too big
+size_t qoi_max_size(const QoiDesc *desc);
+
+// Encode RGBA pixels (4 bytes each, rows `pitch` bytes apart) into out,
+// which must hold qoi_max_size(desc) bytes. With desc->channels == 3 alpha
+// is ignored. Returns the encoded size, or 0 on error.
+size_t qoi_encode(const unsigned char *rgba, int pitch, const QoiDesc *desc,
+                  unsigned char *out);
+
+// Read just the header. Returns 0 if data starts with a valid QOI header.
+int qoi_read_header(const unsigned char *data, size_t size, QoiDesc *desc);
+
+// Decode into RGBA (4 bytes per pixel, rows `pitch` bytes apart, at least
+// desc->width * 4). Returns 0, or -1 if the data is truncated or corrupt.
+int qoi_decode(const unsigned char *data, size_t size, unsigned char *rgba, int pitch);
+
+#endif
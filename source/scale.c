@@ -0,0 +1,292 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SCALE_NEON 1
+#endif
+
+#include "membudget.h"
+#include "scale.h"
+#include "workpool.h"
+
+#define WEIGHT_BITS 14
+#define WEIGHT_ONE  (1 << WEIGHT_BITS)
+
+// For each output pixel along one axis: the first source pixel and
+// `taps` weights (fixed point, summing to WEIGHT_ONE)
+typedef struct {
+    int      *start;
+    uint16_t *weights;
+    int       taps;
+} Taps;
+
+static void free_taps(Taps *t) {
+    scratch_free(t->weights);
+    scratch_free(t->start);
+}
+
+static int build_taps(Taps *t, int src_n, int dst_n) {
+    double scale = (double)src_n / dst_n;
+    int box = scale >= 2.0;
+
+    t->taps    = box ? (int)ceil(scale) + 1 : 2;
+    if (t->taps > src_n) t->taps = src_n;
+    t->start   = scratch_alloc(dst_n * sizeof(int));
+    t->weights = scratch_alloc((size_t)dst_n * t->taps * sizeof(uint16_t));
+    double *fw = scratch_alloc(t->taps * sizeof(double));
+    if (!t->start || !t->weights || !fw) {
+        scratch_free(fw);
+        free_taps(t);
+        return 0;
+    }
+    memset(t->weights, 0, (size_t)dst_n * t->taps * sizeof(uint16_t));
+
+    for (int i = 0; i < dst_n; i++) {
+        uint16_t *w = &t->weights[(size_t)i * t->taps];
+        int first;
+        for (int k = 0; k < t->taps; k++) fw[k] = 0.0;
+
+        if (box) {
+            // Average the source pixels the output pixel covers, weighting
+            // the partially covered ones at either end
+            double lo = i * scale, hi = lo + scale;
+            first = (int)lo;
+            for (int k = 0; k < t->taps && first + k < src_n; k++) {
+                double a = first + k > lo ? first + k : lo;
+                double b = first + k + 1 < hi ? first + k + 1 : hi;
+                if (b > a) fw[k] = (b - a) / scale;
+            }
+        } else {
+            double center = (i + 0.5) * scale - 0.5;
+            if (center < 0) center = 0;
+            first = (int)center;
+            if (first > src_n - 2) first = src_n - 2;
+            if (first < 0) {
+                // Single-pixel source
+                first = 0;
+                fw[0] = 1.0;
+            } else {
+                double f = center - first;
+                if (f > 1.0) f = 1.0;
+                fw[0] = 1.0 - f;
+                fw[1] = f;
+            }
+        }
+
+        // Round to fixed point and put the rounding error on the largest
+        // tap so every output pixel sums to exactly WEIGHT_ONE
+        int sum = 0, big = 0;
+        for (int k = 0; k < t->taps; k++) {
+            w[k] = (uint16_t)(fw[k] * WEIGHT_ONE + 0.5);
+            sum += w[k];
+            if (w[k] > w[big]) big = k;
+        }
+        w[big] += WEIGHT_ONE - sum;
+
+        // Keep every tap inside the row
+        if (first + t->taps > src_n) {
+            int shift = first + t->taps - src_n;
+            memmove(w + shift, w, (t->taps - shift) * sizeof(uint16_t));
+            memset(w, 0, shift * sizeof(uint16_t));
+            first -= shift;
+        }
+        t->start[i] = first;
+    }
+    scratch_free(fw);
+    return 1;
+}
+
+// Horizontal pass: one source row of 4-byte pixels into dst_w pixels
+static void scale_row(const uint8_t *src, uint8_t *dst, int dst_w, const Taps *t) {
+    for (int x = 0; x < dst_w; x++) {
+        const uint8_t  *p = src + (size_t)t->start[x] * 4;
+        const uint16_t *w = &t->weights[(size_t)x * t->taps];
+#ifdef SCALE_NEON
+        uint32x4_t acc = vdupq_n_u32(0);
+        for (int k = 0; k < t->taps; k++, p += 4) {
+            uint32_t px;
+            memcpy(&px, p, 4);
+            uint16x4_t c = vget_low_u16(vmovl_u8(vcreate_u8(px)));
+            acc = vmlal_n_u16(acc, c, w[k]);
+        }
+        uint16x4_t r = vrshrn_n_u32(acc, WEIGHT_BITS);
+        uint8x8_t  b = vqmovn_u16(vcombine_u16(r, r));
+        vst1_lane_u32((uint32_t *)(dst + (size_t)x * 4), vreinterpret_u32_u8(b), 0);
+#else
+        uint32_t acc[4] = {0, 0, 0, 0};
+        for (int k = 0; k < t->taps; k++, p += 4) {
+            acc[0] += p[0] * w[k];
+            acc[1] += p[1] * w[k];
+            acc[2] += p[2] * w[k];
+            acc[3] += p[3] * w[k];
+        }
+        uint8_t *d = dst + (size_t)x * 4;
+        for (int c = 0; c < 4; c++) {
+            uint32_t v = (acc[c] + WEIGHT_ONE / 2) >> WEIGHT_BITS;
+            d[c] = v > 255 ? 255 : (uint8_t)v;
+        }
+#endif
+    }
+}
+
+// Vertical pass: blend `taps` horizontally scaled rows into one output row
+static void blend_rows(uint8_t *const *rows, const uint16_t *w, int taps,
+                       uint8_t *dst, int bytes) {
+    int i = 0;
+#ifdef SCALE_NEON
+    for (; i + 16 <= bytes; i += 16) {
+        uint32x4_t a0 = vdupq_n_u32(0), a1 = a0, a2 = a0, a3 = a0;
+        for (int k = 0; k < taps; k++) {
+            if (!w[k]) continue;
+            uint8x16_t v  = vld1q_u8(rows[k] + i);
+            uint16x8_t lo = vmovl_u8(vget_low_u8(v));
+            uint16x8_t hi = vmovl_u8(vget_high_u8(v));
+            a0 = vmlal_n_u16(a0, vget_low_u16(lo),  w[k]);
+            a1 = vmlal_n_u16(a1, vget_high_u16(lo), w[k]);
+            a2 = vmlal_n_u16(a2, vget_low_u16(hi),  w[k]);
+            a3 = vmlal_n_u16(a3, vget_high_u16(hi), w[k]);
+        }
+        uint16x8_t lo = vcombine_u16(vrshrn_n_u32(a0, WEIGHT_BITS), vrshrn_n_u32(a1, WEIGHT_BITS));
+        uint16x8_t hi = vcombine_u16(vrshrn_n_u32(a2, WEIGHT_BITS), vrshrn_n_u32(a3, WEIGHT_BITS));
+        vst1q_u8(dst + i, vcombine_u8(vqmovn_u16(lo), vqmovn_u16(hi)));
+    }
+#endif
+    for (; i < bytes; i++) {
+        uint32_t acc = WEIGHT_ONE / 2;
+        for (int k = 0; k < taps; k++) acc += rows[k][i] * w[k];
+        acc >>= WEIGHT_BITS;
+        dst[i] = acc > 255 ? 255 : (uint8_t)acc;
+    }
+}
+
+// Row bands scaled in parallel, each with its own ring of horizontally
+// scaled source rows
+#define SCALE_MIN_BAND_ROWS 32
+
+static WorkPool *POOL;
+
+void scale_set_pool(WorkPool *pool) {
+    POOL = pool;
+}
+
+typedef struct {
+    SDL_Surface *in, *out;
+    const Taps  *tx, *ty;
+    int          band_rows;
+    size_t       row_bytes;
+    uint8_t     *rings;         // ty->taps rows per band
+    uint8_t    **rows;          // ty->taps pointers per band
+    int         *ring_rows;     // ty->taps source row numbers per band
+} ScaleJob;
+
+static void scale_band(void *arg, int band) {
+    const ScaleJob *j = arg;
+    const Taps *ty = j->ty;
+    size_t row_bytes = j->row_bytes;
+    uint8_t *ring   = j->rings + (size_t)band * ty->taps * row_bytes;
+    uint8_t **rows  = j->rows + (size_t)band * ty->taps;
+    int *ring_row   = j->ring_rows + (size_t)band * ty->taps;
+    int y0 = band * j->band_rows;
+    int y1 = y0 + j->band_rows < j->out->h ? y0 + j->band_rows : j->out->h;
+
+    // Horizontally scaled source rows, indexed by source row % ty->taps.
+    // Output rows only ever move forward through the source, so ty->taps
+    // slots are enough.
+    for (int k = 0; k < ty->taps; k++) ring_row[k] = -1;
+    for (int y = y0; y < y1; y++) {
+        for (int k = 0; k < ty->taps; k++) {
+            int sy = ty->start[y] + k;
+            int slot = sy % ty->taps;
+            if (ring_row[slot] != sy) {
+                scale_row((const uint8_t *)j->in->pixels + (size_t)sy * j->in->pitch,
+                          ring + slot * row_bytes, j->out->w, j->tx);
+                ring_row[slot] = sy;
+            }
+            rows[k] = ring + slot * row_bytes;
+        }
+        blend_rows(rows, &ty->weights[(size_t)y * ty->taps], ty->taps,
+                   (uint8_t *)j->out->pixels + (size_t)y * j->out->pitch, (int)row_bytes);
+    }
+}
+
+// Scale in (4 bytes per pixel) into out, which has the same format
+static int scale_into(SDL_Surface *in, SDL_Surface *out) {
+    int dst_w = out->w, dst_h = out->h;
+    Taps tx = {0}, ty = {0};
+    ScaleJob job = {0};
+    int rc = -1;
+
+    if (!build_taps(&tx, in->w, dst_w) || !build_taps(&ty, in->h, dst_h))
+        goto done;
+
+    // One band per core, as long as bands stay tall enough that the rows
+    // scaled twice at their edges don't matter
+    int bands = workpool_threads(POOL) + 1;
+    if (bands > dst_h / SCALE_MIN_BAND_ROWS) bands = dst_h / SCALE_MIN_BAND_ROWS;
+    if (bands < 1) bands = 1;
+
+    job.in        = in;
+    job.out       = out;
+    job.tx        = &tx;
+    job.ty        = &ty;
+    job.band_rows = (dst_h + bands - 1) / bands;
+    job.row_bytes = (size_t)dst_w * 4;
+    job.rings     = scratch_alloc(job.row_bytes * ty.taps * bands);
+    job.rows      = scratch_alloc(ty.taps * bands * sizeof(uint8_t *));
+    job.ring_rows = scratch_alloc(ty.taps * bands * sizeof(int));
+    if (!job.rings || !job.rows || !job.ring_rows) goto done;
+
+    if (SDL_MUSTLOCK(in)) SDL_LockSurface(in);
+    workpool_parallel_for(bands > 1 ? POOL : NULL, bands, scale_band, &job);
+    if (SDL_MUSTLOCK(in)) SDL_UnlockSurface(in);
+    rc = 0;
+
+done:
+    scratch_free(job.ring_rows);
+    scratch_free(job.rows);
+    scratch_free(job.rings);
+    free_taps(&ty);
+    free_taps(&tx);
+    return rc;
+}
+
+SDL_Surface *scale_surface(SDL_Surface *src, int dst_w, int dst_h) {
+    if (!src || dst_w < 1 || dst_h < 1) return NULL;
+
+    SDL_Surface *in = src;
+    if (SDL_ISPIXELFORMAT_INDEXED(src->format->format)) {
+        in = SDL_ConvertSurfaceFormat(src, SDL_PIXELFORMAT_ARGB8888, 0);
+        if (!in) return NULL;
+    } else if (src->format->BytesPerPixel != 4) {
+        in = scratch_surface(src->w, src->h, SDL_PIXELFORMAT_ARGB8888);
+        if (!in) return NULL;
+        if (SDL_MUSTLOCK(src)) SDL_LockSurface(src);
+        int rc = SDL_ConvertPixels(src->w, src->h, src->format->format, src->pixels, src->pitch,
+                                   in->format->format, in->pixels, in->pitch);
+        if (SDL_MUSTLOCK(src)) SDL_UnlockSurface(src);
+        if (rc != 0) {
+            SDL_FreeSurface(in);
+            return NULL;
+        }
+    }
+
+    // The output is kept; everything else here is scratch
+    SDL_Surface *out = SDL_CreateRGBSurfaceWithFormat(0, dst_w, dst_h, 32, in->format->format);
+    if (out && scale_into(in, out) != 0) {
+        SDL_FreeSurface(out);
+        out = NULL;
+    }
+    if (in != src) SDL_FreeSurface(in);
+    return out;
+}
+
+int scale_surface_into(SDL_Surface *src, SDL_Surface *dst) {
+    if (!src || !dst || src->format->BytesPerPixel != 4 ||
+        SDL_ISPIXELFORMAT_INDEXED(src->format->format) ||
+        dst->format->format != src->format->format)
+        return -1;
+    return scale_into(src, dst);
+}
@@ -0,0 +1,27 @@
+#ifndef SCALE_H
+#define SCALE_H
+
+#include <SDL2/SDL.h>
+
+#include "workpool.h"
+
+// Separable resampler for 32-bit surfaces. Reductions of 2:1 or more use
+// a box (area-average) filter, anything smaller bilinear. Rows are scaled
+// horizontally on demand into a small ring, so memory is a few rows, not
+// a second full image. Uses NEON on ARM (the Switch), plain C elsewhere.
+// With a worker pool set, the output is split into row bands scaled on
+// all cores at once.
+
+// Returns a new dst_w x dst_h surface in src's pixel format (converted to
+// ARGB8888 first if src isn't 4 bytes per pixel), or NULL on failure.
+SDL_Surface *scale_surface(SDL_Surface *src, int dst_w, int dst_h);
+
+// Scale src into dst, replacing all of it, without allocating a new
+// surface: for frames that go through the same buffer over and over. Both
+// must be 4 bytes per pixel in the same format. 0, or -1 on failure.
+int scale_surface_into(SDL_Surface *src, SDL_Surface *dst);
+
+// Pool to split scales across; NULL (the default) scales on the caller only
+void scale_set_pool(WorkPool *pool);
+
+#endif
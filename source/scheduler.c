@@ -0,0 +1,181 @@
+#include <string.h>
+
+#include "scheduler.h"
+
+void sched_init(Scheduler *s, uint32_t seed) {
+    memset(s, 0, sizeof(*s));
+    for (int i = 0; i < TIMER_COUNT; i++) s->pos[i] = -1;
+    s->online = true;
+    s->charging = true;
+    s->battery_pct = 100;
+    s->charger_pct = 100;
+    s->rng = seed ? seed : 2463534242u;
+}
+
+// ---- heap -----------------------------------------------------------------
+
+static bool earlier(const Scheduler *s, int a, int b) {
+    return s->deadline[s->heap[a]] < s->deadline[s->heap[b]];
+}
+
+static void swap(Scheduler *s, int a, int b) {
+    int t = s->heap[a];
+    s->heap[a] = s->heap[b];
+    s->heap[b] = t;
+    s->pos[s->heap[a]] = a;
+    s->pos[s->heap[b]] = b;
+}
+
+static void sift_up(Scheduler *s, int i) {
+    while (i > 0 && earlier(s, i, (i - 1) / 2)) {
+        swap(s, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void sift_down(Scheduler *s, int i) {
+    for (;;) {
+        int least = i, l = 2 * i + 1, r = l + 1;
+        if (l < s->count && earlier(s, l, least)) least = l;
+        if (r < s->count && earlier(s, r, least)) least = r;
+        if (least == i) return;
+        swap(s, i, least);
+        i = least;
+    }
+}
+
+void sched_at(Scheduler *s, TimerId id, uint64_t when) {
+    s->deadline[id] = when;
+    int i = s->pos[id];
+    if (i < 0) {
+        i = s->count++;
+        s->heap[i] = id;
+        s->pos[id] = i;
+    }
+    // An armed timer may have moved either way
+    sift_up(s, i);
+    sift_down(s, s->pos[id]);
+}
+
+void sched_cancel(Scheduler *s, TimerId id) {
+    int i = s->pos[id];
+    if (i < 0) return;
+    // The last timer takes its place and moves whichever way it has to
+    swap(s, i, --s->count);
+    s->pos[id] = -1;
+    if (i < s->count) {
+        int moved = s->heap[i];
+        sift_up(s, i);
+        sift_down(s, s->pos[moved]);
+    }
+}
+
+bool sched_armed(const Scheduler *s, TimerId id) {
+    return s->pos[id] >= 0;
+}
+
+int sched_due(Scheduler *s, uint64_t now) {
+    if (s->count == 0 || s->deadline[s->heap[0]] > now) return -1;
+    int id = s->heap[0];
+    sched_cancel(s, id);
+    return id;
+}
+
+uint32_t sched_wait(const Scheduler *s, uint64_t now, uint32_t cap) {
+    if (s->count == 0) return cap;
+    uint64_t when = s->deadline[s->heap[0]];
+    if (when <= now) return 0;
+    return when - now < cap ? (uint32_t)(when - now) : cap;
+}
+
+// ---- slide policy ---------------------------------------------------------
+
+static uint32_t next_random(Scheduler *s) {
+    s->rng ^= s->rng << 13;
+    s->rng ^= s->rng >> 17;
+    s->rng ^= s->rng << 5;
+    return s->rng;
+}
+
+void sched_set_power_scale(Scheduler *s, int battery_pct, int charger_pct) {
+    s->battery_pct = battery_pct;
+    s->charger_pct = charger_pct;
+}
+
+uint64_t sched_interval_ms(const Scheduler *s, int interval_mins) {
+    int pct = s->charging ? s->charger_pct : s->battery_pct;
+    return (uint64_t)interval_mins * 60000 * pct / 100;
+}
+
+static uint64_t net_poll_ms(const Scheduler *s) {
+    return s->charging ? SCHED_NET_POLL_MS : SCHED_NET_POLL_BATT_MS;
+}
+
+// Exponential, capped at the interval, with "equal jitter": somewhere in
+// the upper half, so frames that failed together don't retry in lockstep
+static uint64_t backoff_ms(Scheduler *s, int interval_mins) {
+    uint64_t cap = sched_interval_ms(s, interval_mins);
+    uint64_t delay = SCHED_RETRY_MIN_MS;
+    for (int i = 1; i < s->failures && delay < cap; i++) delay *= 2;
+    if (delay > cap) delay = cap;
+    return delay / 2 + next_random(s) % (delay / 2 + 1);
+}
+
+void sched_slide_shown(Scheduler *s, uint64_t now, int interval_mins, bool unreachable) {
+    s->slide_at = now;
+    if (unreachable) {
+        s->failures++;
+        s->retry_ms = backoff_ms(s, interval_mins);
+        sched_at(s, TIMER_SLIDE, now + s->retry_ms);
+        sched_at(s, TIMER_NETWORK, now + net_poll_ms(s));
+    } else {
+        s->failures = 0;
+        sched_at(s, TIMER_SLIDE, now + sched_interval_ms(s, interval_mins));
+        sched_cancel(s, TIMER_NETWORK);
+    }
+}
+
+void sched_slide_wanted(Scheduler *s) {
+    sched_cancel(s, TIMER_SLIDE);
+}
+
+void sched_retime(Scheduler *s, int interval_mins) {
+    if (!sched_armed(s, TIMER_SLIDE)) return;
+    uint64_t wait = sched_interval_ms(s, interval_mins);
+    if (s->failures && s->retry_ms < wait) wait = s->retry_ms;
+    sched_at(s, TIMER_SLIDE, s->slide_at + wait);
+}
+
+bool sched_set_online(Scheduler *s, uint64_t now, bool online) {
+    bool back = online && !s->online;
+    s->online = online;
+    if (s->failures == 0) return false;
+    if (back && sched_armed(s, TIMER_SLIDE)) {
+        // The retry is what tells whether it's really back; keep polling
+        // until a slide gets through
+        sched_at(s, TIMER_SLIDE, now);
+        sched_at(s, TIMER_NETWORK, now + net_poll_ms(s));
+        return true;
+    }
+    sched_at(s, TIMER_NETWORK, now + net_poll_ms(s));
+    return false;
+}
+
+void sched_set_charging(Scheduler *s, bool charging, int interval_mins) {
+    s->charging = charging;
+    sched_retime(s, interval_mins);
+}
+
+static int interval_step_size(int mins) {
+    return mins < 15 ? 1 : mins < 60 ? 5 : mins < 240 ? 15 : 60;
+}
+
+int sched_interval_step(int interval_mins, int dir) {
+    if (dir > 0) {
+        int step = interval_step_size(interval_mins);
+        return (interval_mins / step + 1) * step;
+    }
+    if (interval_mins <= 1) return interval_mins - 1;
+    int step = interval_step_size(interval_mins - 1);
+    return (interval_mins - 1) / step * step;
+}
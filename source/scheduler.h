@@ -0,0 +1,103 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// The render loop's timers and the policy for when the next slide is due.
+//
+// Deadlines live in a min-heap, so the loop sleeps exactly until the
+// earliest one and handles whatever is due when it wakes. A slide whose
+// source couldn't be reached is retried with exponential backoff and
+// jitter instead of after a whole interval, and straight away once the
+// network comes back; intervals are stretched on battery and can be
+// shortened on a charger.
+//
+// Nothing here reads a clock or touches the system: times are passed in,
+// in milliseconds, so the same code runs on the console and under the
+// simulated clock of tools/sched_test.c.
+
+typedef enum {
+    TIMER_SLIDE,        // the next slide (or retry) is due
+    TIMER_UI_HIDE,      // hide the HUD
+    TIMER_CHARGER,      // poll the charger
+    TIMER_NETWORK,      // poll the connection while fetches are failing
+    TIMER_CONFIG,       // check config.ini for edits
+    TIMER_PERF,         // redraw the perf overlay
+    TIMER_SYNC,         // look for images the manifest syncs brought in
+    TIMER_COUNT
+} TimerId;
+
+// Backoff after a failed fetch: the first retry comes after about
+// SCHED_RETRY_MIN_MS, doubling per failure up to the slide interval
+#define SCHED_RETRY_MIN_MS      15000
+// How often the connection is checked while fetches fail
+#define SCHED_NET_POLL_MS       5000    // on a charger
+#define SCHED_NET_POLL_BATT_MS  30000   // on battery
+
+typedef struct {
+    uint64_t deadline[TIMER_COUNT];
+    int      heap[TIMER_COUNT];     // timer ids, earliest deadline first
+    int      pos[TIMER_COUNT];      // index in heap, -1 when not armed
+    int      count;
+
+    uint64_t slide_at;      // when the current slide went up
+    uint64_t retry_ms;      // backoff picked at the last failure
+    int      failures;      // slides in a row whose source was unreachable
+    bool     online;
+    bool     charging;
+    int      battery_pct;   // interval scale on battery, in percent
+    int      charger_pct;   // and on a charger
+    uint32_t rng;
+} Scheduler;
+
+// Nothing armed, online, on a charger, intervals unscaled. seed drives the
+// jitter; any value will do.
+void sched_init(Scheduler *s, uint32_t seed);
+
+// Arm id for time when, or move it there if it's already armed
+void sched_at(Scheduler *s, TimerId id, uint64_t when);
+void sched_cancel(Scheduler *s, TimerId id);
+bool sched_armed(const Scheduler *s, TimerId id);
+
+// The earliest timer due at now, disarmed so it fires once; -1 if none is
+// due. Call until it returns -1.
+int sched_due(Scheduler *s, uint64_t now);
+
+// Milliseconds until the earliest deadline (0 if one is due), at most cap
+uint32_t sched_wait(const Scheduler *s, uint64_t now, uint32_t cap);
+
+// --- slide policy ---
+
+// Percent scales for the slide interval on battery and on a charger
+void sched_set_power_scale(Scheduler *s, int battery_pct, int charger_pct);
+
+// How long a slide stays up at interval_mins, for the current power source
+uint64_t sched_interval_ms(const Scheduler *s, int interval_mins);
+
+// A slide just went up. unreachable means its source couldn't be reached
+// (what's shown, if anything, is an old copy): the next one is then a
+// retry after a backoff, and the connection is polled meanwhile. Arms
+// TIMER_SLIDE and, while failing, TIMER_NETWORK.
+void sched_slide_shown(Scheduler *s, uint64_t now, int interval_mins, bool unreachable);
+
+// The loop is waiting on a slide (its timer fired, or one was forced)
+void sched_slide_wanted(Scheduler *s);
+
+// interval_mins changed, or the power source: move TIMER_SLIDE to match.
+// A pending retry keeps its time unless the new interval is shorter.
+void sched_retime(Scheduler *s, int interval_mins);
+
+// Report the connection (from a TIMER_NETWORK poll or a fetch). Returns
+// true if the slide timer was pulled in because it just came back while
+// fetches were failing.
+bool sched_set_online(Scheduler *s, uint64_t now, bool online);
+
+// Report the power source; re-times the slide for it
+void sched_set_charging(Scheduler *s, bool charging, int interval_mins);
+
+// Next interval for [+] (dir > 0) or [-]: steps of 1 minute up to 15,
+// then 5 up to an hour, 15 up to 4 hours and hours beyond. Unclamped.
+int sched_interval_step(int interval_mins, int dir);
+
+#endif
@@ -0,0 +1,271 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "text.h"
+#include "util.h"
+
+#define ATLAS_SIZE  1024
+#define MAX_GLYPHS  512
+#define LINE_CACHE  32
+
+typedef struct {
+    Uint32   cp;
+    SDL_Rect src;       // in the atlas; w == 0 for blank or unpacked glyphs
+    int      advance;
+} Glyph;
+
+typedef struct {
+    char       *text;
+    size_t      text_cap;
+    Uint32      hash;
+    Uint32      last_used;
+    int         w, h;
+
+    // Vertex batch, laid out at (x, y) in color
+    int         x, y;
+    SDL_Color   color;
+    SDL_Vertex *verts;
+    int        *indices;
+    int         num_quads;
+    int         quad_cap;
+} TextLine;
+
+struct TextRenderer {
+    SDL_Renderer *renderer;
+    TTF_Font     *font;
+    SDL_Texture  *atlas;
+    int           height;
+
+    // Shelf packer state
+    int shelf_x, shelf_y, shelf_h;
+
+    Glyph    glyphs[MAX_GLYPHS];
+    int      num_glyphs;
+
+    TextLine lines[LINE_CACHE];
+    Uint32   stamp;
+};
+
+// Find room for a w x h glyph, one pixel apart, filling the atlas row by row
+static int atlas_pack(TextRenderer *tr, int w, int h, SDL_Rect *out) {
+    if (tr->shelf_x + w > ATLAS_SIZE) {
+        tr->shelf_x = 0;
+        tr->shelf_y += tr->shelf_h + 1;
+        tr->shelf_h = 0;
+    }
+    if (w > ATLAS_SIZE || tr->shelf_y + h > ATLAS_SIZE) return 0;
+
+    out->x = tr->shelf_x;
+    out->y = tr->shelf_y;
+    out->w = w;
+    out->h = h;
+    tr->shelf_x += w + 1;
+    if (h > tr->shelf_h) tr->shelf_h = h;
+    return 1;
+}
+
+static const Glyph *get_glyph(TextRenderer *tr, Uint32 cp) {
+    for (int i = 0; i < tr->num_glyphs; i++)
+        if (tr->glyphs[i].cp == cp) return &tr->glyphs[i];
+    if (tr->num_glyphs >= MAX_GLYPHS) return NULL;
+
+    Glyph *g = &tr->glyphs[tr->num_glyphs++];
+    memset(g, 0, sizeof(*g));
+    g->cp = cp;
+
+    int minx, maxx, miny, maxy;
+    if (TTF_GlyphMetrics32(tr->font, cp, &minx, &maxx, &miny, &maxy, &g->advance) != 0)
+        g->advance = 0;
+
+    // Rasterize in white; lines are tinted through their vertex colors
+    SDL_Color white = {255, 255, 255, 255};
+    SDL_Surface *s = TTF_RenderGlyph32_Blended(tr->font, cp, white);
+    if (!s) return g;
+
+    SDL_Surface *argb = s;
+    if (s->format->format != SDL_PIXELFORMAT_ARGB8888)
+        argb = SDL_ConvertSurfaceFormat(s, SDL_PIXELFORMAT_ARGB8888, 0);
+    if (argb && argb->w > 0 && argb->h > 0 && atlas_pack(tr, argb->w, argb->h, &g->src))
+        SDL_UpdateTexture(tr->atlas, &g->src, argb->pixels, argb->pitch);
+
+    if (argb && argb != s) SDL_FreeSurface(argb);
+    SDL_FreeSurface(s);
+    return g;
+}
+
+// Decode one UTF-8 sequence; invalid bytes come out as '?'
+static Uint32 utf8_next(const char **p) {
+    const unsigned char *s = (const unsigned char *)*p;
+    Uint32 cp;
+    int extra;
+
+    if (s[0] < 0x80)      { cp = s[0];        extra = 0; }
+    else if (s[0] < 0xC0) { *p += 1; return '?'; }
+    else if (s[0] < 0xE0) { cp = s[0] & 0x1F; extra = 1; }
+    else if (s[0] < 0xF0) { cp = s[0] & 0x0F; extra = 2; }
+    else                  { cp = s[0] & 0x07; extra = 3; }
+
+    for (int i = 1; i <= extra; i++) {
+        if ((s[i] & 0xC0) != 0x80) {
+            *p += i;
+            return '?';
+        }
+        cp = (cp << 6) | (s[i] & 0x3F);
+    }
+    *p += extra + 1;
+    return cp;
+}
+
+static int line_reserve(TextLine *line, int quads) {
+    if (quads <= line->quad_cap) return 1;
+    int cap = line->quad_cap ? line->quad_cap : 64;
+    while (cap < quads) cap *= 2;
+
+    SDL_Vertex *v = realloc(line->verts, cap * 4 * sizeof(SDL_Vertex));
+    if (!v) return 0;
+    line->verts = v;
+    int *idx = realloc(line->indices, cap * 6 * sizeof(int));
+    if (!idx) return 0;
+    line->indices = idx;
+    line->quad_cap = cap;
+    return 1;
+}
+
+static void layout_line(TextRenderer *tr, TextLine *line) {
+    line->num_quads = 0;
+    line->x = 0;
+    line->y = 0;
+    line->color = (SDL_Color){255, 255, 255, 255};
+
+    int pen = 0;
+    Uint32 prev = 0;
+    const char *p = line->text;
+    while (*p) {
+        Uint32 cp = utf8_next(&p);
+        const Glyph *g = get_glyph(tr, cp);
+        if (!g) continue;
+
+        if (prev) pen += TTF_GetFontKerningSizeGlyphs32(tr->font, prev, cp);
+        prev = cp;
+
+        if (g->src.w > 0 && line_reserve(line, line->num_quads + 1)) {
+            SDL_Vertex *v = &line->verts[line->num_quads * 4];
+            int *idx = &line->indices[line->num_quads * 6];
+            float x0 = (float)pen, y0 = 0.0f;
+            float x1 = x0 + g->src.w, y1 = y0 + g->src.h;
+            float u0 = (float)g->src.x / ATLAS_SIZE, v0 = (float)g->src.y / ATLAS_SIZE;
+            float u1 = (float)(g->src.x + g->src.w) / ATLAS_SIZE;
+            float v1 = (float)(g->src.y + g->src.h) / ATLAS_SIZE;
+
+            v[0] = (SDL_Vertex){{x0, y0}, line->color, {u0, v0}};
+            v[1] = (SDL_Vertex){{x1, y0}, line->color, {u1, v0}};
+            v[2] = (SDL_Vertex){{x1, y1}, line->color, {u1, v1}};
+            v[3] = (SDL_Vertex){{x0, y1}, line->color, {u0, v1}};
+
+            int base = line->num_quads * 4;
+            idx[0] = base; idx[1] = base + 1; idx[2] = base + 2;
+            idx[3] = base; idx[4] = base + 2; idx[5] = base + 3;
+            line->num_quads++;
+        }
+        pen += g->advance;
+    }
+    line->w = pen;
+    line->h = tr->height;
+}
+
+// Cached layout for text, re-laid out only when it isn't in the cache
+static TextLine *get_line(TextRenderer *tr, const char *utf8) {
+    Uint32 hash = fnv1a32(utf8);
+    tr->stamp++;
+
+    TextLine *victim = &tr->lines[0];
+    for (int i = 0; i < LINE_CACHE; i++) {
+        TextLine *line = &tr->lines[i];
+        if (line->text && line->hash == hash && strcmp(line->text, utf8) == 0) {
+            line->last_used = tr->stamp;
+            return line;
+        }
+        if (line->last_used < victim->last_used) victim = line;
+    }
+
+    size_t len = strlen(utf8) + 1;
+    if (len > victim->text_cap) {
+        char *t = realloc(victim->text, len);
+        if (!t) return NULL;
+        victim->text = t;
+        victim->text_cap = len;
+    }
+    memcpy(victim->text, utf8, len);
+    victim->hash = hash;
+    victim->last_used = tr->stamp;
+    layout_line(tr, victim);
+    return victim;
+}
+
+TextRenderer *text_create(SDL_Renderer *renderer, TTF_Font *font) {
+    TextRenderer *tr = calloc(1, sizeof(TextRenderer));
+    if (!tr) return NULL;
+
+    tr->renderer = renderer;
+    tr->font     = font;
+    tr->height   = TTF_FontHeight(font);
+    tr->atlas    = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+                                     SDL_TEXTUREACCESS_STATIC, ATLAS_SIZE, ATLAS_SIZE);
+    if (!tr->atlas) {
+        free(tr);
+        return NULL;
+    }
+    SDL_SetTextureBlendMode(tr->atlas, SDL_BLENDMODE_BLEND);
+
+    // Start from a fully transparent atlas
+    void *clear = calloc(ATLAS_SIZE * ATLAS_SIZE, 4);
+    if (clear) {
+        SDL_UpdateTexture(tr->atlas, NULL, clear, ATLAS_SIZE * 4);
+        free(clear);
+    }
+
+    // Printable ASCII and the button icons (U+E000..U+E005) up front
+    for (Uint32 cp = 32; cp < 127; cp++) get_glyph(tr, cp);
+    for (Uint32 cp = 0xE000; cp <= 0xE005; cp++) get_glyph(tr, cp);
+    return tr;
+}
+
+void text_destroy(TextRenderer *tr) {
+    if (!tr) return;
+    for (int i = 0; i < LINE_CACHE; i++) {
+        free(tr->lines[i].text);
+        free(tr->lines[i].verts);
+        free(tr->lines[i].indices);
+    }
+    SDL_DestroyTexture(tr->atlas);
+    free(tr);
+}
+
+void text_draw(TextRenderer *tr, const char *utf8, SDL_Color color, int x, int y) {
+    if (!tr) return;
+    TextLine *line = get_line(tr, utf8);
+    if (!line || line->num_quads == 0) return;
+
+    // Move/recolor the cached batch in place if it's drawn somewhere new
+    if (line->x != x || line->y != y ||
+        memcmp(&line->color, &color, sizeof(color)) != 0) {
+        float dx = (float)(x - line->x), dy = (float)(y - line->y);
+        for (int i = 0; i < line->num_quads * 4; i++) {
+            line->verts[i].position.x += dx;
+            line->verts[i].position.y += dy;
+            line->verts[i].color = color;
+        }
+        line->x = x;
+        line->y = y;
+        line->color = color;
+    }
+
+    SDL_RenderGeometry(tr->renderer, tr->atlas, line->verts, line->num_quads * 4,
+                       line->indices, line->num_quads * 6);
+}
+
+void text_size(TextRenderer *tr, const char *utf8, int *w, int *h) {
+    TextLine *line = tr ? get_line(tr, utf8) : NULL;
+    if (w) *w = line ? line->w : 0;
+    if (h) *h = line ? line->h : 0;
+}
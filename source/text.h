@@ -0,0 +1,21 @@
+#ifndef TEXT_H
+#define TEXT_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+
+// Text drawing from a glyph atlas. Glyphs are rasterized once into a GPU
+// texture (ASCII and the button icons up front, anything else on first
+// use), and each laid-out line is cached as a vertex batch, so drawing a
+// string that didn't change costs one SDL_RenderGeometry call.
+
+typedef struct TextRenderer TextRenderer;
+
+TextRenderer *text_create(SDL_Renderer *renderer, TTF_Font *font);
+void text_destroy(TextRenderer *tr);
+
+// Both are no-ops on a NULL renderer (no font loaded)
+void text_draw(TextRenderer *tr, const char *utf8, SDL_Color color, int x, int y);
+void text_size(TextRenderer *tr, const char *utf8, int *w, int *h);
+
+#endif
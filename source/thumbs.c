@@ -0,0 +1,324 @@
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "membudget.h"
+#include "qoi.h"
+#include "thumbs.h"
+#include "util.h"
+
+#define THUMB_MAGIC   "NXTH"
+#define THUMB_VERSION 2   // 2: fill-mode thumbnails are cropped to the screen
+
+typedef struct {
+    char     magic[4];
+    uint32_t version;
+    uint64_t src_size;
+    int64_t  src_mtime;
+    uint32_t fit;
+    uint32_t screen_w;
+    uint32_t screen_h;
+    uint32_t reserved;
+} ThumbHeader;
+
+struct ThumbBuilder {
+    SDL_Thread  *thread;
+    SDL_atomic_t quit;
+    SDL_atomic_t finished;
+    ThumbCache  *tc;
+    const ImageIndex **indexes;
+    int          count;
+    ThumbDecoder decode;
+    ThumbHook    hook;
+};
+
+void thumbs_init(ThumbCache *tc, const char *dir, int fit, int screen_w, int screen_h,
+                 uint64_t budget) {
+    memset(tc, 0, sizeof(*tc));
+    snprintf(tc->dir, sizeof(tc->dir), "%s", dir);
+    tc->fit      = fit;
+    tc->screen_w = screen_w;
+    tc->screen_h = screen_h;
+    tc->budget   = budget;
+    if (budget) mkdir(dir, 0777);
+}
+
+static uint64_t thumb_key(const char *image_path) {
+    return fnv1a64(image_path, strlen(image_path));
+}
+
+static void thumb_path(const ThumbCache *tc, uint64_t key, char *out, size_t len) {
+    snprintf(out, len, "%s/%016llx.thm", tc->dir, (unsigned long long)key);
+}
+
+static void fill_header(const ThumbCache *tc, const struct stat *st, ThumbHeader *h) {
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, THUMB_MAGIC, 4);
+    h->version   = THUMB_VERSION;
+    h->src_size  = (uint64_t)st->st_size;
+    h->src_mtime = (int64_t)st->st_mtime;
+    h->fit       = tc->fit;
+    h->screen_w  = tc->screen_w;
+    h->screen_h  = tc->screen_h;
+}
+
+static int header_fresh(const ThumbCache *tc, const struct stat *st, const ThumbHeader *h) {
+    ThumbHeader want;
+    fill_header(tc, st, &want);
+    return memcmp(h, &want, sizeof(want)) == 0;
+}
+
+SDL_Surface *thumb_load(ThumbCache *tc, const char *image_path, const struct stat *st) {
+    if (tc->budget == 0) return NULL;
+
+    char path[512];
+    thumb_path(tc, thumb_key(image_path), path, sizeof(path));
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+
+    // One sequential read of the whole file
+    struct stat tst;
+    unsigned char *data = NULL;
+    size_t size = 0;
+    if (fstat(fileno(f), &tst) == 0 && tst.st_size > (off_t)sizeof(ThumbHeader)) {
+        size = (size_t)tst.st_size;
+        data = scratch_alloc(size);
+        if (data && fread(data, 1, size, f) != size) {
+            scratch_free(data);
+            data = NULL;
+        }
+    }
+    fclose(f);
+    if (!data) return NULL;
+
+    SDL_Surface *surface = NULL;
+    QoiDesc desc;
+    const unsigned char *qoi = data + sizeof(ThumbHeader);
+    size_t qoi_size = size - sizeof(ThumbHeader);
+    if (header_fresh(tc, st, (const ThumbHeader *)data) &&
+        qoi_read_header(qoi, qoi_size, &desc) == 0) {
+        surface = SDL_CreateRGBSurfaceWithFormat(0, desc.width, desc.height, 32,
+                                                 SDL_PIXELFORMAT_RGBA32);
+        if (surface && qoi_decode(qoi, qoi_size, surface->pixels, surface->pitch) != 0) {
+            SDL_FreeSurface(surface);
+            surface = NULL;
+        }
+    }
+    scratch_free(data);
+    return surface;
+}
+
+int thumb_store(ThumbCache *tc, const char *image_path, const struct stat *st,
+                SDL_Surface *surface) {
+    if (tc->budget == 0) return -1;
+    if ((uint64_t)SDL_AtomicGet(&tc->used_kb) * 1024 >= tc->budget) return -1;
+
+    int alpha = SDL_ISPIXELFORMAT_ALPHA(surface->format->format);
+    SDL_Surface *rgba = surface;
+    if (SDL_ISPIXELFORMAT_INDEXED(surface->format->format)) {
+        rgba = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA32, 0);
+    } else if (surface->format->format != SDL_PIXELFORMAT_RGBA32) {
+        rgba = scratch_surface(surface->w, surface->h, SDL_PIXELFORMAT_RGBA32);
+        if (rgba && SDL_ConvertPixels(surface->w, surface->h, surface->format->format,
+                                      surface->pixels, surface->pitch, SDL_PIXELFORMAT_RGBA32,
+                                      rgba->pixels, rgba->pitch) != 0) {
+            SDL_FreeSurface(rgba);
+            rgba = NULL;
+        }
+    }
+    if (!rgba) return -1;
+
+    QoiDesc desc = { (uint32_t)rgba->w, (uint32_t)rgba->h, alpha ? 4 : 3, 0 };
+    size_t max = qoi_max_size(&desc);
+    unsigned char *qoi = max ? scratch_alloc(max) : NULL;
+    size_t qoi_size = qoi ? qoi_encode(rgba->pixels, rgba->pitch, &desc, qoi) : 0;
+    if (rgba != surface) SDL_FreeSurface(rgba);
+    if (qoi_size == 0) {
+        scratch_free(qoi);
+        return -1;
+    }
+
+    char path[512], tmp[540];
+    thumb_path(tc, thumb_key(image_path), path, sizeof(path));
+    // Per-thread temp name; the worker and the builder may race on one image
+    snprintf(tmp, sizeof(tmp), "%s.%lx.tmp", path, (unsigned long)SDL_ThreadID());
+
+    ThumbHeader h;
+    fill_header(tc, st, &h);
+    FILE *f = fopen(tmp, "wb");
+    int ok = f != NULL;
+    if (ok) {
+        ok = fwrite(&h, sizeof(h), 1, f) == 1 && fwrite(qoi, 1, qoi_size, f) == qoi_size;
+        if (fclose(f) != 0) ok = 0;
+    }
+    scratch_free(qoi);
+
+    struct stat old;
+    int replaced = stat(path, &old) == 0;
+    if (!ok || replace_file(tmp, path) != 0) {
+        remove(tmp);
+        return -1;
+    }
+    if (replaced) SDL_AtomicAdd(&tc->used_kb, -(int)(old.st_size / 1024));
+    SDL_AtomicAdd(&tc->used_kb, (int)((sizeof(h) + qoi_size) / 1024));
+    return 0;
+}
+
+static int header_file_fresh(const ThumbCache *tc, const char *path, const struct stat *st) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0;
+    ThumbHeader h;
+    int fresh = fread(&h, sizeof(h), 1, f) == 1 && header_fresh(tc, st, &h);
+    fclose(f);
+    return fresh;
+}
+
+int thumb_fresh(ThumbCache *tc, const char *image_path, const struct stat *st) {
+    char path[512];
+    thumb_path(tc, thumb_key(image_path), path, sizeof(path));
+    return header_file_fresh(tc, path, st);
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Tally what's already on disk and clear out temp files left by a crash
+static void count_existing(ThumbBuilder *tb) {
+    ThumbCache *tc = tb->tc;
+    DIR *d = opendir(tc->dir);
+    if (!d) return;
+
+    uint64_t total = 0;
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        char path[512];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", tc->dir, entry->d_name);
+        const char *ext = strrchr(entry->d_name, '.');
+        if (ext && strcmp(ext, ".tmp") == 0)
+            remove(path);
+        else if (ext && strcmp(ext, ".thm") == 0 && stat(path, &st) == 0)
+            total += (uint64_t)st.st_size;
+    }
+    closedir(d);
+    SDL_AtomicSet(&tc->used_kb, (int)(total / 1024));
+}
+
+// Delete thumbnails for images that are no longer in any index
+static void remove_orphans(ThumbBuilder *tb, uint64_t *keys, size_t num_keys) {
+    ThumbCache *tc = tb->tc;
+    qsort(keys, num_keys, sizeof(uint64_t), cmp_u64);
+
+    DIR *d = opendir(tc->dir);
+    if (!d) return;
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        const char *ext = strrchr(entry->d_name, '.');
+        if (!ext || strcmp(ext, ".thm") != 0) continue;
+
+        uint64_t key = strtoull(entry->d_name, NULL, 16);
+        if (bsearch(&key, keys, num_keys, sizeof(uint64_t), cmp_u64)) continue;
+
+        char path[512];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", tc->dir, entry->d_name);
+        if (stat(path, &st) == 0 && remove(path) == 0)
+            SDL_AtomicAdd(&tc->used_kb, -(int)(st.st_size / 1024));
+    }
+    closedir(d);
+}
+
+static int build_thread(void *arg) {
+    ThumbBuilder *tb = arg;
+    ThumbCache *tc = tb->tc;
+    SDL_SetThreadPriority(SDL_THREAD_PRIORITY_LOW);
+
+    if (tc->budget) count_existing(tb);
+
+    size_t num_keys = 0, cap_keys = 0;
+    uint64_t *keys = NULL;
+    int complete = 1;
+
+    for (int i = 0; i < tb->count && !SDL_AtomicGet(&tb->quit); i++) {
+        const ImageIndex *idx = tb->indexes[i];
+        // A missing folder (SD not ready, typo) must not wipe its thumbnails
+        if (idx->num_dirs == 0) complete = 0;
+
+        for (uint32_t f = 0; f < idx->num_files && !SDL_AtomicGet(&tb->quit); f++) {
+            char image[512], path[512];
+            if (!index_full_path(idx, f, image, sizeof(image))) continue;
+            uint64_t key = thumb_key(image);
+
+            if (num_keys == cap_keys) {
+                size_t cap = cap_keys ? cap_keys * 2 : 1024;
+                uint64_t *n = realloc(keys, cap * sizeof(uint64_t));
+                if (!n) {
+                    complete = 0;
+                    break;
+                }
+                keys = n;
+                cap_keys = cap;
+            }
+            keys[num_keys++] = key;
+
+            struct stat st;
+            if (stat(image, &st) != 0) continue;
+            bool wanted = tb->hook.wants && tb->hook.wants(tb->hook.user, idx, f, &st);
+            thumb_path(tc, key, path, sizeof(path));
+            bool fresh = tc->budget && header_file_fresh(tc, path, &st);
+            bool room = (uint64_t)SDL_AtomicGet(&tc->used_kb) * 1024 < tc->budget;
+            if (!wanted && (fresh || !room)) continue;
+
+            SDL_Surface *surface = fresh ? thumb_load(tc, image, &st) : NULL;
+            if (!surface) surface = tb->decode(image);
+            if (!surface) continue;
+            if (!fresh && room) thumb_store(tc, image, &st, surface);
+            if (wanted) tb->hook.seen(tb->hook.user, idx, f, &st, surface);
+            SDL_FreeSurface(surface);
+        }
+    }
+
+    if (complete && tc->budget && !SDL_AtomicGet(&tb->quit))
+        remove_orphans(tb, keys, num_keys);
+    free(keys);
+    SDL_AtomicSet(&tb->finished, !SDL_AtomicGet(&tb->quit));
+    return 0;
+}
+
+ThumbBuilder *thumbs_build_start(ThumbCache *tc, const ImageIndex *const *indexes, int count,
+                                 ThumbDecoder decode, const ThumbHook *hook) {
+    if (tc->budget == 0 && !hook) return NULL;
+
+    ThumbBuilder *tb = calloc(1, sizeof(ThumbBuilder));
+    if (!tb) return NULL;
+    tb->tc      = tc;
+    tb->count   = count;
+    tb->decode  = decode;
+    if (hook) tb->hook = *hook;
+    tb->indexes = malloc((count ? count : 1) * sizeof(ImageIndex *));
+    if (tb->indexes) {
+        memcpy(tb->indexes, indexes, count * sizeof(ImageIndex *));
+        tb->thread = SDL_CreateThread(build_thread, "thumbs", tb);
+    }
+    if (!tb->thread) {
+        free(tb->indexes);
+        free(tb);
+        return NULL;
+    }
+    return tb;
+}
+
+bool thumbs_build_finished(ThumbBuilder *tb) {
+    return tb && SDL_AtomicGet(&tb->finished);
+}
+
+void thumbs_build_stop(ThumbBuilder *tb) {
+    if (!tb) return;
+    SDL_AtomicSet(&tb->quit, 1);
+    SDL_WaitThread(tb->thread, NULL);
+    free(tb->indexes);
+    free(tb);
+}
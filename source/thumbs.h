@@ -0,0 +1,68 @@
+#ifndef THUMBS_H
+#define THUMBS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <SDL2/SDL.h>
+
+#include "imageindex.h"
+
+// Screen-sized copies of local images, so a slide is one sequential read
+// and a QOI decode instead of decoding a 4000-pixel original.
+//
+// Each thumbnail is <dir>/<fnv1a64(image path)>.thm: a small header with
+// the source's size and mtime and the placement it was scaled for,
+// followed by a QOI image. It's used only while all of those still match.
+// Writers go through a temp file and rename, so the prefetch worker and
+// the background builder can both store thumbnails safely.
+
+typedef struct {
+    char         dir[256];
+    int          fit;           // FitMode the thumbnails are scaled for
+    int          screen_w;
+    int          screen_h;
+    uint64_t     budget;        // bytes; 0 disables the cache
+    SDL_atomic_t used_kb;       // size of the cache, once the builder has counted it
+} ThumbCache;
+
+void thumbs_init(ThumbCache *tc, const char *dir, int fit, int screen_w, int screen_h,
+                 uint64_t budget);
+
+// The thumbnail for image_path (stat'ed as st), or NULL if there's no
+// fresh one
+SDL_Surface *thumb_load(ThumbCache *tc, const char *image_path, const struct stat *st);
+
+// Whether image_path has an up-to-date thumbnail, reading only its header
+int thumb_fresh(ThumbCache *tc, const char *image_path, const struct stat *st);
+
+// Save a decoded, already placed-size surface as image_path's thumbnail
+int thumb_store(ThumbCache *tc, const char *image_path, const struct stat *st,
+                SDL_Surface *surface);
+
+// Background builder: walks the given indexes, creates missing or stale
+// thumbnails with `decode` and deletes ones whose image is gone. The
+// indexes must not change while it runs.
+typedef SDL_Surface *(*ThumbDecoder)(const char *path);
+typedef struct ThumbBuilder ThumbBuilder;
+
+// Something else the builder's walk is good for: each image wants() asks
+// for gets to seen() placed, from its thumbnail if that's fresh and
+// decoded otherwise. Both are called on the builder's thread.
+typedef struct {
+    bool (*wants)(void *user, const ImageIndex *idx, uint32_t file, const struct stat *st);
+    void (*seen)(void *user, const ImageIndex *idx, uint32_t file, const struct stat *st,
+                 SDL_Surface *placed);
+    void *user;
+} ThumbHook;
+
+// With a hook (which may be NULL) the builder runs even if the cache is
+// disabled
+ThumbBuilder *thumbs_build_start(ThumbCache *tc, const ImageIndex *const *indexes, int count,
+                                 ThumbDecoder decode, const ThumbHook *hook);
+// Whether the builder has been through every image, orphans included
+bool thumbs_build_finished(ThumbBuilder *tb);
+// Stops the builder (between images) and waits for it
+void thumbs_build_stop(ThumbBuilder *tb);
+
+#endif
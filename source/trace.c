@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+
+#include "trace.h"
+#include "util.h"
+
+#ifdef ENABLE_TRACE
+
+#define TRACE_MAX_THREADS 16
+
+typedef struct {
+    Uint64      ticks;      // SDL_GetPerformanceCounter()
+    const char *name;
+    int64_t     value;
+    Uint32      tid;
+    char        phase;
+} TraceEvent;
+
+// Guarded by RING_LOCK; a spinlock since writers only hold it for a copy
+static TraceEvent RING[TRACE_RING_SIZE];
+static Uint32 RING_NEXT;
+static SDL_SpinLock RING_LOCK;
+
+static const char *THREAD_NAMES[TRACE_MAX_THREADS];    // guarded by RING_LOCK
+static SDL_atomic_t NEXT_TID;
+static __thread Uint32 TID;     // 0 until the thread's first event
+
+static Uint32 thread_id(void) {
+    if (TID == 0) TID = SDL_AtomicAdd(&NEXT_TID, 1) + 1;
+    return TID;
+}
+
+void trace_event(char phase, const char *name, int64_t value) {
+    TraceEvent ev = { SDL_GetPerformanceCounter(), name, value, thread_id(), phase };
+    SDL_AtomicLock(&RING_LOCK);
+    RING[RING_NEXT++ & (TRACE_RING_SIZE - 1)] = ev;
+    SDL_AtomicUnlock(&RING_LOCK);
+}
+
+void trace_thread_name(const char *name) {
+    Uint32 tid = thread_id();
+    if (tid >= TRACE_MAX_THREADS) return;
+    SDL_AtomicLock(&RING_LOCK);
+    THREAD_NAMES[tid] = name;
+    SDL_AtomicUnlock(&RING_LOCK);
+}
+
+unsigned trace_count(void) {
+    SDL_AtomicLock(&RING_LOCK);
+    Uint32 count = RING_NEXT < TRACE_RING_SIZE ? RING_NEXT : TRACE_RING_SIZE;
+    SDL_AtomicUnlock(&RING_LOCK);
+    return count;
+}
+
+int trace_dump(const char *path) {
+    // Copy the ring out first so writers aren't held up by the file
+    TraceEvent *copy = malloc(sizeof(RING));
+    if (!copy) return -1;
+    SDL_AtomicLock(&RING_LOCK);
+    Uint32 end = RING_NEXT;
+    Uint32 count = end < TRACE_RING_SIZE ? end : TRACE_RING_SIZE;
+    for (Uint32 i = 0; i < count; i++)
+        copy[i] = RING[(end - count + i) & (TRACE_RING_SIZE - 1)];
+    const char *names[TRACE_MAX_THREADS];
+    memcpy(names, THREAD_NAMES, sizeof(names));
+    SDL_AtomicUnlock(&RING_LOCK);
+
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "w");
+    if (!f) {
+        free(copy);
+        return -1;
+    }
+
+    fprintf(f, "{\"traceEvents\":[\n");
+    int first = 1;
+    for (int tid = 1; tid < TRACE_MAX_THREADS; tid++) {
+        if (!names[tid]) continue;
+        fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                   "\"args\":{\"name\":\"%s\"}}", first ? "" : ",\n", tid, names[tid]);
+        first = 0;
+    }
+
+    double us_per_tick = 1000000.0 / (double)SDL_GetPerformanceFrequency();
+    Uint64 base = count ? copy[0].ticks : 0;
+    for (Uint32 i = 0; i < count; i++) {
+        const TraceEvent *ev = &copy[i];
+        fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%u",
+                first ? "" : ",\n", ev->name, ev->phase,
+                (double)(Sint64)(ev->ticks - base) * us_per_tick, (unsigned)ev->tid);
+        if (ev->phase == 'C')
+            fprintf(f, ",\"args\":{\"value\":%lld}", (long long)ev->value);
+        else if (ev->phase == 'i')
+            fprintf(f, ",\"s\":\"t\"");
+        fputc('}', f);
+        first = 0;
+    }
+    fprintf(f, "\n]}\n");
+    free(copy);
+
+    int failed = ferror(f);
+    if (fclose(f) != 0 || failed || replace_file(tmp, path) != 0) {
+        remove(tmp);
+        return -1;
+    }
+    return (int)count;
+}
+
+#else
+
+// Tracing compiled out: nothing is recorded and there is nothing to dump
+void trace_event(char phase, const char *name, int64_t value) {}
+void trace_thread_name(const char *name) {}
+unsigned trace_count(void) { return 0; }
+int trace_dump(const char *path) { return -1; }
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+// Rolling trace of what each thread was doing, for offline analysis.
+//
+// Events go into a fixed ring in memory (the oldest are overwritten) and
+// can be dumped as Chrome trace JSON, to load in chrome://tracing or
+// Perfetto. Build with `make TRACE=1` to record; otherwise the TRACE_*
+// macros compile to nothing and the ring stays empty.
+//
+// Names must be string literals (or otherwise live for the whole app);
+// only the pointer is stored.
+
+#define TRACE_RING_SIZE 16384   // events; a power of two
+
+#ifdef ENABLE_TRACE
+#define TRACE_BEGIN(name)       trace_event('B', name, 0)
+#define TRACE_END(name)         trace_event('E', name, 0)
+#define TRACE_INSTANT(name)     trace_event('i', name, 0)
+#define TRACE_COUNTER(name, v)  trace_event('C', name, (int64_t)(v))
+#define TRACE_THREAD(name)      trace_thread_name(name)
+#else
+#define TRACE_BEGIN(name)       ((void)0)
+#define TRACE_END(name)         ((void)0)
+#define TRACE_INSTANT(name)     ((void)0)
+#define TRACE_COUNTER(name, v)  ((void)0)
+#define TRACE_THREAD(name)      ((void)0)
+#endif
+
+// phase is a Chrome trace phase: 'B'egin, 'E'nd, 'i'nstant or 'C'ounter
+void trace_event(char phase, const char *name, int64_t value);
+void trace_thread_name(const char *name);
+
+// Events in the ring right now
+unsigned trace_count(void);
+
+// Write the ring to path as Chrome trace JSON, oldest event first.
+// Returns the number of events written, or -1.
+int trace_dump(const char *path);
+
+#endif
@@ -0,0 +1,109 @@
+#include <stdlib.h>
+#include <strings.h>
+
+#include "transition.h"
+
+static const char *NAMES[] = { "cut", "fade", "slide", "kenburns" };
+
+int transition_parse(const char *name) {
+    for (int i = 0; i < (int)(sizeof(NAMES) / sizeof(NAMES[0])); i++)
+        if (strcasecmp(name, NAMES[i]) == 0) return i;
+    return -1;
+}
+
+const char *transition_name(TransitionKind kind) {
+    return NAMES[kind];
+}
+
+void transition_start(Transition *t, TransitionKind kind, Uint32 now, Uint32 hold_ms,
+                      const SDL_Rect *src) {
+    // The outgoing slide stays where it was last drawn (mid-pan for Ken Burns)
+    t->from       = t->to;
+    t->from_src   = t->to_src;
+    t->to_src     = *src;
+    t->kind       = kind;
+    t->start      = now;
+    t->hold_ms    = hold_ms ? hold_ms : 1;
+    t->last_frame = now;
+    t->pan_x      = (rand() & 1) ? 1 : -1;
+    t->pan_y      = (rand() & 1) ? 1 : -1;
+}
+
+void transition_refine(Transition *t, const SDL_Rect *src) {
+    t->to_src = *src;
+}
+
+// 0..1 through the blend, eased in and out
+static float blend_progress(const Transition *t, Uint32 now) {
+    float p = (float)(now - t->start) / TRANSITION_MS;
+    if (p >= 1.0f) return 1.0f;
+    return p * p * (3.0f - 2.0f * p);
+}
+
+// Zoom in around a point that drifts towards one corner; the image never
+// stops covering its original rect
+static SDL_FRect kenburns_rect(const Transition *t, SDL_FRect base, Uint32 now) {
+    float k = (float)(now - t->start) / t->hold_ms;
+    if (k > 1.0f) k = 1.0f;
+    float s = 1.0f + TRANSITION_KB_ZOOM * k;
+
+    SDL_FRect r;
+    r.w = base.w * s;
+    r.h = base.h * s;
+    r.x = base.x + (base.w - r.w) * 0.5f + t->pan_x * (r.w - base.w) * 0.5f;
+    r.y = base.y + (base.h - r.h) * 0.5f + t->pan_y * (r.h - base.h) * 0.5f;
+    return r;
+}
+
+static void draw(SDL_Renderer *renderer, SDL_Texture *tex, const SDL_Rect *src,
+                 const SDL_FRect *dst, float alpha) {
+    SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_BLEND);
+    SDL_SetTextureAlphaMod(tex, (Uint8)(alpha * 255.0f + 0.5f));
+    SDL_RenderCopyExF(renderer, tex, src, dst, 0.0, NULL, SDL_FLIP_NONE);
+}
+
+void transition_draw(Transition *t, SDL_Renderer *renderer, SDL_Texture *from,
+                     SDL_Texture *to, const SDL_Rect *to_rect, Uint32 now) {
+    SDL_FRect dst = { (float)to_rect->x, (float)to_rect->y,
+                      (float)to_rect->w, (float)to_rect->h };
+    if (t->kind == TRANSITION_KENBURNS)
+        dst = kenburns_rect(t, dst, now);
+
+    float p = blend_progress(t, now);
+    if (t->kind == TRANSITION_CUT || !from) p = 1.0f;
+
+    if (t->kind == TRANSITION_SLIDE && p < 1.0f) {
+        // Push the old slide out to the left as the new one comes in
+        int out_w = 0;
+        SDL_GetRendererOutputSize(renderer, &out_w, NULL);
+        SDL_FRect a = t->from, b = dst;
+        a.x -= out_w * p;
+        b.x += out_w * (1.0f - p);
+        draw(renderer, from, &t->from_src, &a, 1.0f);
+        draw(renderer, to, &t->to_src, &b, 1.0f);
+    } else {
+        // Fade over the old slide
+        if (p < 1.0f) draw(renderer, from, &t->from_src, &t->from, 1.0f);
+        draw(renderer, to, &t->to_src, &dst, p);
+    }
+
+    t->to = dst;
+    t->last_frame = now;
+}
+
+bool transition_blend_done(const Transition *t, Uint32 now) {
+    return t->kind == TRANSITION_CUT || now - t->start >= TRANSITION_MS;
+}
+
+int transition_wait(const Transition *t, Uint32 now) {
+    if (!transition_blend_done(t, now)) return 0;
+    if (t->kind != TRANSITION_KENBURNS || now - t->start >= t->hold_ms || t->to.w <= 0)
+        return -1;
+
+    // Redraw once the zoom has moved the edges by about a quarter pixel
+    float px_per_ms = TRANSITION_KB_ZOOM * t->to.w / t->hold_ms;
+    Uint32 step = (Uint32)(0.25f / px_per_ms);
+    if (step < 16) step = 16;
+    Uint32 elapsed = now - t->last_frame;
+    return elapsed >= step ? 0 : (int)(step - elapsed);
+}
@@ -0,0 +1,61 @@
+#ifndef TRANSITION_H
+#define TRANSITION_H
+
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+
+// Slide transitions, done entirely by the renderer: the outgoing and
+// incoming textures are drawn with alpha and/or moving dst rects, so a
+// transition never allocates or re-uploads anything.
+//
+// Ken Burns additionally keeps slowly zooming and panning the slide for
+// as long as it's shown, but only asks for a new frame when the picture
+// has moved by a fraction of a pixel.
+
+#define TRANSITION_MS        800
+#define TRANSITION_KB_ZOOM   0.10f   // Ken Burns zooms in this much over a slide
+
+typedef enum {
+    TRANSITION_CUT,
+    TRANSITION_FADE,
+    TRANSITION_SLIDE,
+    TRANSITION_KENBURNS,
+} TransitionKind;
+
+typedef struct {
+    TransitionKind kind;
+    Uint32    start;        // SDL_GetTicks() when the incoming slide appeared
+    Uint32    hold_ms;      // how long the slide stays up (Ken Burns pan length)
+    Uint32    last_frame;
+    int       pan_x, pan_y; // Ken Burns drift direction, -1 or 1
+    SDL_FRect from;         // where the outgoing slide was last drawn
+    SDL_FRect to;           // where the incoming slide was last drawn
+    SDL_Rect  from_src;     // part of each slide's texture that holds the image
+    SDL_Rect  to_src;
+} Transition;
+
+// "cut", "fade", "slide" or "kenburns"; -1 if unknown
+int transition_parse(const char *name);
+const char *transition_name(TransitionKind kind);
+
+// src is the part of the incoming slide's texture that holds the image
+void transition_start(Transition *t, TransitionKind kind, Uint32 now, Uint32 hold_ms,
+                      const SDL_Rect *src);
+
+// The incoming slide's texture was swapped for a sharper copy of the same
+// picture (a progressive download refining) or its next animation frame;
+// src is the part it covers. Whatever is running carries on.
+void transition_refine(Transition *t, const SDL_Rect *src);
+
+// Draw the outgoing slide (may be NULL) and the incoming one, placed at
+// to_rect when at rest.
+void transition_draw(Transition *t, SDL_Renderer *renderer, SDL_Texture *from,
+                     SDL_Texture *to, const SDL_Rect *to_rect, Uint32 now);
+
+// True once the outgoing slide is no longer drawn and can be freed
+bool transition_blend_done(const Transition *t, Uint32 now);
+
+// Milliseconds until the next frame is needed, or -1 if the picture is still
+int transition_wait(const Transition *t, Uint32 now);
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef UTIL_H
+#define UTIL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// FNV-1a, used to turn paths and URLs into stable cache/index file names
+static inline uint32_t fnv1a32(const char *s) {
+    uint32_t h = 2166136261u;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// 64-bit FNV-1a over a buffer, used to content-address cached images
+static inline uint64_t fnv1a64(const void *data, size_t size) {
+    const unsigned char *p = data;
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < size; i++) {
+        h ^= p[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+// xorshift64*: small, fast and plenty good for picking photos. The state
+// must never be zero; seed it with rng_seed().
+static inline uint32_t rng_next32(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return (uint32_t)((x * 0x2545F4914F6CDD1Dull) >> 32);
+}
+
+// splitmix64 the seed so nearby seeds (e.g. boot times) diverge, and so
+// the state is never zero
+static inline uint64_t rng_seed(uint64_t seed) {
+    uint64_t z = seed + 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    z ^= z >> 31;
+    return z ? z : 1;
+}
+
+// Uniform integer in [0, n), n > 0. Lemire's multiply-and-reject:
+// unbiased without a division per call.
+static inline uint32_t rng_below(uint64_t *state, uint32_t n) {
+    uint64_t m = (uint64_t)rng_next32(state) * n;
+    uint32_t low = (uint32_t)m;
+    if (low < n) {
+        uint32_t threshold = -n % n;
+        while (low < threshold) {
+            m = (uint64_t)rng_next32(state) * n;
+            low = (uint32_t)m;
+        }
+    }
+    return (uint32_t)(m >> 32);
+}
+
+// Replace dst with src. fsdev refuses to rename over an existing file,
+// so fall back to remove + rename when the direct rename fails.
+static inline int replace_file(const char *src, const char *dst) {
+    if (rename(src, dst) == 0) return 0;
+    remove(dst);
+    return rename(src, dst);
+}
+
+#endif
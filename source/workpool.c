@@ -0,0 +1,259 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+#include "workpool.h"
+
+typedef struct {
+    WorkFn      fn;
+    void       *arg;
+    const void *tag;
+} Job;
+
+typedef struct {
+    struct WorkPool *wp;
+    int              index;
+} WorkerStart;
+
+struct WorkPool {
+    SDL_Thread *threads[WORKPOOL_MAX_THREADS];
+    WorkerStart starts[WORKPOOL_MAX_THREADS];
+    int         num_threads;
+    SDL_mutex  *lock;
+    SDL_cond   *work;       // a job was queued, or quit
+    SDL_cond   *idle;       // a parallel_for helper finished
+    bool        quit;
+
+    // Ring of queued jobs, guarded by lock
+    Job *jobs;
+    int  cap;
+    int  head;
+    int  count;
+};
+
+static __thread int WORKER = -1;
+
+static int worker_thread(void *arg) {
+    WorkerStart *start = arg;
+    WorkPool *wp = start->wp;
+    WORKER = start->index;
+    TRACE_THREAD("worker");
+
+    SDL_LockMutex(wp->lock);
+    while (!wp->quit) {
+        if (wp->count == 0) {
+            SDL_CondWait(wp->work, wp->lock);
+            continue;
+        }
+        Job job = wp->jobs[wp->head];
+        wp->head = (wp->head + 1) % wp->cap;
+        wp->count--;
+        SDL_UnlockMutex(wp->lock);
+
+        TRACE_BEGIN("job");
+        job.fn(job.arg);
+        TRACE_END("job");
+
+        SDL_LockMutex(wp->lock);
+    }
+    SDL_UnlockMutex(wp->lock);
+    return 0;
+}
+
+WorkPool *workpool_create(int threads, int queue_cap) {
+    if (threads <= 0) threads = SDL_GetCPUCount() - 1;
+    if (threads < 1) threads = 1;
+    if (threads > WORKPOOL_MAX_THREADS) threads = WORKPOOL_MAX_THREADS;
+    if (queue_cap < 1) queue_cap = 1;
+
+    WorkPool *wp = calloc(1, sizeof(WorkPool));
+    if (!wp) return NULL;
+    wp->cap  = queue_cap;
+    wp->jobs = calloc(queue_cap, sizeof(Job));
+    wp->lock = SDL_CreateMutex();
+    wp->work = SDL_CreateCond();
+    wp->idle = SDL_CreateCond();
+
+    if (wp->jobs && wp->lock && wp->work && wp->idle) {
+        for (int i = 0; i < threads; i++) {
+            wp->starts[i].wp = wp;
+            wp->starts[i].index = i;
+            wp->threads[i] = SDL_CreateThread(worker_thread, "worker", &wp->starts[i]);
+            if (!wp->threads[i]) break;
+            wp->num_threads++;
+        }
+    }
+    if (wp->num_threads == 0) {
+        workpool_destroy(wp);
+        return NULL;
+    }
+    return wp;
+}
+
+void workpool_destroy(WorkPool *wp) {
+    if (!wp) return;
+    if (wp->lock) {
+        SDL_LockMutex(wp->lock);
+        wp->quit = true;
+        wp->count = 0;
+        SDL_CondBroadcast(wp->work);
+        SDL_UnlockMutex(wp->lock);
+    }
+    for (int i = 0; i < wp->num_threads; i++)
+        SDL_WaitThread(wp->threads[i], NULL);
+
+    if (wp->idle) SDL_DestroyCond(wp->idle);
+    if (wp->work) SDL_DestroyCond(wp->work);
+    if (wp->lock) SDL_DestroyMutex(wp->lock);
+    free(wp->jobs);
+    free(wp);
+}
+
+int workpool_threads(const WorkPool *wp) {
+    return wp ? wp->num_threads : 0;
+}
+
+int workpool_submit(WorkPool *wp, WorkFn fn, void *arg, const void *tag) {
+    if (!wp) return -1;
+    SDL_LockMutex(wp->lock);
+    if (wp->count == wp->cap || wp->quit) {
+        SDL_UnlockMutex(wp->lock);
+        return -1;
+    }
+    Job *job = &wp->jobs[(wp->head + wp->count) % wp->cap];
+    job->fn  = fn;
+    job->arg = arg;
+    job->tag = tag;
+    wp->count++;
+    TRACE_COUNTER("queued jobs", wp->count);
+    SDL_CondSignal(wp->work);
+    SDL_UnlockMutex(wp->lock);
+    return 0;
+}
+
+// With wp->lock held
+static int cancel_locked(WorkPool *wp, const void *tag, WorkFn discard) {
+    int kept = 0, removed = 0;
+    for (int i = 0; i < wp->count; i++) {
+        Job job = wp->jobs[(wp->head + i) % wp->cap];
+        if (job.tag == tag) {
+            if (discard) discard(job.arg);
+            removed++;
+        } else {
+            wp->jobs[(wp->head + kept++) % wp->cap] = job;
+        }
+    }
+    wp->count = kept;
+    return removed;
+}
+
+int workpool_cancel(WorkPool *wp, const void *tag, WorkFn discard) {
+    if (!wp) return 0;
+    SDL_LockMutex(wp->lock);
+    int removed = cancel_locked(wp, tag, discard);
+    SDL_UnlockMutex(wp->lock);
+    return removed;
+}
+
+int workpool_worker(void) {
+    return WORKER;
+}
+
+typedef struct {
+    WorkPool *wp;
+    void    (*fn)(void *arg, int i);
+    void     *arg;
+    int       n;
+    SDL_atomic_t next;
+    int       helpers;      // submitted and not yet finished, guarded by wp->lock
+} Batch;
+
+static void run_batch(Batch *b) {
+    int i;
+    while ((i = SDL_AtomicAdd(&b->next, 1)) < b->n)
+        b->fn(b->arg, i);
+}
+
+static void batch_helper(void *arg) {
+    Batch *b = arg;
+    run_batch(b);
+
+    // Last touch of b; the caller may return as soon as helpers hits 0
+    SDL_LockMutex(b->wp->lock);
+    b->helpers--;
+    SDL_CondBroadcast(b->wp->idle);
+    SDL_UnlockMutex(b->wp->lock);
+}
+
+void workpool_parallel_for(WorkPool *wp, int n, void (*fn)(void *arg, int i), void *arg) {
+    Batch b;
+    b.wp      = wp;
+    b.fn      = fn;
+    b.arg     = arg;
+    b.n       = n;
+    b.helpers = 0;
+    SDL_AtomicSet(&b.next, 0);
+
+    int want = wp ? wp->num_threads : 0;
+    if (want > n - 1) want = n - 1;
+    for (int i = 0; i < want; i++) {
+        if (workpool_submit(wp, batch_helper, &b, &b) != 0) break;
+        SDL_LockMutex(wp->lock);
+        b.helpers++;
+        SDL_UnlockMutex(wp->lock);
+    }
+
+    run_batch(&b);
+    if (!wp) return;
+
+    // Helpers still queued have nothing left to do; the ones running are
+    // finishing their last index
+    SDL_LockMutex(wp->lock);
+    b.helpers -= cancel_locked(wp, &b, NULL);
+    while (b.helpers > 0)
+        SDL_CondWait(wp->idle, wp->lock);
+    SDL_UnlockMutex(wp->lock);
+}
+
+typedef struct {
+    Uint64 total;
+    Uint64 max;
+    Uint64 last;
+    Uint32 count;
+} StageStat;
+
+static StageStat STAGES[STAGE_COUNT];
+static SDL_SpinLock STAGE_LOCK;
+
+void stage_record(WorkStage stage, Uint64 start) {
+    Uint64 ticks = SDL_GetPerformanceCounter() - start;
+    SDL_AtomicLock(&STAGE_LOCK);
+    StageStat *s = &STAGES[stage];
+    s->total += ticks;
+    s->count++;
+    s->last = ticks;
+    if (ticks > s->max) s->max = ticks;
+    SDL_AtomicUnlock(&STAGE_LOCK);
+}
+
+float stage_avg_ms(WorkStage stage) {
+    SDL_AtomicLock(&STAGE_LOCK);
+    StageStat s = STAGES[stage];
+    SDL_AtomicUnlock(&STAGE_LOCK);
+    if (s.count == 0) return 0.0f;
+    return (float)((double)s.total * 1000.0 / SDL_GetPerformanceFrequency() / s.count);
+}
+
+float stage_max_ms(WorkStage stage) {
+    SDL_AtomicLock(&STAGE_LOCK);
+    Uint64 max = STAGES[stage].max;
+    SDL_AtomicUnlock(&STAGE_LOCK);
+    return (float)((double)max * 1000.0 / SDL_GetPerformanceFrequency());
+}
+
+float stage_last_ms(WorkStage stage) {
+    SDL_AtomicLock(&STAGE_LOCK);
+    Uint64 last = STAGES[stage].last;
+    SDL_AtomicUnlock(&STAGE_LOCK);
+    return (float)((double)last * 1000.0 / SDL_GetPerformanceFrequency());
+}
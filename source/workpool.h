@@ -0,0 +1,58 @@
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+
+// A few worker threads with a bounded FIFO job queue, for running slide
+// loads side by side and splitting a single scale across cores.
+//
+// Jobs carry a tag so everything queued for one owner (a prefetcher, one
+// parallel_for) can be pulled back out before it runs. Jobs that already
+// started are never interrupted; they poll their own cancellation flag.
+// Only SDL threads are used, so it runs the same on the Switch and a PC.
+
+#define WORKPOOL_MAX_THREADS 4
+
+typedef struct WorkPool WorkPool;
+typedef void (*WorkFn)(void *arg);
+
+// threads <= 0 picks one per core, leaving one for the render thread
+WorkPool *workpool_create(int threads, int queue_cap);
+// Owners must have cancelled or waited for their jobs; anything still
+// queued is dropped without running
+void workpool_destroy(WorkPool *wp);
+int  workpool_threads(const WorkPool *wp);
+
+// Queue fn(arg). Returns -1 if the queue is full (or wp is NULL); nothing
+// is queued then.
+int  workpool_submit(WorkPool *wp, WorkFn fn, void *arg, const void *tag);
+// Remove the queued jobs with this tag, handing each arg to discard (may
+// be NULL). discard runs with the pool locked, so it must only free
+// things. Returns how many were removed.
+int  workpool_cancel(WorkPool *wp, const void *tag, WorkFn discard);
+
+// Index of the calling pool thread, or -1 on any other thread
+int  workpool_worker(void);
+
+// Run fn(arg, 0..n-1) across the pool and the calling thread, returning
+// once all are done. The caller works through the indices too, so this
+// is safe from inside a pool job and with a NULL pool (runs serially).
+void workpool_parallel_for(WorkPool *wp, int n, void (*fn)(void *arg, int i), void *arg);
+
+// Time spent per pipeline stage, from any thread
+typedef enum {
+    STAGE_QUEUE,    // slide load waiting for a worker
+    STAGE_DECODE,
+    STAGE_SCALE,
+    STAGE_UPLOAD,
+    STAGE_COUNT
+} WorkStage;
+
+// start is an SDL_GetPerformanceCounter() value
+void  stage_record(WorkStage stage, Uint64 start);
+float stage_avg_ms(WorkStage stage);
+float stage_max_ms(WorkStage stage);
+float stage_last_ms(WorkStage stage);
+
+#endif
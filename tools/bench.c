@@ -0,0 +1,1492 @@
+// bench.c
+// Benchmarks for the slideshow core, run on a PC through the host build so
+// performance regressions show up before a build goes onto a console.
+//
+// Build and run from the repo root (needs the host build's packages, see
+// Makefile.host):
+//   make -f Makefile.host bench-run
+//
+// Usage: bench [--hours N] [--interval S] [--transition NAME] [--categories N]
+//              [--rate KB] [--album N] [--only NAME] [--out FILE]
+//   --hours, --interval  length of the simulated slideshow and seconds per
+//                        slide (default 1 hour of 300 s slides)
+//   --categories         size of the large generated config.ini (default 20000)
+//   --rate               KB/s the local HTTP server sends progressive images
+//                        at, standing in for slow Wi-Fi (default 512)
+//   --album              images in the synthetic album the perceptual hash
+//                        index is built over (default 100000)
+//   --only               run only the benchmarks whose name contains NAME
+//   --out                write the results there instead of stdout
+//
+// Test images and folders are generated into a temporary directory, so
+// runs are comparable between machines checking out the same commit.
+// Results are one JSON document:
+//   {"benchmarks":[{"name":..., "iterations":..., "mean_us":..., "min_us":...,
+//                   "max_us":..., ...extra fields per benchmark}, ...]}
+
+#define _XOPEN_SOURCE 700
+#include <ftw.h>
+#include <poll.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <curl/curl.h>
+#include <jpeglib.h>
+#include <png.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include <SDL2/SDL_ttf.h>
+#include <webp/encode.h>
+
+#include "anim.h"
+#include "config.h"
+#include "decode.h"
+#include "fetch.h"
+#include "imageindex.h"
+#include "membudget.h"
+#include "phash.h"
+#include "platform.h"
+#include "playlist.h"
+#include "progressive.h"
+#include "qoi.h"
+#include "scale.h"
+#include "text.h"
+#include "transition.h"
+#include "workpool.h"
+
+#define SCREEN_W 1280
+#define SCREEN_H 720
+#define SCRATCH_MB 64
+#define SCAN_DIRS  40
+#define SCAN_FILES 250   // per folder
+
+typedef struct {
+    int    n;
+    double total_us, min_us, max_us;
+} Stats;
+
+static FILE *OUT;
+static int NUM_RESULTS;
+static const char *ONLY;
+static char WORK_DIR[] = "/tmp/nxpf-bench-XXXXXX";
+
+static double now_us(void) {
+    return (double)SDL_GetPerformanceCounter() * 1000000.0 / (double)SDL_GetPerformanceFrequency();
+}
+
+static void stats_add(Stats *s, double us) {
+    if (s->n == 0 || us < s->min_us) s->min_us = us;
+    if (s->n == 0 || us > s->max_us) s->max_us = us;
+    s->total_us += us;
+    s->n++;
+}
+
+static int wanted(const char *name) {
+    return !ONLY || strstr(name, ONLY) != NULL;
+}
+
+// One result record; extra is a printf format for more ,"key":value pairs
+static void report(const char *name, const Stats *s, const char *extra, ...) {
+    fprintf(OUT, "%s\n    {\"name\":\"%s\",\"iterations\":%d,\"mean_us\":%.1f,"
+                 "\"min_us\":%.1f,\"max_us\":%.1f",
+            NUM_RESULTS++ ? "," : "", name, s->n, s->n ? s->total_us / s->n : 0.0,
+            s->min_us, s->max_us);
+    if (extra) {
+        va_list ap;
+        va_start(ap, extra);
+        vfprintf(OUT, extra, ap);
+        va_end(ap);
+    }
+    fputc('}', OUT);
+    fflush(OUT);
+    fprintf(stderr, "%-24s %6d x %10.1f us\n", name, s->n, s->n ? s->total_us / s->n : 0.0);
+}
+
+static void work_path(char *out, size_t len, const char *name) {
+    snprintf(out, len, "%s/%s", WORK_DIR, name);
+}
+
+// ---- test data ------------------------------------------------------------
+
+static Uint32 RNG = 2463534242u;
+
+static Uint32 xorshift(void) {
+    RNG ^= RNG << 13;
+    RNG ^= RNG >> 17;
+    RNG ^= RNG << 5;
+    return RNG;
+}
+
+// A smooth gradient with some grain, so it compresses about like a photo
+static SDL_Surface *make_photo(int w, int h) {
+    SDL_Surface *s = SDL_CreateRGBSurfaceWithFormat(0, w, h, 24, SDL_PIXELFORMAT_RGB24);
+    if (!s) return NULL;
+    for (int y = 0; y < h; y++) {
+        Uint8 *row = (Uint8 *)s->pixels + (size_t)y * s->pitch;
+        for (int x = 0; x < w; x++) {
+            int grain = (int)(xorshift() & 31) - 16;
+            int r = x * 255 / w + grain, g = y * 255 / h + grain, b = (x + y) * 127 / (w + h) + 64;
+            row[x * 3 + 0] = r < 0 ? 0 : r > 255 ? 255 : r;
+            row[x * 3 + 1] = g < 0 ? 0 : g > 255 ? 255 : g;
+            row[x * 3 + 2] = b;
+        }
+    }
+    return s;
+}
+
+static int save_jpeg(SDL_Surface *s, const char *path, int progressive) {
+    FILE *f = fopen(path, "wb");
+    if (!f) return -1;
+
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    jpeg_stdio_dest(&cinfo, f);
+    cinfo.image_width = s->w;
+    cinfo.image_height = s->h;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, 90, TRUE);
+    if (progressive) jpeg_simple_progression(&cinfo);
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        JSAMPROW row = (Uint8 *)s->pixels + (size_t)cinfo.next_scanline * s->pitch;
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+static int write_jpeg(const char *path, int w, int h, int progressive) {
+    SDL_Surface *s = make_photo(w, h);
+    int rc = s ? save_jpeg(s, path, progressive) : -1;
+    SDL_FreeSurface(s);
+    return rc;
+}
+
+static int write_file(const char *path, const void *data, size_t size) {
+    FILE *f = fopen(path, "wb");
+    if (!f) return -1;
+    int ok = fwrite(data, 1, size, f) == size;
+    if (fclose(f) != 0) ok = 0;
+    return ok ? 0 : -1;
+}
+
+static int save_webp(SDL_Surface *s, const char *path, int lossless) {
+    uint8_t *out = NULL;
+    size_t size = lossless ? WebPEncodeLosslessRGB(s->pixels, s->w, s->h, s->pitch, &out)
+                           : WebPEncodeRGB(s->pixels, s->w, s->h, s->pitch, 80, &out);
+    int rc = size ? write_file(path, out, size) : -1;
+    WebPFree(out);
+    return rc;
+}
+
+static void put_le(unsigned char *p, uint32_t v, int bytes) {
+    for (int i = 0; i < bytes; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+// A looping animation of frames w x h, frame i being the window of s
+// i * step pixels from its left edge, each shown delay_ms. libwebp's simple
+// encoder only writes stills, so the container is put together here from
+// each still's VP8 chunk.
+static int save_webp_animated(SDL_Surface *s, int w, int h, int frames, int step, int delay_ms,
+                              const char *path) {
+    uint8_t **still = calloc(frames, sizeof(uint8_t *));
+    size_t *still_size = calloc(frames, sizeof(size_t));
+    unsigned char *file = NULL;
+    int rc = -1;
+    if (!still || !still_size) goto done;
+
+    size_t size = 12 + (8 + 10) + (8 + 6);
+    for (int i = 0; i < frames; i++) {
+        const uint8_t *rgb = (const uint8_t *)s->pixels + (size_t)i * step * 3;
+        still_size[i] = WebPEncodeRGB(rgb, w, h, s->pitch, 80, &still[i]);
+        if (still_size[i] <= 12) goto done;
+        size += 8 + 16 + still_size[i] - 12;    // past RIFF/size/WEBP
+    }
+    file = malloc(size);
+    if (!file) goto done;
+
+    unsigned char *p = file;
+    memcpy(p, "RIFF", 4);
+    put_le(p + 4, (uint32_t)(size - 8), 4);
+    memcpy(p + 8, "WEBP", 4);
+    p += 12;
+    memcpy(p, "VP8X", 4);
+    put_le(p + 4, 10, 4);
+    memset(p + 8, 0, 10);
+    p[8] = 0x02;                                // animation
+    put_le(p + 12, w - 1, 3);
+    put_le(p + 15, h - 1, 3);
+    p += 18;
+    memcpy(p, "ANIM", 4);
+    put_le(p + 4, 6, 4);
+    put_le(p + 8, 0, 4);                        // background
+    put_le(p + 12, 0, 2);                       // loop forever
+    p += 14;
+    for (int i = 0; i < frames; i++) {
+        size_t vp8_size = still_size[i] - 12;   // one chunk, already padded
+        memcpy(p, "ANMF", 4);
+        put_le(p + 4, (uint32_t)(16 + vp8_size), 4);
+        put_le(p + 8, 0, 3);                    // x / 2
+        put_le(p + 11, 0, 3);                   // y / 2
+        put_le(p + 14, w - 1, 3);
+        put_le(p + 17, h - 1, 3);
+        put_le(p + 20, delay_ms, 3);
+        p[23] = 0x02;                           // no blending
+        memcpy(p + 24, still[i] + 12, vp8_size);
+        p += 24 + vp8_size;
+    }
+    rc = write_file(path, file, size);
+
+done:
+    for (int i = 0; still && i < frames; i++) WebPFree(still[i]);
+    free(still);
+    free(still_size);
+    free(file);
+    return rc;
+}
+
+// GIF output: LZW codes packed LSB first into sub-blocks of up to 255 bytes
+typedef struct {
+    FILE    *f;
+    uint32_t bits;
+    int      nbits;
+    unsigned char block[256];
+    int      len;
+} GifWriter;
+
+static void gif_put_code(GifWriter *gw, int code, int size) {
+    gw->bits |= (uint32_t)code << gw->nbits;
+    gw->nbits += size;
+    while (gw->nbits >= 8) {
+        gw->block[1 + gw->len++] = (unsigned char)gw->bits;
+        gw->bits >>= 8;
+        gw->nbits -= 8;
+        if (gw->len == 255) {
+            gw->block[0] = 255;
+            fwrite(gw->block, 1, 256, gw->f);
+            gw->len = 0;
+        }
+    }
+}
+
+// Encode 8-bit indices at min code size 8, clearing when the table fills
+static void gif_put_lzw(GifWriter *gw, const unsigned char *index, size_t count) {
+    enum { CLEAR = 256, END = 257, HASH = 8191 };
+    static int32_t key[HASH];
+    static int16_t value[HASH];
+    int size = 9, next = END + 1;
+    memset(key, 0xff, sizeof(key));
+    fputc(8, gw->f);
+    gif_put_code(gw, CLEAR, size);
+
+    int prefix = index[0];
+    for (size_t i = 1; i < count; i++) {
+        int32_t k = (int32_t)prefix << 8 | index[i];
+        size_t h = (size_t)k % HASH;
+        while (key[h] >= 0 && key[h] != k) h = (h + 1) % HASH;
+        if (key[h] == k) {
+            prefix = value[h];
+            continue;
+        }
+        gif_put_code(gw, prefix, size);
+        if (next < 4096) {
+            if (next == 1 << size) size++;
+            key[h] = k;
+            value[h] = (int16_t)next++;
+        } else {
+            gif_put_code(gw, CLEAR, size);
+            memset(key, 0xff, sizeof(key));
+            size = 9;
+            next = END + 1;
+        }
+        prefix = index[i];
+    }
+    gif_put_code(gw, prefix, size);
+    gif_put_code(gw, END, size);
+    if (gw->nbits > 0) gif_put_code(gw, 0, 8 - gw->nbits);
+    if (gw->len) {
+        gw->block[0] = (unsigned char)gw->len;
+        fwrite(gw->block, 1, 1 + gw->len, gw->f);
+        gw->len = 0;
+    }
+    fputc(0, gw->f);
+}
+
+// Frames as for save_webp_animated(), quantized to a fixed 6x7x6 palette
+// and each shown delay_cs hundredths of a second; one frame writes a still
+static int save_gif(SDL_Surface *s, int w, int h, int frames, int step, int delay_cs,
+                    const char *path) {
+    unsigned char *index = malloc((size_t)w * h);
+    FILE *f = index ? fopen(path, "wb") : NULL;
+    if (!f) {
+        free(index);
+        return -1;
+    }
+    unsigned char header[13] = { 'G', 'I', 'F', '8', '9', 'a' };
+    put_le(header + 6, w, 2);
+    put_le(header + 8, h, 2);
+    header[10] = 0xf7;                          // global palette of 256
+    fwrite(header, 1, sizeof(header), f);
+    for (int i = 0; i < 256; i++) {
+        int c = i < 252 ? i : 251;
+        unsigned char rgb[3] = { c / 42 * 51, c / 6 % 7 * 255 / 6, c % 6 * 51 };
+        fwrite(rgb, 1, 3, f);
+    }
+    if (frames > 1) {
+        static const unsigned char loop[19] = { 0x21, 0xff, 11, 'N', 'E', 'T', 'S', 'C', 'A', 'P',
+                                                'E', '2', '.', '0', 3, 1, 0, 0, 0 };
+        fwrite(loop, 1, sizeof(loop), f);
+    }
+
+    GifWriter gw = { f };
+    for (int i = 0; i < frames; i++) {
+        for (int y = 0; y < h; y++) {
+            const Uint8 *row = (const Uint8 *)s->pixels + (size_t)y * s->pitch + (size_t)i * step * 3;
+            for (int x = 0; x < w; x++) {
+                int r = (row[x * 3 + 0] * 5 + 127) / 255;
+                int g = (row[x * 3 + 1] * 6 + 127) / 255;
+                int b = (row[x * 3 + 2] * 5 + 127) / 255;
+                index[(size_t)y * w + x] = (unsigned char)((r * 7 + g) * 6 + b);
+            }
+        }
+        unsigned char control[8] = { 0x21, 0xf9, 4, 0x04, 0, 0, 0, 0 };   // keep
+        put_le(control + 4, frames > 1 ? delay_cs : 0, 2);
+        unsigned char image[10] = { 0x2c };
+        put_le(image + 5, w, 2);
+        put_le(image + 7, h, 2);
+        fwrite(control, 1, sizeof(control), f);
+        fwrite(image, 1, sizeof(image), f);
+        gif_put_lzw(&gw, index, (size_t)w * h);
+    }
+    fputc(0x3b, f);
+    int rc = ferror(f) ? -1 : 0;
+    if (fclose(f) != 0) rc = -1;
+    free(index);
+    return rc;
+}
+
+static int save_qoi(SDL_Surface *s, const char *path) {
+    SDL_Surface *rgba = SDL_ConvertSurfaceFormat(s, SDL_PIXELFORMAT_RGBA32, 0);
+    if (!rgba) return -1;
+    QoiDesc desc = { (uint32_t)rgba->w, (uint32_t)rgba->h, 3, 0 };
+    size_t max = qoi_max_size(&desc);
+    unsigned char *out = max ? malloc(max) : NULL;
+    size_t size = out ? qoi_encode(rgba->pixels, rgba->pitch, &desc, out) : 0;
+    int rc = size ? write_file(path, out, size) : -1;
+    free(out);
+    SDL_FreeSurface(rgba);
+    return rc;
+}
+
+static int write_png(const char *path, int w, int h) {
+    SDL_Surface *s = make_photo(w, h);
+    int rc = s ? IMG_SavePNG(s, path) : -1;
+    SDL_FreeSurface(s);
+    return rc;
+}
+
+// Adam7-interlaced, which IMG_SavePNG() can't write
+static int write_png_interlaced(const char *path, int w, int h) {
+    SDL_Surface *s = make_photo(w, h);
+    FILE *f = s ? fopen(path, "wb") : NULL;
+    if (!f) {
+        SDL_FreeSurface(s);
+        return -1;
+    }
+
+    volatile int rc = -1;
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_infop info = png ? png_create_info_struct(png) : NULL;
+    if (info && !setjmp(png_jmpbuf(png))) {
+        png_init_io(png, f);
+        png_set_IHDR(png, info, w, h, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_ADAM7,
+                     PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+        png_write_info(png, info);
+        int passes = png_set_interlace_handling(png);
+        for (int pass = 0; pass < passes; pass++)
+            for (int y = 0; y < h; y++)
+                png_write_row(png, (png_bytep)s->pixels + (size_t)y * s->pitch);
+        png_write_end(png, NULL);
+        rc = 0;
+    }
+    png_destroy_write_struct(&png, info ? &info : NULL);
+    if (fclose(f) != 0) rc = -1;
+    SDL_FreeSurface(s);
+    return rc;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+    return remove(path);
+}
+
+// Same decode path as the console's load_image_file()
+static SDL_Surface *load_image(const char *path) {
+    SDL_Surface *surface = decode_image_file(path, FIT_CONTAIN, SCREEN_W, SCREEN_H);
+    if (!surface) surface = IMG_Load(path);
+    if (!surface) return NULL;
+    return shrink_surface(surface, FIT_CONTAIN, SCREEN_W, SCREEN_H);
+}
+
+// ---- benchmarks -----------------------------------------------------------
+
+// The default config.ini plus count categories, a third of them local,
+// and a [Transitions] line for every other one
+static int write_config(const char *path, int count) {
+    if (config_write_default(path) != 0) return -1;
+    FILE *f = fopen(path, "a");
+    if (!f) return -1;
+    fprintf(f, "\n[Categories]\n");
+    for (int i = 0; i < count; i++) {
+        if (i % 3 == 0)
+            fprintf(f, "Category %05d = local://" SDMC_ROOT "Photos/%05d/\n", i, i);
+        else
+            fprintf(f, "Category %05d = https://example.com/photos/%05d.jpg\n", i, i);
+    }
+    fprintf(f, "\n[Transitions]\n");
+    for (int i = 0; i < count; i += 2)
+        fprintf(f, "Category %05d = %s\n", i, i % 4 ? "fade" : "kenburns");
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+static void bench_config(int large) {
+    static const struct { const char *name; int iterations; } cases[] = {
+        { "config_parse",       2000 },
+        { "config_parse_large", 20 },
+    };
+    for (int c = 0; c < 2; c++) {
+        if (!wanted(cases[c].name)) continue;
+        char path[512];
+        work_path(path, sizeof(path), c ? "large.ini" : "config.ini");
+        if (write_config(path, c ? large : 32) != 0) return;
+
+        Stats s = {0};
+        Config config;
+        int categories = 0;
+        for (int i = 0; i < cases[c].iterations; i++) {
+            double t = now_us();
+            config_load(&config, path);
+            stats_add(&s, now_us() - t);
+            categories = config.num_categories;
+            config_free(&config);
+        }
+        struct stat st;
+        report(cases[c].name, &s, ",\"categories\":%d,\"bytes\":%lld", categories,
+               stat(path, &st) == 0 ? (long long)st.st_size : -1LL);
+    }
+
+    // Saving the interval and category, as on every HUD timeout after +/- or
+    // the D-pad: one pass over the file and a rename
+    if (wanted("config_update")) {
+        char path[512];
+        work_path(path, sizeof(path), "update.ini");
+        if (write_config(path, large) != 0) return;
+        Stats s = {0};
+        char interval[16];
+        for (int i = 0; i < 20; i++) {
+            snprintf(interval, sizeof(interval), "%d", 5 + i);
+            ConfigValue values[] = { { "interval_mins", interval }, { "category", "Category 00042" } };
+            double t = now_us();
+            config_update(NULL, path, values, 2);
+            stats_add(&s, now_us() - t);
+        }
+        report("config_update", &s, ",\"categories\":%d", large);
+    }
+}
+
+static void bench_scan(void) {
+    if (!wanted("dir_scan")) return;
+    char root[512], path[600];
+    work_path(root, sizeof(root), "album/");
+    mkdir(root, 0777);
+    for (int d = 0; d < SCAN_DIRS; d++) {
+        snprintf(path, sizeof(path), "%s%03d", root, d);
+        mkdir(path, 0777);
+        for (int i = 0; i < SCAN_FILES; i++) {
+            snprintf(path, sizeof(path), "%s%03d/IMG_%04d.jpg", root, d, i);
+            FILE *f = fopen(path, "wb");
+            if (f) fclose(f);
+        }
+    }
+
+    // Cold: every folder read; warm: nothing changed, only mtimes checked
+    Stats cold = {0}, warm = {0};
+    ImageIndex idx;
+    for (int i = 0; i < 20; i++) {
+        double t = now_us();
+        index_load(&idx, root, NULL);
+        index_refresh(&idx);
+        stats_add(&cold, now_us() - t);
+        if (i < 19) index_free(&idx);
+    }
+    for (int i = 0; i < 200; i++) {
+        double t = now_us();
+        index_refresh(&idx);
+        stats_add(&warm, now_us() - t);
+    }
+    report("dir_scan_cold", &cold, ",\"files\":%u", (unsigned)idx.num_files);
+    report("dir_scan_warm", &warm, ",\"files\":%u", (unsigned)idx.num_files);
+    index_free(&idx);
+}
+
+static void bench_decode(Arena *arena) {
+    char jpeg[512], png[512];
+    work_path(jpeg, sizeof(jpeg), "photo.jpg");
+    work_path(png, sizeof(png), "screenshot.png");
+
+    if (wanted("jpeg_decode") && write_jpeg(jpeg, 4000, 3000, 0) == 0) {
+        // DCT-scaled decode alone, then the whole local load path, then
+        // what it replaced: a full-size IMG_Load blitted down to the same
+        // placed size
+        Stats dct = {0}, load = {0}, blit = {0};
+        for (int i = 0; i < 20; i++) {
+            scratch_begin(arena);
+            double t = now_us();
+            SDL_Surface *s = decode_jpeg_file(jpeg, FIT_CONTAIN, SCREEN_W, SCREEN_H);
+            stats_add(&dct, now_us() - t);
+            SDL_FreeSurface(s);
+        }
+        for (int i = 0; i < 20; i++) {
+            scratch_begin(arena);
+            double t = now_us();
+            SDL_Surface *s = load_image(jpeg);
+            stats_add(&load, now_us() - t);
+            SDL_FreeSurface(s);
+        }
+        for (int i = 0; i < 20; i++) {
+            double t = now_us();
+            SDL_Surface *full = IMG_Load(jpeg);
+            if (!full) break;
+            SDL_Rect r = place_rect(FIT_CONTAIN, full->w, full->h, SCREEN_W, SCREEN_H);
+            SDL_Surface *s = SDL_CreateRGBSurfaceWithFormat(0, r.w, r.h, 32,
+                                                            SDL_PIXELFORMAT_RGBA32);
+            if (s) SDL_BlitScaled(full, NULL, s, NULL);
+            stats_add(&blit, now_us() - t);
+            SDL_FreeSurface(s);
+            SDL_FreeSurface(full);
+        }
+        double base_us = blit.n ? blit.total_us / blit.n : 0;
+        report("jpeg_decode_dct", &dct, ",\"width\":4000,\"height\":3000,\"speedup\":%.2f",
+               dct.n && base_us ? base_us / (dct.total_us / dct.n) : 0.0);
+        report("jpeg_decode_load", &load, ",\"width\":4000,\"height\":3000,\"speedup\":%.2f",
+               load.n && base_us ? base_us / (load.total_us / load.n) : 0.0);
+        report("jpeg_decode_blit", &blit, ",\"width\":4000,\"height\":3000");
+    }
+
+    if (wanted("png_decode") && write_png(png, 1920, 1080) == 0) {
+        Stats load = {0};
+        for (int i = 0; i < 20; i++) {
+            scratch_begin(arena);
+            double t = now_us();
+            SDL_Surface *s = load_image(png);
+            stats_add(&load, now_us() - t);
+            SDL_FreeSurface(s);
+        }
+        report("png_decode_load", &load, ",\"width\":1920,\"height\":1080");
+    }
+}
+
+// The same photos saved in every format the slideshow decodes itself,
+// loaded through the local path; bytes_per_slide is the mean file size,
+// which each decoder reads exactly once
+static void bench_formats(Arena *arena) {
+    static const struct { int w, h; } photos[] = {
+        { 4000, 3000 },     // camera
+        { 3024, 4032 },     // phone, portrait
+        { 1920, 1080 },     // screenshot
+        { 1280, 720 },      // console capture
+    };
+    static const struct { const char *name, *ext; } formats[] = {
+        { "format_jpeg", "jpg" },
+        { "format_png", "png" },
+        { "format_webp_lossy", "webp" },
+        { "format_webp_lossless", "ll.webp" },
+        { "format_webp_animated", "anim.webp" },
+        { "format_gif", "gif" },
+        { "format_qoi", "qoi" },
+    };
+    const int num_photos = sizeof(photos) / sizeof(photos[0]);
+    const int num_formats = sizeof(formats) / sizeof(formats[0]);
+    if (!wanted("format_")) return;
+
+    int have[sizeof(formats) / sizeof(formats[0])] = {0};
+    for (int i = 0; i < num_photos; i++) {
+        SDL_Surface *s = make_photo(photos[i].w, photos[i].h);
+        if (!s) continue;
+        for (int f = 0; f < num_formats; f++) {
+            if (!wanted(formats[f].name)) continue;
+            char name[64], path[512];
+            snprintf(name, sizeof(name), "corpus%d.%s", i, formats[f].ext);
+            work_path(path, sizeof(path), name);
+            int rc;
+            switch (f) {
+                case 0:  rc = save_jpeg(s, path, 0); break;
+                case 1:  rc = IMG_SavePNG(s, path); break;
+                case 2:  rc = save_webp(s, path, 0); break;
+                case 3:  rc = save_webp(s, path, 1); break;
+                case 4:  rc = save_webp_animated(s, s->w, s->h, 2, 0, 500, path); break;
+                case 5:  rc = save_gif(s, s->w, s->h, 1, 0, 0, path); break;
+                default: rc = save_qoi(s, path); break;
+            }
+            if (rc == 0) have[f]++;
+        }
+        SDL_FreeSurface(s);
+    }
+
+    for (int f = 0; f < num_formats; f++) {
+        if (have[f] != num_photos) continue;
+        Stats load = {0};
+        double bytes = 0;
+        int failed = 0;
+        for (int i = 0; i < num_photos; i++) {
+            char name[64], path[512];
+            snprintf(name, sizeof(name), "corpus%d.%s", i, formats[f].ext);
+            work_path(path, sizeof(path), name);
+            struct stat st;
+            if (stat(path, &st) == 0) bytes += (double)st.st_size;
+            for (int rep = 0; rep < 5; rep++) {
+                scratch_begin(arena);
+                double t = now_us();
+                SDL_Surface *s = load_image(path);
+                stats_add(&load, now_us() - t);
+                if (!s) failed++;
+                SDL_FreeSurface(s);
+            }
+        }
+        report(formats[f].name, &load, ",\"slides\":%d,\"bytes_per_slide\":%.0f,\"failed\":%d",
+               num_photos, bytes / num_photos, failed);
+    }
+}
+
+// A one-file HTTP server on 127.0.0.1 that sends its body at a fixed rate,
+// standing in for a slow network
+typedef struct {
+    int            listen_fd;
+    int            port;
+    int            rate;        // bytes per second
+    const unsigned char *body;
+    size_t         size;
+    SDL_atomic_t   quit;
+    SDL_Thread    *thread;
+} SlowServer;
+
+static int slow_server_thread(void *arg) {
+    SlowServer *srv = arg;
+    while (!SDL_AtomicGet(&srv->quit)) {
+        struct pollfd pfd = { srv->listen_fd, POLLIN, 0 };
+        if (poll(&pfd, 1, 100) <= 0) continue;
+        int fd = accept(srv->listen_fd, NULL, NULL);
+        if (fd < 0) continue;
+
+        // Whatever was asked for, after the request headers
+        char request[2048];
+        size_t got = 0;
+        while (got < sizeof(request) - 1) {
+            ssize_t n = recv(fd, request + got, sizeof(request) - 1 - got, 0);
+            if (n <= 0) break;
+            got += n;
+            request[got] = 0;
+            if (strstr(request, "\r\n\r\n")) break;
+        }
+        char head[128];
+        int head_len = snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\nContent-Length: %zu\r\n"
+                                                    "Connection: close\r\n\r\n", srv->size);
+        send(fd, head, head_len, MSG_NOSIGNAL);
+
+        // A slice every 20 ms, catching up to where the rate says it should be
+        double start = now_us();
+        size_t sent = 0;
+        while (sent < srv->size && !SDL_AtomicGet(&srv->quit)) {
+            size_t due = (size_t)((now_us() - start) / 1e6 * srv->rate) + srv->rate / 50;
+            if (due > srv->size) due = srv->size;
+            if (due > sent) {
+                ssize_t n = send(fd, srv->body + sent, due - sent, MSG_NOSIGNAL);
+                if (n <= 0) break;
+                sent += n;
+            }
+            SDL_Delay(20);
+        }
+        close(fd);
+    }
+    return 0;
+}
+
+static int slow_server_start(SlowServer *srv, const unsigned char *body, size_t size, int rate) {
+    memset(srv, 0, sizeof(*srv));
+    srv->body = body;
+    srv->size = size;
+    srv->rate = rate;
+    srv->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (srv->listen_fd < 0) return -1;
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (bind(srv->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(srv->listen_fd, 4) != 0 ||
+        getsockname(srv->listen_fd, (struct sockaddr *)&addr, &len) != 0) {
+        close(srv->listen_fd);
+        return -1;
+    }
+    srv->port = ntohs(addr.sin_port);
+    srv->thread = SDL_CreateThread(slow_server_thread, "slow server", srv);
+    if (!srv->thread) {
+        close(srv->listen_fd);
+        return -1;
+    }
+    return 0;
+}
+
+static void slow_server_stop(SlowServer *srv) {
+    SDL_AtomicSet(&srv->quit, 1);
+    SDL_WaitThread(srv->thread, NULL);
+    close(srv->listen_fd);
+}
+
+typedef struct {
+    ProgressiveDecoder *decoder;
+    double start, first_us;
+    int    previews;
+} BenchStream;
+
+// Like the console's stream_slide(), but makes every preview it can
+static void bench_stream(const unsigned char *data, size_t size, void *arg) {
+    BenchStream *bs = arg;
+    progressive_feed(bs->decoder, data, size);
+    SDL_Surface *preview = progressive_preview(bs->decoder);
+    if (!preview) return;
+    if (bs->previews++ == 0) bs->first_us = now_us() - bs->start;
+    SDL_FreeSurface(preview);
+}
+
+// Time to the first picture and to the final one for a progressive
+// download through the fetcher, against waiting for the whole body and
+// then decoding it, as remote slides were loaded before
+static void bench_download(Fetcher *fetcher, Arena *arena, const char *name, const char *path,
+                           int rate) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    unsigned char *body = size > 0 ? malloc(size) : NULL;
+    int ok = body && fread(body, 1, size, f) == (size_t)size;
+    fclose(f);
+    SlowServer srv;
+    if (!ok || slow_server_start(&srv, body, size, rate) != 0) {
+        free(body);
+        return;
+    }
+
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/%s", srv.port, strrchr(path, '/') + 1);
+    Stats first = {0}, final = {0}, buffered = {0};
+    int previews = 0;
+    for (int i = 0; i < 3; i++) {
+        CURLcode res;
+        scratch_begin(arena);
+        BenchStream bs = { progressive_create(FIT_CONTAIN, SCREEN_W, SCREEN_H), now_us() };
+        FetchContext *ctx = fetcher_take(fetcher, url, NULL, NULL, bench_stream, &bs, &res);
+        SDL_Surface *s = ctx && res == CURLE_OK ? progressive_finish(bs.decoder) : NULL;
+        s = shrink_surface(s, FIT_CONTAIN, SCREEN_W, SCREEN_H);
+        if (s && bs.previews) {
+            stats_add(&first, bs.first_us);
+            stats_add(&final, now_us() - bs.start);
+            previews += bs.previews;
+        }
+        SDL_FreeSurface(s);
+        fetcher_release(fetcher, ctx);
+        progressive_destroy(bs.decoder);
+
+        scratch_begin(arena);
+        double start = now_us();
+        ctx = fetcher_take(fetcher, url, NULL, NULL, NULL, NULL, &res);
+        s = NULL;
+        if (ctx && res == CURLE_OK) {
+            s = decode_jpeg_mem(ctx->data, ctx->size, FIT_CONTAIN, SCREEN_W, SCREEN_H);
+            if (!s) s = IMG_Load_RW(SDL_RWFromConstMem(ctx->data, (int)ctx->size), 1);
+            s = shrink_surface(s, FIT_CONTAIN, SCREEN_W, SCREEN_H);
+        }
+        if (s) stats_add(&buffered, now_us() - start);
+        SDL_FreeSurface(s);
+        fetcher_release(fetcher, ctx);
+    }
+    slow_server_stop(&srv);
+    free(body);
+
+    char label[64];
+    snprintf(label, sizeof(label), "%s_first_pixel", name);
+    report(label, &first, ",\"bytes\":%ld,\"rate_kb\":%d,\"previews\":%.1f", size, rate / 1024,
+           first.n ? (double)previews / first.n : 0.0);
+    snprintf(label, sizeof(label), "%s_final", name);
+    report(label, &final, ",\"bytes\":%ld,\"rate_kb\":%d", size, rate / 1024);
+    snprintf(label, sizeof(label), "%s_buffered", name);
+    report(label, &buffered, ",\"bytes\":%ld,\"rate_kb\":%d", size, rate / 1024);
+}
+
+static void bench_progressive(Arena *arena, int rate_kb) {
+    if (!wanted("progressive")) return;
+    Fetcher *fetcher = fetcher_create(NULL, NULL);
+    if (!fetcher) return;
+    char jpeg[512], png[512];
+    work_path(jpeg, sizeof(jpeg), "progressive.jpg");
+    work_path(png, sizeof(png), "interlaced.png");
+    if (wanted("progressive_jpeg") && write_jpeg(jpeg, 2048, 1536, 1) == 0)
+        bench_download(fetcher, arena, "progressive_jpeg", jpeg, rate_kb * 1024);
+    if (wanted("progressive_png") && write_png_interlaced(png, 1280, 720) == 0)
+        bench_download(fetcher, arena, "progressive_png", png, rate_kb * 1024);
+    fetcher_destroy(fetcher);
+}
+
+static void bench_scale(WorkPool *pool) {
+    if (!wanted("scale")) return;
+    SDL_Surface *src = SDL_CreateRGBSurfaceWithFormat(0, 4000, 3000, 32, SDL_PIXELFORMAT_ARGB8888);
+    if (!src) return;
+    for (int y = 0; y < src->h; y++) {
+        Uint32 *row = (Uint32 *)((Uint8 *)src->pixels + (size_t)y * src->pitch);
+        for (int x = 0; x < src->w; x++) row[x] = xorshift() | 0xff000000u;
+    }
+
+    // 4000x3000 -> 960x720 is a box filter reduction, 1600x1200 -> 1280x960
+    // bilinear; each once on the caller only, once split over the pool and
+    // once with SDL_BlitScaled (nearest neighbour) as the baseline
+    enum { SERIAL, POOLED, BLIT };
+    static const struct { const char *name; int sw, sh, dw, dh, how; } cases[] = {
+        { "scale_box_serial",      4000, 3000,  960, 720, SERIAL },
+        { "scale_box_pooled",      4000, 3000,  960, 720, POOLED },
+        { "scale_box_blit",        4000, 3000,  960, 720, BLIT },
+        { "scale_bilinear_serial", 1600, 1200, 1280, 960, SERIAL },
+        { "scale_bilinear_pooled", 1600, 1200, 1280, 960, POOLED },
+        { "scale_bilinear_blit",   1600, 1200, 1280, 960, BLIT },
+    };
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        if (!wanted(cases[c].name)) continue;
+        SDL_Surface *in = src;
+        if (cases[c].sw != src->w) in = scale_surface(src, cases[c].sw, cases[c].sh);
+        if (!in) continue;
+        scale_set_pool(cases[c].how == POOLED ? pool : NULL);
+
+        Stats s = {0};
+        for (int i = 0; i < 30; i++) {
+            double t = now_us();
+            SDL_Surface *out;
+            if (cases[c].how == BLIT) {
+                out = SDL_CreateRGBSurfaceWithFormat(0, cases[c].dw, cases[c].dh, 32,
+                                                     in->format->format);
+                if (out) SDL_BlitScaled(in, NULL, out, NULL);
+            } else {
+                out = scale_surface(in, cases[c].dw, cases[c].dh);
+            }
+            stats_add(&s, now_us() - t);
+            SDL_FreeSurface(out);
+        }
+        // Source megapixels per second
+        double mean_us = s.n ? s.total_us / s.n : 0.0;
+        report(cases[c].name, &s, ",\"threads\":%d,\"mp_per_s\":%.1f",
+               cases[c].how == POOLED ? workpool_threads(pool) : 0,
+               mean_us > 0 ? (double)cases[c].sw * cases[c].sh / mean_us : 0.0);
+        if (in != src) SDL_FreeSurface(in);
+    }
+    scale_set_pool(NULL);
+    SDL_FreeSurface(src);
+}
+
+// Animations played for a few seconds of real time into a streaming
+// texture, presenting at 60 Hz as the console's vsync would. Reports how
+// close to their delays frames went up and what playing them costs in
+// memory, however long the animation: the long GIF has 5x the frames of
+// the first at a fraction of the size each.
+static void bench_anim(SDL_Renderer *renderer, WorkPool *pool) {
+    static const struct {
+        const char *name, *file;
+        int w, h, frames, delay_ms, play_ms, webp;
+    } cases[] = {
+        { "anim_gif",       "anim.gif",       480,  270,  60, 40, 3000, 0 },
+        { "anim_gif_long",  "long.gif",       160,  120, 300, 20, 7000, 0 },
+        { "anim_webp_1080", "anim1080.webp", 1920, 1080,  30, 33, 2000, 1 },
+    };
+    if (!wanted("anim_")) return;
+    SDL_Texture *texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32,
+                                             SDL_TEXTUREACCESS_STREAMING, SCREEN_W, SCREEN_H);
+    if (!texture) return;
+    scale_set_pool(pool);      // as on the console
+
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        if (!wanted(cases[c].name)) continue;
+        // Frames pan across a wider photo, 4 pixels a frame
+        char path[512];
+        work_path(path, sizeof(path), cases[c].file);
+        SDL_Surface *s = make_photo(cases[c].w + cases[c].frames * 4, cases[c].h);
+        if (!s) continue;
+        int rc = cases[c].webp
+            ? save_webp_animated(s, cases[c].w, cases[c].h, cases[c].frames, 4, cases[c].delay_ms, path)
+            : save_gif(s, cases[c].w, cases[c].h, cases[c].frames, 4, cases[c].delay_ms / 10, path);
+        SDL_FreeSurface(s);
+        if (rc != 0) continue;
+
+        size_t heap_start = heap_in_use(), heap_peak = heap_start;
+        AnimPlayer *a = anim_open(path, FIT_CONTAIN, SCREEN_W, SCREEN_H, 0);
+        if (!a) continue;
+        SDL_Rect rect = place_rect(FIT_CONTAIN, cases[c].w, cases[c].h, SCREEN_W, SCREEN_H);
+        Stats upload = {0};
+        double start = now_us(), first_ms = -1;
+        int vsyncs = 0;
+        for (double t = 0; t < cases[c].play_ms * 1000.0; t = now_us() - start) {
+            double u = now_us();
+            SDL_Rect src;
+            if (anim_update(a, SDL_GetTicks(), texture, &src)) {
+                stats_add(&upload, now_us() - u);
+                if (first_ms < 0) first_ms = (now_us() - start) / 1000.0;
+                SDL_RenderClear(renderer);
+                SDL_RenderCopy(renderer, texture, &src, &rect);
+            }
+            SDL_RenderPresent(renderer);
+            size_t heap = heap_in_use();
+            if (heap > heap_peak) heap_peak = heap;
+            if (anim_finished(a)) break;
+
+            // Sleep to the next refresh, leaving the CPU to the decoder
+            double left = ++vsyncs * 1000000.0 / 60.0 - (now_us() - start);
+            if (left > 0) SDL_Delay((Uint32)(left / 1000) + 1);
+        }
+        AnimStats st;
+        anim_stats(a, &st);
+        anim_close(a);
+
+        report(cases[c].name, &upload,
+               ",\"frames\":%d,\"delay_ms\":%d,\"first_frame_ms\":%.1f,"
+               "\"shown\":%u,\"dropped\":%u,\"late\":%u,\"stalls\":%u,"
+               "\"mean_error_ms\":%.2f,\"max_late_ms\":%u,"
+               "\"decode_mean_ms\":%.2f,\"decode_max_ms\":%.2f,"
+               "\"anim_bytes\":%zu,\"heap_peak_delta\":%zu",
+               cases[c].frames, cases[c].delay_ms, first_ms,
+               st.shown, st.dropped, st.late, st.stalls,
+               st.shown > 1 ? st.error_ms / (st.shown - 1) : 0.0, st.max_late_ms,
+               st.decoded ? st.decode_ms / st.decoded : 0.0, st.max_decode_ms,
+               st.bytes, heap_peak - heap_start);
+    }
+    scale_set_pool(NULL);
+    SDL_DestroyTexture(texture);
+}
+
+// A picture of its own: a random background gradient with a few soft
+// blobs of colour, so unrelated scenes differ in layout, not just grain
+static SDL_Surface *make_scene(int w, int h) {
+    SDL_Surface *s = make_photo(w, h);
+    if (!s) return NULL;
+    int base[3] = { (int)(xorshift() % 160), (int)(xorshift() % 160), (int)(xorshift() % 160) };
+    int gx = (int)(xorshift() % 129) - 64, gy = (int)(xorshift() % 129) - 64;
+    struct { int x, y, r, c[3]; } blobs[5];
+    for (int k = 0; k < 5; k++) {
+        blobs[k].x = (int)(xorshift() % w);
+        blobs[k].y = (int)(xorshift() % h);
+        blobs[k].r = h / 8 + (int)(xorshift() % (h / 3));
+        for (int c = 0; c < 3; c++) blobs[k].c[c] = (int)(xorshift() % 256);
+    }
+    for (int y = 0; y < h; y++) {
+        Uint8 *row = (Uint8 *)s->pixels + (size_t)y * s->pitch;
+        for (int x = 0; x < w; x++) {
+            int v[3];
+            for (int c = 0; c < 3; c++) v[c] = base[c] + gx * x / w + gy * y / h + row[x * 3 + c] / 4;
+            for (int k = 0; k < 5; k++) {
+                int dx = x - blobs[k].x, dy = y - blobs[k].y;
+                int d2 = dx * dx + dy * dy, r2 = blobs[k].r * blobs[k].r;
+                if (d2 >= r2) continue;
+                int a = (r2 - d2) * 256 / r2;
+                for (int c = 0; c < 3; c++) v[c] += (blobs[k].c[c] - v[c]) * a / 256;
+            }
+            for (int c = 0; c < 3; c++) row[x * 3 + c] = v[c] < 0 ? 0 : v[c] > 255 ? 255 : v[c];
+        }
+    }
+    return s;
+}
+
+// The hash of a random smooth 9x8 grid, the shape of a photo's: whole
+// albums of these stand in for hashed slides
+static uint64_t synthetic_hash(SDL_Surface *grid) {
+    int gx = (int)(xorshift() % 41) - 20, gy = (int)(xorshift() % 41) - 20;
+    int base = 128 + (int)(xorshift() % 64) - 32;
+    for (int y = 0; y < grid->h; y++) {
+        Uint8 *row = (Uint8 *)grid->pixels + (size_t)y * grid->pitch;
+        for (int x = 0; x < grid->w; x++) {
+            int v = base + gx * (x - 4) + gy * (y - 4) + (int)(xorshift() % 81) - 40;
+            v = v < 0 ? 0 : v > 255 ? 255 : v;
+            row[x * 3 + 0] = row[x * 3 + 1] = row[x * 3 + 2] = (Uint8)v;
+        }
+    }
+    return phash_surface(grid);
+}
+
+static uint32_t bench_group(void *user, uint32_t item) {
+    return phash_index_group(user, item);
+}
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Perceptual hashes of an album of `album` images: hashing a placed
+// slide; how far edits of one picture land from it and how close
+// unrelated pictures come; then building, searching, saving and loading
+// the index, and shuffling with near-duplicates kept apart. A fifth of
+// the album are burst shots, 1-4 bits from the one before.
+static void bench_phash(int album) {
+    if (!wanted("phash")) return;
+
+    if (wanted("phash_surface")) {
+        SDL_Surface *rgb = make_photo(SCREEN_W, SCREEN_H);
+        SDL_Surface *rgba = SDL_CreateRGBSurfaceWithFormat(0, SCREEN_W, SCREEN_H, 32,
+                                                           SDL_PIXELFORMAT_RGBA32);
+        if (rgb && rgba) {
+            for (int y = 0; y < SCREEN_H; y++) {
+                const Uint8 *in = (const Uint8 *)rgb->pixels + (size_t)y * rgb->pitch;
+                Uint8 *out = (Uint8 *)rgba->pixels + (size_t)y * rgba->pitch;
+                for (int x = 0; x < SCREEN_W; x++) {
+                    memcpy(out + x * 4, in + x * 3, 3);
+                    out[x * 4 + 3] = 255;
+                }
+            }
+            Stats s24 = {0}, s32 = {0};
+            uint64_t h24 = 0, h32 = 0;
+            for (int i = 0; i < 50; i++) {
+                double t = now_us();
+                h24 = phash_surface(rgb);
+                stats_add(&s24, now_us() - t);
+                t = now_us();
+                h32 = phash_surface(rgba);
+                stats_add(&s32, now_us() - t);
+            }
+            report("phash_surface_rgb24", &s24, ",\"pixels\":%d", SCREEN_W * SCREEN_H);
+            report("phash_surface_rgba32", &s32, ",\"pixels\":%d,\"same_hash\":%d",
+                   SCREEN_W * SCREEN_H, h24 == h32);
+        }
+        SDL_FreeSurface(rgb);
+        SDL_FreeSurface(rgba);
+    }
+
+    // Edits a photo goes through on its way to the SD card, against
+    // distinct scenes
+    if (wanted("phash_robust")) {
+        enum { SCENES = 40 };
+        uint64_t hashes[SCENES];
+        int edit_max[3] = {0}, edit_sum[3] = {0}, scenes = 0;
+        char path[512];
+        work_path(path, sizeof(path), "phash.jpg");
+        Stats s = {0};
+        for (int i = 0; i < SCENES; i++) {
+            SDL_Surface *src = make_scene(1600, 1200);
+            if (!src) break;
+            SDL_Surface *placed = shrink_surface(scale_surface(src, 1600, 1200), FIT_CONTAIN,
+                                                 SCREEN_W, SCREEN_H);
+            double t = now_us();
+            hashes[scenes] = placed ? phash_surface(placed) : 0;
+            stats_add(&s, now_us() - t);
+
+            // Recompressed as JPEG, saved at half size, brightened
+            int d[3] = { -1, -1, -1 };
+            SDL_Surface *jpeg = save_jpeg(src, path, 0) == 0 ? load_image(path) : NULL;
+            if (jpeg) d[0] = phash_distance(hashes[scenes], phash_surface(jpeg));
+            SDL_Surface *half = scale_surface(src, 800, 600);
+            if (half) d[1] = phash_distance(hashes[scenes], phash_surface(half));
+            for (int y = 0; y < src->h; y++) {
+                Uint8 *row = (Uint8 *)src->pixels + (size_t)y * src->pitch;
+                for (int x = 0; x < src->w * 3; x++) row[x] = row[x] > 215 ? 255 : row[x] + 40;
+            }
+            d[2] = phash_distance(hashes[scenes], phash_surface(src));
+            for (int e = 0; e < 3; e++) {
+                if (d[e] > edit_max[e]) edit_max[e] = d[e];
+                edit_sum[e] += d[e];
+            }
+            SDL_FreeSurface(jpeg);
+            SDL_FreeSurface(half);
+            SDL_FreeSurface(placed);
+            SDL_FreeSurface(src);
+            scenes++;
+        }
+        int min_apart = 64, near_pairs = 0, pairs = 0;
+        for (int i = 0; i < scenes; i++)
+            for (int j = i + 1; j < scenes; j++, pairs++) {
+                int d = phash_distance(hashes[i], hashes[j]);
+                if (d < min_apart) min_apart = d;
+                near_pairs += d <= PHASH_NEAR;
+            }
+        report("phash_robust", &s,
+               ",\"scenes\":%d,\"jpeg_max_bits\":%d,\"jpeg_mean_bits\":%.2f,"
+               "\"half_max_bits\":%d,\"half_mean_bits\":%.2f,"
+               "\"bright_max_bits\":%d,\"bright_mean_bits\":%.2f,"
+               "\"unrelated_min_bits\":%d,\"unrelated_near_pairs\":%d,\"pairs\":%d",
+               scenes, edit_max[0], scenes ? (double)edit_sum[0] / scenes : 0.0,
+               edit_max[1], scenes ? (double)edit_sum[1] / scenes : 0.0,
+               edit_max[2], scenes ? (double)edit_sum[2] / scenes : 0.0,
+               min_apart, near_pairs, pairs);
+    }
+
+    // The album: hashes as they'd come in from the thumbnail builder
+    SDL_Surface *grid = SDL_CreateRGBSurfaceWithFormat(0, 9, 8, 24, SDL_PIXELFORMAT_RGB24);
+    uint64_t *hashes = malloc((size_t)album * sizeof(uint64_t));
+    ImageIndex idx;
+    memset(&idx, 0, sizeof(idx));
+    idx.files  = malloc((size_t)album * sizeof(uint32_t));
+    idx.strtab = malloc((size_t)album * 16);
+    PhashIndex ix;
+    if (!grid || !hashes || !idx.files || !idx.strtab || album < 2 ||
+        phash_index_init(&ix, (uint32_t)album) != 0) {
+        SDL_FreeSurface(grid);
+        free(hashes);
+        free(idx.files);
+        free(idx.strtab);
+        return;
+    }
+    int bursts = 0;
+    for (int i = 0; i < album; i++) {
+        if (i > 0 && xorshift() % 5 == 0) {
+            uint64_t h = hashes[i - 1];
+            for (int b = 1 + (int)(xorshift() % 4); b > 0; b--) h ^= 1ull << (xorshift() % 64);
+            hashes[i] = h;
+            bursts++;
+        } else {
+            hashes[i] = synthetic_hash(grid);
+        }
+        idx.files[i] = idx.strtab_size;
+        idx.strtab_size += (uint32_t)sprintf(idx.strtab + idx.strtab_size, "IMG_%07d.jpg", i) + 1;
+    }
+    idx.num_files = (uint32_t)album;
+    SDL_FreeSurface(grid);
+
+    Stats insert = {0};
+    for (int i = 0; i < album; i++) {
+        double t = now_us();
+        phash_index_set(&ix, (uint32_t)i, hashes[i], 1);
+        stats_add(&insert, now_us() - t);
+    }
+    // Groups, and how many images are in one with others
+    uint32_t *sizes = calloc((size_t)album, sizeof(uint32_t));
+    uint32_t groups = 0, grouped = 0;
+    for (int i = 0; i < album && sizes; i++) sizes[phash_index_group(&ix, (uint32_t)i)]++;
+    for (int i = 0; i < album && sizes; i++) {
+        groups += sizes[i] > 0;
+        grouped += sizes[i] > 1 ? sizes[i] : 0;
+    }
+    free(sizes);
+    report("phash_index_insert", &insert,
+           ",\"album\":%d,\"bursts\":%d,\"groups\":%u,\"in_groups\":%u,\"buckets\":%u",
+           album, bursts, groups, grouped, ix.mask + 1);
+
+    // Lookups of album hashes a few bits off, against comparing with
+    // every hash, which must find the same images
+    enum { QUERIES = 1000, MAX_OUT = 4096 };
+    static uint32_t found[MAX_OUT], expect[MAX_OUT];
+    Stats mih = {0}, linear = {0};
+    int mismatches = 0;
+    uint64_t total = 0;
+    for (int q = 0; q < QUERIES; q++) {
+        uint64_t h = hashes[xorshift() % album];
+        for (int b = (int)(xorshift() % 4); b > 0; b--) h ^= 1ull << (xorshift() % 64);
+        double t = now_us();
+        uint32_t n = phash_index_near(&ix, h, PHASH_NEAR, found, MAX_OUT);
+        stats_add(&mih, now_us() - t);
+        t = now_us();
+        uint32_t m = 0;
+        for (int i = 0; i < album; i++)
+            if (phash_distance(h, hashes[i]) <= PHASH_NEAR && m < MAX_OUT) expect[m++] = (uint32_t)i;
+        stats_add(&linear, now_us() - t);
+        if (n > MAX_OUT) n = MAX_OUT;
+        qsort(found, n, sizeof(uint32_t), cmp_u32);
+        mismatches += n != m || memcmp(found, expect, n * sizeof(uint32_t)) != 0;
+        total += n;
+    }
+    report("phash_index_near", &mih, ",\"album\":%d,\"radius\":%d,\"mean_found\":%.2f,"
+           "\"mismatches\":%d", album, PHASH_NEAR, (double)total / QUERIES, mismatches);
+    report("phash_linear_scan", &linear, ",\"album\":%d", album);
+
+    // The sidecar file, and grouping the loaded hashes as the builder
+    // checks each one after a restart
+    char path[512];
+    work_path(path, sizeof(path), "album.phs");
+    Stats save = {0}, load = {0}, check = {0};
+    double t = now_us();
+    phash_index_save(&ix, &idx, FIT_CONTAIN, path);
+    stats_add(&save, now_us() - t);
+    PhashIndex loaded;
+    t = now_us();
+    int rc = phash_index_load(&loaded, &idx, FIT_CONTAIN, path);
+    stats_add(&load, now_us() - t);
+    uint32_t checked = 0, same = 0;
+    for (int i = 0; i < album && rc == 0; i++) {
+        t = now_us();
+        checked += phash_index_check(&loaded, (uint32_t)i, 1);
+        stats_add(&check, now_us() - t);
+    }
+    for (int i = 0; i < album && rc == 0; i++)
+        same += phash_index_group(&loaded, (uint32_t)i) == phash_index_group(&ix, (uint32_t)i);
+    struct stat st;
+    report("phash_save", &save, ",\"bytes\":%lld", stat(path, &st) == 0 ? (long long)st.st_size : -1LL);
+    report("phash_load", &load, ",\"hashes\":%u", loaded.hashed);
+    report("phash_check_loaded", &check, ",\"checked\":%u,\"same_groups\":%u", checked, same);
+    phash_index_free(&loaded);
+
+    // Shuffling: no two picks from a group within PLAYLIST_SPACING, and
+    // with skip at most one of each group per round
+    static const struct { const char *name; PlaylistSimilar similar; } modes[] = {
+        { "phash_playlist_space", PLAYLIST_SIMILAR_SPACE },
+        { "phash_playlist_skip",  PLAYLIST_SIMILAR_SKIP },
+        { "phash_playlist_off",   PLAYLIST_SIMILAR_OFF },
+    };
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        if (!wanted(modes[m].name)) continue;
+        Playlist pl;
+        playlist_init(&pl, PLAYLIST_SHUFFLE, 42);
+        if (playlist_reset(&pl, (uint32_t)album, 0, NULL, NULL) != 0) continue;
+        playlist_set_groups(&pl, modes[m].similar, bench_group, &ix);
+        uint8_t *shown = calloc((size_t)album, 1);
+        uint32_t recent[PLAYLIST_SPACING] = {0}, close = 0, repeats = 0, picks = 0;
+        Stats s = {0};
+        for (int i = 0; i < album && shown; i++) {
+            uint32_t pos = pl.pos;
+            t = now_us();
+            uint32_t item = playlist_next(&pl);
+            stats_add(&s, now_us() - t);
+            if (pl.pos <= pos) break;   // one round
+            uint32_t g = phash_index_group(&ix, item);
+            for (uint32_t k = 0; k < PLAYLIST_SPACING && k < picks; k++) close += recent[k] == g;
+            repeats += shown[g]++ > 0;
+            recent[picks++ % PLAYLIST_SPACING] = g;
+        }
+        report(modes[m].name, &s, ",\"picks\":%u,\"close_repeats\":%u,\"round_repeats\":%u",
+               picks, close, repeats);
+        free(shown);
+        playlist_free(&pl);
+    }
+
+    phash_index_free(&ix);
+    free(hashes);
+    free(idx.files);
+    free(idx.strtab);
+}
+
+static void bench_text(SDL_Renderer *renderer, TextRenderer *text) {
+    if (!text || !wanted("text")) return;
+    SDL_Color white = {255, 255, 255, 255};
+    char line[128];
+
+    // The HUD as it usually is (every line cached), and with a status line
+    // that changes every frame
+    Stats cached = {0}, changing = {0};
+    for (int i = 0; i < 2000; i++) {
+        double t = now_us();
+        text_draw(text, "Interval: 5 min  Frame: 1.23 ms  Presents/h: 120", white, 20, 620);
+        text_draw(text, "Category: [Album]  (1/3)", white, 20, 650);
+        text_draw(text, "Local: IMG_0001.jpg (42 ms, 97% thumb hits)", white, 20, 680);
+        stats_add(&cached, now_us() - t);
+    }
+    for (int i = 0; i < 2000; i++) {
+        snprintf(line, sizeof(line), "Local: IMG_%04d.jpg (%d ms)", i, i % 100);
+        double t = now_us();
+        text_draw(text, line, white, 20, 680);
+        stats_add(&changing, now_us() - t);
+    }
+    report("text_draw_cached", &cached, ",\"lines\":3");
+    report("text_draw_changing", &changing, ",\"lines\":1");
+    SDL_RenderClear(renderer);
+}
+
+// Run hours of slides on a virtual clock: each slide is loaded and
+// uploaded like on the console, and only the frames its transition asks
+// for are drawn. Heap and process size at the end against the start show
+// whether a long run leaks or fragments.
+static void bench_slideshow(SDL_Renderer *renderer, TextRenderer *text, Arena *arena,
+                            double hours, int interval_s, TransitionKind kind) {
+    if (!wanted("slideshow")) return;
+    static const struct { const char *name; int w, h; } images[] = {
+        { "slide0.jpg", 4000, 3000 },
+        { "slide1.jpg", 3000, 4000 },
+        { "slide2.jpg", 1920, 1080 },
+        { "slide3.png", 1600, 1200 },
+    };
+    const int num_images = sizeof(images) / sizeof(images[0]);
+    char paths[4][512];
+    for (int i = 0; i < num_images; i++) {
+        work_path(paths[i], sizeof(paths[i]), images[i].name);
+        int rc = strstr(images[i].name, ".png") ? write_png(paths[i], images[i].w, images[i].h)
+                                                : write_jpeg(paths[i], images[i].w, images[i].h, 0);
+        if (rc != 0) return;
+    }
+
+    TexturePool pool;
+    texpool_init(&pool, renderer, 3, SCREEN_W, SCREEN_H);
+    SDL_Texture *current = NULL, *previous = NULL;
+    SDL_Rect rect = {0, 0, SCREEN_W, SCREEN_H};
+    Transition transition = { TRANSITION_CUT };
+    SDL_Color white = {255, 255, 255, 255};
+
+    int slides = (int)(hours * 3600.0 / interval_s + 0.5);
+    Uint32 hold_ms = (Uint32)interval_s * 1000;
+    Stats load = {0}, frames = {0};
+    size_t heap_start = heap_in_use(), heap_peak = heap_start;
+    uint64_t process_start = platform_process_memory();
+    double start = now_us();
+
+    for (int n = 0; n < slides; n++) {
+        Uint32 clock = (Uint32)n * hold_ms;
+
+        scratch_begin(arena);
+        double t = now_us();
+        SDL_Surface *surface = load_image(paths[n % num_images]);
+        SDL_Rect src;
+        SDL_Texture *tex = surface ? texpool_upload(&pool, renderer, surface, &src) : NULL;
+        stats_add(&load, now_us() - t);
+        if (tex) {
+            rect = place_rect(FIT_CONTAIN, surface->w, surface->h, SCREEN_W, SCREEN_H);
+            texpool_release(&pool, previous);
+            previous = current;
+            current = tex;
+            transition_start(&transition, kind, clock, hold_ms, &src);
+        }
+        SDL_FreeSurface(surface);
+
+        // Frames until the next slide is due, as the render loop would draw them
+        for (Uint32 now = clock; current && now < clock + hold_ms;) {
+            double f = now_us();
+            SDL_RenderClear(renderer);
+            transition_draw(&transition, renderer, previous, current, &rect, now);
+            text_draw(text, "Category: [Album]  (1/3)", white, 20, 650);
+            SDL_RenderPresent(renderer);
+            stats_add(&frames, now_us() - f);
+            if (previous && transition_blend_done(&transition, now)) {
+                texpool_release(&pool, previous);
+                previous = NULL;
+            }
+            int wait = transition_wait(&transition, now);
+            if (wait < 0) break;
+            now += wait > 0 ? (Uint32)wait : 1;
+        }
+
+        size_t heap = heap_in_use();
+        if (heap > heap_peak) heap_peak = heap;
+    }
+    double wall_ms = (now_us() - start) / 1000.0;
+
+    texpool_release(&pool, previous);
+    texpool_release(&pool, current);
+    report("slideshow_load", &load,
+           ",\"slides\":%d,\"simulated_hours\":%.2f,\"transition\":\"%s\",\"wall_ms\":%.0f,"
+           "\"heap_start\":%zu,\"heap_end\":%zu,\"heap_peak\":%zu,"
+           "\"process_start\":%llu,\"process_end\":%llu,"
+           "\"arena_high_water\":%zu,\"arena_overflows\":%u,\"texpool_fallbacks\":%u",
+           slides, hours, transition_name(kind), wall_ms,
+           heap_start, heap_in_use(), heap_peak,
+           (unsigned long long)process_start, (unsigned long long)platform_process_memory(),
+           arena->high_water, arena->overflows, pool.fallbacks);
+    report("slideshow_frame", &frames, ",\"frames_per_slide\":%.1f",
+           slides ? (double)frames.n / slides : 0.0);
+    texpool_free(&pool);
+}
+
+int main(int argc, char *argv[]) {
+    double hours = 1.0;
+    int interval_s = 300;
+    int large_config = 20000;
+    int rate_kb = 512;
+    int album = 100000;
+    TransitionKind kind = TRANSITION_FADE;
+    const char *out_path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--hours") == 0 && i + 1 < argc) {
+            hours = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+            interval_s = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--categories") == 0 && i + 1 < argc) {
+            large_config = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+            rate_kb = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--album") == 0 && i + 1 < argc) {
+            album = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--transition") == 0 && i + 1 < argc) {
+            int k = transition_parse(argv[++i]);
+            if (k >= 0) kind = k;
+        } else if (strcmp(argv[i], "--only") == 0 && i + 1 < argc) {
+            ONLY = argv[++i];
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: %s [--hours N] [--interval S] [--transition NAME] "
+                            "[--categories N] [--rate KB] [--album N] [--only NAME] [--out FILE]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (interval_s < 1) interval_s = 1;
+    if (rate_kb < 1) rate_kb = 1;
+
+    OUT = out_path ? fopen(out_path, "w") : stdout;
+    if (!OUT) {
+        fprintf(stderr, "Can't write %s\n", out_path);
+        return 1;
+    }
+    if (!mkdtemp(WORK_DIR)) {
+        fprintf(stderr, "Can't create a work directory\n");
+        return 1;
+    }
+
+    platform_init();
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    SDL_Init(SDL_INIT_VIDEO);
+    IMG_Init(IMG_INIT_JPG | IMG_INIT_PNG);
+    TTF_Init();
+
+    // Same setup as the console: decode scratch, a worker pool for scaling
+    // and a renderer, here a software one drawing into a screen-sized surface
+    Arena arena;
+    arena_init(&arena, (size_t)SCRATCH_MB * 1024 * 1024);
+    WorkPool *pool = workpool_create(0, 32);
+    SDL_Surface *screen = SDL_CreateRGBSurfaceWithFormat(0, SCREEN_W, SCREEN_H, 32,
+                                                         SDL_PIXELFORMAT_ARGB8888);
+    SDL_Renderer *renderer = screen ? SDL_CreateSoftwareRenderer(screen) : NULL;
+    TTF_Font *font = TTF_OpenFont(ROMFS_ROOT "font.ttf", 22);
+    TextRenderer *text = renderer && font ? text_create(renderer, font) : NULL;
+    if (!text)
+        fprintf(stderr, "No renderer or %sfont.ttf, skipping drawing: %s\n", ROMFS_ROOT,
+                SDL_GetError());
+
+    fprintf(OUT, "{\"benchmarks\":[");
+    bench_config(large_config);
+    bench_scan();
+    bench_decode(&arena);
+    bench_formats(&arena);
+    bench_progressive(&arena, rate_kb);
+    bench_scale(pool);
+    if (renderer) bench_anim(renderer, pool);
+    bench_phash(album);
+    bench_text(renderer, text);
+    if (text) bench_slideshow(renderer, text, &arena, hours, interval_s, kind);
+    fprintf(OUT, "\n]}\n");
+    if (OUT != stdout) fclose(OUT);
+
+    text_destroy(text);
+    if (font) TTF_CloseFont(font);
+    if (renderer) SDL_DestroyRenderer(renderer);
+    SDL_FreeSurface(screen);
+    workpool_destroy(pool);
+    arena_free(&arena);
+    TTF_Quit();
+    IMG_Quit();
+    SDL_Quit();
+    curl_global_cleanup();
+    platform_exit();
+    nftw(WORK_DIR, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    return 0;
+}
@@ -0,0 +1,629 @@
+// fetch_test.c
+// Checks for the fetcher's download buffers against a stand-in HTTP
+// server on localhost that sends bodies either with a Content-Length or
+// chunked: a sized body lands in one allocation of exactly its size, a
+// chunked one grows by doubling, a slot's next fetch reuses its buffer
+// without allocating, and a body over FETCH_MAX_BYTES is refused before
+// any of it is buffered. Prints the allocations and peak buffer bytes of
+// every fetch.
+//
+// The same server over HTTPS, with a self-signed certificate made at
+// start, times a first fetch against warm ones: warm fetches reuse the
+// connection, and after fetcher_reset() the new connection resumes the
+// TLS session instead of a full handshake.
+//
+// Delayed responses stand in for a slow server: neighbouring categories
+// warmed together arrive in about the longest delay rather than the sum
+// of them, each transfer's time to first byte covers its delay, and
+// warming other urls cuts the stale transfers off before they finish. A
+// slide taken right after its warm is started gets that transfer, with
+// no second request.
+//
+// From the repo root:
+//   make -f Makefile.host fetch-test
+//   build-host/fetch_test
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <SDL2/SDL.h>
+#include <curl/curl.h>
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+#include "fetch.h"
+
+static int FAILED;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        FAILED++; \
+    } \
+} while (0)
+
+// ---- the server -------------------------------------------------------------
+
+// GET /fixed/<bytes>    body with a Content-Length
+// GET /chunked/<bytes>  body in 16 KB chunks
+// GET /huge             a Content-Length over FETCH_MAX_BYTES, and no body
+// GET /delay/<ms>/<bytes>   a sized body, after waiting ms before the
+//                           headers (anything after <bytes> is ignored)
+//
+// Connections are kept alive, each on its own thread, as a real server's
+// would be. With tls set, they're HTTPS.
+
+#define MAX_CONNS  64
+#define CHUNK_SIZE (16 * 1024)
+
+typedef struct Server Server;
+
+typedef struct {
+    Server     *sv;
+    int         fd;
+    SSL        *ssl;
+    SDL_Thread *thread;
+} Conn;
+
+struct Server {
+    int          port;
+    int          listen_fd;
+    SDL_Thread  *thread;
+    SDL_atomic_t quit;
+    SSL_CTX     *tls;
+    SDL_atomic_t accepted;      // connections
+    SDL_atomic_t resumed;       // of them, TLS sessions resumed
+    SDL_atomic_t delayed;       // /delay requests received
+    SDL_atomic_t cut;           // of them, closed by the client during the delay
+    Conn         conns[MAX_CONNS];
+    int          num_conns;
+};
+
+static Server HTTP, HTTPS;
+
+// Byte i of a body of the given size; fetches are checked against it
+static unsigned char body_byte(size_t size, size_t i) {
+    return (unsigned char)(i * 31 + size);
+}
+
+static bool send_all(Conn *c, const void *data, size_t len) {
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = c->ssl ? SSL_write(c->ssl, p, (int)len) : send(c->fd, p, len, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static bool send_body(Conn *c, size_t size, bool chunked) {
+    unsigned char chunk[CHUNK_SIZE];
+    for (size_t off = 0; off < size; off += CHUNK_SIZE) {
+        size_t n = size - off < CHUNK_SIZE ? size - off : CHUNK_SIZE;
+        for (size_t i = 0; i < n; i++) chunk[i] = body_byte(size, off + i);
+        char line[32];
+        int line_len = snprintf(line, sizeof(line), "%zx\r\n", n);
+        if ((chunked && !send_all(c, line, line_len)) || !send_all(c, chunk, n) ||
+            (chunked && !send_all(c, "\r\n", 2)))
+            return false;
+    }
+    return !chunked || send_all(c, "0\r\n\r\n", 5);
+}
+
+// Sit on a response for ms; false if the client hung up meanwhile. It
+// sends nothing more while waiting, so the socket turning readable can
+// only mean it closed.
+static bool delay(Conn *c, unsigned long ms) {
+    Uint32 start = SDL_GetTicks();
+    while (SDL_GetTicks() - start < ms) {
+        struct pollfd p = { c->fd, POLLIN, 0 };
+        if (SDL_AtomicGet(&c->sv->quit)) return false;
+        if (poll(&p, 1, 10) > 0) {
+            char byte;
+            if (recv(c->fd, &byte, 1, MSG_PEEK) <= 0) return false;
+        }
+    }
+    return true;
+}
+
+// One request; false once the connection should close
+static bool serve(Conn *c) {
+    char request[4096];
+    size_t len = 0;
+    while (len < sizeof(request) - 1) {
+        struct pollfd p = { c->fd, POLLIN, 0 };
+        if (SDL_AtomicGet(&c->sv->quit)) return false;
+        if (!(c->ssl && SSL_pending(c->ssl)) && poll(&p, 1, 100) <= 0) continue;
+        size_t room = sizeof(request) - 1 - len;
+        ssize_t n = c->ssl ? SSL_read(c->ssl, request + len, (int)room)
+                           : recv(c->fd, request + len, room, 0);
+        if (n <= 0) return false;
+        len += (size_t)n;
+        request[len] = 0;
+        if (strstr(request, "\r\n\r\n")) break;
+    }
+
+    char head[256], path[512];
+    unsigned long size = 0, ms = 0;
+    if (sscanf(request, "GET %511s", path) != 1) return false;
+    if (sscanf(path, "/delay/%lu/%lu", &ms, &size) == 2) {
+        SDL_AtomicAdd(&c->sv->delayed, 1);
+        if (!delay(c, ms)) {
+            SDL_AtomicAdd(&c->sv->cut, 1);
+            return false;
+        }
+        snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\nContent-Length: %lu\r\n\r\n", size);
+        return send_all(c, head, strlen(head)) && send_body(c, size, false);
+    }
+    if (sscanf(path, "/fixed/%lu", &size) == 1) {
+        snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\nContent-Length: %lu\r\n\r\n", size);
+        return send_all(c, head, strlen(head)) && send_body(c, size, false);
+    }
+    if (sscanf(path, "/chunked/%lu", &size) == 1) {
+        snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n");
+        return send_all(c, head, strlen(head)) && send_body(c, size, true);
+    }
+    if (strcmp(path, "/huge") == 0) {
+        snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\nContent-Length: %d\r\n\r\n",
+                 FETCH_MAX_BYTES * 2);
+        send_all(c, head, strlen(head));
+        return false;
+    }
+    snprintf(head, sizeof(head), "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+    return send_all(c, head, strlen(head));
+}
+
+static int conn_thread(void *arg) {
+    Conn *c = arg;
+    if (c->sv->tls) {
+        c->ssl = SSL_new(c->sv->tls);
+        if (c->ssl && SSL_set_fd(c->ssl, c->fd) == 1 && SSL_accept(c->ssl) == 1) {
+            if (SSL_session_reused(c->ssl)) SDL_AtomicAdd(&c->sv->resumed, 1);
+            while (serve(c)) {}
+            SSL_shutdown(c->ssl);
+        }
+        SSL_free(c->ssl);
+    } else {
+        while (serve(c)) {}
+    }
+    close(c->fd);
+    return 0;
+}
+
+static int server_thread(void *arg) {
+    Server *sv = arg;
+    while (!SDL_AtomicGet(&sv->quit)) {
+        struct pollfd p = { sv->listen_fd, POLLIN, 0 };
+        if (poll(&p, 1, 100) <= 0) continue;
+        int fd = accept(sv->listen_fd, NULL, NULL);
+        if (fd < 0) continue;
+        if (sv->num_conns == MAX_CONNS) {
+            close(fd);
+            continue;
+        }
+        SDL_AtomicAdd(&sv->accepted, 1);
+        // Headers and body go out in separate writes; don't let Nagle hold
+        // the tail of the body back for a delayed ACK
+        int yes = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+        Conn *c = &sv->conns[sv->num_conns];
+        c->sv = sv;
+        c->fd = fd;
+        c->thread = SDL_CreateThread(conn_thread, "conn", c);
+        if (c->thread) sv->num_conns++;
+        else close(fd);
+    }
+    return 0;
+}
+
+// A throwaway self-signed certificate; the fetcher doesn't verify peers
+static SSL_CTX *tls_context(void) {
+    SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+    EVP_PKEY *key = EVP_EC_gen("P-256");
+    X509 *cert = X509_new();
+    bool ok = ctx && key && cert;
+    if (ok) {
+        ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+        X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+        X509_gmtime_adj(X509_getm_notAfter(cert), 24 * 3600);
+        X509_set_pubkey(cert, key);
+        X509_NAME *name = X509_get_subject_name(cert);
+        X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char *)"127.0.0.1",
+                                   -1, -1, 0);
+        X509_set_issuer_name(cert, name);
+        ok = X509_sign(cert, key, EVP_sha256()) > 0 && SSL_CTX_use_certificate(ctx, cert) == 1 &&
+             SSL_CTX_use_PrivateKey(ctx, key) == 1;
+    }
+    X509_free(cert);
+    EVP_PKEY_free(key);
+    if (!ok) {
+        SSL_CTX_free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+static bool server_start(Server *sv, bool tls) {
+    memset(sv, 0, sizeof(*sv));
+    if (tls && !(sv->tls = tls_context())) {
+        fprintf(stderr, "server: no TLS context\n");
+        return false;
+    }
+    sv->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    if (sv->listen_fd < 0 || bind(sv->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(sv->listen_fd, 16) != 0 ||
+        getsockname(sv->listen_fd, (struct sockaddr *)&addr, &addr_len) != 0) {
+        perror("server");
+        if (sv->listen_fd >= 0) close(sv->listen_fd);
+        return false;
+    }
+    sv->port = ntohs(addr.sin_port);
+    sv->thread = SDL_CreateThread(server_thread, "server", sv);
+    return sv->thread != NULL;
+}
+
+static void server_stop(Server *sv) {
+    SDL_AtomicSet(&sv->quit, 1);
+    SDL_WaitThread(sv->thread, NULL);
+    for (int i = 0; i < sv->num_conns; i++) SDL_WaitThread(sv->conns[i].thread, NULL);
+    close(sv->listen_fd);
+    SSL_CTX_free(sv->tls);
+}
+
+// ---- the tests --------------------------------------------------------------
+
+typedef struct {
+    CURLcode res;
+    long     http_code;
+    size_t   size;
+    unsigned allocs;
+    size_t   peak;
+    bool     intact;    // every byte as the server sent it
+    int      reused;
+    double   ms;        // from asking to having it all
+} Fetched;
+
+static double now_ms(void) {
+    return SDL_GetPerformanceCounter() * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+static Fetched fetch_from(Fetcher *f, const Server *sv, const char *path, size_t size,
+                          bool quiet) {
+    char url[128];
+    snprintf(url, sizeof(url), "%s://127.0.0.1:%d%s", sv->tls ? "https" : "http", sv->port, path);
+    Fetched out = {0};
+    double start = now_ms();
+    FetchContext *ctx = fetcher_take(f, url, NULL, NULL, NULL, NULL, &out.res);
+    out.ms = now_ms() - start;
+    if (ctx) {
+        out.reused    = ctx->reused;
+        out.http_code = ctx->http_code;
+        out.size      = ctx->size;
+        out.allocs    = ctx->allocs;
+        out.peak      = ctx->peak;
+        out.intact    = ctx->size == size;
+        for (size_t i = 0; out.intact && i < size; i++)
+            out.intact = ctx->data[i] == body_byte(size, i);
+    }
+    fetcher_release(f, ctx);
+    if (!quiet)
+        printf("  %-22s %9zu bytes  %u alloc(s)  peak %9zu\n", path, out.size, out.allocs,
+               out.peak);
+    return out;
+}
+
+static Fetched fetch(Fetcher *f, const char *path, size_t size) {
+    return fetch_from(f, &HTTP, path, size, false);
+}
+
+// Allocations as the buffer doubles from FETCH_MIN_CAPACITY up to size
+static unsigned doublings(size_t from, size_t size) {
+    unsigned n = 0;
+    for (size_t cap = from; cap < size; cap *= 2) n++;
+    return n;
+}
+
+static void test_sized(void) {
+    Fetcher *f = fetcher_create(NULL, NULL);
+    char path[64];
+    const size_t size = 3 * 1024 * 1024 + 123;
+    snprintf(path, sizeof(path), "/fixed/%zu", size);
+
+    // One allocation, exactly the body
+    Fetched a = fetch(f, path, size);
+    CHECK(a.res == CURLE_OK && a.http_code == 200 && a.intact);
+    CHECK(a.allocs == 1 && a.peak == size);
+
+    // The slot's buffer is reused: nothing allocated
+    Fetched b = fetch(f, path, size);
+    CHECK(b.res == CURLE_OK && b.intact && b.allocs == 0 && b.peak == size);
+
+    // Nor for anything smaller
+    Fetched c = fetch(f, "/fixed/1000", 1000);
+    CHECK(c.res == CURLE_OK && c.intact && c.allocs == 0 && c.peak == size);
+
+    // An empty body needs no buffer at all
+    Fetched d = fetch(f, "/fixed/0", 0);
+    CHECK(d.res == CURLE_OK && d.size == 0 && d.allocs == 0);
+    fetcher_destroy(f);
+}
+
+static void test_chunked(void) {
+    Fetcher *f = fetcher_create(NULL, NULL);
+    char path[64];
+    const size_t size = 3 * 1024 * 1024 + 123;
+    snprintf(path, sizeof(path), "/chunked/%zu", size);
+
+    // Doubling from FETCH_MIN_CAPACITY: a handful of allocations, at most
+    // twice the body, never one per chunk
+    Fetched a = fetch(f, path, size);
+    CHECK(a.res == CURLE_OK && a.http_code == 200 && a.intact);
+    CHECK(a.allocs == 1 + doublings(FETCH_MIN_CAPACITY, size));
+    CHECK(a.peak >= size && a.peak < 2 * size);
+
+    Fetched b = fetch(f, path, size);
+    CHECK(b.res == CURLE_OK && b.intact && b.allocs == 0 && b.peak == a.peak);
+
+    // A larger sized body after it takes one exact allocation
+    snprintf(path, sizeof(path), "/fixed/%zu", 2 * a.peak + 1);
+    Fetched c = fetch(f, path, 2 * a.peak + 1);
+    CHECK(c.res == CURLE_OK && c.intact && c.allocs == 1 && c.peak == 2 * a.peak + 1);
+
+    // And a larger chunked one doubles from there
+    snprintf(path, sizeof(path), "/chunked/%zu", c.peak + c.peak / 2);
+    Fetched d = fetch(f, path, c.peak + c.peak / 2);
+    CHECK(d.res == CURLE_OK && d.intact && d.allocs == 1 && d.peak == 2 * c.peak);
+    fetcher_destroy(f);
+}
+
+// Turned away on the header, before a byte of body is stored
+static void test_too_big(void) {
+    Fetcher *f = fetcher_create(NULL, NULL);
+    Fetched a = fetch(f, "/huge", 0);
+    CHECK(a.res != CURLE_OK && a.allocs == 0);
+
+    // The slot is fine for the next fetch
+    Fetched b = fetch(f, "/chunked/70000", 70000);
+    CHECK(b.res == CURLE_OK && b.intact);
+    fetcher_destroy(f);
+}
+
+// A fresh fetcher's first fetch from sv against the warm ones after it,
+// over several fetchers. Each fetcher opens exactly one connection.
+static void test_warm(Server *sv, int rounds) {
+    const int warm_per_round = 8;
+    double cold_ms = 0, warm_ms = 0;
+    int cold_new = 0, warm_reused = 0, ok = 0;
+    for (int r = 0; r < rounds; r++) {
+        Fetcher *f = fetcher_create(NULL, NULL);
+        int accepted = SDL_AtomicGet(&sv->accepted);
+        Fetched cold = fetch_from(f, sv, "/fixed/100000", 100000, true);
+        cold_ms += cold.ms;
+        cold_new += !cold.reused;
+        ok += cold.res == CURLE_OK && cold.intact;
+        for (int i = 0; i < warm_per_round; i++) {
+            Fetched warm = fetch_from(f, sv, "/fixed/100000", 100000, true);
+            warm_ms += warm.ms;
+            warm_reused += warm.reused;
+            ok += warm.res == CURLE_OK && warm.intact;
+        }
+        CHECK(SDL_AtomicGet(&sv->accepted) == accepted + 1);
+        fetcher_destroy(f);
+    }
+    CHECK(ok == rounds * (1 + warm_per_round));
+    CHECK(cold_new == rounds && warm_reused == rounds * warm_per_round);
+    cold_ms /= rounds;
+    warm_ms /= rounds * warm_per_round;
+    printf("  %-5s first %6.2f ms  warm %6.2f ms  (%.1fx)\n", sv->tls ? "https" : "http",
+           cold_ms, warm_ms, warm_ms > 0 ? cold_ms / warm_ms : 0.0);
+
+    // A TLS handshake costs round trips and public-key work a reused
+    // connection doesn't, even over loopback
+    if (sv->tls) CHECK(warm_ms < cold_ms);
+}
+
+// After a reset the next fetch opens a new connection, but it resumes the
+// TLS session rather than doing a full handshake
+static void test_reset(Server *sv) {
+    Fetcher *f = fetcher_create(NULL, NULL);
+    Fetched a = fetch_from(f, sv, "/fixed/1000", 1000, true);
+    CHECK(a.res == CURLE_OK && !a.reused);
+    int accepted = SDL_AtomicGet(&sv->accepted), resumed = SDL_AtomicGet(&sv->resumed);
+
+    fetcher_reset(f);
+    Fetched b = fetch_from(f, sv, "/fixed/1000", 1000, true);
+    CHECK(b.res == CURLE_OK && b.intact && !b.reused);
+    CHECK(SDL_AtomicGet(&sv->accepted) == accepted + 1);
+    CHECK(SDL_AtomicGet(&sv->resumed) == resumed + 1);
+    printf("  after reset %.2f ms, session %s\n", b.ms,
+           SDL_AtomicGet(&sv->resumed) > resumed ? "resumed" : "not resumed");
+
+    Fetched c = fetch_from(f, sv, "/fixed/1000", 1000, true);
+    CHECK(c.res == CURLE_OK && c.reused);
+    fetcher_destroy(f);
+}
+
+static void delayed_url(char *url, size_t len, unsigned long ms, size_t size) {
+    snprintf(url, len, "http://127.0.0.1:%d/delay/%lu/%zu", HTTP.port, ms, size);
+}
+
+// Take url and check its body; the transfer's timing goes to *timing
+static bool take_intact(Fetcher *f, const char *url, size_t size, bool *warmed,
+                        FetchTiming *timing) {
+    CURLcode res;
+    FetchContext *ctx = fetcher_take(f, url, NULL, NULL, NULL, NULL, &res);
+    bool intact = ctx && res == CURLE_OK && ctx->http_code == 200 && ctx->size == size;
+    for (size_t i = 0; intact && i < size; i++)
+        intact = ctx->data[i] == body_byte(size, i);
+    if (ctx) {
+        *warmed = ctx->warmed;
+        *timing = ctx->timing;
+    }
+    fetcher_release(f, ctx);
+    return intact;
+}
+
+// The current, next and previous categories' slides from a slow server,
+// one after another and then warmed together, as a D-pad switch would
+static void test_parallel(void) {
+    static const unsigned long delays[] = { 200, 300, 400 };
+    enum { COUNT = sizeof(delays) / sizeof(delays[0]) };
+    const size_t size = 50000;
+    unsigned long sum = 0, longest = 0;
+    char urls[COUNT][128];
+    const char *url_ptrs[COUNT];
+    for (int i = 0; i < COUNT; i++) {
+        delayed_url(urls[i], sizeof(urls[i]), delays[i], size + i);
+        url_ptrs[i] = urls[i];
+        sum += delays[i];
+        if (delays[i] > longest) longest = delays[i];
+    }
+
+    Fetcher *f = fetcher_create(NULL, NULL);
+    bool warmed;
+    FetchTiming tm;
+    double start = now_ms();
+    for (int i = 0; i < COUNT; i++)
+        CHECK(take_intact(f, urls[i], size + i, &warmed, &tm) && !warmed);
+    double serial_ms = now_ms() - start;
+
+    start = now_ms();
+    fetcher_warm(f, url_ptrs, COUNT);
+    for (int i = 0; i < COUNT; i++) {
+        CHECK(take_intact(f, urls[i], size + i, &warmed, &tm) && warmed);
+        // The server sat on the request for the whole delay before the
+        // first byte; the body after it is quick
+        CHECK(tm.ttfb_ms >= (long)delays[i] - 5);
+        CHECK(tm.total_ms >= tm.ttfb_ms && tm.bytes_per_sec > 0);
+        printf("  %-22s ttfb %4ld ms  transfer %3ld ms  %8.1f KB/s\n",
+               strstr(urls[i], "/delay"), tm.ttfb_ms, tm.transfer_ms, tm.bytes_per_sec / 1024.0);
+    }
+    double parallel_ms = now_ms() - start;
+    CHECK(fetcher_last_timing(f, &tm) && tm.ttfb_ms > 0);
+    fetcher_destroy(f);
+
+    printf("  one after another %6.1f ms (delays sum to %lu)\n", serial_ms, sum);
+    printf("  warmed together   %6.1f ms (longest delay %lu)\n", parallel_ms, longest);
+    CHECK(serial_ms >= sum);
+    CHECK(parallel_ms >= longest && parallel_ms < longest + (sum - longest) / 2);
+}
+
+// The app's first remote slide: its category and the neighbours are
+// warmed, then the slide is taken at once, while its transfer is still
+// running. It must come from that transfer, and nothing is asked for
+// twice; a reset in between (as a spurious network change did) would fail
+// the claimed transfer and throw away the others.
+static void test_warm_then_take(void) {
+    enum { COUNT = 3 };
+    const size_t size = 30000;
+    char urls[COUNT][128];
+    const char *url_ptrs[COUNT];
+    for (int i = 0; i < COUNT; i++) {
+        delayed_url(urls[i], sizeof(urls[i]), 200, size + 10 + i);
+        url_ptrs[i] = urls[i];
+    }
+
+    Fetcher *f = fetcher_create(NULL, NULL);
+    int delayed = SDL_AtomicGet(&HTTP.delayed);
+    fetcher_warm(f, url_ptrs, COUNT);
+    bool warmed = false;
+    FetchTiming tm;
+    for (int i = 0; i < COUNT; i++)
+        CHECK(take_intact(f, urls[i], size + 10 + i, &warmed, &tm) && warmed);
+    printf("  warmed and taken at once: %d request(s) for %d slides\n",
+           SDL_AtomicGet(&HTTP.delayed) - delayed, COUNT);
+    CHECK(SDL_AtomicGet(&HTTP.delayed) == delayed + COUNT);
+    fetcher_destroy(f);
+}
+
+// Moving on to other categories cancels the warms for the old ones while
+// the server is still sitting on them, freeing their slots
+static void test_cancel(void) {
+    enum { STALE = 3 };
+    const size_t size = 20000;
+    char stale[STALE][128], fresh[128];
+    const char *stale_ptrs[STALE];
+    for (int i = 0; i < STALE; i++) {
+        delayed_url(stale[i], sizeof(stale[i]), 5000, size + i);
+        stale_ptrs[i] = stale[i];
+    }
+    delayed_url(fresh, sizeof(fresh), 50, size);
+
+    Fetcher *f = fetcher_create(NULL, NULL);
+    int delayed = SDL_AtomicGet(&HTTP.delayed), cut = SDL_AtomicGet(&HTTP.cut);
+    fetcher_warm(f, stale_ptrs, STALE);
+    for (int i = 0; i < 100 && SDL_AtomicGet(&HTTP.delayed) < delayed + STALE; i++)
+        SDL_Delay(10);
+    CHECK(SDL_AtomicGet(&HTTP.delayed) == delayed + STALE);
+
+    const char *fresh_ptr = fresh;
+    double start = now_ms();
+    fetcher_warm(f, &fresh_ptr, 1);
+    for (int i = 0; i < 100 && SDL_AtomicGet(&HTTP.cut) < cut + STALE; i++)
+        SDL_Delay(10);
+    double cancel_ms = now_ms() - start;
+    CHECK(SDL_AtomicGet(&HTTP.cut) == cut + STALE);
+
+    bool warmed = false;
+    FetchTiming tm;
+    CHECK(take_intact(f, fresh, size, &warmed, &tm) && warmed);
+    double fresh_ms = now_ms() - start;
+    printf("  %d stale warms cut off in %.1f ms, the new one in %.1f ms\n", STALE, cancel_ms,
+           fresh_ms);
+    CHECK(fresh_ms < 1000);
+
+    // Every slot is free again: as many fetches at once as there are slots
+    const char *many[FETCH_MAX_TRANSFERS];
+    char many_urls[FETCH_MAX_TRANSFERS][128];
+    for (int i = 0; i < FETCH_MAX_TRANSFERS; i++) {
+        delayed_url(many_urls[i], sizeof(many_urls[i]), 0, 1000 + i);
+        many[i] = many_urls[i];
+    }
+    fetcher_warm(f, many, FETCH_MAX_TRANSFERS);
+    for (int i = 0; i < FETCH_MAX_TRANSFERS; i++)
+        CHECK(take_intact(f, many_urls[i], 1000 + i, &warmed, &tm) && warmed);
+    fetcher_destroy(f);
+}
+
+int main(int argc, char **argv) {
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    if (!server_start(&HTTP, false) || !server_start(&HTTPS, true)) return 1;
+
+    printf("sized:\n");
+    test_sized();
+    printf("chunked:\n");
+    test_chunked();
+    printf("too big:\n");
+    test_too_big();
+    printf("latency:\n");
+    test_warm(&HTTP, 10);
+    test_warm(&HTTPS, 10);
+    test_reset(&HTTPS);
+    printf("delayed:\n");
+    test_parallel();
+    test_warm_then_take();
+    test_cancel();
+
+    server_stop(&HTTP);
+    server_stop(&HTTPS);
+    curl_global_cleanup();
+
+    if (FAILED) {
+        fprintf(stderr, "fetch_test: %d check(s) failed\n", FAILED);
+        return 1;
+    }
+    printf("fetch_test: ok\n");
+    return 0;
+}
@@ -0,0 +1,146 @@
+// fuzz_config.c
+// Fuzz target for the config.ini parser and writer.
+//
+// Each input is parsed, then run through config_update() and parsed again,
+// which must give back the values that were set, whatever the input was.
+//
+// With clang, as a libFuzzer target (from the repo root):
+//   make -f Makefile.host fuzz-config
+// With any compiler, as a standalone driver that runs the files given on
+// the command line, or else random configs built from INI fragments:
+//   make -f Makefile.host fuzz-config-standalone
+//   build-host/fuzz_config_standalone [--runs N] [--seed S] [file...]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "config.h"
+
+static char PATH[64];
+
+static void check(bool ok, const char *what) {
+    if (!ok) {
+        fprintf(stderr, "config_update: %s\n", what);
+        abort();
+    }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    Config c;
+    config_defaults(&c);
+    char *text = malloc(size + 1);
+    if (!text) return 0;
+    memcpy(text, data, size);
+    text[size] = 0;
+    config_parse(&c, text, size);
+
+    // Every category must be reachable by name, and strings must be intact
+    size_t total = 0;
+    for (int i = 0; i < c.num_categories; i++) {
+        total += strlen(c.categories[i].name) + strlen(c.categories[i].url) +
+                 strlen(c.categories[i].localpath) + strlen(c.categories[i].manifest);
+        check(c.categories[i].manifest[0] == 0 || c.categories[i].localpath[0] != 0,
+              "manifest without a folder");
+        check(config_find_category(&c, c.categories[i].name) >= 0, "category lost");
+    }
+    config_free(&c);
+
+    if (!PATH[0]) snprintf(PATH, sizeof(PATH), "/tmp/fuzz_config_%d.ini", (int)getpid());
+    FILE *f = fopen(PATH, "wb");
+    if (!f) return 0;
+    fwrite(data, 1, size, f);
+    fclose(f);
+
+    static const ConfigValue values[] = {
+        { "first_run", "false" },
+        { "interval_mins", "17" },
+        { "category", "Fuzz" },
+    };
+    if (config_update(NULL, PATH, values, 3) == 0) {
+        config_load(&c, PATH);
+        check(!c.first_run, "first_run not set");
+        check(c.interval_mins == 17, "interval_mins not set");
+        check(strcmp(c.category, "Fuzz") == 0, "category not set");
+        config_free(&c);
+    }
+    remove(PATH);
+    return total == (size_t)-1;
+}
+
+#ifdef FUZZ_STANDALONE
+
+static const char *FRAGMENTS[] = {
+    "[Settings]", "[Categories]", "[Transitions]", "[Other]", "[Settings", "[",
+    "first_run = true", "first_run=false", "interval_mins = 3", "interval_mins = 99999",
+    "category = Album", "category =", "prefetch_depth = -4", "decode_threads = 1000",
+    "transition = kenburns", "fit = fill", "order = weighted", "similar = skip", "cache_mb = 12abc",
+    "battery_interval_pct = 0", "charger_interval_pct = 50",
+    "Album = local://sdmc:/Nintendo/Album/", "Remote = https://example.com/a.jpg",
+    "Synced = manifest://example.com/album.txt", "Empty = manifest://",
+    "Album = fade", "Album = cut", "Missing = slide", "= orphan", "key =", "  spaced  =  out  ",
+    "; comment", "# comment", "no equals sign", "a = b = c", "\t\ttabbed\t=\tvalue\t",
+};
+
+static uint64_t RNG = 88172645463325252ull;
+
+static uint32_t next_random(void) {
+    RNG ^= RNG << 13;
+    RNG ^= RNG >> 7;
+    RNG ^= RNG << 17;
+    return (uint32_t)(RNG >> 32);
+}
+
+// A config made of INI fragments, odd line endings and the odd random byte
+static size_t random_config(uint8_t *out, size_t capacity) {
+    static const char *endings[] = { "\n", "\r\n", "\r", "", "\n\n" };
+    const int num_fragments = sizeof(FRAGMENTS) / sizeof(FRAGMENTS[0]);
+    size_t size = 0;
+    int lines = next_random() % 64;
+    for (int i = 0; i < lines; i++) {
+        const char *frag = FRAGMENTS[next_random() % num_fragments];
+        const char *eol = endings[next_random() % 8 < 5 ? 0 : next_random() % 5];
+        size_t n = strlen(frag), m = strlen(eol);
+        if (size + n + m + 1 > capacity) break;
+        memcpy(out + size, frag, n);
+        size += n;
+        if (next_random() % 16 == 0) out[size++] = (uint8_t)next_random();
+        memcpy(out + size, eol, m);
+        size += m;
+    }
+    return size;
+}
+
+int main(int argc, char *argv[]) {
+    long runs = 100000;
+    int files = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            runs = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            RNG = strtoull(argv[++i], NULL, 0) | 1;
+        } else {
+            FILE *f = fopen(argv[i], "rb");
+            if (!f) {
+                fprintf(stderr, "Can't read %s\n", argv[i]);
+                return 1;
+            }
+            static uint8_t data[1 << 20];
+            size_t size = fread(data, 1, sizeof(data), f);
+            fclose(f);
+            LLVMFuzzerTestOneInput(data, size);
+            files++;
+        }
+    }
+    if (files) return 0;
+
+    static uint8_t data[8192];
+    for (long i = 0; i < runs; i++)
+        LLVMFuzzerTestOneInput(data, random_config(data, sizeof(data)));
+    printf("%ld random configs OK\n", runs);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,197 @@
+// gif_test.c
+// Checks for the GIF decoder on small files built in memory: a plain
+// frame lands on the canvas in its palette's colours, indices past the end
+// of a short global or local palette are left transparent, and an LZW
+// minimum code size outside the spec's 2-8 is refused as corrupt instead
+// of reading past the palette.
+//
+// From the repo root:
+//   make -f Makefile.host gif-test
+//   build-host/gif_test
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "gif.h"
+
+static int FAILED;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        FAILED++; \
+    } \
+} while (0)
+
+#define W 4
+#define H 2
+
+// A GIF being written: whole bytes, and LZW codes packed LSB first into
+// one sub-block
+typedef struct {
+    unsigned char data[4096];
+    size_t   len;
+    uint32_t bits;
+    int      nbits;
+    unsigned char block[256];
+    int      block_len;
+} Builder;
+
+static void put(Builder *b, const void *bytes, size_t n) {
+    memcpy(b->data + b->len, bytes, n);
+    b->len += n;
+}
+
+static void put_code(Builder *b, int code, int size) {
+    b->bits |= (uint32_t)code << b->nbits;
+    b->nbits += size;
+    while (b->nbits >= 8) {
+        b->block[b->block_len++] = (unsigned char)b->bits;
+        b->bits >>= 8;
+        b->nbits -= 8;
+    }
+}
+
+// Header for a W x H canvas, with a global palette of colors entries
+// (a power of two from 2 to 256) or none if 0
+static void put_header(Builder *b, int colors) {
+    unsigned char head[13] = { 'G', 'I', 'F', '8', '9', 'a', W, 0, H, 0, 0, 0, 0 };
+    int bits = 0;
+    while (colors && (2 << bits) < colors) bits++;
+    if (colors) head[10] = (unsigned char)(0x80 | bits);
+    put(b, head, sizeof(head));
+    for (int i = 0; i < colors; i++) {
+        unsigned char rgb[3] = { (unsigned char)(10 + i), (unsigned char)(20 + i),
+                                 (unsigned char)(30 + i) };
+        put(b, rgb, 3);
+    }
+}
+
+// One W x H frame, with a local palette of local_colors entries if that's
+// nonzero. Every pixel is sent as a clear code and a literal, so the code
+// size never grows and min_size can be anything.
+static void put_frame(Builder *b, int local_colors, int min_size, const int *index) {
+    unsigned char desc[10] = { 0x2C, 0, 0, 0, 0, W, 0, H, 0, 0 };
+    int bits = 0;
+    while (local_colors && (2 << bits) < local_colors) bits++;
+    if (local_colors) desc[9] = (unsigned char)(0x80 | bits);
+    put(b, desc, sizeof(desc));
+    for (int i = 0; i < local_colors; i++) {
+        unsigned char rgb[3] = { (unsigned char)(100 + i), (unsigned char)(110 + i),
+                                 (unsigned char)(120 + i) };
+        put(b, rgb, 3);
+    }
+
+    unsigned char min = (unsigned char)min_size;
+    put(b, &min, 1);
+    int clear = 1 << min_size, size = min_size + 1;
+    b->bits = 0;
+    b->nbits = 0;
+    b->block_len = 0;
+    for (int i = 0; i < W * H; i++) {
+        put_code(b, clear, size);
+        put_code(b, index[i], size);
+    }
+    put_code(b, clear + 1, size);
+    if (b->nbits > 0) put_code(b, 0, 8 - b->nbits);
+    unsigned char n = (unsigned char)b->block_len, end = 0x3B, terminator = 0;
+    put(b, &n, 1);
+    put(b, b->block, b->block_len);
+    put(b, &terminator, 1);
+    put(b, &end, 1);
+}
+
+// Decode b's first frame into canvas (W * H RGBA); gif_next_frame()'s result
+static int decode(const Builder *b, unsigned char *canvas) {
+    GifDecoder *g = gif_open_mem(b->data, b->len);
+    if (!g) return -2;
+    const unsigned char *rgba;
+    int delay_ms;
+    int rc = gif_next_frame(g, &rgba, &delay_ms);
+    if (rc == 1) memcpy(canvas, rgba, W * H * 4);
+    gif_close(g);
+    return rc;
+}
+
+static void test_plain(void) {
+    static const int index[W * H] = { 0, 1, 2, 3, 3, 2, 1, 0 };
+    Builder b = {0};
+    put_header(&b, 4);
+    put_frame(&b, 0, 2, index);
+    unsigned char canvas[W * H * 4];
+    CHECK(decode(&b, canvas) == 1);
+    for (int i = 0; i < W * H; i++) {
+        const unsigned char *p = canvas + i * 4;
+        CHECK(p[0] == 10 + index[i] && p[1] == 20 + index[i] && p[2] == 30 + index[i]);
+        CHECK(p[3] == 255);
+    }
+}
+
+// Codes that are valid LZW but past the palette's end draw nothing
+static void test_past_palette(void) {
+    static const int index[W * H] = { 0, 3, 4, 7, 1, 5, 2, 6 };
+    unsigned char canvas[W * H * 4];
+
+    Builder global = {0};
+    put_header(&global, 4);
+    put_frame(&global, 0, 3, index);
+    CHECK(decode(&global, canvas) == 1);
+    for (int i = 0; i < W * H; i++) {
+        const unsigned char *p = canvas + i * 4;
+        if (index[i] < 4) CHECK(p[0] == 10 + index[i] && p[3] == 255);
+        else CHECK(p[3] == 0);
+    }
+
+    // A local palette of 2 under a global one of 256: the local one counts
+    Builder local = {0};
+    put_header(&local, 256);
+    put_frame(&local, 2, 3, index);
+    CHECK(decode(&local, canvas) == 1);
+    for (int i = 0; i < W * H; i++) {
+        const unsigned char *p = canvas + i * 4;
+        if (index[i] < 2) CHECK(p[0] == 100 + index[i] && p[3] == 255);
+        else CHECK(p[3] == 0);
+    }
+}
+
+// Minimum code sizes the spec doesn't allow. At 11 the literal after a
+// clear could be up to 2047, thousands of bytes past a 256-entry palette.
+static void test_bad_code_size(void) {
+    static const int small[W * H] = { 0, 1, 0, 1, 1, 0, 1, 0 };
+    static const int large[W * H] = { 2000, 2046, 1500, 300, 1024, 2040, 999, 700 };
+    unsigned char canvas[W * H * 4];
+    static const struct { int min_size; const int *index; } cases[] = {
+        { 0, small }, { 1, small }, { 9, large }, { 11, large }, { 12, small },
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        Builder b = {0};
+        put_header(&b, 256);
+        put_frame(&b, 0, cases[i].min_size, cases[i].index);
+        int rc = decode(&b, canvas);
+        if (rc != -1) fprintf(stderr, "  min code size %d: %d\n", cases[i].min_size, rc);
+        CHECK(rc == -1);
+    }
+
+    // The spec's limits themselves are fine
+    static const int top[W * H] = { 255, 0, 128, 7, 64, 200, 1, 254 };
+    Builder b = {0};
+    put_header(&b, 256);
+    put_frame(&b, 0, 8, top);
+    CHECK(decode(&b, canvas) == 1);
+    for (int i = 0; i < W * H; i++) CHECK(canvas[i * 4] == (unsigned char)(10 + top[i]));
+}
+
+int main(void) {
+    test_plain();
+    test_past_palette();
+    test_bad_code_size();
+
+    if (FAILED) {
+        fprintf(stderr, "gif_test: %d check(s) failed\n", FAILED);
+        return 1;
+    }
+    printf("gif_test: ok\n");
+    return 0;
+}
@@ -0,0 +1,278 @@
+// index_test.c
+// Checks for the persistent image index over a synthetic album of 100k
+// files: a first scan finds every image, the saved index loads back
+// identical, every relpath names a real file, a refresh of an unchanged
+// tree lists no directories, and after files and folders are added and
+// removed only the directories that changed are read again. Files and
+// folders whose full path would pass INDEX_PATH_MAX are left out, not
+// indexed cut short.
+//
+// From the repo root:
+//   make -f Makefile.host index-test
+//   build-host/index_test [--files N]
+
+#define _XOPEN_SOURCE 700
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/stat.h>
+
+#include "imageindex.h"
+
+#define TOP_DIRS 20
+#define SUB_DIRS 20      // per top-level folder
+#define OLD_TIME 1000000000
+
+static int FAILED;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        FAILED++; \
+    } \
+} while (0)
+
+static char ROOT[256];
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void touch(const char *path) {
+    FILE *f = fopen(path, "wb");
+    if (f) fclose(f);
+}
+
+// Directory mtimes have a resolution of a second, so the tree is dated
+// well in the past: a change made now always moves a folder's mtime
+static void set_old(const char *path) {
+    struct utimbuf t = { OLD_TIME, OLD_TIME };
+    utime(path, &t);
+}
+
+// TOP_DIRS x SUB_DIRS folders of files, one of them not an image, plus a
+// few images at the top level
+static int build_tree(int files) {
+    char path[512];
+    int per_dir = files / (TOP_DIRS * SUB_DIRS), made = 0;
+    for (int t = 0; t < TOP_DIRS; t++) {
+        snprintf(path, sizeof(path), "%s%02d", ROOT, t);
+        mkdir(path, 0777);
+        for (int s = 0; s < SUB_DIRS; s++) {
+            snprintf(path, sizeof(path), "%s%02d/%02d", ROOT, t, s);
+            mkdir(path, 0777);
+            for (int i = 0; i < per_dir; i++, made++) {
+                snprintf(path, sizeof(path), "%s%02d/%02d/IMG_%04d.%s", ROOT, t, s, i,
+                         i % 3 ? "jpg" : "PNG");
+                touch(path);
+            }
+            snprintf(path, sizeof(path), "%s%02d/%02d/notes.txt", ROOT, t, s);
+            touch(path);
+            snprintf(path, sizeof(path), "%s%02d/%02d", ROOT, t, s);
+            set_old(path);
+        }
+        snprintf(path, sizeof(path), "%s%02d", ROOT, t);
+        set_old(path);
+    }
+    for (; made < files; made++) {
+        snprintf(path, sizeof(path), "%stop_%04d.jpg", ROOT, made);
+        touch(path);
+    }
+    set_old(ROOT);
+    return made;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+    return remove(path);
+}
+
+// Every file is a real image file under root, each listed once, and each
+// folder's files are the run of files[] its record says
+static void check_index(const ImageIndex *idx) {
+    char path[768];
+    int missing = 0, outside = 0;
+    for (uint32_t i = 0; i < idx->num_files; i++) {
+        struct stat st;
+        index_full_path(idx, i, path, sizeof(path));
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) missing++;
+        if (strstr(index_relpath(idx, i), "notes.txt")) outside++;
+    }
+    CHECK(missing == 0 && outside == 0);
+
+    uint32_t listed = 0;
+    for (uint32_t d = 0; d < idx->num_dirs; d++) {
+        const IndexDir *dir = &idx->dirs[d];
+        const char *dir_path = idx->strtab + dir->path;
+        size_t len = strlen(dir_path);
+        for (uint32_t f = dir->first_file; f < dir->first_file + dir->num_files; f++) {
+            const char *rel = index_relpath(idx, f);
+            if (strncmp(rel, dir_path, len) != 0 || strchr(rel + len, '/')) outside++;
+        }
+        listed += dir->num_files;
+    }
+    CHECK(outside == 0 && listed == idx->num_files);
+}
+
+static bool same_index(const ImageIndex *a, const ImageIndex *b) {
+    if (a->num_files != b->num_files || a->num_dirs != b->num_dirs) return false;
+    for (uint32_t i = 0; i < a->num_files; i++)
+        if (strcmp(index_relpath(a, i), index_relpath(b, i)) != 0) return false;
+    for (uint32_t d = 0; d < a->num_dirs; d++)
+        if (memcmp(&a->dirs[d], &b->dirs[d], sizeof(IndexDir)) != 0) return false;
+    return true;
+}
+
+int main(int argc, char **argv) {
+    int files = 100000;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--files") == 0 && i + 1 < argc) files = atoi(argv[++i]);
+        else {
+            fprintf(stderr, "usage: %s [--files N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    char tmp[] = "/tmp/index_test.XXXXXX", saved[300];
+    if (!mkdtemp(tmp)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(ROOT, sizeof(ROOT), "%s/album/", tmp);
+    snprintf(saved, sizeof(saved), "%s/album.idx", tmp);
+    mkdir(ROOT, 0777);
+    files = build_tree(files);
+    const uint32_t num_dirs = 1 + TOP_DIRS + TOP_DIRS * SUB_DIRS;
+
+    // First scan: everything is read
+    ImageIndex idx;
+    index_load(&idx, ROOT, saved);
+    double t = now_ms();
+    CHECK(index_refresh(&idx) == 1);
+    double scan_ms = now_ms() - t;
+    CHECK(idx.num_files == (uint32_t)files);
+    CHECK(idx.num_dirs == num_dirs && idx.dirs_read == num_dirs);
+    check_index(&idx);
+    CHECK(index_save(&idx, saved) == 0);
+
+    // Saved and loaded back, as at the next start
+    ImageIndex loaded;
+    t = now_ms();
+    CHECK(index_load(&loaded, ROOT, saved) == 0);
+    double load_ms = now_ms() - t;
+    CHECK(same_index(&idx, &loaded));
+
+    // Lookups are array reads; time a million at random
+    unsigned sum = 0, rng = 12345;
+    t = now_ms();
+    for (int i = 0; i < 1000000; i++) {
+        rng = rng * 1103515245u + 12345u;
+        sum += (unsigned char)index_relpath(&loaded, (rng >> 8) % loaded.num_files)[0];
+    }
+    double lookup_ns = (now_ms() - t) * 1e6 / 1000000;
+    CHECK(sum > 0);
+
+    // Nothing changed: only mtimes are checked
+    t = now_ms();
+    CHECK(index_refresh(&loaded) == 0);
+    double warm_ms = now_ms() - t;
+    CHECK(loaded.dirs_read == 0 && same_index(&idx, &loaded));
+
+    // An image added in one folder, one removed from another, a new
+    // subfolder with two images: those four folders are read, no others
+    char path[512];
+    snprintf(path, sizeof(path), "%s03/07/new.jpg", ROOT);
+    touch(path);
+    snprintf(path, sizeof(path), "%s11/02/IMG_0001.jpg", ROOT);
+    CHECK(remove(path) == 0);
+    snprintf(path, sizeof(path), "%s15/trip", ROOT);
+    mkdir(path, 0777);
+    snprintf(path, sizeof(path), "%s15/trip/a.jpg", ROOT);
+    touch(path);
+    snprintf(path, sizeof(path), "%s15/trip/b.webp", ROOT);
+    touch(path);
+
+    CHECK(index_refresh(&loaded) == 1);
+    CHECK(loaded.dirs_read == 4);
+    CHECK(loaded.num_files == (uint32_t)files + 2);
+    CHECK(loaded.num_dirs == num_dirs + 1);
+    check_index(&loaded);
+    bool found_new = false, found_removed = false;
+    for (uint32_t i = 0; i < loaded.num_files; i++) {
+        found_new |= strcmp(index_relpath(&loaded, i), "15/trip/b.webp") == 0;
+        found_removed |= strcmp(index_relpath(&loaded, i), "11/02/IMG_0001.jpg") == 0;
+    }
+    CHECK(found_new && !found_removed);
+
+    // And again nothing
+    CHECK(index_refresh(&loaded) == 0 && loaded.dirs_read == 0);
+
+    // Two folders of long names: in the inner one an image that fits, one
+    // whose name takes it past the limit, and a folder that does too
+    char deep[768], name[256];
+    memset(name, 'x', 200);
+    name[200] = 0;
+    snprintf(deep, sizeof(deep), "%s%s", ROOT, name);
+    mkdir(deep, 0777);
+    memset(name, 'y', 200);
+    snprintf(deep + strlen(deep), sizeof(deep) - strlen(deep), "/%s", name);
+    mkdir(deep, 0777);
+    size_t deep_len = strlen(deep);
+    snprintf(deep + deep_len, sizeof(deep) - deep_len, "/fits.jpg");
+    touch(deep);
+    memset(name, 'z', 200);
+    snprintf(deep + deep_len, sizeof(deep) - deep_len, "/%.100s.jpg", name);
+    touch(deep);
+    snprintf(deep + deep_len, sizeof(deep) - deep_len, "/%.150s", name);
+    mkdir(deep, 0777);
+    strcat(deep, "/a.jpg");
+    touch(deep);
+
+    CHECK(index_refresh(&loaded) == 1);
+    CHECK(loaded.num_files == (uint32_t)files + 3);
+    CHECK(loaded.num_dirs == num_dirs + 3);
+    check_index(&loaded);
+    int fits = 0, too_long = 0;
+    for (uint32_t i = 0; i < loaded.num_files; i++) {
+        const char *rel = index_relpath(&loaded, i);
+        fits += strstr(rel, "/fits.jpg") != NULL;
+        too_long += strlen(ROOT) + strlen(rel) >= INDEX_PATH_MAX;
+        too_long += !index_full_path(&loaded, i, path, sizeof(path));
+    }
+    CHECK(fits == 1 && too_long == 0);
+    CHECK(index_refresh(&loaded) == 0);
+
+    // A buffer too small for the path says so and holds nothing
+    char small[16] = "untouched";
+    CHECK(!index_full_path(&loaded, 0, small, sizeof(small)) && small[0] == 0);
+
+    // A saved index that doesn't check out is refused, leaving an empty one
+    FILE *f = fopen(saved, "r+b");
+    if (f) {
+        fseek(f, 8, SEEK_SET);
+        fputc(0xff, f);
+        fclose(f);
+    }
+    ImageIndex broken;
+    CHECK(index_load(&broken, ROOT, saved) == -1 && broken.num_files == 0);
+    index_free(&broken);
+
+    printf("index_test: %d files in %u folders: scan %.0f ms, load %.1f ms, "
+           "refresh %.1f ms, lookup %.0f ns\n",
+           files, num_dirs, scan_ms, load_ms, warm_ms, lookup_ns);
+    index_free(&idx);
+    index_free(&loaded);
+    nftw(tmp, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+
+    if (FAILED) {
+        fprintf(stderr, "index_test: %d check(s) failed\n", FAILED);
+        return 1;
+    }
+    printf("index_test: ok\n");
+    return 0;
+}
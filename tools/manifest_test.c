@@ -0,0 +1,735 @@
+// manifest_test.c
+// Checks for manifest syncing against a stand-in server on localhost: a
+// first sync, a second one that gets a 304 and downloads nothing, a delta
+// that fetches only the new images and deletes the dropped one, downloads
+// cut off mid-file and continued with a Range request (also from a sync
+// stopped by the app quitting), a server that ignores the Range, a
+// corrupt download that is thrown away, and a synced image cut short on
+// the card, which only a freshly fetched list gets deleted.
+//
+// The server lists the images in a folder, so with --serve it doubles as
+// a manifest server for trying the app against: drop images into the
+// folder and the next sync picks them up.
+//
+// From the repo root:
+//   make -f Makefile.host manifest-test
+//   build-host/manifest_test [--seed S]
+//   build-host/manifest_test --serve DIR [PORT]
+//       then `Name = manifest://http://<this PC>:PORT/album.txt`
+
+#include <dirent.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <SDL2/SDL.h>
+#include <curl/curl.h>
+
+#include "manifest.h"
+#include "util.h"
+
+static int FAILED;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        FAILED++; \
+    } \
+} while (0)
+
+// ---- the server -------------------------------------------------------------
+
+#define LIST_PATH  "/album.txt"
+#define IMAGE_PATH "/images/"
+
+typedef struct {
+    char     name[128];
+    uint64_t size;
+    int64_t  mtime;
+    uint64_t hash;
+} ServedFile;
+
+typedef struct {
+    char          root[512];    // folder served, with a trailing '/'
+    int           port;
+    int           listen_fd;
+    SDL_Thread   *thread;
+    SDL_atomic_t  quit;
+
+    // Guarded by lock: what the test tweaks and reads back
+    SDL_mutex    *lock;
+    ServedFile   *files;        // as last listed
+    int           num_files;
+    int           list_requests;
+    int           not_modified;     // list requests answered 304
+    int           image_requests;
+    int64_t       last_range;       // start of the last Range asked for, -1 if none
+    uint64_t      cut_after;        // next image: drop the connection after this many bytes
+    uint64_t      stall_after;      // next image: stop sending, until the client hangs up
+    bool          corrupt;          // flip a byte of each image sent
+    bool          ignore_range;     // answer Range requests with the whole file
+} Server;
+
+static uint64_t hash_file(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0;
+    unsigned char buf[16384];
+    uint64_t h = 14695981039346656037ull;
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            h ^= buf[i];
+            h *= 1099511628211ull;
+        }
+    }
+    fclose(f);
+    return h;
+}
+
+static int cmp_served(const void *a, const void *b) {
+    return strcmp(((const ServedFile *)a)->name, ((const ServedFile *)b)->name);
+}
+
+// Look at the folder again; files that didn't change keep their hash
+static void rescan(Server *sv) {
+    ServedFile *files = NULL;
+    int count = 0, cap = 0;
+    DIR *d = opendir(sv->root);
+    struct dirent *entry;
+    while (d && (entry = readdir(d)) != NULL) {
+        char path[768];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s%s", sv->root, entry->d_name);
+        if (entry->d_name[0] == '.' || strlen(entry->d_name) >= sizeof(files->name) ||
+            stat(path, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+            continue;
+        if (count == cap) {
+            cap = cap ? cap * 2 : 64;
+            ServedFile *grown = realloc(files, cap * sizeof(ServedFile));
+            if (!grown) break;
+            files = grown;
+        }
+        ServedFile *f = &files[count++];
+        snprintf(f->name, sizeof(f->name), "%s", entry->d_name);
+        f->size = (uint64_t)st.st_size;
+        f->mtime = (int64_t)st.st_mtime;
+        f->hash = 0;
+        for (int i = 0; i < sv->num_files; i++) {
+            const ServedFile *old = &sv->files[i];
+            if (strcmp(old->name, f->name) == 0 && old->size == f->size && old->mtime == f->mtime)
+                f->hash = old->hash;
+        }
+        if (!f->hash) f->hash = hash_file(path);
+    }
+    if (d) closedir(d);
+    if (files) qsort(files, count, sizeof(ServedFile), cmp_served);
+    free(sv->files);
+    sv->files = files;
+    sv->num_files = count;
+}
+
+// The manifest. URLs take turns being relative, host-relative and
+// absolute, so all three get resolved.
+static char *list_text(Server *sv, size_t *len) {
+    size_t cap = 64 + (size_t)sv->num_files * 300;
+    char *text = malloc(cap);
+    if (!text) return NULL;
+    size_t n = snprintf(text, cap, "# %d images\n", sv->num_files);
+    for (int i = 0; i < sv->num_files; i++) {
+        const ServedFile *f = &sv->files[i];
+        const char *prefix = i % 3 == 0 ? "images/" : i % 3 == 1 ? IMAGE_PATH : "";
+        n += snprintf(text + n, cap - n, "%llu %016llx %s", (unsigned long long)f->size,
+                      (unsigned long long)f->hash, prefix);
+        if (i % 3 == 2)
+            n += snprintf(text + n, cap - n, "http://127.0.0.1:%d" IMAGE_PATH, sv->port);
+        n += snprintf(text + n, cap - n, "%s\n", f->name);
+    }
+    *len = n;
+    return text;
+}
+
+static bool send_all(int fd, const void *data, size_t len) {
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+// Value of a request header, or NULL
+static const char *header(const char *request, const char *name) {
+    size_t n = strlen(name);
+    for (const char *line = strstr(request, "\r\n"); line; line = strstr(line + 2, "\r\n")) {
+        if (strncasecmp(line + 2, name, n) == 0) {
+            const char *v = line + 2 + n;
+            while (*v == ' ') v++;
+            return v;
+        }
+    }
+    return NULL;
+}
+
+static void respond(int fd, int code, const char *extra, uint64_t length) {
+    char head[512];
+    const char *reason = code == 200 ? "OK" : code == 206 ? "Partial Content" :
+                         code == 304 ? "Not Modified" : code == 416 ? "Range Not Satisfiable" :
+                         "Not Found";
+    int n = snprintf(head, sizeof(head),
+                     "HTTP/1.1 %d %s\r\nContent-Length: %llu\r\nConnection: close\r\n%s\r\n",
+                     code, reason, (unsigned long long)length, extra);
+    send_all(fd, head, (size_t)n);
+}
+
+static void serve_list(Server *sv, int fd, const char *request) {
+    SDL_LockMutex(sv->lock);
+    sv->list_requests++;
+    rescan(sv);
+    size_t len = 0;
+    char *text = list_text(sv, &len);
+    SDL_UnlockMutex(sv->lock);
+    if (!text) {
+        respond(fd, 404, "", 0);
+        return;
+    }
+
+    char etag[32], extra[64];
+    snprintf(etag, sizeof(etag), "\"%016llx\"", (unsigned long long)fnv1a64(text, len));
+    const char *match = header(request, "If-None-Match:");
+    if (match && strncmp(match, etag, strlen(etag)) == 0) {
+        SDL_LockMutex(sv->lock);
+        sv->not_modified++;
+        SDL_UnlockMutex(sv->lock);
+        respond(fd, 304, "", 0);
+    } else {
+        snprintf(extra, sizeof(extra), "ETag: %s\r\n", etag);
+        respond(fd, 200, extra, len);
+        send_all(fd, text, len);
+    }
+    free(text);
+}
+
+static void serve_image(Server *sv, int fd, const char *request, const char *name) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s%s", sv->root, name);
+    FILE *f = strchr(name, '/') ? NULL : fopen(path, "rb");
+    struct stat st;
+    if (!f || fstat(fileno(f), &st) != 0) {
+        if (f) fclose(f);
+        respond(fd, 404, "", 0);
+        return;
+    }
+    uint64_t size = (uint64_t)st.st_size;
+
+    const char *range = header(request, "Range:");
+    int64_t from = -1;
+    if (range && strncmp(range, "bytes=", 6) == 0) from = strtoll(range + 6, NULL, 10);
+
+    SDL_LockMutex(sv->lock);
+    sv->image_requests++;
+    sv->last_range = from;
+    if (sv->ignore_range) from = -1;
+    uint64_t cut = sv->cut_after, stall = sv->stall_after;
+    bool corrupt = sv->corrupt;
+    sv->cut_after = 0;
+    sv->stall_after = 0;
+    SDL_UnlockMutex(sv->lock);
+
+    if (from >= 0 && (uint64_t)from >= size) {
+        fclose(f);
+        respond(fd, 416, "", 0);
+        return;
+    }
+    char extra[128] = "";
+    uint64_t start = from > 0 ? (uint64_t)from : 0;
+    if (from >= 0)
+        snprintf(extra, sizeof(extra), "Content-Range: bytes %llu-%llu/%llu\r\n",
+                 (unsigned long long)start, (unsigned long long)size - 1,
+                 (unsigned long long)size);
+    respond(fd, from >= 0 ? 206 : 200, extra, size - start);
+
+    fseek(f, (long)start, SEEK_SET);
+    uint64_t sent = 0, limit = cut ? cut : stall ? stall : size - start;
+    char buf[16384];
+    size_t n;
+    while (sent < limit && (n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        if (n > limit - sent) n = (size_t)(limit - sent);
+        if (corrupt && sent == 0) buf[n / 2] ^= 0x55;
+        if (!send_all(fd, buf, n)) break;
+        sent += n;
+    }
+    fclose(f);
+
+    // A stalled transfer waits for the client to give up
+    for (int i = 0; stall && i < 200 && !SDL_AtomicGet(&sv->quit); i++) {
+        struct pollfd p = { fd, POLLIN, 0 };
+        if (poll(&p, 1, 50) > 0 && recv(fd, buf, sizeof(buf), 0) <= 0) break;
+    }
+}
+
+static void serve(Server *sv, int fd) {
+    char request[4096];
+    size_t len = 0;
+    while (len < sizeof(request) - 1) {
+        ssize_t n = recv(fd, request + len, sizeof(request) - 1 - len, 0);
+        if (n <= 0) return;
+        len += (size_t)n;
+        request[len] = 0;
+        if (strstr(request, "\r\n\r\n")) break;
+    }
+
+    char method[8], path[512];
+    if (sscanf(request, "%7s %511s", method, path) != 2 || strcmp(method, "GET") != 0)
+        respond(fd, 404, "", 0);
+    else if (strcmp(path, LIST_PATH) == 0)
+        serve_list(sv, fd, request);
+    else if (strncmp(path, IMAGE_PATH, strlen(IMAGE_PATH)) == 0)
+        serve_image(sv, fd, request, path + strlen(IMAGE_PATH));
+    else
+        respond(fd, 404, "", 0);
+}
+
+static int server_thread(void *arg) {
+    Server *sv = arg;
+    while (!SDL_AtomicGet(&sv->quit)) {
+        struct pollfd p = { sv->listen_fd, POLLIN, 0 };
+        if (poll(&p, 1, 100) <= 0) continue;
+        int fd = accept(sv->listen_fd, NULL, NULL);
+        if (fd < 0) continue;
+        serve(sv, fd);
+        close(fd);
+    }
+    return 0;
+}
+
+// Serve root on port (0 for any free one) of localhost, or every
+// interface if public
+static bool server_start(Server *sv, const char *root, int port, bool public) {
+    memset(sv, 0, sizeof(*sv));
+    size_t len = strlen(root);
+    snprintf(sv->root, sizeof(sv->root), "%s%s", root, len && root[len - 1] == '/' ? "" : "/");
+    sv->last_range = -1;
+    sv->lock = SDL_CreateMutex();
+
+    sv->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int yes = 1;
+    setsockopt(sv->listen_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(public ? INADDR_ANY : INADDR_LOOPBACK);
+    addr.sin_port = htons((uint16_t)port);
+    socklen_t addr_len = sizeof(addr);
+    if (sv->listen_fd < 0 || bind(sv->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(sv->listen_fd, 8) != 0 ||
+        getsockname(sv->listen_fd, (struct sockaddr *)&addr, &addr_len) != 0) {
+        perror("server");
+        if (sv->listen_fd >= 0) close(sv->listen_fd);
+        return false;
+    }
+    sv->port = ntohs(addr.sin_port);
+    sv->thread = SDL_CreateThread(server_thread, "server", sv);
+    return sv->thread != NULL;
+}
+
+static void server_stop(Server *sv) {
+    SDL_AtomicSet(&sv->quit, 1);
+    SDL_WaitThread(sv->thread, NULL);
+    close(sv->listen_fd);
+    SDL_DestroyMutex(sv->lock);
+    free(sv->files);
+}
+
+// ---- the checks -------------------------------------------------------------
+
+static char ALBUM[512], CLIENT[512], URL[128];
+static Server SERVER;
+
+static void write_image(const char *name, size_t size, unsigned seed) {
+    char path[768];
+    snprintf(path, sizeof(path), "%s%s", ALBUM, name);
+    FILE *f = fopen(path, "wb");
+    if (!f) return;
+    srand(seed);
+    for (size_t i = 0; i < size; i++) fputc(rand() & 0xff, f);
+    fclose(f);
+}
+
+static void remove_image(const char *name) {
+    char path[768];
+    snprintf(path, sizeof(path), "%s%s", ALBUM, name);
+    remove(path);
+}
+
+// Where a sync puts an album image
+static void synced_path(const char *name, char *out, size_t len) {
+    char path[768];
+    snprintf(path, sizeof(path), "%s%s", ALBUM, name);
+    const char *ext = strrchr(name, '.');
+    snprintf(out, len, "%s" MANIFEST_IMAGES "%016llx%s", CLIENT,
+             (unsigned long long)hash_file(path), ext ? ext : "");
+}
+
+static bool synced(const char *name) {
+    char path[768], album[768];
+    synced_path(name, path, sizeof(path));
+    snprintf(album, sizeof(album), "%s%s", ALBUM, name);
+    struct stat a, b;
+    return stat(path, &a) == 0 && stat(album, &b) == 0 && a.st_size == b.st_size &&
+           hash_file(path) == hash_file(album);
+}
+
+static int count_files(const char *dir, const char *suffix) {
+    int n = 0;
+    DIR *d = opendir(dir);
+    struct dirent *entry;
+    while (d && (entry = readdir(d)) != NULL) {
+        size_t len = strlen(entry->d_name), slen = strlen(suffix);
+        if (entry->d_name[0] != '.' && len >= slen && strcmp(entry->d_name + len - slen, suffix) == 0)
+            n++;
+    }
+    if (d) closedir(d);
+    return n;
+}
+
+static int synced_images(void) {
+    char images[600];
+    snprintf(images, sizeof(images), "%s" MANIFEST_IMAGES, CLIENT);
+    return count_files(images, "");
+}
+
+// Size of the one .part in the client folder, 0 if none
+static uint64_t part_size(void) {
+    DIR *d = opendir(CLIENT);
+    struct dirent *entry;
+    uint64_t size = 0;
+    while (d && (entry = readdir(d)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        struct stat st;
+        char path[1024];
+        snprintf(path, sizeof(path), "%s%s", CLIENT, entry->d_name);
+        if (len > 5 && strcmp(entry->d_name + len - 5, ".part") == 0 && stat(path, &st) == 0)
+            size = (uint64_t)st.st_size;
+    }
+    if (d) closedir(d);
+    return size;
+}
+
+static void counters(int *lists, int *not_modified, int *images) {
+    SDL_LockMutex(SERVER.lock);
+    *lists = SERVER.list_requests;
+    *not_modified = SERVER.not_modified;
+    *images = SERVER.image_requests;
+    SDL_UnlockMutex(SERVER.lock);
+}
+
+static void set_knobs(uint64_t cut, uint64_t stall, bool corrupt, bool ignore_range) {
+    SDL_LockMutex(SERVER.lock);
+    SERVER.cut_after = cut;
+    SERVER.stall_after = stall;
+    SERVER.corrupt = corrupt;
+    SERVER.ignore_range = ignore_range;
+    SDL_UnlockMutex(SERVER.lock);
+}
+
+static int64_t last_range(void) {
+    SDL_LockMutex(SERVER.lock);
+    int64_t from = SERVER.last_range;
+    SDL_UnlockMutex(SERVER.lock);
+    return from;
+}
+
+static void test_first_sync(unsigned seed) {
+    char name[32];
+    for (int i = 0; i < 5; i++) {
+        snprintf(name, sizeof(name), "photo%d.jpg", i);
+        write_image(name, 50000 + 20000 * i, seed + i);
+    }
+    // Listed twice, or not at all: kept once, or left out
+    write_image("copy.jpg", 50000, seed);
+    write_image("empty.png", 0, seed);
+
+    ManifestStatus st;
+    int lists, not_modified, images;
+    CHECK(manifest_sync_once(URL, CLIENT, &st, NULL) == 0);
+    counters(&lists, &not_modified, &images);
+    CHECK(st.listed == 5 && st.have == 5 && st.added == 5 && st.removed == 0 && st.failed == 0);
+    CHECK(!st.unchanged && st.error[0] == 0);
+    CHECK(lists == 1 && images == 5);
+    for (int i = 0; i < 5; i++) {
+        snprintf(name, sizeof(name), "photo%d.jpg", i);
+        CHECK(synced(name));
+    }
+    CHECK(synced_images() == 5);
+}
+
+static void test_unchanged(void) {
+    ManifestStatus st;
+    int lists, not_modified, images, lists0, not_modified0, images0;
+    counters(&lists0, &not_modified0, &images0);
+    CHECK(manifest_sync_once(URL, CLIENT, &st, NULL) == 0);
+    counters(&lists, &not_modified, &images);
+    CHECK(st.unchanged && st.listed == 5 && st.have == 5 && st.added == 0 && st.bytes == 0);
+    CHECK(lists == lists0 + 1 && not_modified == not_modified0 + 1 && images == images0);
+}
+
+static void test_delta(unsigned seed) {
+    write_image("new1.jpg", 70000, seed + 100);
+    write_image("new2.webp", 90000, seed + 101);
+    char gone[768];
+    synced_path("photo2.jpg", gone, sizeof(gone));
+    remove_image("photo2.jpg");
+
+    ManifestStatus st;
+    int lists, not_modified, images, lists0, not_modified0, images0;
+    counters(&lists0, &not_modified0, &images0);
+    CHECK(manifest_sync_once(URL, CLIENT, &st, NULL) == 0);
+    counters(&lists, &not_modified, &images);
+    CHECK(!st.unchanged && st.listed == 6 && st.have == 6 && st.added == 2 && st.removed == 1);
+    CHECK(st.bytes == 70000 + 90000);
+    CHECK(images == images0 + 2);
+    CHECK(synced("new1.jpg") && synced("new2.webp"));
+    struct stat s;
+    CHECK(stat(gone, &s) != 0);
+    CHECK(synced_images() == 6);
+}
+
+// The connection drops partway; the next sync continues from there
+static void test_resume(unsigned seed) {
+    const uint64_t size = 1000000, cut = 300000;
+    write_image("big.jpg", size, seed + 200);
+    set_knobs(cut, 0, false, false);
+
+    ManifestStatus st;
+    CHECK(manifest_sync_once(URL, CLIENT, &st, NULL) != 0);
+    CHECK(st.listed == 7 && st.have == 6 && st.failed == 1 && st.error[0] != 0);
+    CHECK(part_size() == cut);
+    CHECK(!synced("big.jpg"));
+
+    CHECK(manifest_sync_once(URL, CLIENT, &st, NULL) == 0);
+    CHECK(st.unchanged && st.added == 1 && st.have == 7);
+    CHECK(last_range() == (int64_t)cut);
+    CHECK(st.bytes == size - cut);
+    CHECK(synced("big.jpg"));
+    CHECK(part_size() == 0);
+}
+
+// A server that answers the Range with the whole file starts the part over
+static void test_ignored_range(unsigned seed) {
+    const uint64_t size = 400000;
+    write_image("whole.jpg", size, seed + 300);
+    set_knobs(150000, 0, false, false);
+    ManifestStatus st;
+    CHECK(manifest_sync_once(URL, CLIENT, &st, NULL) != 0);
+    CHECK(part_size() == 150000);
+
+    // Asked to resume, then for the whole file
+    int lists, not_modified, images, images0;
+    counters(&lists, &not_modified, &images0);
+    set_knobs(0, 0, false, true);
+    CHECK(manifest_sync_once(URL, CLIENT, &st, NULL) == 0);
+    counters(&lists, &not_modified, &images);
+    CHECK(images == images0 + 2 && last_range() == -1);
+    CHECK(st.added == 1 && st.bytes == size);
+    CHECK(synced("whole.jpg"));
+    set_knobs(0, 0, false, false);
+}
+
+// Bytes that don't hash to the listed value never make it into the album,
+// and a part that can't be right isn't kept
+static void test_corrupt(unsigned seed) {
+    write_image("bad.jpg", 60000, seed + 400);
+    set_knobs(0, 0, true, false);
+    ManifestStatus st;
+    CHECK(manifest_sync_once(URL, CLIENT, &st, NULL) != 0);
+    CHECK(st.failed == 1 && st.added == 0 && strstr(st.error, "match") != NULL);
+    CHECK(!synced("bad.jpg") && part_size() == 0);
+    CHECK(synced_images() == 8);
+
+    set_knobs(0, 0, false, false);
+    CHECK(manifest_sync_once(URL, CLIENT, &st, NULL) == 0);
+    CHECK(st.unchanged && st.added == 1 && synced("bad.jpg"));
+}
+
+// The part of an image dropped from the list goes with it
+static void test_dropped_part(unsigned seed) {
+    write_image("dropped.jpg", 300000, seed + 500);
+    set_knobs(100000, 0, false, false);
+    ManifestStatus st;
+    CHECK(manifest_sync_once(URL, CLIENT, &st, NULL) != 0);
+    CHECK(part_size() == 100000);
+
+    remove_image("dropped.jpg");
+    CHECK(manifest_sync_once(URL, CLIENT, &st, NULL) == 0);
+    CHECK(part_size() == 0 && st.removed == 0 && st.have == st.listed);
+}
+
+static bool wait_for(ManifestSync *ms, ManifestStatus *st, int syncs) {
+    for (int i = 0; i < 1000; i++) {
+        manifest_sync_status(ms, 0, st);
+        if (st->syncs >= syncs && !st->syncing) return true;
+        SDL_Delay(10);
+    }
+    return false;
+}
+
+// The background thread, from scratch: every image lands as a change
+static void test_background(const char *dir) {
+    const char *urls[] = { URL }, *dirs[] = { dir };
+    ManifestSync *ms = manifest_sync_start(urls, dirs, 1);
+    CHECK(ms != NULL);
+    if (!ms) return;
+    ManifestStatus st;
+    CHECK(wait_for(ms, &st, 1));
+    CHECK(st.listed == 9 && st.have == 9 && st.added == 9 && st.changes == 9);
+    CHECK(st.error[0] == 0);
+
+    manifest_sync_seen(ms, 0, 5);
+    manifest_sync_status(ms, 0, &st);
+    CHECK(st.changes == 4);
+
+    // A sync asked for now comes back 304 with nothing new
+    manifest_sync_now(ms);
+    CHECK(wait_for(ms, &st, 2));
+    CHECK(st.unchanged && st.added == 0 && st.changes == 4);
+    manifest_sync_stop(ms);
+}
+
+// The app quits halfway through a download: stopping doesn't wait for
+// it, and the next sync continues where it stopped
+static void test_interrupted(unsigned seed) {
+    const uint64_t size = 2000000, stall = 500000;
+    write_image("huge.jpg", size, seed + 600);
+    set_knobs(0, stall, false, false);
+
+    const char *urls[] = { URL }, *dirs[] = { CLIENT };
+    ManifestSync *ms = manifest_sync_start(urls, dirs, 1);
+    CHECK(ms != NULL);
+    if (!ms) return;
+    for (int i = 0; i < 1000 && part_size() < stall; i++) SDL_Delay(10);
+    CHECK(part_size() == stall);
+    Uint32 start = SDL_GetTicks();
+    manifest_sync_stop(ms);
+    Uint32 took = SDL_GetTicks() - start;
+    CHECK(took < 3000);
+    CHECK(part_size() == stall);
+
+    ManifestStatus st;
+    CHECK(manifest_sync_once(URL, CLIENT, &st, NULL) == 0);
+    CHECK(last_range() == (int64_t)stall && st.bytes == size - stall);
+    CHECK(synced("huge.jpg"));
+    printf("manifest_test: stopped mid-download in %u ms\n", (unsigned)took);
+}
+
+// An image of the wrong size on the card is deleted when a fresh list
+// says so, but against the saved one (after a 304) it stays up until its
+// download replaces it
+static void test_short_image(unsigned seed) {
+    char path[768];
+    struct stat s;
+    ManifestStatus st;
+
+    // The saved list: kept while its download fails
+    synced_path("photo0.jpg", path, sizeof(path));
+    CHECK(truncate(path, 1000) == 0);
+    set_knobs(500, 0, false, false);
+    CHECK(manifest_sync_once(URL, CLIENT, &st, NULL) != 0);
+    CHECK(st.unchanged && st.removed == 0 && st.failed == 1);
+    CHECK(stat(path, &s) == 0 && s.st_size == 1000);
+
+    set_knobs(0, 0, false, false);
+    CHECK(manifest_sync_once(URL, CLIENT, &st, NULL) == 0);
+    CHECK(st.unchanged && st.added == 1 && synced("photo0.jpg"));
+
+    // A fresh list: deleted, then fetched again
+    write_image("newer.jpg", 40000, seed + 700);
+    synced_path("photo1.jpg", path, sizeof(path));
+    CHECK(truncate(path, 1000) == 0);
+    CHECK(manifest_sync_once(URL, CLIENT, &st, NULL) == 0);
+    CHECK(!st.unchanged && st.removed == 1 && st.added == 2);
+    CHECK(synced("photo1.jpg") && synced("newer.jpg"));
+}
+
+static void remove_tree(const char *dir) {
+    DIR *d = opendir(dir);
+    struct dirent *entry;
+    while (d && (entry = readdir(d)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        char path[1024];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        if (lstat(path, &st) == 0 && S_ISDIR(st.st_mode)) remove_tree(path);
+        else remove(path);
+    }
+    if (d) closedir(d);
+    rmdir(dir);
+}
+
+static int serve_forever(const char *root, int port) {
+    Server sv;
+    if (!server_start(&sv, root, port, true)) return 1;
+    printf("Serving %s as http://<this PC>:%d" LIST_PATH " (Ctrl-C to quit)\n", sv.root, sv.port);
+    for (;;) {
+        SDL_Delay(60000);
+        SDL_LockMutex(sv.lock);
+        printf("%d list requests (%d not modified), %d image requests\n",
+               sv.list_requests, sv.not_modified, sv.image_requests);
+        SDL_UnlockMutex(sv.lock);
+    }
+}
+
+int main(int argc, char **argv) {
+    unsigned seed = 1;
+    curl_global_init(CURL_GLOBAL_ALL);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) seed = strtoul(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc)
+            return serve_forever(argv[i + 1], i + 2 < argc ? atoi(argv[i + 2]) : 8080);
+        else {
+            fprintf(stderr, "usage: %s [--seed S]\n       %s --serve DIR [PORT]\n",
+                    argv[0], argv[0]);
+            return 2;
+        }
+    }
+
+    char tmp[] = "/tmp/manifest_test.XXXXXX", scratch[600];
+    if (!mkdtemp(tmp)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(ALBUM, sizeof(ALBUM), "%s/album/", tmp);
+    snprintf(CLIENT, sizeof(CLIENT), "%s/client/", tmp);
+    snprintf(scratch, sizeof(scratch), "%s/scratch/", tmp);
+    mkdir(ALBUM, 0777);
+    if (!server_start(&SERVER, ALBUM, 0, false)) return 1;
+    snprintf(URL, sizeof(URL), "http://127.0.0.1:%d" LIST_PATH, SERVER.port);
+
+    test_first_sync(seed);
+    test_unchanged();
+    test_delta(seed);
+    test_resume(seed);
+    test_ignored_range(seed);
+    test_corrupt(seed);
+    test_dropped_part(seed);
+    test_background(scratch);
+    test_interrupted(seed);
+    test_short_image(seed);
+
+    server_stop(&SERVER);
+    remove_tree(tmp);
+    curl_global_cleanup();
+
+    if (FAILED) {
+        fprintf(stderr, "manifest_test: %d check(s) failed\n", FAILED);
+        return 1;
+    }
+    printf("manifest_test: ok\n");
+    return 0;
+}
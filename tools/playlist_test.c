@@ -0,0 +1,400 @@
+// playlist_test.c
+// Checks for the playlist's randomness and shuffle guarantees:
+//
+// - rng_below() is uniform by chi-square over small and awkward ranges,
+//   and unbiased where a plain modulo would favour the low values
+// - a fresh shuffle gives every permutation equally often
+// - each round shows every image exactly once, and no image is shown
+//   twice in a row, including across the round boundary
+// - the weighted mode's alias table reproduces the weights exactly, and
+//   picks follow them without repeating back to back
+// - picks given back with playlist_unpick() come up again in order, even
+//   across the end of a round, and rounds still cover everything once
+// - a playlist saved part way through a round, by playlist_save() and then
+//   playlist_save_position() after every pick and give-back as the app
+//   does, loads to go on exactly as one that was never saved, spacing
+//   near-duplicates included
+//
+// From the repo root:
+//   make -f Makefile.host playlist-test
+//   build-host/playlist_test [--seed S]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "playlist.h"
+#include "util.h"
+
+static int FAILED;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        FAILED++; \
+    } \
+} while (0)
+
+// Chi-square of observed counts against expected ones
+static double chi_square(const uint32_t *seen, const double *expected, uint32_t n) {
+    double chi = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        double d = seen[i] - expected[i];
+        chi += d * d / expected[i];
+    }
+    return chi;
+}
+
+// Well past the 0.1% critical value for df degrees of freedom, so a fixed
+// seed that passes keeps passing, yet a real bias of a percent or so fails
+static double chi_limit(uint32_t df) {
+    return df + 5.0 * sqrt(2.0 * df);
+}
+
+static void test_uniform(uint64_t seed) {
+    static const uint32_t ranges[] = { 2, 7, 10, 1000 };
+    for (size_t r = 0; r < sizeof(ranges) / sizeof(ranges[0]); r++) {
+        uint32_t n = ranges[r];
+        uint32_t *seen = calloc(n, sizeof(uint32_t));
+        double *expected = malloc(n * sizeof(double));
+        if (!seen || !expected) {
+            free(seen);
+            free(expected);
+            CHECK(!"out of memory");
+            return;
+        }
+        const uint32_t draws = 2000000;
+        uint64_t rng = rng_seed(seed + r);
+        int out_of_range = 0;
+        for (uint32_t i = 0; i < draws; i++) {
+            uint32_t v = rng_below(&rng, n);
+            if (v >= n) out_of_range++;
+            else seen[v]++;
+        }
+        for (uint32_t i = 0; i < n; i++) expected[i] = (double)draws / n;
+        double chi = chi_square(seen, expected, n);
+        printf("  rng_below(%u): chi-square %.1f (limit %.1f)\n", n, chi, chi_limit(n - 1));
+        CHECK(out_of_range == 0);
+        CHECK(chi < chi_limit(n - 1));
+        free(seen);
+        free(expected);
+    }
+
+    // n = 3 * 2^30: next32 % n would land in the lowest third twice as
+    // often as in either of the others
+    uint64_t rng = rng_seed(seed);
+    const uint32_t n = 3u << 30, draws = 1000000;
+    uint32_t low = 0;
+    for (uint32_t i = 0; i < draws; i++) low += rng_below(&rng, n) < n / 3;
+    printf("  rng_below(3<<30): %.4f in the lowest third\n", (double)low / draws);
+    CHECK(fabs((double)low / draws - 1.0 / 3) < 0.005);
+}
+
+// Every ordering of four images as the first round, equally often
+static void test_permutations(uint64_t seed) {
+    enum { N = 4, PERMS = 24, TRIALS = 240000 };
+    uint32_t seen[PERMS] = {0};
+    double expected[PERMS];
+    Playlist pl;
+    for (int t = 0; t < TRIALS; t++) {
+        playlist_init(&pl, PLAYLIST_SHUFFLE, seed + t);
+        playlist_reset(&pl, N, 0, NULL, NULL);
+        // Lehmer code of the round's order
+        uint32_t rank = 0, used = 0;
+        for (int i = 0; i < N; i++) {
+            uint32_t item = playlist_next(&pl), smaller = 0;
+            for (uint32_t k = 0; k < item; k++) smaller += !(used >> k & 1);
+            used |= 1u << item;
+            rank = rank * (N - i) + smaller;
+        }
+        seen[rank]++;
+        playlist_free(&pl);
+    }
+    for (int i = 0; i < PERMS; i++) expected[i] = (double)TRIALS / PERMS;
+    double chi = chi_square(seen, expected, PERMS);
+    printf("  permutations of %d: chi-square %.1f (limit %.1f)\n", N, chi, chi_limit(PERMS - 1));
+    CHECK(chi < chi_limit(PERMS - 1));
+}
+
+// Rounds cover everything once, and never show the same image twice in
+// a row, even from one round into the next
+static void test_rounds(uint64_t seed) {
+    static const uint32_t counts[] = { 1, 2, 3, 10, 1000 };
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        uint32_t count = counts[c];
+        uint32_t *shown = calloc(count, sizeof(uint32_t));
+        if (!shown) {
+            CHECK(!"out of memory");
+            return;
+        }
+        Playlist pl;
+        playlist_init(&pl, PLAYLIST_SHUFFLE, seed);
+        CHECK(playlist_reset(&pl, count, 0, NULL, NULL) == 0);
+        const int rounds = count > 100 ? 50 : 2000;
+        int incomplete = 0, repeats = 0;
+        uint32_t prev = PLAYLIST_NONE;
+        for (int r = 0; r < rounds; r++) {
+            memset(shown, 0, count * sizeof(uint32_t));
+            for (uint32_t i = 0; i < count; i++) {
+                uint32_t item = playlist_next(&pl);
+                if (item < count) shown[item]++;
+                if (item == prev && count > 1) repeats++;
+                prev = item;
+            }
+            for (uint32_t i = 0; i < count; i++) incomplete += shown[i] != 1;
+        }
+        CHECK(incomplete == 0);
+        CHECK(repeats == 0);
+        playlist_free(&pl);
+        free(shown);
+    }
+}
+
+static void test_weighted(uint64_t seed) {
+    enum { N = 100 };
+    float weights[N];
+    double sum = 0;
+    for (int i = 0; i < N; i++) {
+        // A spread of weights, a few zero
+        weights[i] = i % 17 == 5 ? 0.0f : (float)(1 + i % 10) * (i < 50 ? 1.0f : 3.5f);
+        sum += weights[i];
+    }
+    Playlist pl;
+    playlist_init(&pl, PLAYLIST_WEIGHTED, seed);
+    CHECK(playlist_reset(&pl, N, 0, NULL, weights) == 0);
+    if (!pl.prob) return;
+
+    // The table itself: item i comes from its own column with prob[i] and
+    // from every column aliased to it with the rest
+    double worst = 0;
+    double table[N] = {0};
+    for (int i = 0; i < N; i++) {
+        table[i] += pl.prob[i];
+        if (pl.alias[i] != (uint32_t)i) table[pl.alias[i]] += 1.0 - pl.prob[i];
+    }
+    for (int i = 0; i < N; i++) {
+        double err = fabs(table[i] / N - weights[i] / sum);
+        if (err > worst) worst = err;
+    }
+    printf("  alias table: worst error %.2g\n", worst);
+    CHECK(worst < 1e-6);
+
+    // Picks follow the weights, as bent by the retries that keep an item
+    // from following itself: from item j, item i comes next with
+    // p_i (1 + p_j + ... + p_j^7), and j again with p_j^8. The long-run
+    // shares are the stationary distribution of that chain.
+    double p[N], share[N], next[N];
+    for (int i = 0; i < N; i++) share[i] = p[i] = weights[i] / sum;
+    for (int iter = 0; iter < 200; iter++) {
+        memset(next, 0, sizeof(next));
+        for (int j = 0; j < N; j++) {
+            double again = pow(p[j], 8), other = p[j] < 1 ? (1 - again) / (1 - p[j]) : 0;
+            for (int i = 0; i < N; i++) next[i] += share[j] * (i == j ? again : p[i] * other);
+        }
+        memcpy(share, next, sizeof(share));
+    }
+
+    const uint32_t draws = 2000000;
+    uint32_t seen[N] = {0}, nonzero_seen[N];
+    double expected[N];
+    uint32_t prev = PLAYLIST_NONE, nonzero = 0;
+    int repeats = 0, zero_picked = 0;
+    for (uint32_t d = 0; d < draws; d++) {
+        uint32_t item = playlist_next(&pl);
+        if (item >= N) continue;
+        seen[item]++;
+        repeats += item == prev;
+        prev = item;
+    }
+    for (int i = 0; i < N; i++) {
+        if (weights[i] == 0) {
+            zero_picked += seen[i] != 0;
+            continue;
+        }
+        nonzero_seen[nonzero] = seen[i];
+        expected[nonzero++] = draws * share[i];
+    }
+    double chi = chi_square(nonzero_seen, expected, nonzero);
+    printf("  weighted picks: chi-square %.1f (limit %.1f)\n", chi, chi_limit(nonzero - 1));
+    CHECK(chi < chi_limit(nonzero - 1));
+    CHECK(repeats == 0);
+    CHECK(zero_picked == 0);
+    playlist_free(&pl);
+}
+
+// Picks given back, newest first, come again in the order they were made,
+// and the rounds they straddle still hold every image once
+static void test_unpick(uint64_t seed) {
+    enum { N = 12, PICKS = 10 * N };
+    static const PlaylistMode modes[] = { PLAYLIST_SHUFFLE, PLAYLIST_SEQUENTIAL };
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        Playlist pl;
+        playlist_init(&pl, modes[m], seed);
+        CHECK(playlist_reset(&pl, N, 0, NULL, NULL) == 0);
+        uint32_t shown[PICKS];
+        int num_shown = 0, out_of_order = 0;
+        uint64_t rng = rng_seed(seed);
+        while (num_shown < PICKS) {
+            // Up to four picked ahead, then some shown and the rest given back
+            uint32_t ahead[4];
+            int n = 1 + rng_below(&rng, 4), keep = rng_below(&rng, n + 1);
+            for (int i = 0; i < n; i++) ahead[i] = playlist_next(&pl);
+            for (int i = 0; i < keep && num_shown < PICKS; i++) shown[num_shown++] = ahead[i];
+            for (int i = n - 1; i >= keep; i--) playlist_unpick(&pl, ahead[i]);
+            // Picked again, they're the same; given back once more, the
+            // next round of picks starts with them
+            for (int i = keep; i < n; i++) out_of_order += playlist_next(&pl) != ahead[i];
+            for (int i = n - 1; i >= keep; i--) playlist_unpick(&pl, ahead[i]);
+        }
+        int incomplete = 0;
+        for (int r = 0; r < PICKS / N; r++) {
+            int times[N] = {0};
+            for (int i = r * N; i < (r + 1) * N; i++) times[shown[i]]++;
+            for (int i = 0; i < N; i++) incomplete += times[i] != 1;
+        }
+        CHECK(out_of_order == 0);
+        CHECK(incomplete == 0);
+        playlist_free(&pl);
+    }
+}
+
+// Near-duplicates in runs of three, so spacing has work to do
+static uint32_t group_of_three(void *user, uint32_t item) {
+    (void)user;
+    return item / 3;
+}
+
+// Pick from pl and ref alike, giving some back; pl is saved as it goes
+static void pick_alike(Playlist *pl, Playlist *ref, const char *path, uint64_t *rng, int picks) {
+    while (picks > 0) {
+        uint32_t ahead[4];
+        int n = 1 + rng_below(rng, 4), keep = rng_below(rng, n + 1);
+        for (int i = 0; i < n; i++) {
+            ahead[i] = playlist_next(pl);
+            playlist_next(ref);
+            playlist_save_position(pl, path);
+        }
+        for (int i = n - 1; i >= keep; i--) {
+            playlist_unpick(pl, ahead[i]);
+            playlist_unpick(ref, ahead[i]);
+            playlist_save_position(pl, path);
+        }
+        picks -= keep;
+    }
+}
+
+static const char *similar_name(PlaylistSimilar similar) {
+    return similar == PLAYLIST_SIMILAR_OFF ? "off" :
+           similar == PLAYLIST_SIMILAR_SPACE ? "space" : "skip";
+}
+
+// Save part way, load into a fresh playlist and compare the rest of this
+// round and all of the next with one that was never saved. With across,
+// the picks end on the first of a new round and the last of the old one
+// being given back, so the old round's end is owed. Returns the first
+// pick that differs, -1 if none, or -2 if the load failed.
+static int persist_case(uint64_t seed, PlaylistSimilar similar, int stop, int across,
+                        const char *path) {
+    enum { N = 40 };
+    Playlist pl, ref, back;
+    playlist_init(&pl, PLAYLIST_SHUFFLE, seed + stop);
+    playlist_init(&ref, PLAYLIST_SHUFFLE, seed + stop);
+    playlist_reset(&pl, N, 7, NULL, NULL);
+    playlist_reset(&ref, N, 7, NULL, NULL);
+    playlist_set_groups(&pl, similar, group_of_three, NULL);
+    playlist_set_groups(&ref, similar, group_of_three, NULL);
+    playlist_save(&pl, path);
+
+    uint64_t rng = rng_seed(seed + stop);
+    pick_alike(&pl, &ref, path, &rng, stop);
+    if (across) {
+        while (ref.pos < ref.count) {
+            playlist_next(&pl);
+            playlist_next(&ref);
+            playlist_save_position(&pl, path);
+        }
+        uint32_t end = pl.last, next = playlist_next(&pl);
+        playlist_next(&ref);
+        playlist_save_position(&pl, path);
+        playlist_unpick(&pl, next);
+        playlist_unpick(&ref, next);
+        playlist_unpick(&pl, end);
+        playlist_unpick(&ref, end);
+        playlist_save_position(&pl, path);
+        CHECK(pl.num_returned == 1);
+    }
+
+    int first = -2;
+    playlist_init(&back, PLAYLIST_SHUFFLE, seed + 1);
+    if (playlist_load(&back, path) == 0) {
+        playlist_set_groups(&back, similar, group_of_three, NULL);
+        first = -1;
+        for (int i = 0; i < 2 * N; i++)
+            if (playlist_next(&back) != playlist_next(&ref) && first < 0) first = i;
+    }
+    playlist_free(&pl);
+    playlist_free(&ref);
+    playlist_free(&back);
+    return first;
+}
+
+static void test_persist(uint64_t seed) {
+    static const PlaylistSimilar similar[] = { PLAYLIST_SIMILAR_OFF, PLAYLIST_SIMILAR_SPACE,
+                                               PLAYLIST_SIMILAR_SKIP };
+    char dir[] = "/tmp/playlist_test.XXXXXX", path[64];
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        FAILED++;
+        return;
+    }
+    snprintf(path, sizeof(path), "%s/album.pls", dir);
+
+    int failed_loads = 0, diverged = 0;
+    for (size_t s = 0; s < sizeof(similar) / sizeof(similar[0]); s++) {
+        // Stopping anywhere in the first two rounds, the end of one included
+        for (int stop = 0; stop <= 80; stop += 3) {
+            for (int across = 0; across <= (stop < 40); across++) {
+                int first = persist_case(seed, similar[s], stop, across, path);
+                failed_loads += first == -2;
+                if (first >= 0) {
+                    fprintf(stderr, "  %s, stopped after %d%s: differs at pick %d\n",
+                            similar_name(similar[s]), stop, across ? " and a give-back" : "",
+                            first);
+                    diverged++;
+                }
+            }
+        }
+    }
+    CHECK(failed_loads == 0);
+    CHECK(diverged == 0);
+
+    remove(path);
+    rmdir(dir);
+}
+
+int main(int argc, char **argv) {
+    uint64_t seed = 12345;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) seed = strtoull(argv[++i], NULL, 10);
+        else {
+            fprintf(stderr, "usage: %s [--seed S]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    test_uniform(seed);
+    test_permutations(seed);
+    test_rounds(seed);
+    test_weighted(seed);
+    test_unpick(seed);
+    test_persist(seed);
+
+    if (FAILED) {
+        fprintf(stderr, "playlist_test: %d check(s) failed\n", FAILED);
+        return 1;
+    }
+    printf("playlist_test: ok\n");
+    return 0;
+}
@@ -0,0 +1,326 @@
+// prefetch_test.c
+// Checks for the slide prefetcher against a fake loader that takes a
+// random while and tags each surface with the item it was asked for:
+// slides come out in pick order though loads finish out of order, no more
+// than depth loads run at once, prefetch_pop() never waits on a load,
+// a category switch drops the old category's slides, a failed load stalls
+// further loads until it's consumed and is dropped once stale, previews
+// reach the waiting slide only, and destroy returns with loads running.
+// With real playlists behind it, switching back and forth and restarting
+// mid-round still shows every image once a round.
+//
+// From the repo root:
+//   make -f Makefile.host prefetch-test
+//   build-host/prefetch_test [--slides N]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "playlist.h"
+#include "prefetch.h"
+
+#define CAT_ITEMS 1000      // items of category c are c * CAT_ITEMS + n
+
+static int FAILED;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        FAILED++; \
+    } \
+} while (0)
+
+static SDL_atomic_t PICKED[2];      // per category
+static SDL_atomic_t RUNNING, MOST_RUNNING;
+static SDL_atomic_t HOLD;           // loads wait while set
+static SDL_atomic_t FAIL_ITEM;      // this item's load fails
+static SDL_atomic_t PREVIEWS;       // loads that offered a preview
+static SDL_SpinLock RNG_LOCK;
+static uint32_t RNG = 2463534242u;
+
+static uint32_t xorshift(void) {
+    SDL_AtomicLock(&RNG_LOCK);
+    RNG ^= RNG << 13;
+    RNG ^= RNG >> 17;
+    RNG ^= RNG << 5;
+    uint32_t r = RNG;
+    SDL_AtomicUnlock(&RNG_LOCK);
+    return r;
+}
+
+static uint32_t pick(int cat_index, void *user) {
+    return cat_index * CAT_ITEMS + SDL_AtomicAdd(&PICKED[cat_index], 1);
+}
+
+// Picks from playlists, as the slideshow makes them. Both callbacks run
+// under the prefetcher's lock, which guards the playlists here.
+static Playlist PLAYLISTS[2];
+
+static uint32_t playlist_pick(int cat_index, void *user) {
+    return playlist_next(&PLAYLISTS[cat_index]);
+}
+
+static void playlist_unpick_item(int cat_index, uint32_t item, void *user) {
+    playlist_unpick(&PLAYLISTS[cat_index], item);
+}
+
+static SDL_Surface *tagged(uint32_t item) {
+    SDL_Surface *s = SDL_CreateRGBSurfaceWithFormat(0, 4, 4, 32, SDL_PIXELFORMAT_RGBA32);
+    if (s) s->userdata = (void *)(uintptr_t)item;
+    return s;
+}
+
+static SDL_Surface *load(const PrefetchJob *job, char *status_out, size_t status_len,
+                         bool *retry, void *user) {
+    int running = SDL_AtomicAdd(&RUNNING, 1) + 1;
+    for (int most = SDL_AtomicGet(&MOST_RUNNING); running > most;
+         most = SDL_AtomicGet(&MOST_RUNNING))
+        SDL_AtomicCAS(&MOST_RUNNING, most, running);
+
+    // 0-7 ms, so loads overtake each other
+    int delay = xorshift() % 8;
+    bool offered = false;
+    for (int ms = 0; (ms < delay || SDL_AtomicGet(&HOLD)) && !prefetch_job_cancelled(job); ms++) {
+        if (!offered && prefetch_wants_preview(job)) {
+            offered = true;
+            SDL_AtomicAdd(&PREVIEWS, 1);
+            prefetch_preview(job, tagged(job->item));
+        }
+        SDL_Delay(1);
+    }
+
+    SDL_Surface *s = NULL;
+    if (job->item == (uint32_t)SDL_AtomicGet(&FAIL_ITEM))
+        snprintf(status_out, status_len, "item %u failed", job->item);
+    else
+        s = tagged(job->item);
+    SDL_AtomicAdd(&RUNNING, -1);
+    return s;
+}
+
+static uint32_t item_of(const PrefetchSlide *slide) {
+    return (uint32_t)(uintptr_t)slide->surface->userdata;
+}
+
+// Poll as the render loop does, giving up after timeout_ms
+static bool pop_wait(Prefetcher *pf, PrefetchSlide *slide, int timeout_ms) {
+    for (int ms = 0; ms < timeout_ms; ms++) {
+        if (prefetch_pop(pf, slide)) return true;
+        SDL_Delay(1);
+    }
+    return false;
+}
+
+static void reset_counts(void) {
+    SDL_AtomicSet(&PICKED[0], 0);
+    SDL_AtomicSet(&PICKED[1], 0);
+    SDL_AtomicSet(&MOST_RUNNING, 0);
+    SDL_AtomicSet(&FAIL_ITEM, -1);
+}
+
+// Out-of-order loads, in-order slides, and no more than depth at once
+static void test_order(WorkPool *pool, int slides) {
+    reset_counts();
+    Prefetcher *pf = prefetch_create(pool, 4, 0, pick, NULL, load, NULL, 0);
+    CHECK(pf != NULL);
+    int in_order = 0;
+    for (int i = 0; i < slides; i++) {
+        PrefetchSlide slide;
+        if (!pop_wait(pf, &slide, 1000)) break;
+        in_order += slide.surface && slide.cat_index == 0 && item_of(&slide) == (uint32_t)i;
+        SDL_FreeSurface(slide.surface);
+    }
+    CHECK(in_order == slides);
+    CHECK(SDL_AtomicGet(&MOST_RUNNING) <= 4);
+    CHECK(SDL_AtomicGet(&MOST_RUNNING) > 1);
+    prefetch_destroy(pf);
+}
+
+// With every load held up, pop returns at once with nothing, and a
+// preview of the head slide gets through
+static void test_no_wait(WorkPool *pool) {
+    reset_counts();
+    SDL_AtomicSet(&PREVIEWS, 0);
+    SDL_AtomicSet(&HOLD, 1);
+    Prefetcher *pf = prefetch_create(pool, 3, 0, pick, NULL, load, NULL, 0);
+    PrefetchSlide slide;
+    Uint64 start = SDL_GetPerformanceCounter();
+    int popped = 0;
+    for (int i = 0; i < 1000; i++) popped += prefetch_pop(pf, &slide);
+    double us = (SDL_GetPerformanceCounter() - start) * 1e6 / SDL_GetPerformanceFrequency() / 1000;
+    CHECK(popped == 0);
+    CHECK(us < 100);
+    CHECK(SDL_AtomicGet(&PICKED[0]) == 3);
+
+    // Only the head's load is asked for a preview
+    SDL_Surface *preview = NULL;
+    for (int ms = 0; ms < 1000 && !preview; ms++) {
+        prefetch_pop(pf, &slide);
+        preview = prefetch_take_preview(pf);
+        SDL_Delay(1);
+    }
+    CHECK(preview && (uintptr_t)preview->userdata == 0);
+    SDL_FreeSurface(preview);
+    SDL_Delay(20);
+    CHECK(SDL_AtomicGet(&PREVIEWS) == 1);
+
+    SDL_AtomicSet(&HOLD, 0);
+    CHECK(pop_wait(pf, &slide, 1000) && item_of(&slide) == 0);
+    SDL_FreeSurface(slide.surface);
+    CHECK(prefetch_take_preview(pf) == NULL);
+    prefetch_destroy(pf);
+}
+
+// After a switch only the new category's slides come out
+static void test_category(WorkPool *pool) {
+    reset_counts();
+    Prefetcher *pf = prefetch_create(pool, 4, 0, pick, NULL, load, NULL, 0);
+    PrefetchSlide slide;
+    CHECK(pop_wait(pf, &slide, 1000) && item_of(&slide) == 0);
+    SDL_FreeSurface(slide.surface);
+
+    prefetch_set_category(pf, 1);
+    int from_old = 0, in_order = 0;
+    for (int i = 0; i < 20; i++) {
+        if (!pop_wait(pf, &slide, 1000)) break;
+        from_old += slide.cat_index != 1 || item_of(&slide) < CAT_ITEMS;
+        in_order += item_of(&slide) == CAT_ITEMS + (uint32_t)i;
+        SDL_FreeSurface(slide.surface);
+    }
+    CHECK(from_old == 0 && in_order == 20);
+    prefetch_destroy(pf);
+}
+
+// A failure is handed over in its turn and holds back further loads until
+// it is; left long enough, it's dropped and the next slide follows
+static void test_failure(WorkPool *pool) {
+    reset_counts();
+    SDL_AtomicSet(&FAIL_ITEM, 1);
+    Prefetcher *pf = prefetch_create(pool, 4, 0, pick, NULL, load, NULL, 0);
+    PrefetchSlide slide;
+    CHECK(pop_wait(pf, &slide, 1000) && item_of(&slide) == 0);
+    SDL_FreeSurface(slide.surface);
+
+    // Loads queued before the failure finish; nothing new is queued
+    SDL_Delay(50);
+    int picked = SDL_AtomicGet(&PICKED[0]);
+    SDL_Delay(50);
+    CHECK(SDL_AtomicGet(&PICKED[0]) == picked);
+    CHECK(picked <= 5);
+
+    CHECK(pop_wait(pf, &slide, 1000));
+    CHECK(slide.surface == NULL && slide.item == 1 && strstr(slide.status, "failed"));
+    CHECK(pop_wait(pf, &slide, 1000) && item_of(&slide) == 2);
+    SDL_FreeSurface(slide.surface);
+    SDL_Delay(50);
+    CHECK(SDL_AtomicGet(&PICKED[0]) > picked);
+
+    // Stale: item 7 fails and isn't asked for until after PREFETCH_RETRY_MS
+    SDL_AtomicSet(&FAIL_ITEM, 7);
+    for (uint32_t want = 3; want < 7; want++) {
+        CHECK(pop_wait(pf, &slide, 1000) && item_of(&slide) == want);
+        SDL_FreeSurface(slide.surface);
+    }
+    SDL_Delay(PREFETCH_RETRY_MS + 200);
+    CHECK(!prefetch_pop(pf, &slide));
+    CHECK(pop_wait(pf, &slide, 1000) && item_of(&slide) == 8);
+    SDL_FreeSurface(slide.surface);
+    prefetch_destroy(pf);
+}
+
+// Destroy with loads under way cancels them and waits for them
+static void test_destroy(WorkPool *pool) {
+    reset_counts();
+    SDL_AtomicSet(&HOLD, 1);
+    Prefetcher *pf = prefetch_create(pool, PREFETCH_MAX_DEPTH, 0, pick, NULL, load, NULL, 0);
+    SDL_Delay(20);
+    CHECK(SDL_AtomicGet(&RUNNING) > 0);
+    prefetch_destroy(pf);
+    CHECK(SDL_AtomicGet(&RUNNING) == 0);
+    SDL_AtomicSet(&HOLD, 0);
+}
+
+// Slides are popped a few at a time between category switches and
+// restarts, as when someone flips through categories or the config is
+// reloaded; picks dropped unshown go back, so each round of each category
+// shows every image exactly once
+static void test_rounds(WorkPool *pool) {
+    enum { ITEMS = 40, ROUNDS = 5, SHOWN = ITEMS * ROUNDS };
+    reset_counts();
+    for (int c = 0; c < 2; c++) {
+        playlist_init(&PLAYLISTS[c], PLAYLIST_SHUFFLE, 99 + c);
+        CHECK(playlist_reset(&PLAYLISTS[c], ITEMS, 0, NULL, NULL) == 0);
+    }
+    static uint32_t shown[2][SHOWN];
+    int num_shown[2] = {0, 0}, cat = 0, switches = 0, restarts = 0;
+    Prefetcher *pf = prefetch_create(pool, 4, cat, playlist_pick, playlist_unpick_item, load,
+                                     NULL, 0);
+    while (num_shown[0] < SHOWN || num_shown[1] < SHOWN) {
+        int pops = xorshift() % 7;
+        for (int i = 0; i < pops && num_shown[cat] < SHOWN; i++) {
+            PrefetchSlide slide;
+            if (!pop_wait(pf, &slide, 1000)) break;
+            if (slide.surface && slide.cat_index == cat)
+                shown[cat][num_shown[cat]++] = item_of(&slide);
+            SDL_FreeSurface(slide.surface);
+        }
+        cat ^= 1;
+        if (xorshift() % 4 == 0) {
+            prefetch_destroy(pf);
+            pf = prefetch_create(pool, 4, cat, playlist_pick, playlist_unpick_item, load,
+                                 NULL, 0);
+            restarts++;
+        } else {
+            prefetch_set_category(pf, cat);
+            switches++;
+        }
+        if (switches + restarts > 100 * ROUNDS) break;
+    }
+    prefetch_destroy(pf);
+
+    int incomplete = 0;
+    for (int c = 0; c < 2; c++) {
+        CHECK(num_shown[c] == SHOWN);
+        for (int r = 0; r < ROUNDS; r++) {
+            int times[ITEMS] = {0};
+            for (int i = r * ITEMS; i < (r + 1) * ITEMS && i < num_shown[c]; i++)
+                if (shown[c][i] < ITEMS) times[shown[c][i]]++;
+            for (int i = 0; i < ITEMS; i++) incomplete += times[i] != 1;
+        }
+        playlist_free(&PLAYLISTS[c]);
+    }
+    CHECK(incomplete == 0);
+    CHECK(switches > 0 && restarts > 0);
+}
+
+int main(int argc, char **argv) {
+    int slides = 2000;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--slides") == 0 && i + 1 < argc) slides = atoi(argv[++i]);
+        else {
+            fprintf(stderr, "usage: %s [--slides N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    WorkPool *pool = workpool_create(4, 16);
+    if (!pool) {
+        fprintf(stderr, "prefetch_test: no worker pool\n");
+        return 1;
+    }
+    test_order(pool, slides);
+    test_no_wait(pool);
+    test_category(pool);
+    test_failure(pool);
+    test_destroy(pool);
+    test_rounds(pool);
+    workpool_destroy(pool);
+
+    if (FAILED) {
+        fprintf(stderr, "prefetch_test: %d check(s) failed\n", FAILED);
+        return 1;
+    }
+    printf("prefetch_test: ok\n");
+    return 0;
+}
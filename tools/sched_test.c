@@ -0,0 +1,231 @@
+// sched_test.c
+// Checks for the scheduler under a simulated clock: the timer heap against
+// a brute-force scan, and the slide policy (backoff, jitter, reconnect,
+// power scaling, the +/- ladder) over simulated hours in a few milliseconds.
+//
+// From the repo root:
+//   make -f Makefile.host sched-test
+//   build-host/sched_test [--seed S]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scheduler.h"
+
+static int FAILED;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        FAILED++; \
+    } \
+} while (0)
+
+// Random arms and cancels; every pop must be the earliest armed deadline
+static void test_heap(unsigned seed) {
+    Scheduler s;
+    sched_init(&s, seed);
+    uint64_t shadow[TIMER_COUNT];
+    bool armed[TIMER_COUNT] = {0};
+    uint64_t now = 0;
+    srand(seed);
+
+    for (int step = 0; step < 200000; step++) {
+        int id = rand() % TIMER_COUNT;
+        int op = rand() % 4;
+        if (op < 2) {
+            shadow[id] = now + rand() % 1000;
+            armed[id] = true;
+            sched_at(&s, id, shadow[id]);
+        } else if (op == 2) {
+            armed[id] = false;
+            sched_cancel(&s, id);
+        } else {
+            now += rand() % 300;
+            int timer;
+            while ((timer = sched_due(&s, now)) >= 0) {
+                CHECK(armed[timer] && shadow[timer] <= now);
+                for (int i = 0; i < TIMER_COUNT; i++)
+                    if (armed[i]) CHECK(shadow[i] >= shadow[timer]);
+                armed[timer] = false;
+            }
+        }
+
+        // What's left must agree with the shadow, and so must the wait
+        uint64_t first = UINT64_MAX;
+        for (int i = 0; i < TIMER_COUNT; i++) {
+            CHECK(sched_armed(&s, i) == armed[i]);
+            if (armed[i] && shadow[i] < first) first = shadow[i];
+        }
+        uint32_t wait = sched_wait(&s, now, 5000);
+        if (first == UINT64_MAX) CHECK(wait == 5000);
+        else if (first <= now) CHECK(wait == 0);
+        else CHECK(wait == (first - now < 5000 ? first - now : 5000));
+    }
+}
+
+// Slides fail one after another: retries grow from SCHED_RETRY_MIN_MS,
+// stay in the upper half of their step, never pass the interval, and a
+// success brings back the normal interval
+static void test_backoff(unsigned seed) {
+    const int interval = 30;
+    const uint64_t interval_ms = interval * 60000ull;
+    for (int trial = 0; trial < 1000; trial++) {
+        Scheduler s;
+        sched_init(&s, seed + trial);
+        uint64_t now = 0;
+        uint64_t step = SCHED_RETRY_MIN_MS;
+        for (int fail = 1; fail <= 12; fail++) {
+            sched_slide_shown(&s, now, interval, true);
+            CHECK(s.failures == fail);
+            CHECK(sched_armed(&s, TIMER_SLIDE) && sched_armed(&s, TIMER_NETWORK));
+            uint64_t cap = step < interval_ms ? step : interval_ms;
+            CHECK(s.retry_ms >= cap / 2 && s.retry_ms <= cap);
+            CHECK(s.deadline[TIMER_SLIDE] == now + s.retry_ms);
+            now += s.retry_ms;
+            step *= 2;
+        }
+        sched_slide_shown(&s, now, interval, false);
+        CHECK(s.failures == 0);
+        CHECK(!sched_armed(&s, TIMER_NETWORK));
+        CHECK(s.deadline[TIMER_SLIDE] == now + interval_ms);
+    }
+
+    // Frames that failed together spread out
+    uint64_t lo = UINT64_MAX, hi = 0;
+    for (int frame = 0; frame < 64; frame++) {
+        Scheduler s;
+        sched_init(&s, seed * 7919 + frame);
+        for (int fail = 0; fail < 4; fail++) sched_slide_shown(&s, 0, interval, true);
+        if (s.retry_ms < lo) lo = s.retry_ms;
+        if (s.retry_ms > hi) hi = s.retry_ms;
+    }
+    CHECK(hi - lo > SCHED_RETRY_MIN_MS);
+}
+
+// Offline for a while, then back: the network poll notices within a poll
+// period and the retry goes out then, not when the backoff runs out
+static void test_reconnect(unsigned seed) {
+    Scheduler s;
+    sched_init(&s, seed);
+    uint64_t now = 1000;
+    sched_set_online(&s, now, false);
+    for (int i = 0; i < 6; i++) sched_slide_shown(&s, now, 60, true);
+    uint64_t retry_at = s.deadline[TIMER_SLIDE];
+    uint64_t back_at = now + 42000;
+
+    bool retried = false;
+    while (!retried && now < retry_at) {
+        uint64_t next = now + sched_wait(&s, now, UINT32_MAX);
+        now = next;
+        int timer;
+        while ((timer = sched_due(&s, now)) >= 0) {
+            if (timer == TIMER_NETWORK) {
+                bool back = sched_set_online(&s, now, now >= back_at);
+                CHECK(back == (now >= back_at));
+                CHECK(sched_armed(&s, TIMER_NETWORK));
+            } else if (timer == TIMER_SLIDE) {
+                retried = true;
+            }
+        }
+    }
+    CHECK(retried);
+    CHECK(now >= back_at && now < back_at + SCHED_NET_POLL_MS + 1);
+    CHECK(now < retry_at);
+
+    // Nothing to retry: coming back online changes nothing
+    sched_init(&s, seed);
+    sched_slide_shown(&s, 0, 10, false);
+    sched_set_online(&s, 0, false);
+    CHECK(!sched_set_online(&s, 100, true));
+    CHECK(s.deadline[TIMER_SLIDE] == 600000);
+    CHECK(!sched_armed(&s, TIMER_NETWORK));
+}
+
+// Intervals stretch on battery and shrink on a charger, and the slide
+// that's up is re-timed when the power source changes
+static void test_power(unsigned seed) {
+    Scheduler s;
+    sched_init(&s, seed);
+    sched_set_power_scale(&s, 200, 50);
+    sched_set_charging(&s, true, 10);
+    CHECK(sched_interval_ms(&s, 10) == 300000);
+    sched_slide_shown(&s, 1000, 10, false);
+    CHECK(s.deadline[TIMER_SLIDE] == 1000 + 300000);
+
+    sched_set_charging(&s, false, 10);
+    CHECK(sched_interval_ms(&s, 10) == 1200000);
+    CHECK(s.deadline[TIMER_SLIDE] == 1000 + 1200000);
+
+    sched_set_charging(&s, true, 10);
+    CHECK(s.deadline[TIMER_SLIDE] == 1000 + 300000);
+
+    // A retry that's sooner than the new interval keeps its time
+    sched_slide_shown(&s, 5000, 10, true);
+    uint64_t retry_at = s.deadline[TIMER_SLIDE];
+    sched_set_charging(&s, false, 10);
+    CHECK(s.deadline[TIMER_SLIDE] == retry_at);
+    CHECK(s.deadline[TIMER_NETWORK] == 5000 + SCHED_NET_POLL_MS);
+
+    // Waiting on a slide: nothing to re-time
+    sched_slide_wanted(&s);
+    sched_set_charging(&s, true, 10);
+    CHECK(!sched_armed(&s, TIMER_SLIDE));
+}
+
+// [+] and [-] walk the same ladder both ways and land on round values
+static void test_step(void) {
+    CHECK(sched_interval_step(5, 1) == 6);
+    CHECK(sched_interval_step(14, 1) == 15);
+    CHECK(sched_interval_step(15, 1) == 20);
+    CHECK(sched_interval_step(55, 1) == 60);
+    CHECK(sched_interval_step(60, 1) == 75);
+    CHECK(sched_interval_step(240, 1) == 300);
+    CHECK(sched_interval_step(15, -1) == 14);
+    CHECK(sched_interval_step(20, -1) == 15);
+    CHECK(sched_interval_step(75, -1) == 60);
+    CHECK(sched_interval_step(300, -1) == 240);
+    CHECK(sched_interval_step(1440, -1) == 1380);
+    // Off the ladder (typed into config.ini): the next rung either way
+    CHECK(sched_interval_step(22, 1) == 25);
+    CHECK(sched_interval_step(22, -1) == 20);
+
+    for (int m = 1; m <= 1440; m++) {
+        int up = sched_interval_step(m, 1);
+        int down = sched_interval_step(m, -1);
+        CHECK(up > m && down < m);
+        CHECK(sched_interval_step(up, -1) <= m);
+        CHECK(sched_interval_step(down, 1) >= m);
+    }
+    int m = 5, steps = 0;
+    while (m < 1440) {
+        m = sched_interval_step(m, 1);
+        steps++;
+    }
+    CHECK(m == 1440 && steps <= 51);   // was 1435 presses a minute at a time
+}
+
+int main(int argc, char **argv) {
+    unsigned seed = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) seed = strtoul(argv[++i], NULL, 0);
+        else {
+            fprintf(stderr, "usage: %s [--seed S]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    test_heap(seed);
+    test_backoff(seed);
+    test_reconnect(seed);
+    test_power(seed);
+    test_step();
+
+    if (FAILED) {
+        fprintf(stderr, "sched_test: %d check(s) failed\n", FAILED);
+        return 1;
+    }
+    printf("sched_test: ok\n");
+    return 0;
+}
@@ -0,0 +1,257 @@
+// soak_test.c
+// Weeks of slides in a few minutes: 100k slide changes through the same
+// memory path as the slideshow (decode into a scratch arena, shrink to
+// the screen, upload into the texture pool, draw, present, release the
+// outgoing texture) on SDL's software renderer, cycling through JPEG,
+// WebP and QOI images of assorted sizes and both fit modes.
+//
+// After a warm-up the malloc heap must stay flat, the arena must have
+// served every decode (no spills to the heap) and every slide must have
+// fit the texture pool. The screen is scaled down from the console's so
+// the run stays short; the images are scaled with it.
+//
+// Built without the sanitizers: they replace malloc, and heap_in_use()
+// would see nothing.
+//
+// From the repo root:
+//   make -f Makefile.host soak-test
+//   build-host/soak_test [--slides N]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include <jpeglib.h>
+#include <webp/encode.h>
+
+#include "decode.h"
+#include "membudget.h"
+#include "qoi.h"
+
+#define SCREEN_W     320
+#define SCREEN_H     180
+#define TEXTURES     3          // as SLIDE_TEXTURES in main.c
+#define ARENA_BYTES  (8 << 20)
+#define WARMUP       1000       // slides before the heap is expected to settle
+#define HEAP_SLACK   (256 << 10)
+
+static int FAILED;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        FAILED++; \
+    } \
+} while (0)
+
+static Uint32 RNG = 2463534242u;
+
+static Uint32 xorshift(void) {
+    RNG ^= RNG << 13;
+    RNG ^= RNG >> 17;
+    RNG ^= RNG << 5;
+    return RNG;
+}
+
+typedef struct {
+    unsigned char *data;
+    size_t size;
+    int    w, h;
+    const char *format;
+} Image;
+
+// A smooth gradient with some grain, so it compresses about like a photo
+static unsigned char *make_photo(int w, int h) {
+    unsigned char *rgb = malloc((size_t)w * h * 3);
+    if (!rgb) return NULL;
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++) {
+            unsigned char *p = rgb + ((size_t)y * w + x) * 3;
+            int grain = (int)(xorshift() & 31) - 16;
+            int r = x * 255 / w + grain, g = y * 255 / h + grain;
+            p[0] = r < 0 ? 0 : r > 255 ? 255 : r;
+            p[1] = g < 0 ? 0 : g > 255 ? 255 : g;
+            p[2] = (unsigned char)((x + y) * 127 / (w + h) + 64);
+        }
+    return rgb;
+}
+
+static int encode_jpeg(Image *img, const unsigned char *rgb) {
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    unsigned long size = 0;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo, &img->data, &size);
+    cinfo.image_width = img->w;
+    cinfo.image_height = img->h;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, 85, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        JSAMPROW row = (JSAMPROW)(rgb + (size_t)cinfo.next_scanline * img->w * 3);
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    img->size = size;
+    return img->data ? 0 : -1;
+}
+
+static int encode_webp(Image *img, const unsigned char *rgb) {
+    uint8_t *out = NULL;
+    size_t size = WebPEncodeRGB(rgb, img->w, img->h, img->w * 3, 80, &out);
+    if (!size) return -1;
+    // Kept with malloc'd memory like the others, so free() releases it
+    img->data = malloc(size);
+    if (img->data) memcpy(img->data, out, size);
+    WebPFree(out);
+    img->size = size;
+    return img->data ? 0 : -1;
+}
+
+static int encode_qoi(Image *img, const unsigned char *rgb) {
+    QoiDesc desc = { (uint32_t)img->w, (uint32_t)img->h, 3, 0 };
+    unsigned char *rgba = malloc((size_t)img->w * img->h * 4);
+    img->data = malloc(qoi_max_size(&desc));
+    if (!rgba || !img->data) {
+        free(rgba);
+        return -1;
+    }
+    for (size_t i = 0; i < (size_t)img->w * img->h; i++) {
+        memcpy(rgba + i * 4, rgb + i * 3, 3);
+        rgba[i * 4 + 3] = 255;
+    }
+    img->size = qoi_encode(rgba, img->w * 4, &desc, img->data);
+    free(rgba);
+    return img->size ? 0 : -1;
+}
+
+int main(int argc, char **argv) {
+    int slides = 100000;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--slides") == 0 && i + 1 < argc) slides = atoi(argv[++i]);
+        else {
+            fprintf(stderr, "usage: %s [--slides N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    // Smaller than the screen, about its size, and large enough to be
+    // scaled down (JPEGs partly by the DCT), in landscape and portrait
+    static const struct { int w, h; } sizes[] = {
+        { 160, 120 }, { 320, 180 }, { 400, 300 }, { 480, 270 }, { 180, 320 }, { 640, 480 },
+    };
+    enum { NUM_SIZES = sizeof(sizes) / sizeof(sizes[0]), NUM_IMAGES = NUM_SIZES * 3 };
+    Image images[NUM_IMAGES];
+    memset(images, 0, sizeof(images));
+    for (int i = 0; i < NUM_IMAGES; i++) {
+        Image *img = &images[i];
+        img->w = sizes[i / 3].w;
+        img->h = sizes[i / 3].h;
+        unsigned char *rgb = make_photo(img->w, img->h);
+        int rc = -1;
+        if (rgb) {
+            switch (i % 3) {
+                case 0: img->format = "jpeg"; rc = encode_jpeg(img, rgb); break;
+                case 1: img->format = "webp"; rc = encode_webp(img, rgb); break;
+                case 2: img->format = "qoi";  rc = encode_qoi(img, rgb);  break;
+            }
+        }
+        free(rgb);
+        if (rc != 0) {
+            fprintf(stderr, "soak_test: couldn't encode a %dx%d %s\n", img->w, img->h,
+                    img->format);
+            return 1;
+        }
+    }
+
+    SDL_Surface *screen = SDL_CreateRGBSurfaceWithFormat(0, SCREEN_W, SCREEN_H, 32,
+                                                         SDL_PIXELFORMAT_ARGB8888);
+    SDL_Renderer *renderer = screen ? SDL_CreateSoftwareRenderer(screen) : NULL;
+    TexturePool pool;
+    Arena arena;
+    if (!renderer || texpool_init(&pool, renderer, TEXTURES, SCREEN_W, SCREEN_H) != TEXTURES ||
+        arena_init(&arena, ARENA_BYTES) != 0) {
+        fprintf(stderr, "soak_test: no software renderer: %s\n", SDL_GetError());
+        return 1;
+    }
+
+    size_t heap_start = 0, heap_max = 0, heap_min = (size_t)-1;
+    int failed_slides = 0;
+    SDL_Texture *current = NULL, *previous = NULL;
+    Uint32 start = SDL_GetTicks();
+    for (int n = 0; n < slides; n++) {
+        const Image *img = &images[xorshift() % NUM_IMAGES];
+        FitMode mode = n & 1 ? FIT_FILL : FIT_CONTAIN;
+
+        // A worker's load
+        scratch_begin(&arena);
+        SDL_Surface *s = decode_image_mem(img->data, img->size, mode, SCREEN_W, SCREEN_H);
+        if (s) s = shrink_surface(s, mode, SCREEN_W, SCREEN_H);
+        scratch_begin(NULL);
+
+        // The render thread's upload and first frame of the new slide
+        SDL_Rect src, dst;
+        SDL_Texture *t = s ? texpool_upload(&pool, renderer, s, &src) : NULL;
+        if (!t) {
+            failed_slides++;
+            SDL_FreeSurface(s);
+            continue;
+        }
+        dst = place_rect(mode, s->w, s->h, SCREEN_W, SCREEN_H);
+        SDL_FreeSurface(s);
+        SDL_RenderClear(renderer);
+        SDL_RenderCopy(renderer, t, &src, &dst);
+        SDL_RenderPresent(renderer);
+
+        // The outgoing slide is let go once the transition is over
+        texpool_release(&pool, previous);
+        previous = current;
+        current = t;
+
+        size_t heap = heap_in_use();
+        if (n == WARMUP) heap_start = heap;
+        if (n >= WARMUP) {
+            if (heap > heap_max) heap_max = heap;
+            if (heap < heap_min) heap_min = heap;
+        }
+        if ((n + 1) % 10000 == 0)
+            printf("  %6d slides  heap %.1f KB\n", n + 1, heap / 1024.0);
+    }
+    size_t heap_end = heap_in_use();
+    Uint32 ms = SDL_GetTicks() - start;
+
+    printf("  %d slides in %.1f s: heap %.1f KB after warm-up, %.1f-%.1f KB since, "
+           "%.1f KB at the end\n", slides, ms / 1000.0, heap_start / 1024.0,
+           heap_min / 1024.0, heap_max / 1024.0, heap_end / 1024.0);
+    printf("  arena peak %.1f of %d MB, %u overflows; textures %d/%d in use, %u fallbacks\n",
+           arena.high_water / (1024.0 * 1024.0), ARENA_BYTES >> 20, arena.overflows,
+           pool.high_water, pool.count, pool.fallbacks);
+
+    CHECK(failed_slides == 0);
+    CHECK(arena.overflows == 0);
+    CHECK(pool.fallbacks == 0 && pool.high_water <= TEXTURES);
+    if (slides > WARMUP) {
+        CHECK(heap_start > 0);
+        CHECK(heap_max <= heap_start + HEAP_SLACK);
+        CHECK(heap_end <= heap_start + HEAP_SLACK);
+    }
+
+    texpool_release(&pool, current);
+    texpool_release(&pool, previous);
+    texpool_free(&pool);
+    arena_free(&arena);
+    SDL_DestroyRenderer(renderer);
+    SDL_FreeSurface(screen);
+    for (int i = 0; i < NUM_IMAGES; i++) free(images[i].data);
+
+    if (FAILED) {
+        fprintf(stderr, "soak_test: %d check(s) failed\n", FAILED);
+        return 1;
+    }
+    printf("soak_test: ok\n");
+    return 0;
+}
@@ -0,0 +1,145 @@
+// thumbgen.c
+// Pre-build NX PhotoFrame's thumbnail cache on a PC, so the console can
+// show a big library from screen-sized copies from the first boot instead
+// of decoding every original on the Switch.
+//
+// Build on Linux (needs SDL2, SDL2_image, libjpeg, libpng and libwebp
+// development packages), as one command:
+//   cc -O2 -Isource -o thumbgen tools/thumbgen.c source/thumbs.c source/qoi.c source/membudget.c
+//      source/workpool.c source/decode.c source/scale.c source/imageindex.c source/imageformat.c
+//      $(sdl2-config --cflags --libs) -lSDL2_image -ljpeg -lpng -lwebpdemux -lwebp -lm
+//
+// Usage: thumbgen [--fit fit|fill|stretch] [--mb N] <sd-root> <sdmc-folder>...
+//   e.g. thumbgen /media/me/SWITCH sdmc:/Nintendo/Album/
+//
+// Folders must be written exactly as in config.ini (local://sdmc:/...), as
+// thumbnails are keyed by that path, and --fit must match the fit setting.
+// Freshness is checked by file size and mtime; if the PC shifts FAT
+// timestamps by its timezone the console simply rebuilds those thumbnails.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+
+#include "decode.h"
+#include "imageindex.h"
+#include "thumbs.h"
+
+#define SCREEN_W 1280
+#define SCREEN_H 720
+#define THUMB_SUBDIR "/config/NXPhotoFrame/thumbs"
+
+static FitMode fit_mode = FIT_CONTAIN;
+
+// Same decode path as the console's load_image_file()
+static SDL_Surface *decode(const char *path) {
+    SDL_Surface *surface = decode_image_file(path, fit_mode, SCREEN_W, SCREEN_H);
+    if (!surface)
+        surface = IMG_Load(path);
+    return shrink_surface(surface, fit_mode, SCREEN_W, SCREEN_H);
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    int mb = 1024;
+    int arg = 1;
+    for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg += 2) {
+        if (arg + 1 >= argc) break;
+        if (strcmp(argv[arg], "--fit") == 0) {
+            int mode = fit_mode_parse(argv[arg + 1]);
+            if (mode < 0) {
+                fprintf(stderr, "Unknown fit mode: %s\n", argv[arg + 1]);
+                return 1;
+            }
+            fit_mode = mode;
+        } else if (strcmp(argv[arg], "--mb") == 0) {
+            mb = atoi(argv[arg + 1]);
+        }
+    }
+    if (argc - arg < 2) {
+        fprintf(stderr, "Usage: %s [--fit fit|fill|stretch] [--mb N] <sd-root> <sdmc-folder>...\n",
+                argv[0]);
+        return 1;
+    }
+
+    const char *sd_root = argv[arg++];
+    char dir[512];
+    snprintf(dir, sizeof(dir), "%s/config", sd_root);
+    mkdir(dir, 0777);
+    snprintf(dir, sizeof(dir), "%s/config/NXPhotoFrame", sd_root);
+    mkdir(dir, 0777);
+    snprintf(dir, sizeof(dir), "%s%s", sd_root, THUMB_SUBDIR);
+
+    IMG_Init(IMG_INIT_JPG | IMG_INIT_PNG);
+    ThumbCache tc;
+    thumbs_init(&tc, dir, fit_mode, SCREEN_W, SCREEN_H, (uint64_t)mb * 1024 * 1024);
+
+    unsigned made = 0, fresh = 0, failed = 0;
+    double start = now_sec();
+
+    for (; arg < argc; arg++) {
+        const char *folder = argv[arg];
+        if (strncmp(folder, "sdmc:/", 6) != 0) {
+            fprintf(stderr, "Skipping %s: folders must start with sdmc:/\n", folder);
+            continue;
+        }
+
+        // Walk the folder on the PC's mount, name thumbnails by the console path
+        char host_root[512];
+        snprintf(host_root, sizeof(host_root), "%s/%s", sd_root, folder + 6);
+        ImageIndex idx;
+        index_load(&idx, host_root, NULL);
+        if (index_refresh(&idx) < 0) {
+            fprintf(stderr, "Can't open %s\n", host_root);
+            index_free(&idx);
+            continue;
+        }
+
+        char console_root[256];
+        snprintf(console_root, sizeof(console_root), "%s%s", folder,
+                 folder[strlen(folder) - 1] == '/' ? "" : "/");
+
+        for (uint32_t i = 0; i < idx.num_files; i++) {
+            char host_path[768], console_path[768];
+            // Past the console's path limit it could never be opened there
+            if (!index_full_path(&idx, i, host_path, sizeof(host_path)) ||
+                snprintf(console_path, sizeof(console_path), "%s%s", console_root,
+                         index_relpath(&idx, i)) >= INDEX_PATH_MAX)
+                continue;
+
+            struct stat st;
+            if (stat(host_path, &st) != 0) continue;
+            if (thumb_fresh(&tc, console_path, &st)) {
+                fresh++;
+                continue;
+            }
+
+            SDL_Surface *surface = decode(host_path);
+            if (surface && thumb_store(&tc, console_path, &st, surface) == 0) {
+                made++;
+            } else {
+                failed++;
+                fprintf(stderr, "Failed: %s\n", host_path);
+            }
+            if (surface) SDL_FreeSurface(surface);
+
+            if ((made + failed) % 50 == 0)
+                printf("%u made, %u up to date, %u failed...\n", made, fresh, failed);
+        }
+        index_free(&idx);
+    }
+
+    double secs = now_sec() - start;
+    printf("%u made, %u up to date, %u failed in %.1f s (%.1f images/s)\n",
+           made, fresh, failed, secs, secs > 0 ? made / secs : 0.0);
+    IMG_Quit();
+    return failed ? 2 : 0;
+}
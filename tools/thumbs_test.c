@@ -0,0 +1,257 @@
+// thumbs_test.c
+// Checks for the thumbnail cache in a scratch folder, with a stand-in
+// decoder:
+//
+// - a stored thumbnail loads back pixel for pixel
+// - it goes stale when its image changes size or mtime, or when the fit
+//   mode or screen size it was scaled for changes
+// - the background builder makes missing thumbnails, rebuilds stale ones
+//   and leaves fresh ones alone
+// - thumbnails whose image is gone are deleted only after a walk that
+//   covered every folder, not while one of them is missing
+//
+// From the repo root:
+//   make -f Makefile.host thumbs-test
+//   build-host/thumbs_test
+
+#define _XOPEN_SOURCE 700
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/stat.h>
+
+#include "imageindex.h"
+#include "thumbs.h"
+#include "util.h"
+
+#define W 24
+#define H 16
+#define OLD_TIME 1000000000
+#define BUDGET   (1 << 20)
+
+static int FAILED;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        FAILED++; \
+    } \
+} while (0)
+
+static char ALBUM[256], THUMBS[256];
+
+static SDL_atomic_t DECODES;
+
+// Stands in for the decoder: a small surface whose pixels come from the
+// path, so a thumbnail can be matched to its image
+static SDL_Surface *fake_decode(const char *path) {
+    SDL_AtomicAdd(&DECODES, 1);
+    SDL_Surface *s = SDL_CreateRGBSurfaceWithFormat(0, W, H, 32, SDL_PIXELFORMAT_RGBA32);
+    if (!s) return NULL;
+    uint32_t seed = fnv1a32(path);
+    for (int y = 0; y < H; y++) {
+        unsigned char *row = (unsigned char *)s->pixels + y * s->pitch;
+        for (int x = 0; x < W; x++) {
+            row[x * 4 + 0] = (unsigned char)(seed + x * 7);
+            row[x * 4 + 1] = (unsigned char)((seed >> 8) + y * 13);
+            row[x * 4 + 2] = (unsigned char)((seed >> 16) + x * y);
+            row[x * 4 + 3] = 255;
+        }
+    }
+    return s;
+}
+
+static bool same_pixels(const SDL_Surface *a, const SDL_Surface *b) {
+    if (a->w != b->w || a->h != b->h || a->format->format != b->format->format) return false;
+    for (int y = 0; y < a->h; y++)
+        if (memcmp((const unsigned char *)a->pixels + y * a->pitch,
+                   (const unsigned char *)b->pixels + y * b->pitch, (size_t)a->w * 4) != 0)
+            return false;
+    return true;
+}
+
+static void set_mtime(const char *path, time_t mtime) {
+    struct utimbuf t = { mtime, mtime };
+    utime(path, &t);
+}
+
+// An "image" of size bytes, dated mtime; only the stand-in decoder ever
+// reads it
+static void write_image(const char *path, size_t size, time_t mtime) {
+    FILE *f = fopen(path, "wb");
+    if (!f) return;
+    for (size_t i = 0; i < size; i++) fputc('x', f);
+    fclose(f);
+    set_mtime(path, mtime);
+}
+
+static bool exists(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0;
+}
+
+static void thumb_file(const char *image, char *out, size_t len) {
+    snprintf(out, len, "%s/%016llx.thm", THUMBS,
+             (unsigned long long)fnv1a64(image, strlen(image)));
+}
+
+static int remove_entry(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+    return remove(path);
+}
+
+// ---- freshness --------------------------------------------------------------
+
+static void test_fresh(void) {
+    ThumbCache tc;
+    thumbs_init(&tc, THUMBS, 0, 1280, 720, BUDGET);
+    char image[512];
+    snprintf(image, sizeof(image), "%sfresh.jpg", ALBUM);
+    write_image(image, 1000, OLD_TIME);
+    struct stat st;
+    stat(image, &st);
+
+    CHECK(!thumb_fresh(&tc, image, &st) && !thumb_load(&tc, image, &st));
+    SDL_Surface *decoded = fake_decode(image);
+    CHECK(thumb_store(&tc, image, &st, decoded) == 0);
+    CHECK(thumb_fresh(&tc, image, &st));
+    SDL_Surface *loaded = thumb_load(&tc, image, &st);
+    CHECK(loaded && same_pixels(loaded, decoded));
+    SDL_FreeSurface(loaded);
+
+    // A byte longer, same mtime
+    write_image(image, 1001, OLD_TIME);
+    stat(image, &st);
+    CHECK(!thumb_fresh(&tc, image, &st) && !thumb_load(&tc, image, &st));
+    CHECK(thumb_store(&tc, image, &st, decoded) == 0 && thumb_fresh(&tc, image, &st));
+
+    // Same size, a minute newer
+    write_image(image, 1001, OLD_TIME + 60);
+    stat(image, &st);
+    CHECK(!thumb_fresh(&tc, image, &st) && !thumb_load(&tc, image, &st));
+    CHECK(thumb_store(&tc, image, &st, decoded) == 0 && thumb_fresh(&tc, image, &st));
+
+    // Another fit mode or screen size wants its own scaling
+    ThumbCache fill, docked;
+    thumbs_init(&fill, THUMBS, 1, 1280, 720, BUDGET);
+    thumbs_init(&docked, THUMBS, 0, 1920, 1080, BUDGET);
+    CHECK(!thumb_fresh(&fill, image, &st) && !thumb_load(&fill, image, &st));
+    CHECK(!thumb_fresh(&docked, image, &st) && !thumb_load(&docked, image, &st));
+    CHECK(thumb_fresh(&tc, image, &st));
+
+    // Disabled, there's nothing to load or store
+    ThumbCache off;
+    thumbs_init(&off, THUMBS, 0, 1280, 720, 0);
+    CHECK(!thumb_load(&off, image, &st) && thumb_store(&off, image, &st, decoded) == -1);
+
+    SDL_FreeSurface(decoded);
+    remove(image);
+    char thm[600];
+    thumb_file(image, thm, sizeof(thm));
+    remove(thm);
+}
+
+// ---- background builder -----------------------------------------------------
+
+// One full pass of the builder; returns the images it decoded
+static int build(ThumbCache *tc, const ImageIndex *const *indexes, int count) {
+    int before = SDL_AtomicGet(&DECODES);
+    ThumbBuilder *tb = thumbs_build_start(tc, indexes, count, fake_decode, NULL);
+    CHECK(tb != NULL);
+    Uint32 start = SDL_GetTicks();
+    while (tb && !thumbs_build_finished(tb) && SDL_GetTicks() - start < 10000) SDL_Delay(1);
+    CHECK(thumbs_build_finished(tb));
+    thumbs_build_stop(tb);
+    return SDL_AtomicGet(&DECODES) - before;
+}
+
+static void test_builder(void) {
+    enum { IMAGES = 4 };
+    char image[IMAGES][512], thm[IMAGES][600];
+    for (int i = 0; i < IMAGES; i++) {
+        snprintf(image[i], sizeof(image[i]), "%simg_%d.jpg", ALBUM, i);
+        write_image(image[i], 500 + i, OLD_TIME);
+        thumb_file(image[i], thm[i], sizeof(thm[i]));
+    }
+    // Dated in the past, so deleting an image moves the folder's mtime
+    set_mtime(ALBUM, OLD_TIME);
+    ImageIndex idx;
+    index_load(&idx, ALBUM, NULL);
+    CHECK(index_refresh(&idx) == 1 && idx.num_files == IMAGES);
+    const ImageIndex *indexes[] = { &idx };
+
+    ThumbCache tc;
+    thumbs_init(&tc, THUMBS, 0, 1280, 720, BUDGET);
+    CHECK(build(&tc, indexes, 1) == IMAGES);
+    int made = 0;
+    for (int i = 0; i < IMAGES; i++) {
+        struct stat st;
+        stat(image[i], &st);
+        made += thumb_fresh(&tc, image[i], &st);
+    }
+    CHECK(made == IMAGES);
+
+    // Nothing changed, nothing decoded
+    CHECK(build(&tc, indexes, 1) == 0);
+
+    // One image grows, another is touched: just those two are rebuilt
+    write_image(image[1], 900, OLD_TIME);
+    write_image(image[2], 502, OLD_TIME + 60);
+    CHECK(build(&tc, indexes, 1) == 2);
+    for (int i = 1; i <= 2; i++) {
+        struct stat st;
+        stat(image[i], &st);
+        CHECK(thumb_fresh(&tc, image[i], &st));
+    }
+
+    // A deleted image and a stray thumbnail are orphans...
+    remove(image[0]);
+    CHECK(index_refresh(&idx) == 1 && idx.num_files == IMAGES - 1);
+    char stray[600];
+    snprintf(stray, sizeof(stray), "%s/0123456789abcdef.thm", THUMBS);
+    write_image(stray, 100, OLD_TIME);
+    CHECK(exists(thm[0]) && exists(stray));
+
+    // ...but not while another folder is missing: its thumbnails would go
+    // too, the moment the SD card was slow to come up
+    char gone[300];
+    snprintf(gone, sizeof(gone), "%snot-there/", ALBUM);
+    ImageIndex missing;
+    index_load(&missing, gone, NULL);
+    CHECK(index_refresh(&missing) == -1 && missing.num_dirs == 0);
+    const ImageIndex *with_missing[] = { &idx, &missing };
+    CHECK(build(&tc, with_missing, 2) == 0);
+    CHECK(exists(thm[0]) && exists(stray));
+
+    // Every folder there: the orphans go, the rest stay
+    CHECK(build(&tc, indexes, 1) == 0);
+    CHECK(!exists(thm[0]) && !exists(stray));
+    for (int i = 1; i < IMAGES; i++) CHECK(exists(thm[i]));
+
+    index_free(&idx);
+    index_free(&missing);
+}
+
+int main(void) {
+    char tmp[] = "/tmp/thumbs_test.XXXXXX";
+    if (!mkdtemp(tmp)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(ALBUM, sizeof(ALBUM), "%s/album/", tmp);
+    snprintf(THUMBS, sizeof(THUMBS), "%s/thumbs", tmp);
+    mkdir(ALBUM, 0777);
+
+    test_fresh();
+    test_builder();
+    nftw(tmp, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+
+    if (FAILED) {
+        fprintf(stderr, "thumbs_test: %d check(s) failed\n", FAILED);
+        return 1;
+    }
+    printf("thumbs_test: ok\n");
+    return 0;
+}
@@ -0,0 +1,198 @@
+// transition_test.c
+// Frame pacing of the slide transitions on SDL's software renderer, which
+// has no GPU to hide behind. Each kind is played against a simulated 60 Hz
+// display for one slide, drawing a frame whenever transition_wait() asks
+// for one, as the main loop does:
+//
+// - every vsync of a blend is drawn, and none after it except Ken Burns,
+//   whose redraws come at least a frame apart, each once the picture has
+//   moved a fraction of a pixel
+// - drawing a frame (clear, transition, present) stays within the frame
+//   budget at the 95th percentile
+// - the heap is the same size after the last frame as after the first
+//
+// From the repo root:
+//   make -f Makefile.host transition-test
+//   build-host/transition_test [--budget-ms MS] [--hold-ms MS]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+
+#include "membudget.h"
+#include "transition.h"
+
+#define SCREEN_W 1280
+#define SCREEN_H 720
+#define VSYNC_HZ 60
+#define MAX_FRAMES 4096
+
+static int FAILED;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        FAILED++; \
+    } \
+} while (0)
+
+static double now_ms(void) {
+    return SDL_GetPerformanceCounter() * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+// A full-screen slide with something in it to blend and scale
+static SDL_Texture *make_slide(SDL_Renderer *renderer, Uint32 *pixels, int shade) {
+    for (int y = 0; y < SCREEN_H; y++)
+        for (int x = 0; x < SCREEN_W; x++)
+            pixels[y * SCREEN_W + x] = 0xff000000u | (Uint32)((x * 255 / SCREEN_W) << 16) |
+                                       (Uint32)((y * 255 / SCREEN_H) << 8) | (Uint32)shade;
+    SDL_Texture *tex = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+                                         SDL_TEXTUREACCESS_STREAMING, SCREEN_W, SCREEN_H);
+    if (tex) SDL_UpdateTexture(tex, NULL, pixels, SCREEN_W * 4);
+    return tex;
+}
+
+typedef struct {
+    int    frames;
+    int    blend_vsyncs;    // vsyncs while blending
+    int    blend_frames;    // frames drawn while blending
+    int    after_frames;    // frames drawn after the blend
+    Uint32 min_gap_ms;      // between frames after the blend
+    float  max_step_px;     // how far the picture moved between them
+    double mean_ms, p95_ms, max_ms;
+    long   heap_growth;
+} Pacing;
+
+static Pacing play(SDL_Renderer *renderer, SDL_Texture *from, SDL_Texture *to,
+                   TransitionKind kind, Uint32 hold_ms) {
+    static double frame_ms[MAX_FRAMES];
+    Pacing pc = {0};
+    pc.min_gap_ms = UINT32_MAX;
+
+    Transition t;
+    memset(&t, 0, sizeof(t));
+    SDL_Rect src = { 0, 0, SCREEN_W, SCREEN_H };
+    SDL_Rect rect = src;
+
+    // The outgoing slide at rest first, as it would be
+    transition_start(&t, TRANSITION_CUT, 0, hold_ms, &src);
+    transition_draw(&t, renderer, NULL, from, &rect, 0);
+
+    const Uint32 start = 100000;
+    transition_start(&t, kind, start, hold_ms, &src);
+    size_t heap_first = 0;
+    Uint32 last_drawn = 0;
+    float last_w = 0;
+    for (int vsync = 0;; vsync++) {
+        Uint32 now = start + (Uint32)(vsync * 1000.0 / VSYNC_HZ);
+        if (now - start > hold_ms) break;
+        bool blending = !transition_blend_done(&t, now);
+        pc.blend_vsyncs += blending;
+        if (vsync > 0 && transition_wait(&t, now) != 0) continue;
+
+        double begin = now_ms();
+        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+        SDL_RenderClear(renderer);
+        transition_draw(&t, renderer, blending ? from : NULL, to, &rect, now);
+        SDL_RenderPresent(renderer);
+        if (pc.frames < MAX_FRAMES) frame_ms[pc.frames] = now_ms() - begin;
+        pc.frames++;
+        if (pc.frames == 1) heap_first = heap_in_use();
+
+        if (blending) {
+            pc.blend_frames++;
+        } else {
+            if (pc.after_frames > 0 || !transition_blend_done(&t, last_drawn)) {
+                if (now - last_drawn < pc.min_gap_ms) pc.min_gap_ms = now - last_drawn;
+                if (fabsf(t.to.w - last_w) > pc.max_step_px) pc.max_step_px = fabsf(t.to.w - last_w);
+            }
+            pc.after_frames++;
+        }
+        last_drawn = now;
+        last_w = t.to.w;
+    }
+    pc.heap_growth = (long)heap_in_use() - (long)heap_first;
+
+    int n = pc.frames < MAX_FRAMES ? pc.frames : MAX_FRAMES;
+    double total = 0;
+    for (int i = 0; i < n; i++) total += frame_ms[i];
+    qsort(frame_ms, n, sizeof(double), cmp_double);
+    pc.mean_ms = n ? total / n : 0;
+    pc.p95_ms  = n ? frame_ms[(n * 95) / 100 < n ? (n * 95) / 100 : n - 1] : 0;
+    pc.max_ms  = n ? frame_ms[n - 1] : 0;
+    return pc;
+}
+
+int main(int argc, char **argv) {
+    double budget_ms = 1000.0 / VSYNC_HZ;
+    Uint32 hold_ms = 10000;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--budget-ms") == 0 && i + 1 < argc) budget_ms = atof(argv[++i]);
+        else if (strcmp(argv[i], "--hold-ms") == 0 && i + 1 < argc) hold_ms = atoi(argv[++i]);
+        else {
+            fprintf(stderr, "usage: %s [--budget-ms MS] [--hold-ms MS]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (hold_ms < 2 * TRANSITION_MS) hold_ms = 2 * TRANSITION_MS;
+
+    SDL_Surface *screen = SDL_CreateRGBSurfaceWithFormat(0, SCREEN_W, SCREEN_H, 32,
+                                                         SDL_PIXELFORMAT_ARGB8888);
+    SDL_Renderer *renderer = screen ? SDL_CreateSoftwareRenderer(screen) : NULL;
+    Uint32 *pixels = malloc((size_t)SCREEN_W * SCREEN_H * 4);
+    SDL_Texture *from = renderer && pixels ? make_slide(renderer, pixels, 0x20) : NULL;
+    SDL_Texture *to = renderer && pixels ? make_slide(renderer, pixels, 0xc0) : NULL;
+    free(pixels);
+    if (!from || !to) {
+        fprintf(stderr, "transition_test: no software renderer: %s\n", SDL_GetError());
+        return 1;
+    }
+
+    const int blend_vsyncs = (TRANSITION_MS * VSYNC_HZ + 999) / 1000;
+    for (int kind = TRANSITION_CUT; kind <= TRANSITION_KENBURNS; kind++) {
+        Pacing pc = play(renderer, from, to, kind, hold_ms);
+        printf("  %-9s %4d frames  %6.2f ms mean  %6.2f p95  %6.2f max  heap %+ld\n",
+               transition_name(kind), pc.frames, pc.mean_ms, pc.p95_ms, pc.max_ms,
+               pc.heap_growth);
+
+        CHECK(pc.p95_ms <= budget_ms);
+        CHECK(pc.heap_growth == 0);
+        if (kind == TRANSITION_CUT) {
+            // One frame, and nothing more to draw
+            CHECK(pc.frames == 1 && pc.blend_vsyncs == 0);
+        } else {
+            CHECK(pc.blend_vsyncs >= blend_vsyncs - 1 && pc.blend_vsyncs <= blend_vsyncs + 1);
+            CHECK(pc.blend_frames == pc.blend_vsyncs);
+        }
+        if (kind == TRANSITION_FADE || kind == TRANSITION_SLIDE) CHECK(pc.after_frames <= 1);
+        if (kind == TRANSITION_KENBURNS) {
+            // Keeps moving for the whole slide, smoothly, without redrawing
+            // every vsync
+            CHECK(pc.after_frames > 10);
+            CHECK(pc.after_frames < (int)(hold_ms * VSYNC_HZ / 1000) * 2 / 3);
+            CHECK(pc.min_gap_ms >= 1000 / VSYNC_HZ);
+            // A quarter pixel, plus what rounding up to a vsync adds
+            CHECK(pc.max_step_px <= 0.25f + TRANSITION_KB_ZOOM * SCREEN_W * 2000.0f /
+                                            (VSYNC_HZ * hold_ms));
+        }
+    }
+
+    SDL_DestroyTexture(from);
+    SDL_DestroyTexture(to);
+    SDL_DestroyRenderer(renderer);
+    SDL_FreeSurface(screen);
+
+    if (FAILED) {
+        fprintf(stderr, "transition_test: %d check(s) failed\n", FAILED);
+        return 1;
+    }
+    printf("transition_test: ok (budget %.1f ms)\n", budget_ms);
+    return 0;
+}
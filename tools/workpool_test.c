@@ -0,0 +1,227 @@
+// workpool_test.c
+// Stress checks for the worker pool: workpool_parallel_for() runs every
+// index exactly once whatever n is, also when called from inside pool
+// jobs, and jobs submitted and cancelled from several threads at once
+// are each either run or handed to discard, never both or neither.
+//
+// Then a fixed CPU-bound load runs serially and across the pool (one
+// worker per core but one, plus the calling thread, as the app creates
+// it). With more than one core it must finish faster, by a good part of
+// the core count; on one core that check is skipped.
+//
+// From the repo root:
+//   make -f Makefile.host workpool-test
+//   build-host/workpool_test
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "workpool.h"
+
+static int FAILED;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        FAILED++; \
+    } \
+} while (0)
+
+static double now_ms(void) {
+    return SDL_GetPerformanceCounter() * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+// ---- exactly once -----------------------------------------------------------
+
+#define MAX_N 512
+
+typedef struct {
+    SDL_atomic_t runs[MAX_N];
+} Counts;
+
+static void count_index(void *arg, int i) {
+    Counts *c = arg;
+    SDL_AtomicAdd(&c->runs[i], 1);
+}
+
+static void test_once(WorkPool *pool) {
+    static Counts c;
+    int bad = 0;
+    for (int n = 0; n <= MAX_N; n += n < 16 ? 1 : 37) {
+        for (int rep = 0; rep < 20; rep++) {
+            memset(&c, 0, sizeof(c));
+            workpool_parallel_for(pool, n, count_index, &c);
+            for (int i = 0; i < MAX_N; i++)
+                bad += SDL_AtomicGet(&c.runs[i]) != (i < n);
+        }
+    }
+    CHECK(bad == 0);
+}
+
+// parallel_for from pool jobs, as a scale inside a slide load does: the
+// callers' own indices can't wait on workers that are all busy calling
+typedef struct {
+    WorkPool    *pool;
+    Counts       counts;
+    SDL_atomic_t done;
+} Nested;
+
+static void nested_job(void *arg) {
+    Nested *nest = arg;
+    workpool_parallel_for(nest->pool, 64, count_index, &nest->counts);
+    SDL_AtomicAdd(&nest->done, 1);
+}
+
+static void test_nested(WorkPool *pool) {
+    enum { JOBS = 16 };
+    static Nested nests[JOBS];
+    int submitted = 0;
+    for (int i = 0; i < JOBS; i++) {
+        memset(&nests[i], 0, sizeof(nests[i]));
+        nests[i].pool = pool;
+        submitted += workpool_submit(pool, nested_job, &nests[i], &nests[i]) == 0;
+    }
+    CHECK(submitted > 0);
+    Uint32 start = SDL_GetTicks();
+    int done = 0;
+    while (done < submitted && SDL_GetTicks() - start < 10000) {
+        done = 0;
+        for (int i = 0; i < JOBS; i++) done += SDL_AtomicGet(&nests[i].done);
+        SDL_Delay(1);
+    }
+    CHECK(done == submitted);
+    int bad = 0;
+    for (int i = 0; i < JOBS; i++)
+        for (int k = 0; k < 64 && SDL_AtomicGet(&nests[i].done); k++)
+            bad += SDL_AtomicGet(&nests[i].counts.runs[k]) != 1;
+    CHECK(bad == 0);
+}
+
+// ---- submit and cancel from several threads -------------------------------
+
+#define SUBMITTERS 4
+#define PER_THREAD 5000
+
+typedef struct {
+    WorkPool    *pool;
+    SDL_atomic_t submitted, ran, discarded;
+} Churn;
+
+static Churn CHURN;
+
+static void churn_job(void *arg) {
+    SDL_AtomicAdd(&CHURN.ran, 1);
+    (void)arg;
+}
+
+static void churn_discard(void *arg) {
+    SDL_AtomicAdd(&CHURN.discarded, 1);
+    (void)arg;
+}
+
+static int submitter(void *arg) {
+    const void *tag = arg;
+    for (int i = 0; i < PER_THREAD; i++) {
+        if (workpool_submit(CHURN.pool, churn_job, NULL, tag) == 0)
+            SDL_AtomicAdd(&CHURN.submitted, 1);
+        if (i % 7 == 0) workpool_cancel(CHURN.pool, tag, churn_discard);
+    }
+    workpool_cancel(CHURN.pool, tag, churn_discard);
+    return 0;
+}
+
+static void test_churn(WorkPool *pool) {
+    static int tags[SUBMITTERS];
+    memset(&CHURN, 0, sizeof(CHURN));
+    CHURN.pool = pool;
+    SDL_Thread *threads[SUBMITTERS];
+    for (int i = 0; i < SUBMITTERS; i++)
+        threads[i] = SDL_CreateThread(submitter, "submitter", &tags[i]);
+    for (int i = 0; i < SUBMITTERS; i++) SDL_WaitThread(threads[i], NULL);
+
+    // Every queue was cancelled last, so only running jobs are left
+    Uint32 start = SDL_GetTicks();
+    while (SDL_AtomicGet(&CHURN.ran) + SDL_AtomicGet(&CHURN.discarded) <
+               SDL_AtomicGet(&CHURN.submitted) && SDL_GetTicks() - start < 5000)
+        SDL_Delay(1);
+    int submitted = SDL_AtomicGet(&CHURN.submitted);
+    int ran = SDL_AtomicGet(&CHURN.ran), discarded = SDL_AtomicGet(&CHURN.discarded);
+    printf("  churn: %d submitted, %d ran, %d cancelled\n", submitted, ran, discarded);
+    CHECK(submitted > 0 && ran + discarded == submitted);
+}
+
+// ---- scaling ----------------------------------------------------------------
+
+#define CHUNKS      256
+#define CHUNK_WORK  200000
+
+typedef struct {
+    uint32_t out[CHUNKS];
+} Load;
+
+// Pure arithmetic on its own data, so nothing but the cores limits it
+static void load_chunk(void *arg, int i) {
+    Load *load = arg;
+    uint32_t x = 2463534242u + (uint32_t)i;
+    for (int k = 0; k < CHUNK_WORK; k++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+    }
+    load->out[i] = x;
+}
+
+// Best of a few runs, in ms
+static double time_load(WorkPool *pool, Load *load) {
+    double best = 0;
+    for (int rep = 0; rep < 5; rep++) {
+        double start = now_ms();
+        workpool_parallel_for(pool, CHUNKS, load_chunk, load);
+        double ms = now_ms() - start;
+        if (rep == 0 || ms < best) best = ms;
+    }
+    return best;
+}
+
+static void test_scaling(WorkPool *pool) {
+    static Load serial, pooled;
+    double serial_ms = time_load(NULL, &serial);
+    double pooled_ms = time_load(pool, &pooled);
+    CHECK(memcmp(serial.out, pooled.out, sizeof(serial.out)) == 0);
+
+    int cores = SDL_GetCPUCount();
+    int threads = workpool_threads(pool) + 1;
+    int ideal = threads < cores ? threads : cores;
+    double speedup = pooled_ms > 0 ? serial_ms / pooled_ms : 0;
+    printf("  scaling: 1 thread %.1f ms, %d threads %.1f ms: %.2fx on %d core(s)\n",
+           serial_ms, threads, pooled_ms, speedup, cores);
+    if (ideal < 2) {
+        printf("  scaling: one core, speedup not checked\n");
+        return;
+    }
+    // Well short of perfect, to leave room for a busy machine
+    CHECK(speedup >= 1.0 + 0.5 * (ideal - 1));
+}
+
+int main(void) {
+    WorkPool *pool = workpool_create(0, 64);
+    if (!pool) {
+        fprintf(stderr, "workpool_test: no pool\n");
+        return 1;
+    }
+    printf("workpool_test: %d worker(s)\n", workpool_threads(pool));
+    test_once(pool);
+    test_once(NULL);
+    test_nested(pool);
+    test_churn(pool);
+    test_scaling(pool);
+    workpool_destroy(pool);
+
+    if (FAILED) {
+        fprintf(stderr, "workpool_test: %d check(s) failed\n", FAILED);
+        return 1;
+    }
+    printf("workpool_test: ok\n");
+    return 0;
+}